@@ -59,6 +59,9 @@ ldap_pvt_thread_get_concurrency LDAP_P(( void ));
 LDAP_F( int )
 ldap_pvt_thread_set_concurrency LDAP_P(( int ));
 
+LDAP_F( int )
+ldap_pvt_thread_bindcpu LDAP_P(( int cpu ));
+
 #define LDAP_PVT_THREAD_CREATE_JOINABLE 0
 #define LDAP_PVT_THREAD_CREATE_DETACHED 1
 
@@ -249,6 +252,22 @@ ldap_pvt_thread_pool_submit2 LDAP_P((
 	void *arg,
 	void **cookie ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_q LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg,
+	void **cookie,
+	int qidx ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_batch LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void **args,
+	int nargs,
+	int qidx ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	void *cookie ));
@@ -263,6 +282,11 @@ ldap_pvt_thread_pool_queues LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int numqs ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_bindcpus LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int bind ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
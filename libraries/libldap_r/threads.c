@@ -13,9 +13,16 @@
  * <http://www.OpenLDAP.org/license.html>.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1			/* Needed for CPU_SET */
+#endif
+
 #include "portable.h"
 
 #include <stdio.h>
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
 
 #include <ac/stdarg.h>
 #include <ac/stdlib.h>
@@ -97,6 +104,26 @@ ldap_pvt_thread_set_concurrency ( int concurrency )
 }
 #endif
 
+/* Bind the calling thread to one CPU, counted modulo the online CPUs.
+ * Returns -1 where this is not supported.
+ */
+int
+ldap_pvt_thread_bindcpu ( int cpu )
+{
+#if defined( CPU_SET ) && defined( _SC_NPROCESSORS_ONLN )
+	cpu_set_t set;
+	long ncpu = sysconf( _SC_NPROCESSORS_ONLN );
+
+	if ( cpu < 0 || ncpu < 1 )
+		return -1;
+	CPU_ZERO( &set );
+	CPU_SET( cpu % ncpu, &set );
+	return sched_setaffinity( 0, sizeof( set ), &set );
+#else
+	return -1;
+#endif
+}
+
 #ifndef LDAP_THREAD_HAVE_SLEEP
 /*
  * Here we assume we have fully preemptive threads and that sleep()
@@ -173,6 +173,9 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Threads of queue N are bound to CPU N */
+	int ltp_bindcpus;
 };
 
 static ldap_int_tpool_plist_t empty_pending_list =
@@ -339,36 +342,17 @@ ldap_pvt_thread_pool_init (
 }
 
 /* Submit a task to be performed by the thread pool */
-int
-ldap_pvt_thread_pool_submit (
-	ldap_pvt_thread_pool_t *tpool,
-	ldap_pvt_thread_start_t *start_routine, void *arg )
-{
-	return ldap_pvt_thread_pool_submit2( tpool, start_routine, arg, NULL );
-}
-
-/* Submit a task to be performed by the thread pool */
-int
-ldap_pvt_thread_pool_submit2 (
-	ldap_pvt_thread_pool_t *tpool,
-	ldap_pvt_thread_start_t *start_routine, void *arg,
-	void **cookie )
+/* Pick queue qidx (modulo the number of queues), or the least busy
+ * queue if qidx < 0.
+ */
+static int
+pool_pickq( struct ldap_int_thread_pool_s *pool, int qidx )
 {
-	struct ldap_int_thread_pool_s *pool;
-	struct ldap_int_thread_poolq_s *pq;
-	ldap_int_thread_task_t *task;
-	ldap_pvt_thread_t thr;
-	int i, j;
-
-	if (tpool == NULL)
-		return(-1);
-
-	pool = *tpool;
-
-	if (pool == NULL)
-		return(-1);
+	int i;
 
-	if ( pool->ltp_numqs > 1 ) {
+	if ( qidx >= 0 ) {
+		i = qidx % pool->ltp_numqs;
+	} else if ( pool->ltp_numqs > 1 ) {
 		int min = pool->ltp_wqs[0]->ltp_max_pending + pool->ltp_wqs[0]->ltp_max_count;
 		int min_x = 0, cnt;
 		for ( i = 0; i < pool->ltp_numqs; i++ ) {
@@ -386,28 +370,27 @@ ldap_pvt_thread_pool_submit2 (
 		i = min_x;
 	} else
 		i = 0;
+	return i;
+}
 
-	j = i;
-	while(1) {
-		ldap_pvt_thread_mutex_lock(&pool->ltp_wqs[i]->ltp_mutex);
-		if (pool->ltp_wqs[i]->ltp_pending_count < pool->ltp_wqs[i]->ltp_max_pending) {
-			break;
-		}
-		ldap_pvt_thread_mutex_unlock(&pool->ltp_wqs[i]->ltp_mutex);
-		i++;
-		i %= pool->ltp_numqs;
-		if ( i == j )
-			return -1;
-	}
+/* Queue a task on pq, whose mutex the caller holds, and get a
+ * thread to run it.
+ */
+static int
+pool_enqueue( struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_pvt_thread_start_t *start_routine, void *arg, void **cookie )
+{
+	ldap_int_thread_task_t *task;
+	ldap_pvt_thread_t thr;
 
-	pq = pool->ltp_wqs[i];
 	task = LDAP_SLIST_FIRST(&pq->ltp_free_list);
 	if (task) {
 		LDAP_SLIST_REMOVE_HEAD(&pq->ltp_free_list, ltt_next.l);
 	} else {
 		task = (ldap_int_thread_task_t *) LDAP_MALLOC(sizeof(*task));
 		if (task == NULL)
-			goto failed;
+			return(-1);
 	}
 
 	task->ltt_start_routine = start_routine;
@@ -420,7 +403,7 @@ ldap_pvt_thread_pool_submit2 (
 	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
 
 	if (pool->ltp_pause)
-		goto done;
+		return(0);
 
 	/* should we open (create) a thread? */
 	if (pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count &&
@@ -458,7 +441,7 @@ ldap_pvt_thread_pool_submit2 (
 						ldap_int_thread_task_s, ltt_next.q);
 					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
 						ltt_next.l);
-					goto failed;
+					return(-1);
 				}
 			}
 			/* there is another open thread, so this
@@ -468,13 +451,150 @@ ldap_pvt_thread_pool_submit2 (
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
- done:
-	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	return(0);
+}
+
+/* pq, whose mutex the caller holds, has more pending tasks than
+ * threads of its own that are idle or starting up to take them.
+ */
+static int
+pool_backlog( struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	return pool->ltp_numqs > 1 && !pool->ltp_pause &&
+		pq->ltp_open_count >= pq->ltp_max_count &&
+		pq->ltp_pending_count > pq->ltp_open_count - pq->ltp_active_count;
+}
+
+/* Wake an idle thread of another queue to steal from pq, which has a
+ * backlog.  Called without any queue locked; the idle thread checks
+ * for work to steal under its queue's mutex before it waits, so taking
+ * that mutex here ensures the wakeup is not lost.
+ */
+static void
+pool_nudge( struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	int i;
+
+	for (i = 0; i < pool->ltp_numqs; i++) {
+		vq = pool->ltp_wqs[i];
+		/* unlocked peek, checked again under the lock */
+		if (vq == pq || vq->ltp_open_count <= vq->ltp_active_count)
+			continue;
+		ldap_pvt_thread_mutex_lock(&vq->ltp_mutex);
+		if (vq->ltp_open_count - vq->ltp_starting > vq->ltp_active_count &&
+			LDAP_STAILQ_EMPTY(vq->ltp_work_list))
+		{
+			ldap_pvt_thread_cond_signal(&vq->ltp_cond);
+			i = pool->ltp_numqs;
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+}
+
+int
+ldap_pvt_thread_pool_submit (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg )
+{
+	return ldap_pvt_thread_pool_submit2( tpool, start_routine, arg, NULL );
+}
+
+/* Submit a task to be performed by the thread pool */
+int
+ldap_pvt_thread_pool_submit2 (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	void **cookie )
+{
+	return ldap_pvt_thread_pool_submit_q( tpool, start_routine, arg,
+		cookie, -1 );
+}
+
+/* Submit a task to queue qidx (modulo the number of queues) of the
+ * thread pool, or to the least busy queue if qidx < 0.  Tasks of the
+ * same qidx run on the same threads, unless the queue is full or its
+ * backlog is taken by idle threads of other queues.
+ */
+int
+ldap_pvt_thread_pool_submit_q (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	void **cookie, int qidx )
+{
+	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	int i, j, rc, nudge;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
 
- failed:
+	if (pool == NULL)
+		return(-1);
+
+	i = pool_pickq( pool, qidx );
+
+	j = i;
+	while(1) {
+		ldap_pvt_thread_mutex_lock(&pool->ltp_wqs[i]->ltp_mutex);
+		if (pool->ltp_wqs[i]->ltp_pending_count < pool->ltp_wqs[i]->ltp_max_pending) {
+			break;
+		}
+		ldap_pvt_thread_mutex_unlock(&pool->ltp_wqs[i]->ltp_mutex);
+		i++;
+		i %= pool->ltp_numqs;
+		if ( i == j )
+			return -1;
+	}
+
+	pq = pool->ltp_wqs[i];
+	rc = pool_enqueue( pool, pq, start_routine, arg, cookie );
+	nudge = rc == 0 && pool_backlog( pool, pq );
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
-	return(-1);
+	if (nudge)
+		pool_nudge( pool, pq );
+	return(rc);
+}
+
+/* Submit a task for each of the nargs args to queue qidx, as with
+ * ldap_pvt_thread_pool_submit_q(), but taking the queue's lock only
+ * once.  Returns the number of tasks submitted, which is short of
+ * nargs if the queue filled up, or -1 on error.
+ */
+int
+ldap_pvt_thread_pool_submit_batch (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void **args, int nargs,
+	int qidx )
+{
+	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	int n, nudge;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pq = pool->ltp_wqs[pool_pickq( pool, qidx )];
+	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	for ( n = 0; n < nargs; n++ ) {
+		if ( pq->ltp_pending_count >= pq->ltp_max_pending ||
+			pool_enqueue( pool, pq, start_routine, args[n], NULL ))
+			break;
+	}
+	nudge = n && pool_backlog( pool, pq );
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	if (nudge)
+		pool_nudge( pool, pq );
+	return(n);
 }
 
 static void *
@@ -585,6 +705,26 @@ ldap_pvt_thread_pool_queues(
 	return 0;
 }
 
+/* Bind the threads of queue N to CPU N, for threads started from now on */
+int
+ldap_pvt_thread_pool_bindcpus(
+	ldap_pvt_thread_pool_t *tpool,
+	int bind )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_bindcpus = bind;
+	return(0);
+}
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -823,13 +963,18 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 			ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
 			ldap_pvt_thread_cond_wait(&pq->ltp_cond, &pq->ltp_mutex);
 		}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
 
+	/* Threads of other queues may have tried a queue's mutex
+	 * in pool_steal() until they all closed */
+	for (i=0; i<pool->ltp_numqs; i++) {
+		pq = pool->ltp_wqs[i];
 		while ((task = LDAP_SLIST_FIRST(&pq->ltp_free_list)) != NULL)
 		{
 			LDAP_SLIST_REMOVE_HEAD(&pq->ltp_free_list, ltt_next.l);
 			LDAP_FREE(task);
 		}
-		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 		ldap_pvt_thread_cond_destroy(&pq->ltp_cond);
 		ldap_pvt_thread_mutex_destroy(&pq->ltp_mutex);
 	}
@@ -850,6 +995,48 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 	return(0);
 }
 
+/* Take the oldest pending task of another queue, for a thread of pq
+ * that has nothing to do, so a backlog behind one busy queue does not
+ * wait while threads of other queues are idle.  Called with pq->ltp_mutex
+ * locked.  The other queues are only tried, so threads stealing from
+ * each other cannot deadlock.  Paused queues show empty_pending_list,
+ * so nothing is taken during a pause.  Idle threads try again after
+ * every wakeup, and pool_nudge() wakes one when a queue falls behind.
+ * Stolen tasks are returned to their own queue's free list.
+ */
+static ldap_int_thread_task_t *
+pool_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, n = pool->ltp_numqs, self;
+
+	if (n < 2 || pool->ltp_pause || pool->ltp_finishing ||
+		pq->ltp_open_count > pq->ltp_max_count)
+		return(NULL);
+
+	for (self = 0; self < n && pool->ltp_wqs[self] != pq; self++)
+		;
+	for (i = 1; i < n; i++) {
+		vq = pool->ltp_wqs[(self + i) % n];
+		/* unlocked peek, checked again under the lock */
+		if (LDAP_STAILQ_EMPTY(vq->ltp_work_list) ||
+			ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex))
+			continue;
+		task = LDAP_STAILQ_FIRST(vq->ltp_work_list);
+		if (task) {
+			LDAP_STAILQ_REMOVE_HEAD(vq->ltp_work_list, ltt_next.q);
+			vq->ltp_pending_count--;
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+		if (task)
+			break;
+	}
+	return(task);
+}
+
 /* Thread loop.  Accept and handle submitted tasks. */
 static void *
 ldap_int_thread_pool_wrapper ( 
@@ -887,6 +1074,13 @@ ldap_int_thread_pool_wrapper (
 	 * pointer to our keys there; start at the thread ID
 	 * itself (mod LDAP_MAXTHR) and look for an empty slot.
 	 */
+	if (pool->ltp_bindcpus) {
+		/* the queues do not change outside of a pause */
+		for (i = 0; i < (unsigned)pool->ltp_numqs && pool->ltp_wqs[i] != pq; i++)
+			;
+		ldap_pvt_thread_bindcpu(i);
+	}
+
 	ldap_pvt_thread_mutex_lock(&ldap_pvt_thread_pool_mutex);
 	for (keyslot = hash & (LDAP_MAXTHR-1);
 		(kctx = thread_keys[keyslot].ctx) && kctx != DELETED_THREAD_CTX;
@@ -901,6 +1095,10 @@ ldap_int_thread_pool_wrapper (
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
 		task = LDAP_STAILQ_FIRST(work_list);
+		if (task == NULL && (task = pool_steal(pool, pq)) != NULL) {
+			ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			goto run;
+		}
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -946,6 +1144,13 @@ ldap_int_thread_pool_wrapper (
 
 				work_list = pq->ltp_work_list;
 				task = LDAP_STAILQ_FIRST(work_list);
+				if (task == NULL && !pool_lock &&
+					(task = pool_steal(pool, pq)) != NULL)
+				{
+					pq->ltp_active_count++;
+					ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+					goto run;
+				}
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -960,10 +1165,23 @@ ldap_int_thread_pool_wrapper (
 		pq->ltp_pending_count--;
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
+	run:
 		task->ltt_start_routine(&ctx, task->ltt_arg);
 
-		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
-		LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task, ltt_next.l);
+		/* A stolen task goes back to its own queue, which allocates
+		 * its tasks.  That queue cannot go away meanwhile: queues are
+		 * only dropped during a pause, which waits for this thread.
+		 */
+		if (task->ltt_queue != pq) {
+			struct ldap_int_thread_poolq_s *vq = task->ltt_queue;
+			ldap_pvt_thread_mutex_lock(&vq->ltp_mutex);
+			LDAP_SLIST_INSERT_HEAD(&vq->ltp_free_list, task, ltt_next.l);
+			ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		} else {
+			ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+			LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task, ltt_next.l);
+		}
 	}
  done:
 
@@ -303,6 +303,10 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** log the pages written by each commit, for #mdb_env_copy_delta() */
+#define MDB_PAGELOG		0x4000000
+	/** grow the dirty page list instead of spilling pages */
+#define MDB_KEEPDIRTY		0x2000000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -321,6 +325,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_INTEGERDUP	0x20
 	/** with #MDB_DUPSORT, use reverse string dups */
 #define MDB_REVERSEDUP	0x40
+	/** store the keys of each leaf page with their common prefix factored out */
+#define MDB_PREFIXKEY	0x80
 	/** create DB if not already existing */
 #define MDB_CREATE		0x40000
 /** @} */
@@ -356,6 +362,10 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
  * pages sequentially.
  */
 #define MDB_CP_COMPACT	0x01
+/** With #MDB_CP_COMPACT: read ahead of the copy with several threads,
+ * walking the upcoming parts of the main DB and the named DBs concurrently.
+ */
+#define MDB_CP_PARALLEL	0x02
 /*	@} */
 
 /** @brief Cursor Get operations.
@@ -463,6 +473,14 @@ typedef struct MDB_stat {
 	size_t		ms_entries;			/**< Number of data items */
 } MDB_stat;
 
+/** @brief Key storage statistics for a database, see #mdb_prefix_stat() */
+typedef struct MDB_pfxstat {
+	size_t		ms_leaf_pages;		/**< Number of leaf pages */
+	size_t		ms_prefix_pages;	/**< Number of leaf pages storing a common key prefix */
+	size_t		ms_key_bytes;		/**< Total size of the keys on the leaf pages */
+	size_t		ms_stored_bytes;	/**< Space the keys take, counting each page prefix once */
+} MDB_pfxstat;
+
 /** @brief Information about the environment */
 typedef struct MDB_envinfo {
 	void	*me_mapaddr;			/**< Address of map, if fixed */
@@ -614,6 +632,26 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_PAGELOG
+	 *		Append the numbers of the pages written by each commit to a page
+	 *		log, a file named "plog.mdb" next to the data file ("path-plog"
+	 *		with #MDB_NOSUBDIR). #mdb_env_copy_delta() uses the log to copy
+	 *		only the pages that changed since an earlier copy. The log must be
+	 *		kept by every process that writes to the environment, or deltas
+	 *		spanning its commits fail. It is not synced, so after a system
+	 *		crash a full copy may be needed again. The log grows without bound;
+	 *		it may be truncated while the environment is closed, which makes
+	 *		deltas since earlier transactions fail. Ignored with #MDB_RDONLY.
+	 *	<li>#MDB_KEEPDIRTY
+	 *		Keep all the pages dirtied by a write transaction in memory until
+	 *		it commits. By default a transaction that dirties more than about
+	 *		128k pages writes some of them out early, and must read them back
+	 *		if they are changed again. With this flag the list of dirty pages
+	 *		grows instead, as long as memory can be allocated, and pages are
+	 *		only spilled if that fails. #MDB_TXN_FULL is then returned only
+	 *		when memory runs out. Nested transactions that change many pages
+	 *		of their parent still pay for copying each of those pages.
+	 *		This flag may be changed at any time using #mdb_env_set_flags().
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -681,6 +719,11 @@ int  mdb_env_copyfd(MDB_env *env, mdb_filehandle_t fd);
 	 *		pages and sequentially renumber all pages in output. This option
 	 *		consumes more CPU and runs more slowly than the default.
 	 *		Currently it fails if the environment has suffered a page leak.
+	 *	<li>#MDB_CP_PARALLEL - With #MDB_CP_COMPACT, use several threads
+	 *		to read the pages the copy will need next, in parallel and with
+	 *		readahead advice to the OS. The copy itself is unchanged. This
+	 *		speeds up copying an environment that is not in the OS cache,
+	 *		at the cost of some extra CPU.
 	 * </ul>
 	 * @return A non-zero error value on failure and 0 on success.
 	 */
@@ -705,6 +748,70 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Copy the pages of an LMDB environment that changed since a
+	 *	given transaction.
+	 *
+	 * The result is a delta that #mdb_env_apply_delta() applies to a
+	 * copy made by #mdb_env_copy() (not a compacting copy) at that
+	 * transaction or later, making the copy equal to a copy of the
+	 * current environment. Deltas are small when few pages change
+	 * between backups, and applying them in turn keeps a copy current.
+	 * The environment must be written to with #MDB_PAGELOG by every
+	 * process since the given transaction.
+	 * @note This call can trigger significant file size growth if run in
+	 * parallel with write transactions, because it employs a read-only
+	 * transaction. See long-lived transactions under @ref caveats_sec.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] path The file to write the delta to. It must not exist.
+	 * @param[in] txnid The transaction of the copy the delta will be
+	 * applied to, as reported by #mdb_env_info().
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_NOTFOUND - the page log doesn't cover all transactions
+	 *		since \b txnid; a full copy is needed.
+	 *	<li>EINVAL - \b txnid is newer than the environment.
+	 * </ul>
+	 */
+int  mdb_env_copy_delta(MDB_env *env, const char *path, size_t txnid);
+
+	/** @brief Copy the pages of an LMDB environment that changed since a
+	 *	given transaction to the specified file descriptor.
+	 *
+	 * See #mdb_env_copy_delta() for details.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the delta to. It must
+	 * have already been opened for Write access.
+	 * @param[in] txnid The transaction of the copy the delta will be
+	 * applied to.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copyfd_delta(MDB_env *env, mdb_filehandle_t fd, size_t txnid);
+
+	/** @brief Apply a delta written by #mdb_env_copy_delta() to a copy
+	 *	of an LMDB environment.
+	 *
+	 * The copy must not be open by any process. The meta pages are written
+	 * last, so the copy stays valid until all other pages are applied; if
+	 * the call fails after that began, the copy is damaged and must be
+	 * restored before applying the delta again.
+	 * @param[in] path The directory in which the copy resides, or with
+	 * #MDB_NOSUBDIR its data file.
+	 * @param[in] flags 0 or #MDB_NOSUBDIR.
+	 * @param[in] fd The filedescriptor to read the delta from.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INVALID - the input is not a delta.
+	 *	<li>#MDB_INCOMPATIBLE - the copy is older than the start of the
+	 *		delta, newer than its end, or has another page size.
+	 *	<li>#MDB_CORRUPTED - the delta is truncated.
+	 * </ul>
+	 */
+int  mdb_env_apply_delta(const char *path, unsigned int flags, mdb_filehandle_t fd);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -844,6 +951,38 @@ int  mdb_env_get_fd(MDB_env *env, mdb_filehandle_t *fd);
 	 */
 int  mdb_env_set_mapsize(MDB_env *env, size_t size);
 
+	/** @brief Let the memory map grow on demand.
+	 *
+	 * When a write transaction needs more pages than the memory map holds,
+	 * the map is grown by \b step bytes at a time, up to \b max bytes,
+	 * instead of failing with #MDB_MAP_FULL. Address space for \b max bytes
+	 * is reserved when the map is created, so growing never moves the map
+	 * and does not disturb transactions running in other threads. Only the
+	 * pages actually used take space in the data file.
+	 *
+	 * The grown size is persisted when the write transaction commits.
+	 * Other processes that reserved at least as much address space follow
+	 * the growth when they begin their next transaction; in others,
+	 * #mdb_txn_begin() returns #MDB_MAP_RESIZED as usual.
+	 *
+	 * This function should be called after #mdb_env_create() and before
+	 * #mdb_env_open(). Like #mdb_env_set_mapsize(), it may be called later
+	 * if no transactions are active in this process, and the map is then
+	 * recreated.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] step The number of bytes to grow the map by, or 0 to
+	 * disable growth
+	 * @param[in] max The size in bytes the map may grow to
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, the environment has
+	 *   	an active write transaction, or the platform can't reserve address
+	 *		space beyond the end of the file (Windows).
+	 * </ul>
+	 */
+int  mdb_env_set_mapgrowth(MDB_env *env, size_t step, size_t max);
+
 	/** @brief Set the maximum number of threads/reader slots for the environment.
 	 *
 	 * This defines the number of slots in the lock table that is used to track readers in the
@@ -1112,6 +1251,16 @@ int  mdb_txn_renew(MDB_txn *txn);
 	 *	<li>#MDB_REVERSEDUP
 	 *		This option specifies that duplicate data items should be compared as
 	 *		strings in reverse order.
+	 *	<li>#MDB_PREFIXKEY
+	 *		Store the prefix shared by all keys of a leaf page only once on that
+	 *		page. This suits databases of long keys sorted by their leading bytes.
+	 *		It may not be combined with #MDB_REVERSEKEY or #MDB_INTEGERKEY, and
+	 *		#mdb_set_compare() may not be used on such a database. Keys returned
+	 *		by a cursor on it are only valid until the next operation on that
+	 *		cursor. Existing databases keep the setting they were created with.
+	 *		Once a write transaction using such a database commits, the
+	 *		environment gets a new datafile version, and libraries without
+	 *		this option fail to open it with #MDB_VERSION_MISMATCH.
 	 *	<li>#MDB_CREATE
 	 *		Create the named database if it doesn't exist. This option is not
 	 *		allowed in a read-only transaction or a read-only environment.
@@ -1141,6 +1290,23 @@ int  mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *d
 	 */
 int  mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *stat);
 
+	/** @brief Retrieve key storage statistics for a database.
+	 *
+	 * This walks every leaf page of the database, to show how much
+	 * #MDB_PREFIXKEY saves. For other databases the stored size of the
+	 * keys is their total size.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[out] stat The address of an #MDB_pfxstat structure
+	 * 	where the statistics will be copied
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_prefix_stat(MDB_txn *txn, MDB_dbi dbi, MDB_pfxstat *stat);
+
 	/** @brief Retrieve the DB flags for a database handle.
 	 *
 	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
@@ -535,6 +535,12 @@ static txnid_t mdb_debug_start;
 
 	/**	The version number for a database's datafile format. */
 #define MDB_DATA_VERSION	 ((MDB_DEVEL) ? 999 : 1)
+	/**	The datafile version once any database has used #MDB_PREFIXKEY.
+	 *	Its #P_PREFIX pages cannot be read by a library that does not
+	 *	know them, so such a library fails with #MDB_VERSION_MISMATCH.
+	 *	The version is never lowered again.
+	 */
+#define MDB_PREFIX_VERSION	 (MDB_DATA_VERSION + 1)
 	/**	The version number for a database's lockfile format. */
 #define MDB_LOCK_VERSION	 1
 
@@ -803,7 +809,8 @@ typedef struct MDB_page {
 		pgno_t		p_pgno;	/**< page number */
 		struct MDB_page *p_next; /**< for in-memory list of freed pages */
 	} mp_p;
-	uint16_t	mp_pad;			/**< key size if this is a LEAF2 page */
+	uint16_t	mp_pad;			/**< key size if this is a LEAF2 page,
+								 *	prefix size if this is a #P_PREFIX page */
 /**	@defgroup mdb_page	Page Flags
  *	@ingroup internal
  *	Flags for the page headers.
@@ -816,6 +823,7 @@ typedef struct MDB_page {
 #define	P_DIRTY		 0x10		/**< dirty page, also set for #P_SUBP pages */
 #define	P_LEAF2		 0x20		/**< for #MDB_DUPFIXED records */
 #define	P_SUBP		 0x40		/**< for #MDB_DUPSORT sub-pages */
+#define	P_PREFIX	 0x80		/**< leaf page with a common key prefix */
 #define	P_LOOSE		 0x4000		/**< page was dirtied then freed, can be reused */
 #define	P_KEEP		 0x8000		/**< leave this page alone during spill */
 /** @} */
@@ -866,6 +874,15 @@ typedef struct MDB_page {
 #define IS_OVERFLOW(p)	 F_ISSET((p)->mp_flags, P_OVERFLOW)
 	/** Test if a page is a sub page */
 #define IS_SUBP(p)	 F_ISSET((p)->mp_flags, P_SUBP)
+	/** Test if a page stores its keys without their common prefix */
+#define IS_PREFIX(p)	 F_ISSET((p)->mp_flags, P_PREFIX)
+
+	/** Length of the common key prefix of a leaf page */
+#define PFXLEN(p)	 (IS_PREFIX(p) ? (p)->mp_pad : 0)
+	/** Address of the common key prefix, kept at the top of the page */
+#define PFXKEY(env, p)	 ((char *)(p) + (env)->me_psize - (p)->mp_pad)
+	/** Size of a buffer for the whole key of a #MDB_PREFIXKEY database */
+#define PFXKEYMAX	 ((MDB_MAXKEYSIZE) > 0 ? (MDB_MAXKEYSIZE) : 1)
 
 	/** The number of overflow pages needed to store the given size. */
 #define OVPAGES(size, psize)	((PAGEHDRSZ-1 + (size)) / (psize) + 1)
@@ -988,12 +1005,9 @@ typedef struct MDB_node {
 	 */
 #define LEAF2KEY(p, i, ks)	((char *)(p) + PAGEHDRSZ + ((i)*(ks)))
 
-	/** Set the \b node's key into \b keyptr, if requested. */
-#define MDB_GET_KEY(node, keyptr)	{ if ((keyptr) != NULL) { \
-	(keyptr)->mv_size = NODEKSZ(node); (keyptr)->mv_data = NODEKEY(node); } }
-
-	/** Set the \b node's key into \b key. */
-#define MDB_GET_KEY2(node, key)	{ key.mv_size = NODEKSZ(node); key.mv_data = NODEKEY(node); }
+	/** Set the key of \b node on the cursor's page into \b keyptr, if requested. */
+#define MDB_GET_KEY(mc, node, keyptr)	{ if ((keyptr) != NULL) \
+	mdb_cursor_key(mc, node, keyptr); }
 
 	/** Information about a single database in the environment. */
 typedef struct MDB_db {
@@ -1011,7 +1025,7 @@ typedef struct MDB_db {
 #define PERSISTENT_FLAGS	(0xffff & ~(MDB_VALID))
 	/** #mdb_dbi_open() flags */
 #define VALID_FLAGS	(MDB_REVERSEKEY|MDB_DUPSORT|MDB_INTEGERKEY|MDB_DUPFIXED|\
-	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_CREATE)
+	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_PREFIXKEY|MDB_CREATE)
 
 	/** Handle for the DB used to track free pages. */
 #define	FREE_DBI	0
@@ -1031,7 +1045,8 @@ typedef struct MDB_meta {
 		/** Stamp identifying this as an LMDB file. It must be set
 		 *	to #MDB_MAGIC. */
 	uint32_t	mm_magic;
-		/** Version number of this file. Must be set to #MDB_DATA_VERSION. */
+		/** Version number of this file. Must be set to #MDB_DATA_VERSION,
+		 *	or #MDB_PREFIX_VERSION. */
 	uint32_t	mm_version;
 	void		*mm_address;		/**< address for fixed mapping */
 	size_t		mm_mapsize;			/**< size of mmap region */
@@ -1060,6 +1075,46 @@ typedef union MDB_metabuf {
 	} mb_metabuf;
 } MDB_metabuf;
 
+	/** A stamp that identifies a page log record */
+#define MDB_PLOG_MAGIC	 0xBEEF1065
+
+	/** Header of a page log record. With #MDB_PAGELOG every commit
+	 *	appends one record to the page log, before it writes the meta
+	 *	page. It is followed by \b pl_nruns #MDB_pgrun entries naming
+	 *	the pages that the transaction wrote.
+	 */
+typedef struct MDB_plrec {
+	uint32_t	pl_magic;		/**< #MDB_PLOG_MAGIC */
+	uint32_t	pl_nruns;		/**< number of runs that follow */
+	txnid_t		pl_txnid;		/**< the committing txn */
+} MDB_plrec;
+
+	/** A run of consecutive pages, in the page log and in a delta */
+typedef struct MDB_pgrun {
+	pgno_t		pr_pgno;		/**< first page of the run */
+	pgno_t		pr_count;		/**< number of pages, 0 ends a delta */
+} MDB_pgrun;
+
+	/** A stamp that identifies a delta written by #mdb_env_copy_delta() */
+#define MDB_DELTA_MAGIC	 0xBEEFDE17
+
+	/** Version of the delta format */
+#define MDB_DELTA_VERSION	 1
+
+	/** Header of a delta. It is followed by the #NUM_METAS meta pages of
+	 *	txn \b md_txnid, then by #MDB_pgrun entries, each followed by the
+	 *	contents of its pages, and by a final entry with \b pr_count 0.
+	 */
+typedef struct MDB_dhead {
+	uint32_t	md_magic;		/**< #MDB_DELTA_MAGIC */
+	uint32_t	md_version;		/**< #MDB_DELTA_VERSION */
+	uint32_t	md_psize;		/**< page size of the environment */
+	uint32_t	md_pad;
+	txnid_t		md_since;		/**< the delta holds all pages written after this txn */
+	txnid_t		md_txnid;		/**< the txn the delta brings the copy up to */
+	pgno_t		md_next_pgno;	/**< first unallocated page of \b md_txnid */
+} MDB_dhead;
+
 	/** Auxiliary DB info.
 	 *	The information here is mostly static/read-only. There is
 	 *	only a single copy of this record in the environment.
@@ -1147,6 +1202,7 @@ struct MDB_txn {
 #define MDB_TXN_DIRTY		0x04		/**< must write, even if dirty list is empty */
 #define MDB_TXN_SPILLS		0x08		/**< txn or a parent has spilled pages */
 #define MDB_TXN_HAS_CHILD	0x10		/**< txn has an #MDB_txn.%mt_child */
+#define MDB_TXN_PREFIX		0x20		/**< commit with #MDB_PREFIX_VERSION */
 	/** most operations on the txn are currently illegal */
 #define MDB_TXN_BLOCKED		(MDB_TXN_FINISHED|MDB_TXN_ERROR|MDB_TXN_HAS_CHILD)
 /** @} */
@@ -1208,6 +1264,8 @@ struct MDB_cursor {
 	unsigned int	mc_flags;	/**< @ref mdb_cursor */
 	MDB_page	*mc_pg[CURSOR_STACK];	/**< stack of pushed pages */
 	indx_t		mc_ki[CURSOR_STACK];	/**< stack of page indices */
+	/** Whole key returned from a #P_PREFIX page */
+	char		mc_kbuf[PFXKEYMAX];
 };
 
 	/** Context for sorted-dup records.
@@ -1249,11 +1307,18 @@ typedef struct MDB_pgstate {
 	txnid_t		mf_pglast;	/**< ID of last used record, or 0 if !mf_pghead */
 } MDB_pgstate;
 
+	/** A run of consecutive page numbers in me_pghead */
+typedef struct MDB_pgext {
+	pgno_t		pe_len;		/**< number of pages */
+	pgno_t		pe_pgno;	/**< lowest page number */
+} MDB_pgext;
+
 	/** The database environment. */
 struct MDB_env {
 	HANDLE		me_fd;		/**< The main data file */
 	HANDLE		me_lfd;		/**< The lock file */
 	HANDLE		me_mfd;		/**< For writing and syncing the meta pages */
+	HANDLE		me_plfd;	/**< The page log, with #MDB_PAGELOG */
 	/** Failed to update the meta page. Probably an I/O error. */
 #define	MDB_FATAL_ERROR	0x80000000U
 	/** Some fields are initialized. */
@@ -1279,6 +1344,8 @@ struct MDB_env {
 	MDB_txn		*me_txn;		/**< current write transaction */
 	MDB_txn		*me_txn0;		/**< prealloc'd write transaction */
 	size_t		me_mapsize;		/**< size of the data memory map */
+	size_t		me_mapgrow;		/**< bytes to grow the map by when full */
+	size_t		me_mapmax;		/**< size the map may grow to */
 	off_t		me_size;		/**< current file size */
 	pgno_t		me_maxpg;		/**< me_mapsize / me_psize */
 	MDB_dbx		*me_dbxs;		/**< array of static DB info */
@@ -1289,11 +1356,20 @@ struct MDB_env {
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+	/** Index of the runs of pages in me_pghead, see #mdb_pgext_find() */
+	MDB_pgext	*me_pgext;
+	unsigned	me_pgext_num;	/**< runs in me_pgext */
+	unsigned	me_pgext_max;	/**< room in me_pgext */
+	MDB_pgext	me_pgext_tail;	/**< run holding the tail of me_pghead */
+	pgno_t		*me_pgext_head;	/**< me_pghead that the index describes */
+	pgno_t		me_pgext_len;	/**< and its length */
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
-	/** ID2L of pages written during a write txn. Length MDB_IDL_UM_SIZE. */
+	/** ID2L of pages written during a write txn. Length #me_dirty_max. */
 	MDB_ID2L	me_dirty_list;
+	/** Room in each dirty list of a write txn, grown with #MDB_KEEPDIRTY */
+	unsigned int	me_dirty_max;
 	/** Max number of freelist items that can fit in a single overflow page */
 	int			me_maxfree_1pg;
 	/** Max size of a node on a page */
@@ -1316,6 +1392,10 @@ struct MDB_env {
 	MDB_assert_func *me_assert_func; /**< Callback for assertion failures */
 };
 
+	/** Length of the mapping of \b env, which reserves room to grow into */
+#define MDB_MAPLEN(env) \
+	((env)->me_mapmax > (env)->me_mapsize ? (env)->me_mapmax : (env)->me_mapsize)
+
 	/** Nested transaction */
 typedef struct MDB_ntxn {
 	MDB_txn		mnt_txn;		/**< the transaction */
@@ -1341,6 +1421,7 @@ typedef struct MDB_ntxn {
 	((txn)->mt_dbiseqs[dbi] != (txn)->mt_env->me_dbiseqs[dbi])
 
 static int  mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp);
+static int  mdb_env_grow(MDB_env *env, pgno_t pgno);
 static int  mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp);
 static int  mdb_page_touch(MDB_cursor *mc);
 
@@ -1407,6 +1488,8 @@ static int	mdb_cursor_first(MDB_cursor *mc, MDB_val *key, MDB_val *data);
 static int	mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data);
 
 static void	mdb_cursor_init(MDB_cursor *mc, MDB_txn *txn, MDB_dbi dbi, MDB_xcursor *mx);
+static void	mdb_cursor_key(MDB_cursor *mc, MDB_node *node, MDB_val *key);
+static int	mdb_page_pfxfit(MDB_cursor *mc, MDB_val *key, size_t nsize);
 static void	mdb_xcursor_init0(MDB_cursor *mc);
 static void	mdb_xcursor_init1(MDB_cursor *mc, MDB_node *node);
 static void	mdb_xcursor_init2(MDB_cursor *mc, MDB_xcursor *src_mx, int force);
@@ -1960,6 +2043,38 @@ mdb_pages_xkeep(MDB_cursor *mc, unsigned pflags, int all)
 
 static int mdb_page_flush(MDB_txn *txn, int keep);
 
+/** Make room for more dirty pages, for #MDB_KEEPDIRTY.
+ * The mt_dirty_room of a txn counts the dirty pages of its parents
+ * too, so the dirty lists of all of them grow alike.
+ * @param[in] txn the transaction that is out of room.
+ * @param[in] need the number of pages needed.
+ * @return 0 on success, ENOMEM if the lists could not be grown.
+ */
+static int
+mdb_dirty_grow(MDB_txn *txn, unsigned int need)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_txn *tx2;
+	unsigned int num = env->me_dirty_max * 2;
+
+	if (num < env->me_dirty_max + need)
+		num = env->me_dirty_max + need;
+	if (num < env->me_dirty_max)
+		return ENOMEM;
+	/* Lists that grew before a failure are merely larger than needed */
+	for (tx2 = txn; tx2; tx2 = tx2->mt_parent) {
+		if (mdb_mid2l_grow(&tx2->mt_u.dirty_list, num))
+			return ENOMEM;
+		if (!tx2->mt_parent)
+			env->me_dirty_list = tx2->mt_u.dirty_list;
+	}
+	for (tx2 = txn; tx2; tx2 = tx2->mt_parent)
+		tx2->mt_dirty_room += num - env->me_dirty_max;
+	env->me_dirty_max = num;
+	DPRINTF(("dirty list grown to %u pages", num));
+	return MDB_SUCCESS;
+}
+
 /**	Spill pages from the dirty list back to disk.
  * This is intended to prevent running into #MDB_TXN_FULL situations,
  * but note that they may still occur in a few cases:
@@ -2018,6 +2133,11 @@ mdb_page_spill(MDB_cursor *m0, MDB_val *key, MDB_val *data)
 	if (txn->mt_dirty_room > i)
 		return MDB_SUCCESS;
 
+	/* Rather keep everything in memory, if there's enough */
+	if ((txn->mt_env->me_flags & MDB_KEEPDIRTY) &&
+		mdb_dirty_grow(txn, i) == MDB_SUCCESS)
+		return MDB_SUCCESS;
+
 	if (!txn->mt_spill_pgs) {
 		txn->mt_spill_pgs = mdb_midl_alloc(MDB_IDL_UM_MAX);
 		if (!txn->mt_spill_pgs)
@@ -2128,6 +2248,208 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** @defgroup pgext	Free page runs
+ *
+ * Finding room for a multi-page overflow value used to mean scanning
+ * all of me_pghead for a long enough run of consecutive pages, once
+ * per allocation and again after each freeDB record merged in. On a
+ * fragmented map with no fitting run that is a full scan every time.
+ *
+ * Instead, me_pgext indexes the runs of two or more pages in me_pghead,
+ * sorted by length and then page number, so the shortest fitting run
+ * (the lowest one of that length) is found by binary search. The run
+ * at the tail of me_pghead, where single pages are taken from, is kept
+ * apart in me_pgext_tail so that taking them doesn't touch the index.
+ * Whatever else changes me_pghead, or replaces it as child txns begin
+ * and end, clears me_pgext_head so that the index is rebuilt on next use.
+ *	@{
+ */
+
+	/** Compare two runs by length, then page number */
+#define PGEXT_CMP(a, b) \
+	((a)->pe_len != (b)->pe_len ? ((a)->pe_len < (b)->pe_len ? -1 : 1) : \
+	 (a)->pe_pgno != (b)->pe_pgno ? ((a)->pe_pgno < (b)->pe_pgno ? -1 : 1) : 0)
+
+static int
+mdb_pgext_cmp(const void *a, const void *b)
+{
+	return PGEXT_CMP((const MDB_pgext *)a, (const MDB_pgext *)b);
+}
+
+/** Return the first index entry not less than \b key */
+static unsigned
+mdb_pgext_search(MDB_env *env, MDB_pgext *key)
+{
+	unsigned lo = 0, hi = env->me_pgext_num, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (PGEXT_CMP(&env->me_pgext[mid], key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/** Return the length of the run starting at me_pghead[\b i] */
+static pgno_t
+mdb_pgext_runlen(pgno_t *mop, unsigned i)
+{
+	pgno_t pgno = mop[i];
+	unsigned lo = 0, hi = 1;
+
+	/* Gallop towards the head, then bisect. mop[i-k] - k
+	 * never decreases, so the run is where it equals pgno.
+	 */
+	while (hi < i && mop[i-hi] == pgno+hi) {
+		lo = hi;
+		hi <<= 1;
+	}
+	if (hi > i-1)
+		hi = i-1;
+	while (lo < hi) {
+		unsigned mid = (lo + hi + 1) >> 1;
+		if (mop[i-mid] == pgno+mid)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo + 1;
+}
+
+/** Make the run at the tail of me_pghead the tail run, if it is used up */
+static void
+mdb_pgext_retail(MDB_env *env)
+{
+	pgno_t *mop = env->me_pghead;
+	MDB_pgext *pe = &env->me_pgext_tail;
+	unsigned x;
+
+	if (pe->pe_len || !mop[0])
+		return;
+	pe->pe_pgno = mop[mop[0]];
+	pe->pe_len = mdb_pgext_runlen(mop, mop[0]);
+	if (pe->pe_len > 1) {
+		x = mdb_pgext_search(env, pe);
+		mdb_eassert(env, x < env->me_pgext_num &&
+			!PGEXT_CMP(&env->me_pgext[x], pe));
+		env->me_pgext_num--;
+		memmove(&env->me_pgext[x], &env->me_pgext[x+1],
+			(env->me_pgext_num - x) * sizeof(MDB_pgext));
+	}
+}
+
+/** Index the runs of me_pghead from scratch */
+static int
+mdb_pgext_build(MDB_env *env)
+{
+	pgno_t *mop = env->me_pghead;
+	unsigned i, n = 0;
+	MDB_pgext *pe;
+
+	env->me_pgext_head = NULL;
+	for (i = mop[0]; i > 1; i--)
+		if (mop[i-1] != mop[i]+1)
+			n++;
+	if (n >= env->me_pgext_max) {
+		pe = realloc(env->me_pgext, (n + n/2 + 16) * sizeof(MDB_pgext));
+		if (!pe)
+			return ENOMEM;
+		env->me_pgext = pe;
+		env->me_pgext_max = n + n/2 + 16;
+	}
+
+	pe = env->me_pgext;
+	n = 0;
+	env->me_pgext_tail.pe_len = 0;
+	for (i = mop[0]; i; ) {
+		pgno_t len = mdb_pgext_runlen(mop, i);
+		if (i == mop[0]) {
+			env->me_pgext_tail.pe_pgno = mop[i];
+			env->me_pgext_tail.pe_len = len;
+		} else if (len > 1) {
+			pe[n].pe_len = len;
+			pe[n].pe_pgno = mop[i];
+			n++;
+		}
+		i -= len;
+	}
+	env->me_pgext_num = n;
+	qsort(pe, n, sizeof(MDB_pgext), mdb_pgext_cmp);
+	env->me_pgext_head = mop;
+	env->me_pgext_len = mop[0];
+	return MDB_SUCCESS;
+}
+
+/** Find \b num consecutive pages in me_pghead, num > 1. The index is
+ * updated as if they were taken out, which the caller must then do.
+ * @return the lowest page number of the run, or 0 if there is none.
+ */
+static pgno_t
+mdb_pgext_find(MDB_env *env, int num)
+{
+	pgno_t *mop = env->me_pghead, pgno;
+	MDB_pgext key, *pe, *tail = &env->me_pgext_tail;
+	unsigned x, i;
+
+	if (env->me_pgext_head != mop || env->me_pgext_len != mop[0]) {
+		if (mdb_pgext_build(env) != MDB_SUCCESS) {
+			/* No memory for the index, just scan */
+			for (i = mop[0]; i > (unsigned)num-1; i--)
+				if (mop[i-num+1] == mop[i]+num-1)
+					return mop[i];
+			return 0;
+		}
+	}
+	mdb_pgext_retail(env);
+
+	key.pe_len = num;
+	key.pe_pgno = 0;
+	x = mdb_pgext_search(env, &key);
+	pe = x < env->me_pgext_num ? &env->me_pgext[x] : NULL;
+	/* Take the shortest run that fits, the tail run on a tie */
+	if (tail->pe_len >= (pgno_t)num && (!pe || pe->pe_len >= tail->pe_len)) {
+		pgno = tail->pe_pgno;
+		tail->pe_pgno += num;
+		tail->pe_len -= num;
+	} else if (pe) {
+		pgno = pe->pe_pgno;
+		key.pe_len = pe->pe_len - num;
+		key.pe_pgno = pgno + num;
+		env->me_pgext_num--;
+		memmove(pe, pe+1, (env->me_pgext_num - x) * sizeof(MDB_pgext));
+		if (key.pe_len > 1) {
+			/* Reinsert the rest of the run, which the removal
+			 * left room for and which can only sort earlier.
+			 */
+			x = mdb_pgext_search(env, &key);
+			memmove(&env->me_pgext[x+1], &env->me_pgext[x],
+				(env->me_pgext_num - x) * sizeof(MDB_pgext));
+			env->me_pgext[x] = key;
+			env->me_pgext_num++;
+		}
+	} else {
+		return 0;
+	}
+	env->me_pgext_len = mop[0] - num;
+	return pgno;
+}
+
+/** Account for the caller taking the last page of me_pghead */
+static void
+mdb_pgext_tail1(MDB_env *env)
+{
+	if (env->me_pgext_head == env->me_pghead &&
+		env->me_pgext_len == env->me_pghead[0]) {
+		mdb_pgext_retail(env);
+		env->me_pgext_tail.pe_pgno++;
+		env->me_pgext_tail.pe_len--;
+		env->me_pgext_len--;
+	}
+}
+/** @} */
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.  Set #MDB_TXN_ERROR on failure.
  *
@@ -2182,7 +2504,8 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 	*mp = NULL;
 
 	/* If our dirty list is already full, we can't do anything */
-	if (txn->mt_dirty_room == 0) {
+	if (txn->mt_dirty_room == 0 && !((env->me_flags & MDB_KEEPDIRTY) &&
+		mdb_dirty_grow(txn, 1) == MDB_SUCCESS)) {
 		rc = MDB_TXN_FULL;
 		goto fail;
 	}
@@ -2196,12 +2519,16 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		 * pages at the tail, just truncating the list.
 		 */
 		if (mop_len > n2) {
-			i = mop_len;
-			do {
+			if (!n2) {
+				i = mop_len;
 				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
-					goto search_done;
-			} while (--i > n2);
+				mdb_pgext_tail1(env);
+				goto search_done;
+			}
+			if ((pgno = mdb_pgext_find(env, num)) != 0) {
+				i = mdb_midl_search(mop, pgno);
+				goto search_done;
+			}
 			if (--retry < 0)
 				break;
 		}
@@ -2276,15 +2603,18 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		/* Merge in descending sorted order */
 		mdb_midl_xmerge(mop, idl);
 		mop_len = mop[0];
+		env->me_pgext_head = NULL;
 	}
 
 	/* Use new pages from the map when nothing suitable in the freeDB */
 	i = 0;
 	pgno = txn->mt_next_pgno;
 	if (pgno + num >= env->me_maxpg) {
+		if (!env->me_mapgrow || (rc = mdb_env_grow(env, pgno + num)) != 0) {
 			DPUTS("DB size maxed out");
 			rc = MDB_MAP_FULL;
 			goto fail;
+		}
 	}
 
 search_done:
@@ -2362,7 +2692,8 @@ mdb_page_unspill(MDB_txn *txn, MDB_page *mp, MDB_page **ret)
 		if (x <= tx2->mt_spill_pgs[0] && tx2->mt_spill_pgs[x] == pn) {
 			MDB_page *np;
 			int num;
-			if (txn->mt_dirty_room == 0)
+			if (txn->mt_dirty_room == 0 && !((env->me_flags & MDB_KEEPDIRTY) &&
+				mdb_dirty_grow(txn, 1) == MDB_SUCCESS))
 				return MDB_TXN_FULL;
 			if (IS_OVERFLOW(mp))
 				num = mp->mp_pages;
@@ -2457,7 +2788,7 @@ mdb_page_touch(MDB_cursor *mc)
 				return 0;
 			}
 		}
-		mdb_cassert(mc, dl[0].mid < MDB_IDL_UM_MAX);
+		mdb_cassert(mc, dl[0].mid < MDB_ID2L_ALLOCLEN(dl));
 		/* No - copy it */
 		np = mdb_page_malloc(txn, 1);
 		if (!np)
@@ -2762,7 +3093,7 @@ mdb_txn_renew0(MDB_txn *txn)
 		txn->mt_child = NULL;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
-		txn->mt_dirty_room = MDB_IDL_UM_MAX;
+		txn->mt_dirty_room = env->me_dirty_max;
 		txn->mt_u.dirty_list = env->me_dirty_list;
 		txn->mt_u.dirty_list[0].mid = 0;
 		txn->mt_free_pgs = env->me_free_pgs;
@@ -2793,9 +3124,16 @@ mdb_txn_renew0(MDB_txn *txn)
 	if (env->me_flags & MDB_FATAL_ERROR) {
 		DPUTS("environment had fatal error, must shutdown!");
 		rc = MDB_PANIC;
-	} else if (env->me_maxpg < txn->mt_next_pgno) {
+	} else if (env->me_maxpg < txn->mt_next_pgno &&
+		(meta->mm_mapsize > MDB_MAPLEN(env) ||
+		 meta->mm_mapsize / env->me_psize < txn->mt_next_pgno)) {
 		rc = MDB_MAP_RESIZED;
 	} else {
+		if (env->me_maxpg < txn->mt_next_pgno) {
+			/* Another process grew the map into our reserved room */
+			env->me_mapsize = meta->mm_mapsize;
+			env->me_maxpg = env->me_mapsize / env->me_psize;
+		}
 		return MDB_SUCCESS;
 	}
 	mdb_txn_end(txn, new_notls /*0 or MDB_END_SLOT*/ | MDB_END_FAIL_BEGIN);
@@ -2865,11 +3203,11 @@ mdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
 		unsigned int i;
 		txn->mt_cursors = (MDB_cursor **)(txn->mt_dbs + env->me_maxdbs);
 		txn->mt_dbiseqs = parent->mt_dbiseqs;
-		txn->mt_u.dirty_list = malloc(sizeof(MDB_ID2)*MDB_IDL_UM_SIZE);
+		txn->mt_u.dirty_list = mdb_mid2l_alloc(env->me_dirty_max);
 		if (!txn->mt_u.dirty_list ||
 			!(txn->mt_free_pgs = mdb_midl_alloc(MDB_IDL_UM_MAX)))
 		{
-			free(txn->mt_u.dirty_list);
+			mdb_mid2l_free(txn->mt_u.dirty_list);
 			free(txn);
 			return ENOMEM;
 		}
@@ -2892,6 +3230,7 @@ mdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **ret)
 		if (env->me_pghead) {
 			size = MDB_IDL_SIZEOF(env->me_pghead);
 			env->me_pghead = mdb_midl_alloc(env->me_pghead[0]);
+			env->me_pgext_head = NULL;
 			if (env->me_pghead)
 				memcpy(env->me_pghead, ntxn->mnt_pgstate.mf_pghead, size);
 			else
@@ -3015,6 +3354,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			/* me_pgstate: */
 			env->me_pghead = NULL;
 			env->me_pglast = 0;
+			env->me_pgext_head = NULL;
 
 			env->me_txn = NULL;
 			mode = 0;	/* txn == env->me_txn0, do not free() it */
@@ -3026,9 +3366,10 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			txn->mt_parent->mt_child = NULL;
 			txn->mt_parent->mt_flags &= ~MDB_TXN_HAS_CHILD;
 			env->me_pgstate = ((MDB_ntxn *)txn)->mnt_pgstate;
+			env->me_pgext_head = NULL;
 			mdb_midl_free(txn->mt_free_pgs);
 			mdb_midl_free(txn->mt_spill_pgs);
-			free(txn->mt_u.dirty_list);
+			mdb_mid2l_free(txn->mt_u.dirty_list);
 		}
 
 		mdb_midl_free(pghead);
@@ -3220,6 +3561,7 @@ mdb_freelist_save(MDB_txn *txn)
 		loose[0] = count;
 		mdb_midl_sort(loose);
 		mdb_midl_xmerge(mop, loose);
+		env->me_pgext_head = NULL;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
 		mop_len = mop[0];
@@ -3407,6 +3749,87 @@ done:
 	return MDB_SUCCESS;
 }
 
+/** Append a record of the pages written by a txn to the page log.
+ * The log lets #mdb_env_copy_delta() find the pages that changed
+ * since an earlier txn without reading the whole map.
+ * @param[in] txn the transaction that's being committed
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_plog_write(MDB_txn *txn)
+{
+	MDB_env		*env = txn->mt_env;
+	MDB_ID2L	dl = txn->mt_u.dirty_list;
+	MDB_IDL		sl = txn->mt_spill_pgs;
+	MDB_plrec	*pl;
+	MDB_pgrun	*pr;
+	MDB_page	*dp;
+	unsigned	i, n = dl[0].mid + (sl ? sl[0] : 0);
+	size_t		len;
+	char		*ptr;
+	int			rc = MDB_SUCCESS;
+#ifdef _WIN32
+	DWORD		wres;
+#else
+	ssize_t		wres;
+#endif
+
+	len = sizeof(MDB_plrec) + n * sizeof(MDB_pgrun);
+	if ((pl = malloc(len)) == NULL)
+		return ENOMEM;
+	pl->pl_magic = MDB_PLOG_MAGIC;
+	pl->pl_txnid = txn->mt_txnid;
+	pr = (MDB_pgrun *)(pl + 1);
+	for (i=1; i<=dl[0].mid; i++) {
+		dp = dl[i].mptr;
+		pr->pr_pgno = dl[i].mid;
+		pr->pr_count = IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+		pr++;
+	}
+	/* Spilled pages were already written to the map. Slots
+	 * marked deleted were unspilled, and are in the dirty list.
+	 */
+	for (i=1; sl && i<=sl[0]; i++) {
+		if (sl[i] & 1)
+			continue;
+		pr->pr_pgno = sl[i] >> 1;
+		dp = (MDB_page *)(env->me_map + env->me_psize * pr->pr_pgno);
+		pr->pr_count = IS_OVERFLOW(dp) ? dp->mp_pages : 1;
+		pr++;
+	}
+	pl->pl_nruns = pr - (MDB_pgrun *)(pl + 1);
+	len = (char *)pr - (char *)pl;
+
+	/* One write per record, so that an append is never interleaved
+	 * with another process' record.
+	 */
+	for (ptr = (char *)pl; len; ptr += wres, len -= wres) {
+#ifdef _WIN32
+		if (!WriteFile(env->me_plfd, ptr, len, &wres, NULL)) {
+			rc = ErrCode();
+			break;
+		}
+#else
+		wres = write(env->me_plfd, ptr, len);
+		if (wres < 0) {
+			rc = ErrCode();
+			if (rc == EINTR) {
+				rc = MDB_SUCCESS;
+				wres = 0;
+				continue;
+			}
+			break;
+		}
+#endif
+		if (!wres) {
+			rc = EIO;
+			break;
+		}
+	}
+	free(pl);
+	return rc;
+}
+
 int
 mdb_txn_commit(MDB_txn *txn)
 {
@@ -3531,7 +3954,7 @@ mdb_txn_commit(MDB_txn *txn)
 				}
 			}
 		} else { /* Simplify the above for single-ancestor case */
-			len = MDB_IDL_UM_MAX - txn->mt_dirty_room;
+			len = env->me_dirty_max - txn->mt_dirty_room;
 		}
 		/* Merge our dirty list with parent's */
 		y = src[0].mid;
@@ -3544,7 +3967,7 @@ mdb_txn_commit(MDB_txn *txn)
 		}
 		mdb_tassert(txn, i == x);
 		dst[0].mid = len;
-		free(txn->mt_u.dirty_list);
+		mdb_mid2l_free(txn->mt_u.dirty_list);
 		parent->mt_dirty_room = txn->mt_dirty_room;
 		if (txn->mt_spill_pgs) {
 			if (parent->mt_spill_pgs) {
@@ -3567,6 +3990,7 @@ mdb_txn_commit(MDB_txn *txn)
 
 		parent->mt_child = NULL;
 		mdb_midl_free(((MDB_ntxn *)txn)->mnt_pgstate.mf_pghead);
+		env->me_pgext_head = NULL;
 		free(txn);
 		return rc;
 	}
@@ -3621,6 +4045,10 @@ mdb_txn_commit(MDB_txn *txn)
 	mdb_audit(txn);
 #endif
 
+	if (env->me_plfd != INVALID_HANDLE_VALUE &&
+		(rc = mdb_plog_write(txn)))
+		goto fail;
+
 	if ((rc = mdb_page_flush(txn, 0)) ||
 		(rc = mdb_env_sync(env, 0)) ||
 		(rc = mdb_env_write_meta(txn)))
@@ -3688,7 +4116,8 @@ mdb_env_read_header(MDB_env *env, MDB_meta *meta)
 			return MDB_INVALID;
 		}
 
-		if (m->mm_version != MDB_DATA_VERSION) {
+		if (m->mm_version != MDB_DATA_VERSION &&
+			m->mm_version != MDB_PREFIX_VERSION) {
 			DPRINTF(("database is version %u, expected version %u",
 				m->mm_version, MDB_DATA_VERSION));
 			return MDB_VERSION_MISMATCH;
@@ -3778,7 +4207,7 @@ mdb_env_write_meta(MDB_txn *txn)
 {
 	MDB_env *env;
 	MDB_meta	meta, metab, *mp;
-	unsigned flags;
+	unsigned flags, version;
 	size_t mapsize;
 	off_t off;
 	int rc, len, toggle;
@@ -3801,8 +4230,13 @@ mdb_env_write_meta(MDB_txn *txn)
 	/* Persist any increases of mapsize config */
 	if (mapsize < env->me_mapsize)
 		mapsize = env->me_mapsize;
+	/* Keep a version bump, the other meta page may still be older */
+	version = env->me_metas[toggle ^ 1]->mm_version;
+	if (txn->mt_flags & MDB_TXN_PREFIX)
+		version = MDB_PREFIX_VERSION;
 
 	if (flags & MDB_WRITEMAP) {
+		mp->mm_version = version;
 		mp->mm_mapsize = mapsize;
 		mp->mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
 		mp->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
@@ -3839,6 +4273,11 @@ mdb_env_write_meta(MDB_txn *txn)
 	meta.mm_txnid = txn->mt_txnid;
 
 	off = offsetof(MDB_meta, mm_mapsize);
+	if (mp->mm_version != version) {
+		meta.mm_version = version;
+		meta.mm_address = mp->mm_address;
+		off = offsetof(MDB_meta, mm_version);
+	}
 	ptr = (char *)&meta + off;
 	len = sizeof(MDB_meta) - off;
 	off += (char *)mp - env->me_map;
@@ -3924,6 +4363,7 @@ mdb_env_create(MDB_env **env)
 	e->me_fd = INVALID_HANDLE_VALUE;
 	e->me_lfd = INVALID_HANDLE_VALUE;
 	e->me_mfd = INVALID_HANDLE_VALUE;
+	e->me_plfd = INVALID_HANDLE_VALUE;
 #ifdef MDB_USE_POSIX_SEM
 	e->me_rmutex = SEM_FAILED;
 	e->me_wmutex = SEM_FAILED;
@@ -3985,7 +4425,7 @@ mdb_env_map(MDB_env *env, void *addr)
 		if (ftruncate(env->me_fd, env->me_mapsize) < 0)
 			return ErrCode();
 	}
-	env->me_map = mmap(addr, env->me_mapsize, prot, MAP_SHARED,
+	env->me_map = mmap(addr, MDB_MAPLEN(env), prot, MAP_SHARED,
 		env->me_fd, 0);
 	if (env->me_map == MAP_FAILED) {
 		env->me_map = NULL;
@@ -3995,10 +4435,10 @@ mdb_env_map(MDB_env *env, void *addr)
 	if (flags & MDB_NORDAHEAD) {
 		/* Turn off readahead. It's harmful when the DB is larger than RAM. */
 #ifdef MADV_RANDOM
-		madvise(env->me_map, env->me_mapsize, MADV_RANDOM);
+		madvise(env->me_map, MDB_MAPLEN(env), MADV_RANDOM);
 #else
 #ifdef POSIX_MADV_RANDOM
-		posix_madvise(env->me_map, env->me_mapsize, POSIX_MADV_RANDOM);
+		posix_madvise(env->me_map, MDB_MAPLEN(env), POSIX_MADV_RANDOM);
 #endif /* POSIX_MADV_RANDOM */
 #endif /* MADV_RANDOM */
 	}
@@ -4040,7 +4480,7 @@ mdb_env_set_mapsize(MDB_env *env, size_t size)
 			if (size < minsize)
 				size = minsize;
 		}
-		munmap(env->me_map, env->me_mapsize);
+		munmap(env->me_map, MDB_MAPLEN(env));
 		env->me_mapsize = size;
 		old = (env->me_flags & MDB_FIXEDMAP) ? env->me_map : NULL;
 		rc = mdb_env_map(env, old);
@@ -4053,6 +4493,65 @@ mdb_env_set_mapsize(MDB_env *env, size_t size)
 	return MDB_SUCCESS;
 }
 
+int ESECT
+mdb_env_set_mapgrowth(MDB_env *env, size_t step, size_t max)
+{
+#ifdef _WIN32
+	/* Windows maps no further than the end of the file */
+	return EINVAL;
+#else
+	if (step && !max)
+		return EINVAL;
+	if (!step)
+		max = 0;
+	if (env->me_map) {
+		int rc;
+		void *old;
+		if (env->me_txn)
+			return EINVAL;
+		if (max == env->me_mapmax) {
+			env->me_mapgrow = step;
+			return MDB_SUCCESS;
+		}
+		munmap(env->me_map, MDB_MAPLEN(env));
+		env->me_mapgrow = step;
+		env->me_mapmax = max;
+		old = (env->me_flags & MDB_FIXEDMAP) ? env->me_map : NULL;
+		rc = mdb_env_map(env, old);
+		if (rc)
+			return rc;
+	}
+	env->me_mapgrow = step;
+	env->me_mapmax = max;
+	return MDB_SUCCESS;
+#endif
+}
+
+/** Grow the map of \b env so that it holds page \b pgno, within the
+ * room reserved by #mdb_env_set_mapgrowth(). Only the writer calls this.
+ */
+static int ESECT
+mdb_env_grow(MDB_env *env, pgno_t pgno)
+{
+	size_t size = env->me_mapsize;
+
+	do
+		size += env->me_mapgrow;
+	while (size / env->me_psize <= pgno);
+	if (size > env->me_mapmax)
+		size = env->me_mapmax;
+	if (size / env->me_psize <= pgno)
+		return MDB_MAP_FULL;
+#ifndef _WIN32
+	if ((env->me_flags & MDB_WRITEMAP) && ftruncate(env->me_fd, size) < 0)
+		return ErrCode();
+#endif
+	DPRINTF(("growing map to %"Z"u bytes", size));
+	env->me_mapsize = size;
+	env->me_maxpg = size / env->me_psize;
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_set_maxdbs(MDB_env *env, MDB_dbi dbs)
 {
@@ -4120,10 +4619,11 @@ typedef struct MDB_name {
 	mdb_nchar_t	*mn_val;		/**< Contents */
 } MDB_name;
 
-/** Filename suffixes [datafile,lockfile][without,with MDB_NOSUBDIR] */
-static const mdb_nchar_t *const mdb_suffixes[2][2] = {
+/** Filename suffixes [datafile,lockfile,pagelog][without,with MDB_NOSUBDIR] */
+static const mdb_nchar_t *const mdb_suffixes[3][2] = {
 	{ MDB_NAME("/data.mdb"), MDB_NAME("")      },
-	{ MDB_NAME("/lock.mdb"), MDB_NAME("-lock") }
+	{ MDB_NAME("/lock.mdb"), MDB_NAME("-lock") },
+	{ MDB_NAME("/plog.mdb"), MDB_NAME("-plog") }
 };
 
 #define MDB_SUFFLEN 9	/**< Max string length in #mdb_suffixes[] */
@@ -4139,7 +4639,8 @@ static const mdb_nchar_t *const mdb_suffixes[2][2] = {
 static int ESECT
 mdb_fname_init(const char *path, unsigned envflags, MDB_name *fname)
 {
-	int no_suffix = F_ISSET(envflags, MDB_NOSUBDIR|MDB_NOLOCK);
+	int no_suffix = F_ISSET(envflags, MDB_NOSUBDIR|MDB_NOLOCK) &&
+		!(envflags & MDB_PAGELOG);
 	fname->mn_alloced = 0;
 #ifdef _WIN32
 	return utf8_to_utf16(path, fname, no_suffix ? 0 : MDB_SUFFLEN);
@@ -4170,18 +4671,24 @@ mdb_fname_init(const char *path, unsigned envflags, MDB_name *fname)
 /** File type, access mode etc. for #mdb_fopen() */
 enum mdb_fopen_type {
 #ifdef _WIN32
-	MDB_O_RDONLY, MDB_O_RDWR, MDB_O_META, MDB_O_COPY, MDB_O_LOCKS
+	MDB_O_RDONLY, MDB_O_RDWR, MDB_O_META, MDB_O_COPY, MDB_O_LOCKS,
+	MDB_O_PLOG, MDB_O_PLOGRD, MDB_O_DELTA
 #else
 	/* A comment in mdb_fopen() explains some O_* flag choices. */
 	MDB_O_RDONLY= O_RDONLY,                            /**< for RDONLY me_fd */
 	MDB_O_RDWR  = O_RDWR  |O_CREAT,                    /**< for me_fd */
 	MDB_O_META  = O_WRONLY|MDB_DSYNC     |MDB_CLOEXEC, /**< for me_mfd */
 	MDB_O_COPY  = O_WRONLY|O_CREAT|O_EXCL|MDB_CLOEXEC, /**< for #mdb_env_copy() */
+	MDB_O_PLOG  = O_WRONLY|O_CREAT|O_APPEND|MDB_CLOEXEC, /**< for me_plfd */
 	/** Bitmask for open() flags in enum #mdb_fopen_type.  The other bits
 	 * distinguish otherwise-equal MDB_O_* constants from each other.
 	 */
-	MDB_O_MASK  = MDB_O_RDWR|MDB_CLOEXEC | MDB_O_RDONLY|MDB_O_META|MDB_O_COPY,
-	MDB_O_LOCKS = MDB_O_RDWR|MDB_CLOEXEC | ((MDB_O_MASK+1) & ~MDB_O_MASK) /**< for me_lfd */
+	MDB_O_MASK  = MDB_O_RDWR|MDB_CLOEXEC | MDB_O_RDONLY|MDB_O_META|MDB_O_COPY|MDB_O_PLOG,
+	MDB_O_LOCKS = MDB_O_RDWR|MDB_CLOEXEC | ((MDB_O_MASK+1) & ~MDB_O_MASK), /**< for me_lfd */
+	/** for reading the page log in #mdb_env_copy_delta() */
+	MDB_O_PLOGRD= O_RDONLY|MDB_CLOEXEC | ((MDB_O_MASK+1) & ~MDB_O_MASK),
+	/** for #mdb_env_copy_delta(), buffered and without a suffix */
+	MDB_O_DELTA = MDB_O_COPY | ((MDB_O_MASK+1) & ~MDB_O_MASK)
 #endif
 };
 
@@ -4207,13 +4714,17 @@ mdb_fopen(const MDB_env *env, MDB_name *fname,
 	int flags;
 #endif
 
-	if (fname->mn_alloced)		/* modifiable copy */
+	if (fname->mn_alloced && which != MDB_O_DELTA)		/* modifiable copy */
 		mdb_name_cpy(fname->mn_val + fname->mn_len,
-			mdb_suffixes[which==MDB_O_LOCKS][F_ISSET(env->me_flags, MDB_NOSUBDIR)]);
+			mdb_suffixes[which==MDB_O_LOCKS ? 1 :
+				(which==MDB_O_PLOG || which==MDB_O_PLOGRD) ? 2 : 0]
+				[F_ISSET(env->me_flags, MDB_NOSUBDIR)]);
 
 	/* The directory must already exist.  Usually the file need not.
 	 * MDB_O_META requires the file because we already created it using
 	 * MDB_O_RDWR.  MDB_O_COPY must not overwrite an existing file.
+	 * MDB_O_PLOG only ever appends, so that writers in several
+	 * processes cannot overwrite each other's records.
 	 *
 	 * With MDB_O_COPY we do not want the OS to cache the writes, since
 	 * the source data is already in the OS cache.
@@ -4246,6 +4757,17 @@ mdb_fopen(const MDB_env *env, MDB_name *fname,
 		disp = CREATE_NEW;
 		attrs = FILE_FLAG_NO_BUFFERING|FILE_FLAG_WRITE_THROUGH;
 		break;
+	case MDB_O_PLOG:			/* page log, append only */
+		acc = FILE_APPEND_DATA;
+		break;
+	case MDB_O_PLOGRD:			/* page log, for mdb_env_copy_delta() */
+		acc = GENERIC_READ;
+		disp = OPEN_EXISTING;
+		break;
+	case MDB_O_DELTA:			/* mdb_env_copy_delta() */
+		acc = GENERIC_WRITE;
+		disp = CREATE_NEW;
+		break;
 	default: break;	/* silence gcc -Wswitch (not all enum values handled) */
 	}
 	fd = CreateFileW(fname->mn_val, acc, share, NULL, disp, attrs, NULL);
@@ -4910,9 +5432,10 @@ fail:
 	 *	at runtime. Changing other flags requires closing the
 	 *	environment and re-opening it with the new flags.
 	 */
-#define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
+#define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT| \
+	MDB_KEEPDIRTY)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
-	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD|MDB_PAGELOG)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
@@ -4938,8 +5461,9 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 		flags &= ~MDB_WRITEMAP;
 	} else {
 		if (!((env->me_free_pgs = mdb_midl_alloc(MDB_IDL_UM_MAX)) &&
-			  (env->me_dirty_list = calloc(MDB_IDL_UM_SIZE, sizeof(MDB_ID2)))))
+			  (env->me_dirty_list = mdb_mid2l_alloc(MDB_IDL_UM_MAX))))
 			rc = ENOMEM;
+		env->me_dirty_max = MDB_IDL_UM_MAX;
 	}
 	env->me_flags = flags |= MDB_ENV_ACTIVE;
 	if (rc)
@@ -4983,6 +5507,11 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 			if (rc)
 				goto leave;
 		}
+		if ((flags & (MDB_RDONLY|MDB_PAGELOG)) == MDB_PAGELOG) {
+			rc = mdb_fopen(env, &fname, MDB_O_PLOG, mode, &env->me_plfd);
+			if (rc)
+				goto leave;
+		}
 		DPRINTF(("opened dbenv %p", (void *) env));
 		if (excl > 0) {
 			rc = mdb_env_share_locks(env, &excl);
@@ -5035,10 +5564,14 @@ mdb_env_close0(MDB_env *env, int excl)
 	}
 
 	free(env->me_pbuf);
+	free(env->me_pgext);
+	env->me_pgext = NULL;
+	env->me_pgext_max = 0;
+	env->me_pgext_head = NULL;
 	free(env->me_dbiseqs);
 	free(env->me_dbflags);
 	free(env->me_path);
-	free(env->me_dirty_list);
+	mdb_mid2l_free(env->me_dirty_list);
 	free(env->me_txn0);
 	mdb_midl_free(env->me_free_pgs);
 
@@ -5056,10 +5589,12 @@ mdb_env_close0(MDB_env *env, int excl)
 	}
 
 	if (env->me_map) {
-		munmap(env->me_map, env->me_mapsize);
+		munmap(env->me_map, MDB_MAPLEN(env));
 	}
 	if (env->me_mfd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_mfd);
+	if (env->me_plfd != INVALID_HANDLE_VALUE)
+		(void) close(env->me_plfd);
 	if (env->me_fd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_fd);
 	if (env->me_txns) {
@@ -5229,6 +5764,81 @@ mdb_cmp_memnr(const MDB_val *a, const MDB_val *b)
 	return len_diff<0 ? -1 : len_diff;
 }
 
+/** Return the length of the common prefix of two keys. */
+static unsigned int
+mdb_pfx_len(const MDB_val *a, const MDB_val *b)
+{
+	const unsigned char *p1 = a->mv_data, *p2 = b->mv_data;
+	unsigned int i, len = a->mv_size < b->mv_size ? a->mv_size : b->mv_size;
+
+	for (i = 0; i < len && p1[i] == p2[i]; i++) ;
+	return i;
+}
+
+/** Compare a key with the common key prefix of leaf page \b mp.
+ * @return < 0 if the key sorts before every key the page can hold,
+ * > 0 if it sorts after all of them, 0 if the key starts with the prefix.
+ */
+static int
+mdb_pfx_cmp(MDB_env *env, MDB_page *mp, const MDB_val *key)
+{
+	unsigned int len = PFXLEN(mp);
+	int rc;
+
+	rc = memcmp(key->mv_data, PFXKEY(env, mp),
+		key->mv_size < len ? key->mv_size : len);
+	if (rc == 0 && key->mv_size < len)
+		rc = -1;
+	return rc;
+}
+
+/** Get the whole key of a node on leaf page \b mp.
+ * The key of a #P_PREFIX page is assembled in \b buf, which must
+ * hold #PFXKEYMAX bytes. Otherwise it is returned in place.
+ */
+static void
+mdb_node_key(MDB_env *env, MDB_page *mp, MDB_node *node, MDB_val *key, char *buf)
+{
+	if (IS_PREFIX(mp)) {
+		memcpy(buf, PFXKEY(env, mp), mp->mp_pad);
+		memcpy(buf + mp->mp_pad, NODEKEY(node), NODEKSZ(node));
+		key->mv_size = mp->mp_pad + NODEKSZ(node);
+		key->mv_data = buf;
+	} else {
+		key->mv_size = NODEKSZ(node);
+		key->mv_data = NODEKEY(node);
+	}
+}
+
+/** Get the key of a node on the cursor's current page.
+ * A key from a #P_PREFIX page is kept in the cursor, and is
+ * only valid until the next operation on it.
+ */
+static void
+mdb_cursor_key(MDB_cursor *mc, MDB_node *node, MDB_val *key)
+{
+	mdb_node_key(mc->mc_txn->mt_env, mc->mc_pg[mc->mc_top], node, key,
+		mc->mc_kbuf);
+}
+
+/** Compare a key with the key of a node on leaf page \b mp. */
+static int
+mdb_node_cmp(MDB_cursor *mc, MDB_page *mp, MDB_node *node, MDB_val *key)
+{
+	MDB_val nodekey, sfx;
+	int rc;
+
+	nodekey.mv_size = NODEKSZ(node);
+	nodekey.mv_data = NODEKEY(node);
+	if (!IS_PREFIX(mp))
+		return mc->mc_dbx->md_cmp(key, &nodekey);
+	if ((rc = mdb_pfx_cmp(mc->mc_txn->mt_env, mp, key)) != 0)
+		return rc;
+	sfx.mv_size = key->mv_size - mp->mp_pad;
+	sfx.mv_data = (char *)key->mv_data + mp->mp_pad;
+	return mc->mc_dbx->md_cmp(&sfx, &nodekey);
+}
+
 /** Search for key within a page, using binary search.
  * Returns the smallest entry larger or equal to the key.
  * If exactp is non-null, stores whether the found entry was an exact match
@@ -5244,7 +5854,7 @@ mdb_node_search(MDB_cursor *mc, MDB_val *key, int *exactp)
 	int		 rc = 0;
 	MDB_page *mp = mc->mc_pg[mc->mc_top];
 	MDB_node	*node = NULL;
-	MDB_val	 nodekey;
+	MDB_val	 nodekey, sfx;
 	MDB_cmp_func *cmp;
 	DKBUF;
 
@@ -5285,6 +5895,23 @@ mdb_node_search(MDB_cursor *mc, MDB_val *key, int *exactp)
 				high = i - 1;
 		}
 	} else {
+		if (IS_PREFIX(mp)) {
+			/* Keys outside the page prefix sort before or after
+			 * all of its nodes, others compare by their suffix.
+			 */
+			rc = mdb_pfx_cmp(mc->mc_txn->mt_env, mp, key);
+			if (rc) {
+				i = rc < 0 ? 0 : nkeys;
+				if (i < nkeys)
+					node = NODEPTR(mp, i);
+				rc = -1;
+				low = high + 1;
+			} else {
+				sfx.mv_size = key->mv_size - mp->mp_pad;
+				sfx.mv_data = (char *)key->mv_data + mp->mp_pad;
+				key = &sfx;
+			}
+		}
 		while (low <= high) {
 			i = (low + high) >> 1;
 
@@ -5700,6 +6327,7 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		env->me_pgext_head = NULL;
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -5848,7 +6476,7 @@ mdb_cursor_next(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 				rc = mdb_cursor_next(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_NEXT);
 				if (op != MDB_NEXT || rc != MDB_NOTFOUND) {
 					if (rc == MDB_SUCCESS)
-						MDB_GET_KEY(leaf, key);
+						MDB_GET_KEY(mc, leaf, key);
 					return rc;
 				}
 			}
@@ -5904,7 +6532,7 @@ skip:
 		}
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -5932,7 +6560,7 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 				rc = mdb_cursor_prev(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_PREV);
 				if (op != MDB_PREV || rc != MDB_NOTFOUND) {
 					if (rc == MDB_SUCCESS) {
-						MDB_GET_KEY(leaf, key);
+						MDB_GET_KEY(mc, leaf, key);
 						mc->mc_flags &= ~C_EOF;
 					}
 					return rc;
@@ -5987,7 +6615,7 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 		}
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -6019,11 +6647,11 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		if (mp->mp_flags & P_LEAF2) {
 			nodekey.mv_size = mc->mc_db->md_pad;
 			nodekey.mv_data = LEAF2KEY(mp, 0, nodekey.mv_size);
+			rc = mc->mc_dbx->md_cmp(key, &nodekey);
 		} else {
 			leaf = NODEPTR(mp, 0);
-			MDB_GET_KEY2(leaf, nodekey);
+			rc = mdb_node_cmp(mc, mp, leaf, key);
 		}
-		rc = mc->mc_dbx->md_cmp(key, &nodekey);
 		if (rc == 0) {
 			/* Probably happens rarely, but first node on the page
 			 * was the one we wanted.
@@ -6040,11 +6668,11 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				if (mp->mp_flags & P_LEAF2) {
 					nodekey.mv_data = LEAF2KEY(mp,
 						 nkeys-1, nodekey.mv_size);
+					rc = mc->mc_dbx->md_cmp(key, &nodekey);
 				} else {
 					leaf = NODEPTR(mp, nkeys-1);
-					MDB_GET_KEY2(leaf, nodekey);
+					rc = mdb_node_cmp(mc, mp, leaf, key);
 				}
-				rc = mc->mc_dbx->md_cmp(key, &nodekey);
 				if (rc == 0) {
 					/* last node was the one we wanted */
 					mc->mc_ki[mc->mc_top] = nkeys-1;
@@ -6058,11 +6686,11 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 						if (mp->mp_flags & P_LEAF2) {
 							nodekey.mv_data = LEAF2KEY(mp,
 								 mc->mc_ki[mc->mc_top], nodekey.mv_size);
+							rc = mc->mc_dbx->md_cmp(key, &nodekey);
 						} else {
 							leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
-							MDB_GET_KEY2(leaf, nodekey);
+							rc = mdb_node_cmp(mc, mp, leaf, key);
 						}
-						rc = mc->mc_dbx->md_cmp(key, &nodekey);
 						if (rc == 0) {
 							/* current node was the one we wanted */
 							if (exactp)
@@ -6185,7 +6813,7 @@ set1:
 
 	/* The key already matches in all other cases */
 	if (op == MDB_SET_RANGE || op == MDB_SET_KEY)
-		MDB_GET_KEY(leaf, key);
+		MDB_GET_KEY(mc, leaf, key);
 	DPRINTF(("==> cursor placed on key [%s]", DKEY(key)));
 
 	return rc;
@@ -6231,7 +6859,7 @@ mdb_cursor_first(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 				return rc;
 		}
 	}
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -6257,8 +6885,10 @@ mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 	leaf = NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]);
 
 	if (IS_LEAF2(mc->mc_pg[mc->mc_top])) {
-		key->mv_size = mc->mc_db->md_pad;
-		key->mv_data = LEAF2KEY(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top], key->mv_size);
+		if (key) {
+			key->mv_size = mc->mc_db->md_pad;
+			key->mv_data = LEAF2KEY(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top], key->mv_size);
+		}
 		return MDB_SUCCESS;
 	}
 
@@ -6274,7 +6904,7 @@ mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 		}
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -6310,7 +6940,7 @@ mdb_cursor_get(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				key->mv_data = LEAF2KEY(mp, mc->mc_ki[mc->mc_top], key->mv_size);
 			} else {
 				MDB_node *leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
-				MDB_GET_KEY(leaf, key);
+				MDB_GET_KEY(mc, leaf, key);
 				if (data) {
 					if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 						rc = mdb_cursor_get(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_GET_CURRENT);
@@ -6436,7 +7066,7 @@ fetchm:
 		{
 			MDB_node *leaf = NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]);
 			if (!F_ISSET(leaf->mn_flags, F_DUPDATA)) {
-				MDB_GET_KEY(leaf, key);
+				MDB_GET_KEY(mc, leaf, key);
 				rc = mdb_node_read(mc, leaf, data);
 				break;
 			}
@@ -6568,9 +7198,18 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		MDB_val d2;
 		if (flags & MDB_APPEND) {
 			MDB_val k2;
-			rc = mdb_cursor_last(mc, &k2, &d2);
+			rc = mdb_cursor_last(mc, NULL, &d2);
 			if (rc == 0) {
-				rc = mc->mc_dbx->md_cmp(key, &k2);
+				MDB_page *mp = mc->mc_pg[mc->mc_top];
+				if (IS_LEAF2(mp)) {
+					k2.mv_size = mc->mc_db->md_pad;
+					k2.mv_data = LEAF2KEY(mp, mc->mc_ki[mc->mc_top], k2.mv_size);
+					rc = mc->mc_dbx->md_cmp(key, &k2);
+				} else {
+					/* Leave the cursor's key buffer alone, key may be in it */
+					rc = mdb_node_cmp(mc, mp,
+						NODEPTR(mp, mc->mc_ki[mc->mc_top]), key);
+				}
 				if (rc > 0) {
 					rc = MDB_NOTFOUND;
 					mc->mc_ki[mc->mc_top]++;
@@ -6761,7 +7400,8 @@ more:
 			}
 
 			fp_flags = fp->mp_flags;
-			if (NODESIZE + NODEKSZ(leaf) + xdata.mv_size > env->me_nodemax) {
+			if (NODESIZE + NODEKSZ(leaf) + PFXLEN(mc->mc_pg[mc->mc_top]) +
+				xdata.mv_size > env->me_nodemax) {
 					/* Too big for a sub-page, convert to sub-DB */
 					fp_flags &= ~P_SUBP;
 prep_subDB:
@@ -6905,13 +7545,17 @@ current:
 new_sub:
 	nflags = flags & NODE_ADD_FLAGS;
 	nsize = IS_LEAF2(mc->mc_pg[mc->mc_top]) ? key->mv_size : mdb_leaf_size(env, key, rdata);
-	if (SIZELEFT(mc->mc_pg[mc->mc_top]) < nsize) {
+	if ((mc->mc_db->md_flags & MDB_PREFIXKEY) || IS_PREFIX(mc->mc_pg[mc->mc_top]))
+		rc = mdb_page_pfxfit(mc, key, nsize);
+	else
+		rc = SIZELEFT(mc->mc_pg[mc->mc_top]) < nsize ? MDB_PAGE_FULL : 0;
+	if (rc == MDB_PAGE_FULL) {
 		if (( flags & (F_DUPDATA|F_SUBDATA)) == F_DUPDATA )
 			nflags &= ~MDB_APPEND; /* sub-page may need room to grow */
 		if (!insert_key)
 			nflags |= MDB_SPLIT_REPLACE;
 		rc = mdb_page_split(mc, key, rdata, P_INVALID, nflags);
-	} else {
+	} else if (rc == MDB_SUCCESS) {
 		/* There is room already in this leaf page. */
 		rc = mdb_node_add(mc, mc->mc_ki[mc->mc_top], key, rdata, 0, nflags);
 		if (rc == 0) {
@@ -7215,51 +7859,225 @@ mdb_branch_size(MDB_env *env, MDB_val *key)
 	return sz + sizeof(indx_t);
 }
 
-/** Add a node to the page pointed to by the cursor.
- * Set #MDB_TXN_ERROR on failure.
- * @param[in] mc The cursor for this operation.
- * @param[in] indx The index on the page where the new node should be added.
- * @param[in] key The key for the new node.
- * @param[in] data The data for the new node, if any.
- * @param[in] pgno The page number, if adding a branch node.
- * @param[in] flags Flags for the node.
- * @return 0 on success, non-zero on failure. Possible errors are:
- * <ul>
- *	<li>ENOMEM - failed to allocate overflow pages for the node.
- *	<li>MDB_PAGE_FULL - there is insufficient room in the page. This error
- *	should never happen since all callers already calculate the
- *	page's free space before calling this function.
- * </ul>
+/** Calculate the space the nodes of a leaf page need when their
+ * keys are stored without a common prefix of \b len bytes.
+ * \b len must not be longer than the prefix all keys on the page
+ * share. The space for the prefix itself is not included.
  */
-static int
-mdb_node_add(MDB_cursor *mc, indx_t indx,
-    MDB_val *key, MDB_val *data, pgno_t pgno, unsigned int flags)
+static size_t
+mdb_page_pfxsize(MDB_page *mp, unsigned int len)
 {
-	unsigned int	 i;
-	size_t		 node_size = NODESIZE;
-	ssize_t		 room;
-	indx_t		 ofs;
 	MDB_node	*node;
-	MDB_page	*mp = mc->mc_pg[mc->mc_top];
-	MDB_page	*ofp = NULL;		/* overflow page */
-	void		*ndata;
-	DKBUF;
+	unsigned int	 i, nkeys = NUMKEYS(mp), old = PFXLEN(mp);
+	size_t		 sz, total = 0;
 
-	mdb_cassert(mc, mp->mp_upper >= mp->mp_lower);
+	for (i = 0; i < nkeys; i++) {
+		node = NODEPTR(mp, i);
+		sz = NODESIZE + NODEKSZ(node) + old - len;
+		if (F_ISSET(node->mn_flags, F_BIGDATA))
+			sz += sizeof(pgno_t);
+		else
+			sz += NODEDSZ(node);
+		total += EVEN(sz) + sizeof(indx_t);
+	}
+	return total;
+}
 
-	DPRINTF(("add to %s %spage %"Z"u index %i, data size %"Z"u key size %"Z"u [%s]",
-	    IS_LEAF(mp) ? "leaf" : "branch",
-		IS_SUBP(mp) ? "sub-" : "",
-		mdb_dbg_pgno(mp), indx, data ? data->mv_size : 0,
-		key ? key->mv_size : 0, key ? DKEY(key) : "null"));
+/** Rebuild the cursor's leaf page with a new common key prefix.
+ * The nodes keep their order. The caller must have checked that
+ * they fit, see #mdb_page_pfxsize().
+ * @param[in] mc The cursor pointing to the page, which must be dirty.
+ * @param[in] pfx The new prefix. All keys on the page must share it.
+ * @param[in] len The length of the new prefix, 0 to store whole keys.
+ * @return 0 on success, ENOMEM on failure.
+ */
+static int
+mdb_page_prefix(MDB_cursor *mc, const char *pfx, unsigned int len)
+{
+	MDB_env		*env = mc->mc_txn->mt_env;
+	MDB_page	*mp = mc->mc_pg[mc->mc_top], *np;
+	MDB_node	*node, *nn;
+	MDB_cursor	*m2;
+	unsigned int	 i, nkeys = NUMKEYS(mp), old = PFXLEN(mp), top = mc->mc_top;
+	size_t		 dsz;
+	indx_t		 ofs;
 
-	if (IS_LEAF2(mp)) {
-		/* Move higher keys up one slot. */
-		int ksize = mc->mc_db->md_pad, dif;
-		char *ptr = LEAF2KEY(mp, indx, ksize);
-		dif = NUMKEYS(mp) - indx;
-		if (dif > 0)
-			memmove(ptr+ksize, ptr, dif*ksize);
+	if ((np = mdb_page_malloc(mc->mc_txn, 1)) == NULL)
+		return ENOMEM;
+	memcpy(np, mp, PAGEHDRSZ);
+	np->mp_flags &= ~P_PREFIX;
+	np->mp_pad = 0;
+	ofs = env->me_psize - PAGEBASE - EVEN(len);
+	if (len) {
+		np->mp_flags |= P_PREFIX;
+		np->mp_pad = len;
+		memcpy(PFXKEY(env, np), pfx, len);
+	}
+	for (i = 0; i < nkeys; i++) {
+		node = NODEPTR(mp, i);
+		if (F_ISSET(node->mn_flags, F_BIGDATA))
+			dsz = sizeof(pgno_t);
+		else
+			dsz = NODEDSZ(node);
+		ofs -= EVEN(NODESIZE + NODEKSZ(node) + old - len + dsz);
+		np->mp_ptrs[i] = ofs;
+		nn = NODEPTR(np, i);
+		memcpy(nn, node, NODESIZE);
+		nn->mn_ksize = NODEKSZ(node) + old - len;
+		if (len < old) {
+			memcpy(NODEKEY(nn), PFXKEY(env, mp) + len, old - len);
+			memcpy((char *)NODEKEY(nn) + old - len, NODEKEY(node), NODEKSZ(node));
+		} else {
+			memcpy(NODEKEY(nn), (char *)NODEKEY(node) + len - old, nn->mn_ksize);
+		}
+		memcpy(NODEDATA(nn), NODEDATA(node), dsz);
+	}
+	np->mp_upper = ofs;
+	mdb_page_copy(mp, np, env->me_psize);
+	mdb_page_free(env, np);
+
+	/* Sub-pages have moved along with their nodes */
+	XCURSOR_REFRESH(mc, top, mp);
+	for (m2 = mc->mc_txn->mt_cursors[mc->mc_dbi]; m2; m2=m2->mc_next) {
+		if (m2 == mc || m2->mc_snum <= top || m2->mc_pg[top] != mp)
+			continue;
+		XCURSOR_REFRESH(m2, top, mp);
+	}
+	return MDB_SUCCESS;
+}
+
+/** Make room for a new node on a leaf page of a #MDB_PREFIXKEY database.
+ * The page prefix is lengthened if the page is full and its keys and
+ * the new one share a longer prefix. It is shortened if the new key
+ * does not share it and the page has room for the longer keys.
+ * @param[in] mc The cursor pointing to the page, which must be dirty.
+ * @param[in] key The key of the new node.
+ * @param[in] nsize The size of the new node, with the whole key.
+ * @return 0 if the node fits, MDB_PAGE_FULL if the page must be split,
+ * or ENOMEM.
+ */
+static int
+mdb_page_pfxfit(MDB_cursor *mc, MDB_val *key, size_t nsize)
+{
+	MDB_env		*env = mc->mc_txn->mt_env;
+	MDB_page	*mp = mc->mc_pg[mc->mc_top];
+	MDB_val		 first, last;
+	char		 buf1[PFXKEYMAX], buf2[PFXKEYMAX];
+	unsigned int	 len, len2, nkeys = NUMKEYS(mp), old = PFXLEN(mp);
+	int		 share = !old || !mdb_pfx_cmp(env, mp, key);
+
+	if (!nkeys || (share && SIZELEFT(mp) >= nsize))
+		return MDB_SUCCESS;
+
+	/* The longest prefix all the keys can share */
+	mdb_node_key(env, mp, NODEPTR(mp, 0), &first, buf1);
+	mdb_node_key(env, mp, NODEPTR(mp, nkeys-1), &last, buf2);
+	len = mdb_pfx_len(&first, key);
+	len2 = mdb_pfx_len(&first, &last);
+	if (len2 < len)
+		len = len2;
+	if (len == old ||
+		mdb_page_pfxsize(mp, len) + EVEN(len) + EVEN(nsize - len) >
+		env->me_psize - PAGEHDRSZ)
+		return MDB_PAGE_FULL;
+	DPRINTF(("prefix of page %"Z"u changes from %u to %u bytes",
+		mp->mp_pgno, old, len));
+	return mdb_page_prefix(mc, first.mv_data, len);
+}
+
+/** Check whether nodes of leaf page \b src fit onto the nonempty leaf
+ * page \b dst, whose prefix may have to be shortened to take them.
+ * The check is conservative; it assumes the prefix of \b dst keeps
+ * its length until the last node is added.
+ * @param[in] env The environment handle.
+ * @param[in] src The page the nodes come from.
+ * @param[in] dst The page they are added to.
+ * @param[in] first The index of the first node to move.
+ * @param[in] last The index of the last node to move.
+ * @return 1 if they fit, 0 otherwise.
+ */
+static int
+mdb_page_pfxroom(MDB_env *env, MDB_page *src, MDB_page *dst,
+	unsigned int first, unsigned int last)
+{
+	MDB_node	*node;
+	MDB_val		 key, pfx;
+	char		 buf[PFXKEYMAX];
+	unsigned int	 i, j, len = PFXLEN(dst), slen = PFXLEN(src);
+	size_t		 sz, total;
+
+	/* Moved keys lie between the first and last one, so they
+	 * share at least as much of the prefix as those two do.
+	 */
+	pfx.mv_size = len;
+	pfx.mv_data = PFXKEY(env, dst);
+	for (i = first; len; i = last) {
+		mdb_node_key(env, src, NODEPTR(src, i), &key, buf);
+		j = mdb_pfx_len(&key, &pfx);
+		if (j < len)
+			len = j;
+		if (i == last)
+			break;
+	}
+	total = mdb_page_pfxsize(dst, len) + EVEN(PFXLEN(dst));
+	for (i = first; i <= last; i++) {
+		node = NODEPTR(src, i);
+		sz = NODESIZE + NODEKSZ(node) + slen - len;
+		if (F_ISSET(node->mn_flags, F_BIGDATA))
+			sz += sizeof(pgno_t);
+		else
+			sz += NODEDSZ(node);
+		total += EVEN(sz) + sizeof(indx_t);
+	}
+	return total <= env->me_psize - PAGEHDRSZ;
+}
+
+/** Add a node to the page pointed to by the cursor.
+ * Set #MDB_TXN_ERROR on failure.
+ * @param[in] mc The cursor for this operation.
+ * @param[in] indx The index on the page where the new node should be added.
+ * @param[in] key The key for the new node.
+ * @param[in] data The data for the new node, if any.
+ * @param[in] pgno The page number, if adding a branch node.
+ * @param[in] flags Flags for the node.
+ * @return 0 on success, non-zero on failure. Possible errors are:
+ * <ul>
+ *	<li>ENOMEM - failed to allocate overflow pages for the node.
+ *	<li>MDB_PAGE_FULL - there is insufficient room in the page. This error
+ *	should never happen since all callers already calculate the
+ *	page's free space before calling this function.
+ * </ul>
+ */
+static int
+mdb_node_add(MDB_cursor *mc, indx_t indx,
+    MDB_val *key, MDB_val *data, pgno_t pgno, unsigned int flags)
+{
+	unsigned int	 i;
+	size_t		 node_size = NODESIZE;
+	ssize_t		 room;
+	indx_t		 ofs;
+	MDB_node	*node;
+	MDB_page	*mp = mc->mc_pg[mc->mc_top];
+	MDB_page	*ofp = NULL;		/* overflow page */
+	void		*ndata;
+	unsigned int	 plen = 0;
+	DKBUF;
+
+	mdb_cassert(mc, mp->mp_upper >= mp->mp_lower);
+
+	DPRINTF(("add to %s %spage %"Z"u index %i, data size %"Z"u key size %"Z"u [%s]",
+	    IS_LEAF(mp) ? "leaf" : "branch",
+		IS_SUBP(mp) ? "sub-" : "",
+		mdb_dbg_pgno(mp), indx, data ? data->mv_size : 0,
+		key ? key->mv_size : 0, key ? DKEY(key) : "null"));
+
+	if (IS_LEAF2(mp)) {
+		/* Move higher keys up one slot. */
+		int ksize = mc->mc_db->md_pad, dif;
+		char *ptr = LEAF2KEY(mp, indx, ksize);
+		dif = NUMKEYS(mp) - indx;
+		if (dif > 0)
+			memmove(ptr+ksize, ptr, dif*ksize);
 		/* insert new key */
 		memcpy(ptr, key->mv_data, ksize);
 
@@ -7269,6 +8087,23 @@ mdb_node_add(MDB_cursor *mc, indx_t indx,
 		return MDB_SUCCESS;
 	}
 
+	if (IS_PREFIX(mp)) {
+		MDB_env *env = mc->mc_txn->mt_env;
+		if (mdb_pfx_cmp(env, mp, key)) {
+			/* Shorten the page prefix to the part the key shares */
+			MDB_val pfx;
+			int rc;
+			pfx.mv_size = mp->mp_pad;
+			pfx.mv_data = PFXKEY(env, mp);
+			plen = mdb_pfx_len(key, &pfx);
+			if (mdb_page_pfxsize(mp, plen) + EVEN(plen) > env->me_psize - PAGEHDRSZ)
+				goto full;
+			if ((rc = mdb_page_prefix(mc, pfx.mv_data, plen)))
+				return rc;
+		}
+		plen = PFXLEN(mp);
+	}
+
 	room = (ssize_t)SIZELEFT(mp) - (ssize_t)sizeof(indx_t);
 	if (key != NULL)
 		node_size += key->mv_size;
@@ -7283,7 +8118,7 @@ mdb_node_add(MDB_cursor *mc, indx_t indx,
 			/* Put data on overflow page. */
 			DPRINTF(("data size is %"Z"u, node would be %"Z"u, put data on overflow page",
 			    data->mv_size, node_size+data->mv_size));
-			node_size = EVEN(node_size + sizeof(pgno_t));
+			node_size = EVEN(node_size - plen + sizeof(pgno_t));
 			if ((ssize_t)node_size > room)
 				goto full;
 			if ((rc = mdb_page_new(mc, P_OVERFLOW, ovpages, &ofp)))
@@ -7295,7 +8130,7 @@ mdb_node_add(MDB_cursor *mc, indx_t indx,
 			node_size += data->mv_size;
 		}
 	}
-	node_size = EVEN(node_size);
+	node_size = EVEN(node_size - plen);
 	if ((ssize_t)node_size > room)
 		goto full;
 
@@ -7313,7 +8148,7 @@ update:
 
 	/* Write the node data. */
 	node = NODEPTR(mp, indx);
-	node->mn_ksize = (key == NULL) ? 0 : key->mv_size;
+	node->mn_ksize = (key == NULL) ? 0 : key->mv_size - plen;
 	node->mn_flags = flags;
 	if (IS_LEAF(mp))
 		SETDSZ(node,data->mv_size);
@@ -7321,7 +8156,7 @@ update:
 		SETPGNO(node,pgno);
 
 	if (key)
-		memcpy(NODEKEY(node), key->mv_data, key->mv_size);
+		memcpy(NODEKEY(node), (char *)key->mv_data + plen, key->mv_size - plen);
 
 	if (IS_LEAF(mp)) {
 		ndata = NODEDATA(node);
@@ -7813,8 +8648,10 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 	MDB_val		 key, data;
 	pgno_t	srcpg;
 	MDB_cursor mn;
+	MDB_env		*env = csrc->mc_txn->mt_env;
 	int			 rc;
 	unsigned short flags;
+	char		 kbuf[PFXKEYMAX];
 
 	DKBUF;
 
@@ -7847,14 +8684,12 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(csrc->mc_pg[csrc->mc_top], 0, key.mv_size);
 			} else {
 				s2 = NODEPTR(csrc->mc_pg[csrc->mc_top], 0);
-				key.mv_size = NODEKSZ(s2);
-				key.mv_data = NODEKEY(s2);
+				mdb_node_key(env, csrc->mc_pg[csrc->mc_top], s2, &key, kbuf);
 			}
 			csrc->mc_snum = snum--;
 			csrc->mc_top = snum;
 		} else {
-			key.mv_size = NODEKSZ(srcnode);
-			key.mv_data = NODEKEY(srcnode);
+			mdb_node_key(env, csrc->mc_pg[csrc->mc_top], srcnode, &key, kbuf);
 		}
 		data.mv_size = NODEDSZ(srcnode);
 		data.mv_data = NODEDATA(srcnode);
@@ -7864,6 +8699,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 		unsigned int snum = cdst->mc_snum;
 		MDB_node *s2;
 		MDB_val bkey;
+		char bbuf[PFXKEYMAX];
 		/* must find the lowest key below dst */
 		mdb_cursor_copy(cdst, &mn);
 		rc = mdb_page_search_lowest(&mn);
@@ -7874,8 +8710,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 			bkey.mv_data = LEAF2KEY(mn.mc_pg[mn.mc_top], 0, bkey.mv_size);
 		} else {
 			s2 = NODEPTR(mn.mc_pg[mn.mc_top], 0);
-			bkey.mv_size = NODEKSZ(s2);
-			bkey.mv_data = NODEKEY(s2);
+			mdb_node_key(env, mn.mc_pg[mn.mc_top], s2, &bkey, bbuf);
 		}
 		mn.mc_snum = snum--;
 		mn.mc_top = snum;
@@ -7968,8 +8803,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(csrc->mc_pg[csrc->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(csrc->mc_pg[csrc->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(env, csrc->mc_pg[csrc->mc_top], srcnode, &key, kbuf);
 			}
 			DPRINTF(("update separator for source page %"Z"u to [%s]",
 				csrc->mc_pg[csrc->mc_top]->mp_pgno, DKEY(&key)));
@@ -7999,8 +8833,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(cdst->mc_pg[cdst->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(cdst->mc_pg[cdst->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(env, cdst->mc_pg[cdst->mc_top], srcnode, &key, kbuf);
 			}
 			DPRINTF(("update separator for destination page %"Z"u to [%s]",
 				cdst->mc_pg[cdst->mc_top]->mp_pgno, DKEY(&key)));
@@ -8041,9 +8874,11 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 	MDB_page	*psrc, *pdst;
 	MDB_node	*srcnode;
 	MDB_val		 key, data;
+	MDB_env		*env = csrc->mc_txn->mt_env;
 	unsigned	 nkeys;
 	int			 rc;
 	indx_t		 i, j;
+	char		 kbuf[PFXKEYMAX];
 
 	psrc = csrc->mc_pg[csrc->mc_top];
 	pdst = cdst->mc_pg[cdst->mc_top];
@@ -8060,6 +8895,14 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 	/* get dst page again now that we've touched it. */
 	pdst = cdst->mc_pg[cdst->mc_top];
 
+	/* An empty dst page takes the key prefix of src, so the
+	 * nodes fit as they did there.
+	 */
+	if (!NUMKEYS(pdst) && (IS_PREFIX(pdst) || IS_PREFIX(psrc))) {
+		if ((rc = mdb_page_prefix(cdst, PFXKEY(env, psrc), PFXLEN(psrc))))
+			return rc;
+	}
+
 	/* Move all nodes from src to dst.
 	 */
 	j = nkeys = NUMKEYS(pdst);
@@ -8089,12 +8932,10 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 					key.mv_data = LEAF2KEY(mn.mc_pg[mn.mc_top], 0, key.mv_size);
 				} else {
 					s2 = NODEPTR(mn.mc_pg[mn.mc_top], 0);
-					key.mv_size = NODEKSZ(s2);
-					key.mv_data = NODEKEY(s2);
+					mdb_node_key(env, mn.mc_pg[mn.mc_top], s2, &key, kbuf);
 				}
 			} else {
-				key.mv_size = srcnode->mn_ksize;
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(env, psrc, srcnode, &key, kbuf);
 			}
 
 			data.mv_size = NODEDSZ(srcnode);
@@ -8196,6 +9037,34 @@ mdb_cursor_copy(const MDB_cursor *csrc, MDB_cursor *cdst)
 	}
 }
 
+/** Check whether the nodes a rebalance moves fit on their new page.
+ * They may not if the pages store different key prefixes. In that
+ * case a page that still has nodes is left as it is.
+ * @param[in] mc Cursor pointing to the page being rebalanced.
+ * @param[in] mn Cursor pointing to its neighbor.
+ * @param[in] merge Whether the pages are merged, or one node moves.
+ * @param[in] fromleft Whether the neighbor is on the left.
+ * @return 1 if the nodes fit, 0 otherwise.
+ */
+static int
+mdb_rebalance_fits(MDB_cursor *mc, MDB_cursor *mn, int merge, int fromleft)
+{
+	MDB_page *mp = mc->mc_pg[mc->mc_top], *np = mn->mc_pg[mn->mc_top];
+	MDB_env *env = mc->mc_txn->mt_env;
+	unsigned int nkeys = NUMKEYS(np);
+
+	if (!IS_LEAF(mp) || !(IS_PREFIX(mp) || IS_PREFIX(np)) || !NUMKEYS(mp))
+		return 1;
+	if (!merge)		/* move the neighbor's nearest node to mp */
+		return mdb_page_pfxroom(env, np, mp,
+			fromleft ? nkeys-1 : 0, fromleft ? nkeys-1 : 0);
+	if (!nkeys)
+		return 1;
+	if (fromleft)	/* mp is merged into its left neighbor */
+		return mdb_page_pfxroom(env, mp, np, 0, NUMKEYS(mp)-1);
+	return mdb_page_pfxroom(env, np, mp, 0, nkeys-1);
+}
+
 /** Rebalance the tree after a delete operation.
  * @param[in] mc Cursor pointing to the page where rebalancing
  * should begin.
@@ -8362,12 +9231,16 @@ mdb_rebalance(MDB_cursor *mc)
 	 * (A branch page must never have less than 2 keys.)
 	 */
 	if (PAGEFILL(mc->mc_txn->mt_env, mn.mc_pg[mn.mc_top]) >= thresh && NUMKEYS(mn.mc_pg[mn.mc_top]) > minkeys) {
+		if (!mdb_rebalance_fits(mc, &mn, 0, fromleft))
+			return MDB_SUCCESS;
 		rc = mdb_node_move(&mn, mc, fromleft);
 		if (fromleft) {
 			/* if we inserted on left, bump position up */
 			oldki++;
 		}
 	} else {
+		if (!mdb_rebalance_fits(mc, &mn, 1, fromleft))
+			return MDB_SUCCESS;
 		if (!fromleft) {
 			rc = mdb_page_merge(&mn, mc);
 		} else {
@@ -8543,6 +9416,54 @@ mdb_del0(MDB_txn *txn, MDB_dbi dbi,
 	return rc;
 }
 
+/** Give one half of a leaf page being split its common key prefix.
+ * The half holds the nodes \b first to \b last of the page with the
+ * new key inserted at \b newindx; their positions are in the mp_ptrs
+ * of \b copy. The prefix is only used if it saves space over the
+ * prefix of the page, see #mdb_page_split().
+ * @param[in] env The environment handle.
+ * @param[in] mp The page being split.
+ * @param[in] np The empty page for the half.
+ * @param[in] copy The page listing the nodes in their new order.
+ * @param[in] newkey The key being inserted.
+ * @param[in] newindx The index of the new key.
+ * @param[in] first The index of the first node of the half.
+ * @param[in] last The index of the last node of the half.
+ */
+static void
+mdb_split_prefix(MDB_env *env, MDB_page *mp, MDB_page *np, MDB_page *copy,
+	MDB_val *newkey, int newindx, int first, int last)
+{
+	MDB_val		 k1, k2;
+	char		 buf1[PFXKEYMAX], buf2[PFXKEYMAX];
+	unsigned int	 len = 0, old = PFXLEN(mp);
+
+	if (first < last) {
+		if (first == newindx)
+			k1 = *newkey;
+		else
+			mdb_node_key(env, mp, (MDB_node *)((char *)mp +
+				copy->mp_ptrs[first] + PAGEBASE), &k1, buf1);
+		if (last == newindx)
+			k2 = *newkey;
+		else
+			mdb_node_key(env, mp, (MDB_node *)((char *)mp +
+				copy->mp_ptrs[last] + PAGEBASE), &k2, buf2);
+		len = mdb_pfx_len(&k1, &k2);
+		/* A prefix only a little longer may not pay for its rounding */
+		if (len < old + 3)
+			len = len < old ? 0 : old;
+	}
+	np->mp_flags &= ~P_PREFIX;
+	np->mp_pad = 0;
+	if (len) {
+		np->mp_flags |= P_PREFIX;
+		np->mp_pad = len;
+		memcpy(PFXKEY(env, np), k1.mv_data, len);
+		np->mp_upper = env->me_psize - PAGEBASE - EVEN(len);
+	}
+}
+
 /** Split a page and insert a new node.
  * Set #MDB_TXN_ERROR on failure.
  * @param[in,out] mc Cursor pointing to the page and desired insertion index.
@@ -8568,22 +9489,26 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 	MDB_val	 sepkey, rkey, xdata, *rdata = &xdata;
 	MDB_page	*copy = NULL;
 	MDB_page	*mp, *rp, *pp;
-	int ptop;
+	int ptop, pfx;
 	MDB_cursor	mn;
+	char		 sepbuf[PFXKEYMAX], kbuf[PFXKEYMAX];
 	DKBUF;
 
 	mp = mc->mc_pg[mc->mc_top];
 	newindx = mc->mc_ki[mc->mc_top];
 	nkeys = NUMKEYS(mp);
+	/* Do the halves get their own key prefixes? */
+	pfx = IS_PREFIX(mp) || (IS_LEAF(mp) && !IS_LEAF2(mp) &&
+		(mc->mc_db->md_flags & MDB_PREFIXKEY));
 
 	DPRINTF(("-----> splitting %s page %"Z"u and adding [%s] at index %i/%i",
 	    IS_LEAF(mp) ? "leaf" : "branch", mp->mp_pgno,
 	    DKEY(newkey), mc->mc_ki[mc->mc_top], nkeys));
 
 	/* Create a right sibling. */
-	if ((rc = mdb_page_new(mc, mp->mp_flags, 1, &rp)))
+	if ((rc = mdb_page_new(mc, mp->mp_flags & ~P_PREFIX, 1, &rp)))
 		return rc;
-	rp->mp_pad = mp->mp_pad;
+	rp->mp_pad = IS_PREFIX(mp) ? 0 : mp->mp_pad;
 	DPRINTF(("new right sibling: page %"Z"u", rp->mp_pgno));
 
 	/* Usually when splitting the root page, the cursor
@@ -8676,8 +9601,11 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 			}
 		} else {
 			int psize, nsize, k;
-			/* Maximum free space in an empty page */
-			pmax = env->me_psize - PAGEHDRSZ;
+			/* Maximum free space in an empty page, less what
+			 * the current key prefix takes. A half which gets a
+			 * longer prefix saves more than that on its nodes.
+			 */
+			pmax = env->me_psize - PAGEHDRSZ - EVEN(PFXLEN(mp));
 			if (IS_LEAF(mp))
 				nsize = mdb_leaf_size(env, newkey, newdata);
 			else
@@ -8691,7 +9619,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 				goto done;
 			}
 			copy->mp_pgno  = mp->mp_pgno;
-			copy->mp_flags = mp->mp_flags;
+			copy->mp_flags = mp->mp_flags & ~P_PREFIX;
 			copy->mp_lower = (PAGEHDRSZ-PAGEBASE);
 			copy->mp_upper = env->me_psize - PAGEBASE;
 
@@ -8717,8 +9645,14 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 			 * spot on the page (and thus, onto the new page), bias
 			 * the split so the new page is emptier than the old page.
 			 * This yields better packing during sequential inserts.
+			 *
+			 * A new key without the page's key prefix sorts before
+			 * or after all others. It goes alone onto its half, so
+			 * the prefix stays valid for the old nodes.
 			 */
-			if (nkeys < 20 || nsize > pmax/16 || newindx >= nkeys) {
+			if (IS_PREFIX(mp) && mdb_pfx_cmp(env, mp, newkey)) {
+				split_indx = newindx ? nkeys : 1;
+			} else if (nkeys < 20 || nsize > pmax/16 || newindx >= nkeys) {
 				/* Find split point */
 				psize = 0;
 				if (newindx <= split_indx || newindx >= nkeys) {
@@ -8754,8 +9688,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 				sepkey.mv_data = newkey->mv_data;
 			} else {
 				node = (MDB_node *)((char *)mp + copy->mp_ptrs[split_indx] + PAGEBASE);
-				sepkey.mv_size = node->mn_ksize;
-				sepkey.mv_data = NODEKEY(node);
+				mdb_node_key(env, mp, node, &sepkey, sepbuf);
 			}
 		}
 	}
@@ -8814,6 +9747,12 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 		for (i=0; i<mc->mc_top; i++)
 			mc->mc_ki[i] = mn.mc_ki[i];
 	} else if (!IS_LEAF2(mp)) {
+		if (pfx) {
+			mdb_split_prefix(env, mp, rp, copy, newkey, newindx,
+				split_indx, nkeys);
+			mdb_split_prefix(env, mp, copy, copy, newkey, newindx,
+				0, split_indx - 1);
+		}
 		/* Move nodes */
 		mc->mc_pg[mc->mc_top] = rp;
 		i = split_indx;
@@ -8831,8 +9770,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 				mc->mc_ki[mc->mc_top] = j;
 			} else {
 				node = (MDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
-				rkey.mv_data = NODEKEY(node);
-				rkey.mv_size = node->mn_ksize;
+				mdb_node_key(env, mp, node, &rkey, kbuf);
 				if (IS_LEAF(mp)) {
 					xdata.mv_data = NODEDATA(node);
 					xdata.mv_size = NODEDSZ(node);
@@ -8865,8 +9803,13 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 			mp->mp_ptrs[i] = copy->mp_ptrs[i];
 		mp->mp_lower = copy->mp_lower;
 		mp->mp_upper = copy->mp_upper;
+		/* This also copies the key prefix at the top of the page */
 		memcpy(NODEPTR(mp, nkeys-1), NODEPTR(copy, nkeys-1),
 			env->me_psize - copy->mp_upper - PAGEBASE);
+		if (pfx) {
+			mp->mp_flags = copy->mp_flags;
+			mp->mp_pad = copy->mp_pad;
+		}
 
 		/* reset back to original page */
 		if (newindx < split_indx) {
@@ -8998,10 +9941,39 @@ mdb_put(MDB_txn *txn, MDB_dbi dbi,
 #endif
 #define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
 
+#ifndef MDB_CP_THREADS
+#define MDB_CP_THREADS	4	/**< readahead threads for #MDB_CP_PARALLEL */
+#endif
+#ifndef MDB_CP_AHEAD
+#define MDB_CP_AHEAD	8192	/**< max leaf pages read ahead of the copy */
+#endif
+
+	/** Readahead state for a compacting copy with #MDB_CP_PARALLEL.
+	 *	The threads take units in the order the copy visits them:
+	 *	a leaf-parent branch page of the main DB or a named DB with
+	 *	its leaves, their overflow pages and their sorted-duplicate
+	 *	sub-DBs. They stay at most #MDB_CP_AHEAD leaf pages ahead,
+	 *	so the readahead is not evicted before the copy uses it.
+	 */
+typedef struct mdb_cpf {
+	MDB_txn *pf_txn;
+	pthread_mutex_t pf_mutex;
+	pthread_cond_t pf_cond;	/**< Condition variable for #pf_copied and #pf_done */
+	MDB_cursor pf_main;		/**< The main DB, at leaf level */
+	MDB_cursor pf_sub;		/**< A named DB, at leaf-parent level */
+	unsigned pf_ki;			/**< Next node in the main DB leaf */
+	int pf_state;			/**< 0 start, 1 in main DB leaf, 2 in named DB, 3 done */
+	size_t pf_issued;		/**< Leaf pages in the units handed out */
+	/** Leaf pages copied so far. Only the copy changes it, without the mutex */
+	volatile size_t pf_copied;
+	volatile int pf_done;	/**< Stop reading ahead */
+} mdb_cpf;
+
 	/** State needed for a double-buffering compacting copy. */
 typedef struct mdb_copy {
 	MDB_env *mc_env;
 	MDB_txn *mc_txn;
+	mdb_cpf *mc_pf;			/**< Readahead, with #MDB_CP_PARALLEL */
 	pthread_mutex_t mc_mutex;
 	pthread_cond_t mc_cond;	/**< Condition variable for #mc_new */
 	char *mc_wbuf[2];
@@ -9116,6 +10088,204 @@ mdb_env_cthr_toggle(mdb_copy *my, int adjust)
 	return my->mc_error;
 }
 
+	/** Advise the OS that pages will be read soon. */
+static void ESECT
+mdb_cpf_advise(mdb_cpf *pf, pgno_t pg, pgno_t n)
+{
+#ifdef MADV_WILLNEED
+	MDB_env *env = pf->pf_txn->mt_env;
+	char *ptr;
+	size_t off;
+
+	if (pg + n > pf->pf_txn->mt_next_pgno)
+		return;
+	ptr = env->me_map + env->me_psize * pg;
+	off = (size_t)ptr & (env->me_os_psize - 1);
+	(void) madvise(ptr - off, env->me_psize * n + off, MADV_WILLNEED);
+#endif
+}
+
+static void ESECT mdb_cpf_tree(mdb_cpf *pf, MDB_cursor *mc, pgno_t pg);
+
+	/** Read a leaf page, and advise the pages it references. */
+static void ESECT
+mdb_cpf_leaf(mdb_cpf *pf, MDB_cursor *mc, MDB_page *mp)
+{
+	MDB_node *ni;
+	MDB_db db;
+	pgno_t pg;
+	unsigned i, n = NUMKEYS(mp);	/* faults the page in */
+
+	if (IS_LEAF2(mp))
+		return;
+	for (i=0; i<n; i++) {
+		ni = NODEPTR(mp, i);
+		if (ni->mn_flags & F_BIGDATA) {
+			memcpy(&pg, NODEDATA(ni), sizeof(pg));
+			mdb_cpf_advise(pf, pg, OVPAGES(NODEDSZ(ni), pf->pf_txn->mt_env->me_psize));
+		}
+	}
+	for (i=0; i<n && !pf->pf_done; i++) {
+		ni = NODEPTR(mp, i);
+		if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) == (F_SUBDATA|F_DUPDATA)) {
+			memcpy(&db, NODEDATA(ni), sizeof(db));
+			mdb_cpf_tree(pf, mc, db.md_root);
+		}
+	}
+}
+
+	/** Read a branch page's children, advising all of them first. */
+static void ESECT
+mdb_cpf_children(mdb_cpf *pf, MDB_cursor *mc, MDB_page *mp)
+{
+	MDB_page *cp;
+	unsigned i, n = NUMKEYS(mp);
+
+	for (i=0; i<n; i++)
+		mdb_cpf_advise(pf, NODEPGNO(NODEPTR(mp, i)), 1);
+	for (i=0; i<n && !pf->pf_done; i++) {
+		if (mdb_page_get(mc, NODEPGNO(NODEPTR(mp, i)), &cp, NULL))
+			break;
+		if (IS_LEAF(cp))
+			mdb_cpf_leaf(pf, mc, cp);
+		else
+			mdb_cpf_children(pf, mc, cp);
+	}
+}
+
+	/** Read a whole sorted-duplicate sub-DB. */
+static void ESECT
+mdb_cpf_tree(mdb_cpf *pf, MDB_cursor *mc, pgno_t pg)
+{
+	MDB_page *mp;
+
+	if (pg == P_INVALID || mdb_page_get(mc, pg, &mp, NULL))
+		return;
+	if (IS_LEAF(mp))
+		mdb_cpf_leaf(pf, mc, mp);
+	else
+		mdb_cpf_children(pf, mc, mp);
+}
+
+	/** Position a cursor on the first leaf of a tree, or with \b up
+	 *	on the first leaf-parent branch page.
+	 */
+static int ESECT
+mdb_cpf_first(mdb_cpf *pf, MDB_cursor *mc, pgno_t root, int up)
+{
+	int rc;
+
+	memset(mc, 0, sizeof(*mc));
+	mc->mc_txn = pf->pf_txn;
+	mc->mc_snum = 1;
+	if ((rc = mdb_page_get(mc, root, &mc->mc_pg[0], NULL)) ||
+		(rc = mdb_page_search_root(mc, NULL, MDB_PS_FIRST)))
+		return rc;
+	if (up && mc->mc_snum > 1)
+		mdb_cursor_pop(mc);
+	return MDB_SUCCESS;
+}
+
+	/** Hand out the next readahead unit, in the order of #mdb_env_cwalk().
+	 *	Called with #pf_mutex held. The main DB leaves are read here,
+	 *	to find the named DBs in them.
+	 * @param[in] pf readahead state.
+	 * @param[out] nleaves the number of leaf pages in the unit.
+	 * @return the unit's leaf or leaf-parent page, or NULL at the end.
+	 */
+static MDB_page * ESECT
+mdb_cpf_next(mdb_cpf *pf, size_t *nleaves)
+{
+	MDB_cursor *mc;
+	MDB_page *mp;
+	MDB_node *ni;
+	MDB_db db;
+
+	for (;;) {
+		switch (pf->pf_state) {
+		case 0:
+			if (mdb_cpf_first(pf, &pf->pf_main,
+				pf->pf_txn->mt_dbs[MAIN_DBI].md_root, 0)) {
+				pf->pf_state = 3;
+				break;
+			}
+			pf->pf_ki = 0;
+			pf->pf_issued++;
+			pf->pf_state = 1;
+			break;
+		case 1:
+			mc = &pf->pf_main;
+			mp = mc->mc_pg[mc->mc_top];
+			while (pf->pf_ki < NUMKEYS(mp)) {
+				ni = NODEPTR(mp, pf->pf_ki++);
+				if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) == F_SUBDATA) {
+					memcpy(&db, NODEDATA(ni), sizeof(db));
+					if (db.md_root != P_INVALID &&
+						!mdb_cpf_first(pf, &pf->pf_sub, db.md_root, 1)) {
+						pf->pf_state = 2;
+						break;
+					}
+				}
+			}
+			if (pf->pf_state == 2)
+				break;
+			if (mdb_cursor_sibling(mc, 1)) {
+				pf->pf_state = 3;
+				break;
+			}
+			pf->pf_ki = 0;
+			pf->pf_issued++;
+			break;
+		case 2:
+			mc = &pf->pf_sub;
+			mp = mc->mc_pg[mc->mc_top];
+			if (IS_LEAF(mp)) {
+				*nleaves = 1;
+				pf->pf_state = 1;
+			} else {
+				*nleaves = NUMKEYS(mp);
+				if (mdb_cursor_sibling(mc, 1))
+					pf->pf_state = 1;
+			}
+			return mp;
+		default:
+			return NULL;
+		}
+	}
+}
+
+	/** Readahead thread for compacting copy. */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_cpfthr(void *arg)
+{
+	mdb_cpf *pf = arg;
+	MDB_cursor mc = {0};
+	MDB_page *mp;
+	size_t n;
+
+	mc.mc_txn = pf->pf_txn;
+	pthread_mutex_lock(&pf->pf_mutex);
+	for (;;) {
+		while (!pf->pf_done && pf->pf_issued >= pf->pf_copied + MDB_CP_AHEAD)
+			pthread_cond_wait(&pf->pf_cond, &pf->pf_mutex);
+		if (pf->pf_done || (mp = mdb_cpf_next(pf, &n)) == NULL)
+			break;
+		pf->pf_issued += n;
+		/* Another thread may take the next unit */
+		pthread_cond_signal(&pf->pf_cond);
+		pthread_mutex_unlock(&pf->pf_mutex);
+		if (IS_LEAF(mp))
+			mdb_cpf_leaf(pf, &mc, mp);
+		else
+			mdb_cpf_children(pf, &mc, mp);
+		pthread_mutex_lock(&pf->pf_mutex);
+	}
+	/* Pass on the wakeup, so every thread sees the end */
+	pthread_cond_signal(&pf->pf_cond);
+	pthread_mutex_unlock(&pf->pf_mutex);
+	return (THREAD_RET)0;
+}
+
 	/** Depth-first tree traversal for compacting copy.
 	 * @param[in] my control structure.
 	 * @param[in,out] pg database root.
@@ -9260,6 +10430,13 @@ again:
 		mdb_page_copy(mo, mp, my->mc_env->me_psize);
 		mo->mp_pgno = my->mc_next_pgno++;
 		my->mc_wlen[toggle] += my->mc_env->me_psize;
+		if (my->mc_pf && IS_LEAF(mp) && !(flags & F_DUPDATA) &&
+			!(++my->mc_pf->pf_copied & 63)) {
+			/* Let waiting readahead threads continue */
+			pthread_mutex_lock(&my->mc_pf->pf_mutex);
+			pthread_cond_signal(&my->mc_pf->pf_cond);
+			pthread_mutex_unlock(&my->mc_pf->pf_mutex);
+		}
 		if (mc.mc_top) {
 			/* Update parent if there is one */
 			ni = NODEPTR(mc.mc_pg[mc.mc_top-1], mc.mc_ki[mc.mc_top-1]);
@@ -9278,13 +10455,15 @@ done:
 
 	/** Copy environment with compaction. */
 static int ESECT
-mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+mdb_env_copyfd1(MDB_env *env, HANDLE fd, unsigned int flags)
 {
 	MDB_meta *mm;
 	MDB_page *mp;
 	mdb_copy my = {0};
+	mdb_cpf pf = {0};
 	MDB_txn *txn = NULL;
-	pthread_t thr;
+	pthread_t thr, pfthr[MDB_CP_THREADS];
+	int i, npf = 0;
 	pgno_t root, new_root;
 	int rc = MDB_SUCCESS;
 
@@ -9340,6 +10519,7 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 	mm = (MDB_meta *)METADATA(mp);
 	mdb_env_init_meta0(env, mm);
 	mm->mm_address = env->me_metas[0]->mm_address;
+	mm->mm_version = mdb_env_pick_meta(env)->mm_version;
 
 	mp = (MDB_page *)(my.mc_wbuf[0] + env->me_psize);
 	mp->mp_pgno = 1;
@@ -9381,10 +10561,46 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 
 	my.mc_wlen[0] = env->me_psize * NUM_METAS;
 	my.mc_txn = txn;
+	if ((flags & MDB_CP_PARALLEL) && root != P_INVALID) {
+		/* Readahead is optional, carry on without it on failure */
+		pf.pf_txn = txn;
+#ifdef _WIN32
+		pf.pf_mutex = CreateMutex(NULL, FALSE, NULL);
+		pf.pf_cond = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (!pf.pf_mutex || !pf.pf_cond) {
+			if (pf.pf_mutex) CloseHandle(pf.pf_mutex);
+			if (pf.pf_cond) CloseHandle(pf.pf_cond);
+		} else
+#else
+		if (!pthread_mutex_init(&pf.pf_mutex, NULL) &&
+			!pthread_cond_init(&pf.pf_cond, NULL))
+#endif
+		{
+			for (; npf < MDB_CP_THREADS; npf++)
+				if (THREAD_CREATE(pfthr[npf], mdb_env_cpfthr, &pf))
+					break;
+			my.mc_pf = &pf;
+		}
+	}
 	rc = mdb_env_cwalk(&my, &root, 0);
 	if (rc == MDB_SUCCESS && root != new_root) {
 		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
 	}
+	if (my.mc_pf) {
+		pthread_mutex_lock(&pf.pf_mutex);
+		pf.pf_done = 1;
+		pthread_cond_signal(&pf.pf_cond);
+		pthread_mutex_unlock(&pf.pf_mutex);
+		for (i=0; i<npf; i++)
+			THREAD_FINISH(pfthr[i]);
+#ifdef _WIN32
+		CloseHandle(pf.pf_cond);
+		CloseHandle(pf.pf_mutex);
+#else
+		pthread_cond_destroy(&pf.pf_cond);
+		pthread_mutex_destroy(&pf.pf_mutex);
+#endif
+	}
 
 finish:
 	if (rc)
@@ -9511,7 +10727,7 @@ int ESECT
 mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
 {
 	if (flags & MDB_CP_COMPACT)
-		return mdb_env_copyfd1(env, fd);
+		return mdb_env_copyfd1(env, fd, flags);
 	else
 		return mdb_env_copyfd0(env, fd);
 }
@@ -9548,6 +10764,385 @@ mdb_env_copy(MDB_env *env, const char *path)
 	return mdb_env_copy2(env, path, 0);
 }
 
+/** Write a buffer to a file handle, at a given offset or,
+ * if \b pos is -1, at the current position.
+ */
+static int ESECT
+mdb_fwrite(HANDLE fd, const char *ptr, size_t len, size_t pos)
+{
+	size_t w2;
+#ifdef _WIN32
+	DWORD wres;
+	OVERLAPPED ov;
+#else
+	ssize_t wres;
+#endif
+
+	while (len > 0) {
+		w2 = len > MAX_WRITE ? MAX_WRITE : len;
+#ifdef _WIN32
+		if (pos != (size_t)-1) {
+			memset(&ov, 0, sizeof(ov));
+			ov.Offset = pos & 0xffffffff;
+			ov.OffsetHigh = pos >> 16 >> 16;
+		}
+		if (!WriteFile(fd, ptr, w2, &wres, pos != (size_t)-1 ? &ov : NULL))
+			return ErrCode();
+#else
+		if (pos != (size_t)-1)
+			wres = pwrite(fd, ptr, w2, pos);
+		else
+			wres = write(fd, ptr, w2);
+		if (wres < 0) {
+			int rc = ErrCode();
+			if (rc == EINTR)
+				continue;
+			return rc;
+		}
+#endif
+		if (wres == 0)
+			return EIO;	/* Non-blocking or async handles are not supported */
+		ptr += wres;
+		len -= wres;
+		if (pos != (size_t)-1)
+			pos += wres;
+	}
+	return MDB_SUCCESS;
+}
+
+/** Read from a file handle until \b len bytes or end of file.
+ * @param[out] got the number of bytes read
+ */
+static int ESECT
+mdb_fread(HANDLE fd, char *ptr, size_t len, size_t *got)
+{
+#ifdef _WIN32
+	DWORD rres;
+#else
+	ssize_t rres;
+#endif
+
+	*got = 0;
+	while (len > 0) {
+#ifdef _WIN32
+		if (!ReadFile(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len, &rres, NULL))
+			return ErrCode();
+#else
+		rres = read(fd, ptr, len > MAX_WRITE ? MAX_WRITE : len);
+		if (rres < 0) {
+			int rc = ErrCode();
+			if (rc == EINTR)
+				continue;
+			return rc;
+		}
+#endif
+		if (rres == 0)
+			break;
+		ptr += rres;
+		len -= rres;
+		*got += rres;
+	}
+	return MDB_SUCCESS;
+}
+
+/** Collect the pages written by txns \b since+1 to \b last from
+ * the page log.
+ * @param[in] env the environment handle
+ * @param[in] since the txn the delta starts after
+ * @param[in] last the txn the delta ends with
+ * @param[in,out] pgs the written pages, unsorted
+ * @return 0 on success, #MDB_NOTFOUND if the log misses any of the txns.
+ */
+static int ESECT
+mdb_env_plog_read(MDB_env *env, txnid_t since, txnid_t last, MDB_IDL *pgs)
+{
+	MDB_name fname;
+	HANDLE fd;
+	MDB_plrec pl;
+	MDB_pgrun *runs = NULL, *pr;
+	size_t got, len, rsize = 0;
+	txnid_t next = since + 1;
+	unsigned i;
+	int rc;
+
+	rc = mdb_fname_init(env->me_path,
+		(env->me_flags & MDB_NOSUBDIR) | MDB_PAGELOG, &fname);
+	if (rc)
+		return rc;
+	rc = mdb_fopen(env, &fname, MDB_O_PLOGRD, 0, &fd);
+	mdb_fname_destroy(fname);
+	if (rc)
+		return rc == ENOENT ? MDB_NOTFOUND : rc;
+
+	for (;;) {
+		/* A short read is the end of the log, or a record that
+		 * is being appended by a txn that is newer than ours.
+		 */
+		if ((rc = mdb_fread(fd, (char *)&pl, sizeof(pl), &got)) ||
+			got < sizeof(pl))
+			break;
+		if (pl.pl_magic != MDB_PLOG_MAGIC) {
+			rc = MDB_CORRUPTED;
+			break;
+		}
+		len = pl.pl_nruns * sizeof(MDB_pgrun);
+		if (len > rsize) {
+			free(runs);
+			if ((runs = malloc(len)) == NULL) {
+				rc = ENOMEM;
+				break;
+			}
+			rsize = len;
+		}
+		if ((rc = mdb_fread(fd, (char *)runs, len, &got)) || got < len)
+			break;
+		if (pl.pl_txnid <= since || pl.pl_txnid > last)
+			continue;
+		/* A txn may be logged more than once if its commit failed
+		 * after it was logged. Any gap means some process committed
+		 * without #MDB_PAGELOG.
+		 */
+		if (pl.pl_txnid > next) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
+		if (pl.pl_txnid == next)
+			next++;
+		for (i=0, pr=runs; i<pl.pl_nruns; i++, pr++) {
+			if ((rc = mdb_midl_append_range(pgs, pr->pr_pgno, pr->pr_count)))
+				break;
+		}
+		if (rc)
+			break;
+	}
+	free(runs);
+	(void) close(fd);
+	if (rc == MDB_SUCCESS && next != last + 1)
+		rc = MDB_NOTFOUND;
+	return rc;
+}
+
+int ESECT
+mdb_env_copyfd_delta(MDB_env *env, HANDLE fd, size_t txnid)
+{
+	MDB_txn *txn = NULL;
+	mdb_mutexref_t wmutex = NULL;
+	MDB_IDL pgs = NULL;
+	MDB_dhead dh;
+	MDB_pgrun pr;
+	char *metas;
+	size_t fsize = 0, psize = env->me_psize, max = MAX_WRITE / env->me_psize;
+	pgno_t pg, last;
+	unsigned i;
+	int rc;
+
+	if ((metas = malloc(psize * NUM_METAS)) == NULL)
+		return ENOMEM;
+
+	/* As in mdb_env_copyfd0(): snapshot the meta pages with writers blocked */
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto leave;
+	if (env->me_txns) {
+		mdb_txn_end(txn, MDB_END_RESET_TMP);
+		wmutex = env->me_wmutex;
+		if (LOCK_MUTEX(rc, env, wmutex))
+			goto leave;
+		rc = mdb_txn_renew0(txn);
+		if (rc) {
+			UNLOCK_MUTEX(wmutex);
+			goto leave;
+		}
+	}
+	memcpy(metas, env->me_map, psize * NUM_METAS);
+	if (wmutex)
+		UNLOCK_MUTEX(wmutex);
+
+	if (txnid > txn->mt_txnid) {
+		rc = EINVAL;
+		goto leave;
+	}
+	if ((pgs = mdb_midl_alloc(MDB_IDL_UM_MAX)) == NULL) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	if (txnid < txn->mt_txnid &&
+		(rc = mdb_env_plog_read(env, txnid, txn->mt_txnid, &pgs)))
+		goto leave;
+	mdb_midl_sort(pgs);
+	if ((rc = mdb_fsize(env->me_fd, &fsize)))
+		goto leave;
+
+	memset(&dh, 0, sizeof(dh));
+	dh.md_magic = MDB_DELTA_MAGIC;
+	dh.md_version = MDB_DELTA_VERSION;
+	dh.md_psize = psize;
+	dh.md_since = txnid;
+	dh.md_txnid = txn->mt_txnid;
+	dh.md_next_pgno = txn->mt_next_pgno;
+	if ((rc = mdb_fwrite(fd, (char *)&dh, sizeof(dh), (size_t)-1)) ||
+		(rc = mdb_fwrite(fd, metas, psize * NUM_METAS, (size_t)-1)))
+		goto leave;
+
+	/* Pages written since txnid but no longer part of our snapshot
+	 * may be reused while we copy them. That's harmless, the copy
+	 * doesn't reference them. Pages of our snapshot are stable.
+	 */
+	last = 0;
+	pr.pr_count = 0;
+	for (i = pgs[0]; ; i--) {
+		pg = i ? pgs[i] : 0;
+		if (i && (pg < NUM_METAS || pg < last || pg >= txn->mt_next_pgno ||
+			(pg + 1) * psize > fsize))
+			continue;
+		if (i && pr.pr_count && pg == last && pr.pr_count < max) {
+			pr.pr_count++;
+			last++;
+			continue;
+		}
+		if (pr.pr_count) {
+			if ((rc = mdb_fwrite(fd, (char *)&pr, sizeof(pr), (size_t)-1)) ||
+				(rc = mdb_fwrite(fd, env->me_map + pr.pr_pgno * psize,
+					pr.pr_count * psize, (size_t)-1)))
+				goto leave;
+		}
+		if (!i)
+			break;
+		pr.pr_pgno = pg;
+		pr.pr_count = 1;
+		last = pg + 1;
+	}
+	pr.pr_pgno = 0;
+	pr.pr_count = 0;
+	rc = mdb_fwrite(fd, (char *)&pr, sizeof(pr), (size_t)-1);
+
+leave:
+	mdb_midl_free(pgs);
+	mdb_txn_abort(txn);
+	free(metas);
+	return rc;
+}
+
+int ESECT
+mdb_env_copy_delta(MDB_env *env, const char *path, size_t txnid)
+{
+	int rc;
+	MDB_name fname;
+	HANDLE newfd = INVALID_HANDLE_VALUE;
+
+	rc = mdb_fname_init(path, MDB_NOSUBDIR|MDB_NOLOCK, &fname);
+	if (rc == MDB_SUCCESS) {
+		rc = mdb_fopen(env, &fname, MDB_O_DELTA, 0666, &newfd);
+		mdb_fname_destroy(fname);
+	}
+	if (rc == MDB_SUCCESS) {
+		rc = mdb_env_copyfd_delta(env, newfd, txnid);
+		if (close(newfd) < 0 && rc == MDB_SUCCESS)
+			rc = ErrCode();
+	}
+	return rc;
+}
+
+int ESECT
+mdb_env_apply_delta(const char *path, unsigned int flags, HANDLE fd)
+{
+	MDB_env *env;
+	MDB_dhead dh;
+	MDB_pgrun pr;
+	MDB_meta *meta;
+	MDB_name fname;
+	HANDLE wfd = INVALID_HANDLE_VALUE;
+	char *metas = NULL, *buf = NULL;
+	size_t got, n, psize, max;
+	int rc;
+
+	if (flags & ~MDB_NOSUBDIR)
+		return EINVAL;
+	if ((rc = mdb_env_create(&env)))
+		return rc;
+	/* Opening read-only checks that the copy exists and is valid */
+	rc = mdb_env_open(env, path, flags|MDB_RDONLY|MDB_NOLOCK, 0);
+	if (rc)
+		goto leave;
+	meta = mdb_env_pick_meta(env);
+	psize = env->me_psize;
+
+	if ((rc = mdb_fread(fd, (char *)&dh, sizeof(dh), &got)))
+		goto leave;
+	if (got < sizeof(dh) || dh.md_magic != MDB_DELTA_MAGIC ||
+		dh.md_version != MDB_DELTA_VERSION) {
+		rc = MDB_INVALID;
+		goto leave;
+	}
+	/* The copy must hold every page that the delta doesn't */
+	if (dh.md_psize != psize || meta->mm_txnid < dh.md_since ||
+		meta->mm_txnid > dh.md_txnid) {
+		rc = MDB_INCOMPATIBLE;
+		goto leave;
+	}
+
+	max = psize < (1U << 20) ? (1U << 20) / psize : 1;
+	if ((metas = malloc(psize * NUM_METAS)) == NULL ||
+		(buf = malloc(psize * max)) == NULL) {
+		rc = ENOMEM;
+		goto leave;
+	}
+	if ((rc = mdb_fread(fd, metas, psize * NUM_METAS, &got)))
+		goto leave;
+	if (got < psize * NUM_METAS) {
+		rc = MDB_CORRUPTED;
+		goto leave;
+	}
+
+	rc = mdb_fname_init(path, env->me_flags, &fname);
+	if (rc)
+		goto leave;
+	rc = mdb_fopen(env, &fname, MDB_O_RDWR, 0, &wfd);
+	mdb_fname_destroy(fname);
+	if (rc)
+		goto leave;
+
+	for (;;) {
+		if ((rc = mdb_fread(fd, (char *)&pr, sizeof(pr), &got)))
+			goto leave;
+		if (got < sizeof(pr) || (pr.pr_count && pr.pr_pgno < NUM_METAS)) {
+			rc = MDB_CORRUPTED;
+			goto leave;
+		}
+		if (!pr.pr_count)
+			break;
+		while (pr.pr_count) {
+			n = pr.pr_count > max ? max : pr.pr_count;
+			if ((rc = mdb_fread(fd, buf, n * psize, &got)))
+				goto leave;
+			if (got < n * psize) {
+				rc = MDB_CORRUPTED;
+				goto leave;
+			}
+			if ((rc = mdb_fwrite(wfd, buf, n * psize, pr.pr_pgno * psize)))
+				goto leave;
+			pr.pr_pgno += n;
+			pr.pr_count -= n;
+		}
+	}
+
+	/* The pages must be on disk before the meta pages point to them */
+	if (MDB_FDATASYNC(wfd) ||
+		(rc = mdb_fwrite(wfd, metas, psize * NUM_METAS, 0)) ||
+		MDB_FDATASYNC(wfd)) {
+		if (!rc)
+			rc = ErrCode();
+	}
+
+leave:
+	if (wfd != INVALID_HANDLE_VALUE)
+		(void) close(wfd);
+	free(buf);
+	free(metas);
+	mdb_env_close(env);
+	return rc;
+}
+
 int ESECT
 mdb_env_set_flags(MDB_env *env, unsigned int flag, int onoff)
 {
@@ -9690,6 +11285,22 @@ mdb_default_cmp(MDB_txn *txn, MDB_dbi dbi)
 		 : ((f & MDB_REVERSEDUP) ? mdb_cmp_memnr : mdb_cmp_memn));
 }
 
+/** Note that a write transaction uses a #MDB_PREFIXKEY database,
+ * so that its commit raises the datafile to #MDB_PREFIX_VERSION.
+ * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+ * @param[in] dbi A database handle returned by #mdb_dbi_open()
+ */
+static void
+mdb_dbi_prefix(MDB_txn *txn, MDB_dbi dbi)
+{
+	if (!(txn->mt_dbs[dbi].md_flags & MDB_PREFIXKEY) ||
+		(txn->mt_flags & (MDB_TXN_RDONLY|MDB_TXN_PREFIX)))
+		return;
+	txn->mt_flags |= MDB_TXN_PREFIX;
+	if (mdb_env_pick_meta(txn->mt_env)->mm_version != MDB_PREFIX_VERSION)
+		txn->mt_flags |= MDB_TXN_DIRTY;
+}
+
 int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *dbi)
 {
 	MDB_val key, data;
@@ -9703,6 +11314,10 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 
 	if (flags & ~VALID_FLAGS)
 		return EINVAL;
+	/* Page prefixes need keys compared bytewise from the start */
+	if ((flags & MDB_PREFIXKEY) &&
+		(!(MDB_MAXKEYSIZE) || (flags & (MDB_REVERSEKEY|MDB_INTEGERKEY))))
+		return EINVAL;
 	if (txn->mt_flags & MDB_TXN_BLOCKED)
 		return MDB_BAD_TXN;
 
@@ -9717,6 +11332,7 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 				txn->mt_flags |= MDB_TXN_DIRTY;
 			}
 		}
+		mdb_dbi_prefix(txn, MAIN_DBI);
 		mdb_default_cmp(txn, MAIN_DBI);
 		return MDB_SUCCESS;
 	}
@@ -9800,6 +11416,7 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 
 		memcpy(&txn->mt_dbs[slot], data.mv_data, sizeof(MDB_db));
 		*dbi = slot;
+		mdb_dbi_prefix(txn, slot);
 		mdb_default_cmp(txn, slot);
 		if (!unused) {
 			txn->mt_numdbs++;
@@ -9827,6 +11444,47 @@ mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *arg)
 	return mdb_stat0(txn->mt_env, &txn->mt_dbs[dbi], arg);
 }
 
+int
+mdb_prefix_stat(MDB_txn *txn, MDB_dbi dbi, MDB_pfxstat *arg)
+{
+	MDB_cursor mc;
+	MDB_xcursor mx;
+	MDB_page *mp;
+	unsigned int i, nkeys;
+	int rc;
+
+	if (!arg || !TXN_DBI_EXIST(txn, dbi, DB_VALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	memset(arg, 0, sizeof(*arg));
+	mdb_cursor_init(&mc, txn, dbi, &mx);
+	rc = mdb_page_search(&mc, NULL, MDB_PS_FIRST);
+	while (rc == MDB_SUCCESS) {
+		mp = mc.mc_pg[mc.mc_top];
+		nkeys = NUMKEYS(mp);
+		arg->ms_leaf_pages++;
+		if (IS_LEAF2(mp)) {
+			arg->ms_key_bytes += nkeys * mc.mc_db->md_pad;
+			arg->ms_stored_bytes += nkeys * mc.mc_db->md_pad;
+		} else {
+			if (IS_PREFIX(mp)) {
+				arg->ms_prefix_pages++;
+				arg->ms_key_bytes += nkeys * mp->mp_pad;
+				arg->ms_stored_bytes += mp->mp_pad;
+			}
+			for (i = 0; i < nkeys; i++) {
+				arg->ms_key_bytes += NODEKSZ(NODEPTR(mp, i));
+				arg->ms_stored_bytes += NODEKSZ(NODEPTR(mp, i));
+			}
+		}
+		rc = mdb_cursor_sibling(&mc, 1);
+	}
+	return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+}
+
 void mdb_dbi_close(MDB_env *env, MDB_dbi dbi)
 {
 	char *ptr;
@@ -10007,6 +11665,9 @@ int mdb_set_compare(MDB_txn *txn, MDB_dbi dbi, MDB_cmp_func *cmp)
 	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
 		return EINVAL;
 
+	if (txn->mt_dbs[dbi].md_flags & MDB_PREFIXKEY)
+		return EINVAL;
+
 	txn->mt_dbxs[dbi].md_cmp = cmp;
 	return MDB_SUCCESS;
 }
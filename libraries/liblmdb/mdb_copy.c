@@ -34,12 +34,25 @@ int main(int argc,char * argv[])
 	const char *progname = argv[0], *act;
 	unsigned flags = MDB_RDONLY;
 	unsigned cpflags = 0;
+	int delta = 0;
+	size_t since = 0;
+	char *end;
 
 	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
+		else if (argv[1][1] == 'p' && argv[1][2] == '\0')
+			cpflags |= MDB_CP_PARALLEL;
+		else if (argv[1][1] == 'd' && argv[1][2] == '\0' && argc > 2) {
+			since = strtoul(argv[2], &end, 0);
+			if (*end || !*argv[2])
+				argc = 0;
+			delta = 1;
+			argc--;
+			argv++;
+		}
 		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
@@ -47,8 +60,9 @@ int main(int argc,char * argv[])
 			argc = 0;
 	}
 
-	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+	if (argc<2 || argc>3 || (delta && cpflags) ||
+		(cpflags & (MDB_CP_COMPACT|MDB_CP_PARALLEL)) == MDB_CP_PARALLEL) {
+		fprintf(stderr, "usage: %s [-V] [-c [-p]] [-n] [-d txnid] srcpath [dstpath]\n", progname);
 		exit(EXIT_FAILURE);
 	}
 
@@ -68,7 +82,12 @@ int main(int argc,char * argv[])
 	}
 	if (rc == MDB_SUCCESS) {
 		act = "copying";
-		if (argc == 2)
+		if (delta) {
+			if (argc == 2)
+				rc = mdb_env_copyfd_delta(env, MDB_STDOUT, since);
+			else
+				rc = mdb_env_copy_delta(env, argv[2], since);
+		} else if (argc == 2)
 			rc = mdb_env_copyfd2(env, MDB_STDOUT, cpflags);
 		else
 			rc = mdb_env_copy2(env, argv[2], cpflags);
@@ -0,0 +1,72 @@
+/* mdb_patch.c - memory-mapped database delta apply tool */
+/*
+ * Copyright 2012-2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#define	MDB_STDIN	GetStdHandle(STD_INPUT_HANDLE)
+#define	MDB_OPEN(name)	CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, \
+	NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)
+#define	MDB_BADFD	INVALID_HANDLE_VALUE
+#define	close(fd)	CloseHandle(fd)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define	MDB_STDIN	0
+#define	MDB_OPEN(name)	open(name, O_RDONLY)
+#define	MDB_BADFD	(-1)
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "lmdb.h"
+
+int main(int argc,char * argv[])
+{
+	int rc;
+	const char *progname = argv[0];
+	unsigned flags = 0;
+	mdb_filehandle_t fd = MDB_STDIN;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (argv[1][1] == 'n' && argv[1][2] == '\0')
+			flags |= MDB_NOSUBDIR;
+		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
+			printf("%s\n", MDB_VERSION_STRING);
+			exit(0);
+		} else
+			argc = 0;
+	}
+
+	if (argc<2 || argc>3) {
+		fprintf(stderr, "usage: %s [-V] [-n] dstpath [deltafile]\n", progname);
+		exit(EXIT_FAILURE);
+	}
+
+	if (argc == 3) {
+		fd = MDB_OPEN(argv[2]);
+		if (fd == MDB_BADFD) {
+			fprintf(stderr, "%s: %s: %s\n", progname, argv[2], strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	rc = mdb_env_apply_delta(argv[1], flags, fd);
+	if (rc)
+		fprintf(stderr, "%s: applying delta failed, error %d (%s)\n",
+			progname, rc, mdb_strerror(rc));
+	if (argc == 3)
+		close(fd);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -35,9 +35,25 @@ static void prstat(MDB_stat *ms)
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+static int prkeys(MDB_txn *txn, MDB_dbi dbi)
+{
+	MDB_pfxstat ps;
+	int rc;
+
+	rc = mdb_prefix_stat(txn, dbi, &ps);
+	if (rc)
+		return rc;
+	printf("  Prefixed leaf pages: %"Z"u of %"Z"u\n",
+		ps.ms_prefix_pages, ps.ms_leaf_pages);
+	printf("  Key bytes: %"Z"u, stored: %"Z"u (%.1f%%)\n",
+		ps.ms_key_bytes, ps.ms_stored_bytes,
+		ps.ms_key_bytes ? 100.0 * ps.ms_stored_bytes / ps.ms_key_bytes : 100.0);
+	return MDB_SUCCESS;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-k] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -52,7 +68,7 @@ int main(int argc, char *argv[])
 	char *prog = argv[0];
 	char *envname;
 	char *subname = NULL;
-	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0, keyinfo = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -62,12 +78,13 @@ int main(int argc, char *argv[])
 	 * -s: print stat of only the named subDB
 	 * -e: print env info
 	 * -f: print freelist info
+	 * -k: print key prefix info
 	 * -r: print reader info
 	 * -n: use NOSUBDIR flag on env_open
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "Vaefknrs:")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -84,6 +101,9 @@ int main(int argc, char *argv[])
 		case 'f':
 			freinfo++;
 			break;
+		case 'k':
+			keyinfo++;
+			break;
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
 			break;
@@ -216,6 +236,10 @@ int main(int argc, char *argv[])
 	}
 	printf("Status of %s\n", subname ? subname : "Main DB");
 	prstat(&mst);
+	if (keyinfo && (rc = prkeys(txn, dbi))) {
+		fprintf(stderr, "mdb_prefix_stat failed, error %d %s\n", rc, mdb_strerror(rc));
+		goto txn_abort;
+	}
 
 	if (alldbs) {
 		MDB_cursor *cursor;
@@ -245,6 +269,10 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 			prstat(&mst);
+			if (keyinfo && (rc = prkeys(txn, db2))) {
+				fprintf(stderr, "mdb_prefix_stat failed, error %d %s\n", rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
 			mdb_close(env, db2);
 		}
 		mdb_cursor_close(cursor);
@@ -313,6 +313,35 @@ unsigned mdb_mid2l_search( MDB_ID2L ids, MDB_ID id )
 	return cursor;
 }
 
+MDB_ID2L mdb_mid2l_alloc(unsigned num)
+{
+	MDB_ID2L ids = malloc((num+2) * sizeof(MDB_ID2));
+	if (ids) {
+		ids->mid = num;
+		ids++;
+		ids->mid = 0;
+	}
+	return ids;
+}
+
+void mdb_mid2l_free(MDB_ID2L ids)
+{
+	if (ids)
+		free(ids-1);
+}
+
+int mdb_mid2l_grow( MDB_ID2L *idp, unsigned num )
+{
+	MDB_ID2L ids = *idp;
+	if (num > ids[-1].mid) {
+		if (!(ids = realloc(ids-1, (num+2) * sizeof(MDB_ID2))))
+			return ENOMEM;
+		ids->mid = num;
+		*idp = ids+1;
+	}
+	return 0;
+}
+
 int mdb_mid2l_insert( MDB_ID2L ids, MDB_ID2 *id )
 {
 	unsigned x, i;
@@ -329,7 +358,7 @@ int mdb_mid2l_insert( MDB_ID2L ids, MDB_ID2 *id )
 		return -1;
 	}
 
-	if ( ids[0].mid >= MDB_IDL_UM_MAX ) {
+	if ( ids[0].mid >= ids[-1].mid ) {
 		/* too big */
 		return -2;
 
@@ -347,7 +376,7 @@ int mdb_mid2l_insert( MDB_ID2L ids, MDB_ID2 *id )
 int mdb_mid2l_append( MDB_ID2L ids, MDB_ID2 *id )
 {
 	/* Too big? */
-	if (ids[0].mid >= MDB_IDL_UM_MAX) {
+	if (ids[0].mid >= ids[-1].mid) {
 		return -2;
 	}
 	ids[0].mid++;
@@ -156,6 +156,27 @@ typedef struct MDB_ID2 {
 	 */
 typedef MDB_ID2 *MDB_ID2L;
 
+	/** Current max length of an #mdb_mid2l_alloc()ed ID2L */
+#define MDB_ID2L_ALLOCLEN( ids )	( (ids)[-1].mid )
+
+	/** Allocate an ID2L.
+	 * Allocates memory for an ID2L of the given size.
+	 * @return	ID2L on success, NULL on failure.
+	 */
+MDB_ID2L mdb_mid2l_alloc(unsigned num);
+
+	/** Free an ID2L.
+	 * @param[in] ids	The ID2L to free.
+	 */
+void mdb_mid2l_free(MDB_ID2L ids);
+
+	/** Make an ID2L able to hold at least num elements.
+	 * @param[in,out] idp	Address of the ID2L.
+	 * @param[in] num	Number of elements to make room for.
+	 * @return	0 on success, ENOMEM on failure.
+	 */
+int mdb_mid2l_grow(MDB_ID2L *idp, unsigned num);
+
 	/** Search for an ID in an ID2L.
 	 * @param[in] ids	The ID2L to search.
 	 * @param[in] id	The ID to search for.
@@ -167,7 +188,8 @@ unsigned mdb_mid2l_search( MDB_ID2L ids, MDB_ID id );
 	/** Insert an ID2 into a ID2L.
 	 * @param[in,out] ids	The ID2L to insert into.
 	 * @param[in] id	The ID2 to insert.
-	 * @return	0 on success, -1 if the ID was already present in the ID2L.
+	 * @return	0 on success, -1 if the ID was already present in the ID2L,
+	 *	-2 if the ID2L is too big.
 	 */
 int mdb_mid2l_insert( MDB_ID2L ids, MDB_ID2 *id );
 
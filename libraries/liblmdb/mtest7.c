@@ -0,0 +1,123 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2018 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Benchmark for overflow page allocation on a fragmented map.
+ * Fills the map with two-page values and deletes every other one,
+ * leaving many short runs of free pages that are too small for the
+ * larger values whose puts are then timed in a single txn.
+ *
+ * Usage: mtest7 [nfill [nbig]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+static double
+now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, rc, nfill = 200000, nbig = 2000;
+	MDB_env *env;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	MDB_stat mst;
+	MDB_envinfo info;
+	char *buf;
+	unsigned psize;
+	double t0, t, tmax = 0, total;
+
+	if (argc > 1)
+		nfill = atoi(argv[1]);
+	if (argc > 2)
+		nbig = atoi(argv[2]);
+	srand(7);
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, (size_t)4 << 30));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, NULL, 0, &dbi));
+	E(mdb_stat(txn, dbi, &mst));
+	psize = mst.ms_psize;
+	buf = calloc(1, psize * 17);
+	key.mv_size = sizeof(i);
+	key.mv_data = &i;
+
+	/* Fill with values of two overflow pages, in several txns */
+	for (i = 0; i < nfill; i++) {
+		data.mv_size = psize + psize / 2;
+		data.mv_data = buf;
+		E(mdb_put(txn, dbi, &key, &data, 0));
+		if (i % 10000 == 9999) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+		}
+	}
+	E(mdb_txn_commit(txn));
+
+	/* Free every other one, scattering short free runs */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < nfill; i += 2)
+		E(mdb_del(txn, dbi, &key, NULL));
+	E(mdb_txn_commit(txn));
+	/* Once more, so the pages freed above are reusable */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	i = nfill;
+	data.mv_size = 1;
+	data.mv_data = buf;
+	E(mdb_put(txn, dbi, &key, &data, 0));
+	E(mdb_txn_commit(txn));
+
+	mdb_env_info(env, &info);
+	printf("filled %d, map uses %zu pages\n", nfill, info.me_last_pgno+1);
+
+	/* Time puts of 4-16 page values */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	total = now();
+	for (i = nfill+1; i <= nfill+nbig; i++) {
+		data.mv_size = psize * (4 + rand() % 13) - 64;
+		data.mv_data = buf;
+		t0 = now();
+		E(mdb_put(txn, dbi, &key, &data, 0));
+		t = now() - t0;
+		if (t > tmax)
+			tmax = t;
+	}
+	total = now() - total;
+	E(mdb_txn_commit(txn));
+
+	mdb_env_info(env, &info);
+	printf("%d puts of 4-16 pages: %.3f s, avg %.1f us, max %.1f us; "
+		"map uses %zu pages\n", nbig, total, total * 1e6 / nbig, tmax * 1e6,
+		info.me_last_pgno+1);
+
+	free(buf);
+	mdb_env_close(env);
+
+	return 0;
+}
@@ -87,6 +87,23 @@ mdb_attr_mask(
 	return i < 0 ? NULL : mdb->mi_attrs[i];
 }
 
+/* Ordered equality indexes keep the normalized values as keys, and
+ * substring indexes keep many keys per value; both fill their leaf
+ * pages with keys sharing a prefix.
+ */
+static int
+mdb_attr_prefixkeys( AttrInfo *ai )
+{
+	AttributeType *at = ai->ai_desc->ad_type;
+	slap_mask_t mask = ai->ai_indexmask | ai->ai_newmask;
+
+	if ( IS_SLAP_INDEX( mask, SLAP_INDEX_SUBSTR ))
+		return 1;
+	return IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ) &&
+		at->sat_ordering &&
+		( at->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX );
+}
+
 /* Open all un-opened index DB handles */
 int
 mdb_attr_dbs_open(
@@ -123,7 +140,9 @@ mdb_attr_dbs_open(
 		if ( mdb->mi_attrs[i]->ai_dbi )	/* already open */
 			continue;
 		rc = mdb_dbi_open( txn, mdb->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
-			flags, &mdb->mi_attrs[i]->ai_dbi );
+			flags | ((( mdb->mi_flags & MDB_PREFIX_KEYS ) &&
+				mdb_attr_prefixkeys( mdb->mi_attrs[i] )) ? MDB_PREFIXKEY : 0 ),
+			&mdb->mi_attrs[i]->ai_dbi );
 		if ( rc ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s) failed: %s (%d).",
@@ -381,9 +400,14 @@ fail:
 		a->ai_cr = NULL;
 #endif
 		a->ai_cursor = NULL;
+		a->ai_bulk = NULL;
 		a->ai_root = NULL;
 		a->ai_desc = ad;
 		a->ai_dbi = 0;
+		a->ai_ixnext = 0;
+		a->ai_ixlast = 0;
+		a->ai_ixold = 0;
+		a->ai_ixtxn = 0;
 
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			a->ai_indexmask = 0;
@@ -431,10 +455,13 @@ fail:
 				if ( b->ai_indexmask & MDB_INDEX_DELETING ) {
 					/* If we were editing this attr, reset it */
 					b->ai_indexmask &= ~MDB_INDEX_DELETING;
-					/* If this is leftover from a previous add, commit it */
-					if ( b->ai_newmask )
+					/* If this is leftover from a previous add, commit it.
+					 * An unfinished online build starts over instead.
+					 */
+					if ( b->ai_newmask && !b->ai_ixlast )
 						b->ai_indexmask = b->ai_newmask;
 					b->ai_newmask = a->ai_newmask;
+					b->ai_ixlast = 0;
 					ch_free( a );
 					rc = 0;
 					continue;
@@ -571,6 +598,11 @@ int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn )
 	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
 
 	while ( rc == MDB_SUCCESS ) {
+		int k;
+		/* past the last one, see MDB_AD2ID_CLUSTER */
+		memcpy( &k, key.mv_data, sizeof(k) );
+		if ( k != i )
+			break;
 		bdata.bv_len = data.mv_size;
 		bdata.bv_val = data.mv_data;
 		ad = NULL;
@@ -33,7 +33,8 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_ID2COL		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -51,6 +52,9 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Seconds the candidates of a paged search are kept */
+#define DEFAULT_PAGED_TTL	300
+
 #ifdef LDAP_DEVEL
 #define MDB_MONITOR_IDX
 #endif
@@ -63,6 +67,67 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Decoded entry cache, see ecache.c */
+#define MDB_ECACHE_STRIPES	16
+#define MDB_ECACHE_STAMPS	4096	/* a multiple of the stripes, whose
+					 * mutexes guard the stamps */
+
+struct mdb_ecache_entry;
+
+/* Group commit, see commit.c */
+typedef struct mdb_group mdb_group;
+
+/* Attribute columns, see column.c */
+typedef struct mdb_column {
+	AttributeDescription *mc_ad;	/* NULL for the entry flags */
+	ID		mc_next;	/* next entry ID to build, NOID when complete */
+	ID		mc_last;	/* last entry ID when the build started */
+} mdb_column;
+
+/* Most columns a search filter may use */
+#define MDB_COLSCAN_MAX	8
+
+typedef struct mdb_colscan mdb_colscan;
+
+/* State of a search whose candidates are tested by several threads */
+typedef struct mdb_pscan mdb_pscan;
+
+/* Candidates of a paged search, kept for its next page */
+typedef struct mdb_paged {
+	struct mdb_paged	*mp_next;
+	unsigned long	mp_connid;
+	ID		mp_cookie;	/* last ID of the page sent */
+	ID		mp_txnid;	/* snapshot the candidates were computed in */
+	time_t		mp_used;
+	int		mp_scope;
+	struct berval	mp_base;
+	struct berval	mp_filter;
+	ID		*mp_ids;
+} mdb_paged;
+
+/* A thread's reader txn, and the operation that took its snapshot.
+ * Read without the lock by the monitor, so it may be a moment old.
+ */
+typedef struct mdb_rslot {
+	struct mdb_rslot	*mr_next;
+	struct mdb_info	*mr_mdb;
+	MDB_txn		*mr_txn;
+	ldap_pvt_thread_t	mr_tid;
+	unsigned long	mr_connid;
+	unsigned long	mr_opid;
+	time_t		mr_since;
+} mdb_rslot;
+
+typedef struct mdb_ecache_stripe {
+	ldap_pvt_thread_mutex_t	ecs_mutex;
+	Avlnode		*ecs_tree;
+	LDAP_TAILQ_HEAD(ecs_lru_head, mdb_ecache_entry) ecs_lru;
+	size_t		ecs_size;
+	unsigned long	ecs_count;
+	unsigned long	ecs_hits;
+	unsigned long	ecs_misses;
+} mdb_ecache_stripe;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -72,6 +137,10 @@ struct mdb_info {
 	int			mi_dbenv_mode;
 
 	size_t		mi_mapsize;
+	size_t		mi_mapgrow;
+	size_t		mi_mapmax;
+		/* grow the map by mi_mapgrow bytes when it is full,
+		 * up to mi_mapmax, 0 disables */
 	ID			mi_nextid;
 	size_t		mi_maxentrysize;
 
@@ -83,15 +152,59 @@ struct mdb_info {
 	int			mi_readers;
 
 	uint32_t	mi_rtxn_size;
+	unsigned	mi_rtxn_age;
+		/* seconds after which a search renews its snapshot */
+	mdb_rslot	*mi_rslots;
+	ldap_pvt_thread_mutex_t	mi_rslot_mutex;
+	unsigned	mi_search_threads;
+		/* threads a search may use to test candidates,
+		 * 0 or 1 keeps searches sequential */
+	unsigned	mi_paged_max;
+	unsigned	mi_paged_ttl;
+		/* paged searches whose candidates are kept between
+		 * pages and for how many seconds, 0 disables */
+	int			mi_paged_n;
+	mdb_paged	*mi_paged;	/* most recently used first */
+	ID			mi_paged_txnid;
+		/* last write txn that changed the indexes or the DIT */
+	ldap_pvt_thread_mutex_t	mi_paged_mutex;
+	unsigned	mi_idl_max;
+		/* more than this many IDs in an index key
+		 * collapses it into a range */
 	int			mi_txn_cp;
 	uint32_t	mi_txn_cp_min;
 	uint32_t	mi_txn_cp_kbyte;
 
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	struct re_s		*mi_cluster_task;
+	ID			mi_cluster_txnid;	/* txn that last renumbered */
+	time_t		mi_index_start;
+	ID			mi_index_done;
+		/* when the online index task started and how many
+		 * entries it has indexed since, for the ETA */
 
 	mdb_monitor_t	mi_monitor;
 
+	size_t		mi_ecache_max;
+		/* bytes of decoded entries to cache, 0 disables */
+	mdb_ecache_stripe	mi_ecache[MDB_ECACHE_STRIPES];
+	size_t		mi_ecache_stamps[MDB_ECACHE_STAMPS];
+		/* txnid of the last write to the IDs in each slot */
+
+	unsigned	mi_gc_window;
+		/* microseconds a group commit waits for more
+		 * operations to join, 0 disables */
+	unsigned	mi_gc_maxops;
+	ldap_pvt_thread_mutex_t	mi_gc_mutex;
+	ldap_pvt_thread_cond_t	mi_gc_cond;
+	mdb_group	*mi_gc_open;	/* the group taking new members */
+
+	int			mi_ncols;
+	mdb_column	*mi_cols;
+		/* attributes also stored in column form, the
+		 * entry flags first */
+
 #ifdef MDB_MONITOR_IDX
 	ldap_pvt_thread_mutex_t	mi_idx_mutex;
 	Avlnode		*mi_idx;
@@ -103,6 +216,10 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_DEL_COLUMN	0x40
+#define	MDB_CLUSTER		0x80	/* keep entry IDs in subtree order */
+#define	MDB_PREFIX_KEYS	0x100	/* create range index DBs with MDB_PREFIXKEY */
+#define	MDB_NO_ID2COL	0x200	/* opened read-only without an id2c DB */
 
 	int mi_numads;
 
@@ -122,16 +239,21 @@ struct mdb_info {
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_id2col	mi_dbis[MDB_ID2COL]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
 	MDB_txn*	moi_txn;
 	int			moi_ref;
 	char		moi_flag;
+	int			moi_numads;	/* mi_numads when moi_txn began */
+	mdb_group	*moi_group;
 } mdb_op_info;
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUP	0x08
+#define MOI_CHANGED	0x10	/* the txn changed the indexes or the DIT */
 
 LDAP_END_DECL
 
@@ -145,10 +267,38 @@ typedef struct mdb_attrinfo {
 #endif
 	TAvlnode *ai_root;		/* for tools */
 	MDB_cursor *ai_cursor;	/* for tools */
+	struct mdb_tool_bulk *ai_bulk;	/* for tools */
 	int ai_idx;	/* position in AI array */
 	MDB_dbi ai_dbi;
+	/* online index build, see mdb_online_index() */
+	ID ai_ixnext;	/* next entry ID to index */
+	ID ai_ixlast;	/* last entry ID when the build started */
+	slap_mask_t ai_ixold;	/* mask fully built before the build */
+	size_t ai_ixtxn;	/* txn that completed the build */
 } AttrInfo;
 
+/* Progress of online index builds, stored as an array under key 0
+ * of the ad2id DB so that it is consistent with each reader's snapshot
+ * and survives a restart.
+ */
+typedef struct mdb_ixprog {
+	ID ip_next;
+	ID ip_last;
+	slap_mask_t ip_oldmask;
+	slap_mask_t ip_newmask;
+	ID ip_ad;	/* index into mi_ads */
+} mdb_ixprog;
+
+/* How much of the entry IDs are in subtree order, see cluster.c.
+ * Stored under the MDB_AD2ID_CLUSTER key of the ad2id DB, past
+ * the keys of the attribute descriptions.
+ */
+typedef struct mdb_idcluster {
+	ID ic_high;	/* the IDs up to here are in preorder */
+	ID ic_dels;	/* entries deleted below ic_high since */
+} mdb_idcluster;
+#define MDB_AD2ID_CLUSTER	0x7fffffff
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -0,0 +1,564 @@
+/* cluster.c - entry IDs in subtree order */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+#include "ldap_rq.h"
+
+/*
+ * Entry IDs are handed out in the order the entries are added, so the
+ * entries of a subtree are usually scattered over the whole ID space.
+ * With "clusterids" the entries are renumbered in preorder of the DIT:
+ * each entry gets the next ID before its children do, so every subtree
+ * occupies one contiguous range of IDs, starting at the ID of its root
+ * and as long as the root's subtree count. A subtree search can drop
+ * its candidates outside that range without looking at them, and walks
+ * id2entry sequentially.
+ *
+ * The mdb_idcluster record under MDB_AD2ID_CLUSTER in ad2id tells how
+ * much of that order is left. The IDs up to ic_high are still in
+ * preorder. Entries added later, or moved to another superior, have or
+ * push ic_high below their ID. Deleted entries shrink the subtree counts
+ * of their superiors; ic_dels counts them so that the ranges can still
+ * be widened enough to cover the entries that remain.
+ */
+
+int
+mdb_cluster_get(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	mdb_idcluster *ic )
+{
+	MDB_val key, data;
+	int i = MDB_AD2ID_CLUSTER, rc;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc == 0 ) {
+		if ( data.mv_size != sizeof( *ic ))
+			return MDB_NOTFOUND;
+		memcpy( ic, data.mv_data, sizeof( *ic ));
+	}
+	return rc;
+}
+
+static int
+mdb_cluster_put(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	mdb_idcluster *ic )
+{
+	MDB_val key, data;
+	int i = MDB_AD2ID_CLUSTER, rc;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	if ( ic->ic_high ) {
+		data.mv_size = sizeof( *ic );
+		data.mv_data = ic;
+		rc = mdb_put( txn, mdb->mi_ad2id, &key, &data, 0 );
+	} else {
+		rc = mdb_del( txn, mdb->mi_ad2id, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+	}
+	return rc;
+}
+
+/* Entry id was just placed under a superior, by an Add or a move. With
+ * ndel, its old DN with ndel entries in its subtree was removed instead.
+ */
+int
+mdb_cluster_update(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id,
+	ID ndel )
+{
+	mdb_idcluster ic;
+	int rc;
+
+	if ( !id )
+		return 0;
+
+	rc = mdb_cluster_get( mdb, txn, &ic );
+	if ( rc )
+		return rc == MDB_NOTFOUND ? 0 : rc;
+	if ( id > ic.ic_high )
+		return 0;
+
+	if ( ndel )
+		ic.ic_dels += ndel;
+	else
+		ic.ic_high = id - 1;
+	return mdb_cluster_put( mdb, txn, &ic );
+}
+
+/* Drop the candidates of a search below entry base that are outside
+ * the base's subtree range. nsubs is the base's subtree count.
+ */
+void
+mdb_cluster_scope(
+	Operation *op,
+	MDB_txn *txn,
+	MDB_cursor *mci,
+	ID base,
+	ID nsubs,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_idcluster ic;
+	MDB_val key;
+	ID hi, last = NOID;
+
+	if ( !base || !nsubs || MDB_IDL_IS_ZERO( ids ))
+		return;
+	if ( mdb_cluster_get( mdb, txn, &ic ) || base > ic.ic_high )
+		return;
+
+	hi = base + nsubs - 1 + ic.ic_dels;
+	if ( hi > ic.ic_high || hi < base )
+		hi = ic.ic_high;
+
+	if ( MDB_IDL_IS_RANGE( ids ) && MDB_IDL_RANGE_LAST( ids ) > ic.ic_high &&
+		mdb_cursor_get( mci, &key, NULL, MDB_LAST ) == 0 )
+	{
+		memcpy( &last, key.mv_data, sizeof( last ));
+	}
+
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_cluster_scope)
+		": base %ld range %ld-%ld\n",
+		(long) base, (long) hi, (long) ic.ic_high );
+
+	mdb_idl_clip_scope( ids, base, hi, ic.ic_high, last );
+}
+
+/* Highest ID first, so the oldest child is popped first */
+static int
+mdb_cluster_idcmp( const void *a, const void *b )
+{
+	ID x = *(const ID *)a, y = *(const ID *)b;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* Push the children of id onto the stack. Siblings keep the order
+ * in which they were added, with the oldest child on top.
+ */
+static int
+mdb_cluster_kids(
+	MDB_cursor *mc,
+	ID id,
+	ID *stack,
+	ID *sp,
+	ID max )
+{
+	MDB_val key, data;
+	ID i;
+	int rc;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+	if ( rc )
+		return rc == MDB_NOTFOUND ? 0 : rc;
+
+	/* The first item is the node itself, each child
+	 * carries its ID and subtree count at the end.
+	 */
+	i = *sp;
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP )) == 0 ) {
+		if ( *sp >= max )
+			return MDB_CORRUPTED;
+		memcpy( &stack[(*sp)++], (char *)data.mv_data + data.mv_size
+			- 2*sizeof(ID), sizeof(ID) );
+	}
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+
+	if ( *sp - i > 1 )
+		qsort( stack + i, *sp - i, sizeof(ID), mdb_cluster_idcmp );
+	return 0;
+}
+
+/* Copy the dn2id items of old entry oid to key nid, with the IDs of
+ * the parent and children renumbered.
+ */
+static int
+mdb_cluster_dn2id(
+	MDB_cursor *src,
+	MDB_cursor *dst,
+	ID oid,
+	ID nid,
+	ID *map,
+	struct berval *buf )
+{
+	MDB_val key, data, nkey, ndata;
+	unsigned flag = MDB_APPEND;
+	ID id;
+	int rc, op = MDB_SET;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &oid;
+	nkey.mv_size = sizeof(ID);
+	nkey.mv_data = &nid;
+
+	while (( rc = mdb_cursor_get( src, &key, &data, op )) == 0 ) {
+		if ( data.mv_size > buf->bv_len ) {
+			buf->bv_len = data.mv_size;
+			buf->bv_val = ch_realloc( buf->bv_val, buf->bv_len );
+		}
+		memcpy( buf->bv_val, data.mv_data, data.mv_size );
+		ndata.mv_size = data.mv_size;
+		ndata.mv_data = buf->bv_val;
+
+		/* the node itself ends with the parent's ID, the children
+		 * with their own ID followed by their subtree count. The
+		 * dummy node of the root has no ID.
+		 */
+		if ( op == MDB_SET ) {
+			if ( oid ) {
+				memcpy( &id, buf->bv_val + data.mv_size - sizeof(ID), sizeof(ID) );
+				id = map[id];
+				memcpy( buf->bv_val + data.mv_size - sizeof(ID), &id, sizeof(ID) );
+			}
+		} else {
+			memcpy( &id, buf->bv_val + data.mv_size - 2*sizeof(ID), sizeof(ID) );
+			id = map[id];
+			memcpy( buf->bv_val + data.mv_size - 2*sizeof(ID), &id, sizeof(ID) );
+		}
+
+		rc = mdb_cursor_put( dst, &nkey, &ndata, flag );
+		if ( rc )
+			return rc;
+		flag = MDB_APPENDDUP;
+		op = MDB_NEXT_DUP;
+	}
+	return rc == MDB_NOTFOUND ? 0 : rc;
+}
+
+/* Give all entries new IDs in preorder of the DIT. The databases keyed
+ * by entry ID are emptied and written again in one txn, from a read
+ * snapshot of their old contents. With reindex the attribute indices
+ * are rebuilt along, otherwise they are left empty for the caller.
+ * The number of entries renumbered is returned in *nrenum, zero if
+ * they were still in order.
+ *
+ * Returns LDAP_BUSY if an online index build is in progress, since it
+ * keeps its position by entry ID.
+ */
+int
+mdb_cluster_renumber(
+	Operation *op,
+	int reindex,
+	ID *nrenum )
+{
+	BackendDB *be = op->o_bd;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *txn = NULL, *rtxn = NULL;
+	MDB_cursor *src = NULL, *srcd = NULL, *dst = NULL, *dstd = NULL;
+	MDB_val key, data;
+	MDB_stat ms;
+	mdb_idcluster ic;
+	struct berval buf = BER_BVNULL;
+	ID *map = NULL, *order = NULL, *stack = NULL;
+	ID id, last, nent, n, sp, i, first, oldtxnid;
+	Entry *e;
+	int rc, j, zero = 0;
+
+	if ( nrenum )
+		*nrenum = 0;
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc )
+		goto done;
+	/* Nothing else can commit until we do, the snapshot is
+	 * the same as what txn sees.
+	 */
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &rtxn );
+	if ( rc )
+		goto done;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &zero;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc == 0 ) {
+		/* Tools rebuild all indices anyway */
+		if ( !( slapMode & SLAP_TOOL_MODE )) {
+			rc = LDAP_BUSY;
+			goto done;
+		}
+		rc = mdb_del( txn, mdb->mi_ad2id, &key, NULL );
+	} else if ( rc == MDB_NOTFOUND ) {
+		rc = 0;
+	}
+	if ( rc )
+		goto done;
+	if ( !( slapMode & SLAP_TOOL_MODE )) {
+		for ( j = 0; j < mdb->mi_ncols; j++ ) {
+			if ( mdb->mi_cols[j].mc_next != NOID ) {
+				rc = LDAP_BUSY;
+				goto done;
+			}
+		}
+	}
+
+	rc = mdb_cursor_open( rtxn, mdb->mi_id2entry, &src );
+	if ( rc )
+		goto done;
+	rc = mdb_cursor_open( rtxn, mdb->mi_dn2id, &srcd );
+	if ( rc )
+		goto done;
+
+	key.mv_size = sizeof(ID);
+	rc = mdb_cursor_get( src, &key, NULL, MDB_LAST );
+	if ( rc ) {
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		goto done;
+	}
+	memcpy( &last, key.mv_data, sizeof( last ));
+	mdb_stat( rtxn, mdb->mi_id2entry, &ms );
+	nent = ms.ms_entries;
+
+	if ( mdb_cluster_get( mdb, txn, &ic ) == 0 &&
+		ic.ic_high == last && !ic.ic_dels )
+	{
+		/* still in order */
+		goto done;
+	}
+
+	Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_cluster_renumber)
+		": database %s: renumbering %ld entries\n",
+		be->be_suffix[0].bv_val, (long) nent, 0 );
+
+	/* Walk dn2id from the root, numbering the entries as they are
+	 * visited. map[old ID] is the new ID, order[new ID] the old one.
+	 */
+	map = ch_calloc( last + 1, sizeof(ID) );
+	order = ch_malloc( ( nent + 1 ) * sizeof(ID) );
+	stack = ch_malloc( ( nent + 1 ) * sizeof(ID) );
+	n = 0;
+	sp = 0;
+	rc = mdb_cluster_kids( srcd, 0, stack, &sp, nent );
+	while ( rc == 0 && sp ) {
+		id = stack[--sp];
+		if ( !id || id > last || map[id] || n == nent ) {
+			rc = MDB_CORRUPTED;
+			break;
+		}
+		map[id] = ++n;
+		order[n] = id;
+		rc = mdb_cluster_kids( srcd, id, stack, &sp, nent );
+	}
+	ch_free( stack );
+	stack = NULL;
+
+	/* An empty suffix has its root entry at ID 0 */
+	key.mv_size = sizeof(ID);
+	id = 0;
+	key.mv_data = &id;
+	order[0] = 0;
+	first = mdb_cursor_get( src, &key, &data, MDB_SET ) == 0 ? 0 : 1;
+	if ( rc == 0 && n + 1 - first != nent ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_cluster_renumber)
+			": database %s: %ld of %ld entries are in the DIT\n",
+			be->be_suffix[0].bv_val, (long) n, (long) nent );
+		rc = MDB_CORRUPTED;
+	}
+	if ( rc )
+		goto done;
+
+	rc = mdb_drop( txn, mdb->mi_id2entry, 0 );
+	if ( rc == 0 )
+		rc = mdb_drop( txn, mdb->mi_dn2id, 0 );
+	if ( rc == 0 )
+		rc = mdb_drop( txn, mdb->mi_id2val, 0 );
+	if ( rc == 0 && !( mdb->mi_flags & MDB_NO_ID2COL ))
+		rc = mdb_drop( txn, mdb->mi_id2col, 0 );
+	for ( j = 0; rc == 0 && j < mdb->mi_nattrs; j++ ) {
+		rc = mdb_drop( txn, mdb->mi_attrs[j]->ai_dbi, 0 );
+		mdb->mi_attrs[j]->ai_cursor = NULL;
+	}
+	if ( rc )
+		goto done;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &dst );
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_dn2id, &dstd );
+	if ( rc == 0 )
+		rc = mdb_cluster_dn2id( srcd, dstd, 0, 0, map, &buf );
+	if ( rc )
+		goto done;
+
+	/* Everything is appended */
+	mdb->mi_nextid = 0;
+	for ( i = first; i <= n; i++ ) {
+		id = order[i];
+		if ( i ) {
+			rc = mdb_cluster_dn2id( srcd, dstd, id, i, map, &buf );
+			if ( rc )
+				break;
+		}
+		key.mv_data = &id;
+		rc = mdb_cursor_get( src, &key, &data, MDB_SET );
+		if ( rc )
+			break;
+		if ( !data.mv_size ) {
+			/* stub of a missing parent from slapadd */
+			key.mv_data = &i;
+			rc = mdb_cursor_put( dst, &key, &data, MDB_APPEND );
+			if ( rc )
+				break;
+			continue;
+		}
+		rc = mdb_entry_decode( op, rtxn, &data, id, &e );
+		if ( rc )
+			break;
+		e->e_id = i;
+		e->e_name.bv_val = NULL;
+		e->e_nname.bv_val = NULL;
+		rc = mdb_id2entry_add( op, txn, dst, e );
+		if ( rc == 0 && reindex )
+			rc = mdb_index_entry_add( op, txn, e );
+		mdb_entry_return( op, e );
+		if ( rc )
+			break;
+	}
+	if ( rc )
+		goto done;
+
+	if ( mdb->mi_ncols ) {
+		rc = mdb_column_complete( mdb, txn );
+		if ( rc )
+			goto done;
+	}
+
+	ic.ic_high = n;
+	ic.ic_dels = 0;
+	rc = mdb_cluster_put( mdb, txn, &ic );
+	if ( rc )
+		goto done;
+
+	/* Cached entries were decoded under their old IDs */
+	mdb_ecache_stamp_all( mdb, txn );
+
+	mdb_cursor_close( src );
+	mdb_cursor_close( srcd );
+	src = srcd = NULL;
+	mdb_txn_abort( rtxn );
+	rtxn = NULL;
+	/* searches that renew their read txn must not continue */
+	oldtxnid = mdb->mi_cluster_txnid;
+	mdb->mi_cluster_txnid = mdb_txn_id( txn );
+	mdb_paged_changed( mdb, mdb_txn_id( txn ));
+	rc = mdb_txn_commit( txn );
+	txn = NULL;
+	if ( rc )
+		mdb->mi_cluster_txnid = oldtxnid;
+	if ( rc == 0 ) {
+		mdb_ecache_flush( mdb, 0 );
+		if ( nrenum )
+			*nrenum = n;
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_cluster_renumber)
+			": database %s: renumbered\n",
+			be->be_suffix[0].bv_val, 0, 0 );
+	}
+
+done:
+	if ( src )
+		mdb_cursor_close( src );
+	if ( srcd )
+		mdb_cursor_close( srcd );
+	if ( rtxn )
+		mdb_txn_abort( rtxn );
+	if ( txn )
+		mdb_txn_abort( txn );
+	for ( j = 0; j < mdb->mi_nattrs; j++ )
+		mdb->mi_attrs[j]->ai_cursor = NULL;
+	mdb->mi_nextid = 0;
+	ch_free( buf.bv_val );
+	ch_free( stack );
+	ch_free( order );
+	ch_free( map );
+	if ( rc && rc != LDAP_BUSY ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_cluster_renumber)
+			": database %s: failed: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
+/* renumber the entries of a running server */
+static void *
+mdb_cluster_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = be->be_private;
+
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	int rc = LDAP_BUSY;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	op->o_bd = be;
+
+	if ( !( mdb->mi_flags & MDB_CLUSTER ))
+		rc = 0;
+	else if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+		!mdb->mi_index_task && !slapd_shutdown )
+		rc = mdb_cluster_renumber( op, 1, NULL );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	if ( rc == LDAP_BUSY && !slapd_shutdown ) {
+		/* try again after the index builds */
+		ldap_pvt_runqueue_resched( &slapd_rq, rtask, 0 );
+	} else {
+		mdb->mi_cluster_task = NULL;
+		ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/* Schedule the renumbering unless it is already pending */
+int
+mdb_cluster_start( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+
+	if ( mdb->mi_cluster_task )
+		return 0;
+	if ( be->be_suffix == NULL || BER_BVISNULL( &be->be_suffix[0] ) )
+		return 1;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	mdb->mi_cluster_task = ldap_pvt_runqueue_insert( &slapd_rq, 60,
+		mdb_cluster_task, be,
+		LDAP_XSTRING(mdb_cluster_task), be->be_suffix[0].bv_val );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return 0;
+}
@@ -0,0 +1,789 @@
+/* column.c - attribute values kept in column form */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/*
+ * A search whose filter cannot be resolved by the indexes decodes
+ * every candidate entry just to test a few of its attributes. For the
+ * attributes configured with "column", the id2c DB keeps a copy of
+ * each entry's values keyed by attribute first and entry ID second,
+ * so that the values of one attribute for consecutive entries sit
+ * next to each other in a few pages.
+ *
+ * The key is the 2 byte attribute index followed by the entry ID,
+ * both big-endian so that the default key order groups the rows by
+ * attribute and then by ID. A row holds the values of all of the
+ * entry's attributes that are subtypes of the column's attribute:
+ *
+ *	numvals [| MDB_COL_NVALS]
+ *	length of each value [, length of each normalized value]
+ *	each value NUL [, each normalized value NUL]
+ *
+ * The row is absent if the entry has no such values. Attribute index 0
+ * holds the entry's e_ocflags as an unsigned int for every entry.
+ *
+ * Under ID 0 each column records the next entry ID that still has to
+ * be written by the online indexer, or NOID once the column holds
+ * every entry. A search only uses the columns that are complete in
+ * its own snapshot.
+ *
+ * The columns only serve as a prefilter: a candidate whose partial
+ * entry fails the search filter is skipped without touching id2entry,
+ * any other candidate goes through the usual full decode and filter
+ * test, so access control and the returned entries are unaffected.
+ */
+
+#define MDB_COL_NVALS	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
+#define MDB_COL_KSIZE	(2+sizeof(ID))
+
+/* State of a search using the columns. Slot 0 of the cursors is
+ * the entry flags, the others follow cs_ad.
+ */
+struct mdb_colscan {
+	Operation cs_op;	/* root identity, so ACLs don't apply */
+	BackendDB cs_be;
+	int cs_nf;
+	Filter *cs_f[MDB_COLSCAN_MAX];	/* the parts of the filter to test */
+	int cs_n;
+	AttributeDescription *cs_ad[MDB_COLSCAN_MAX];
+	unsigned short cs_adx[MDB_COLSCAN_MAX+1];
+	MDB_cursor *cs_mc[MDB_COLSCAN_MAX+1];
+	char cs_pos[MDB_COLSCAN_MAX+1];	/* cursor is on a row */
+	ID cs_lastid;
+};
+
+static struct berval mdb_col_rootdn = BER_BVC("cn=column scan");
+
+static void
+mdb_column_key( unsigned char *buf, unsigned short adx, ID id )
+{
+	int i;
+
+	buf[0] = adx >> 8;
+	buf[1] = adx & 0xff;
+	for ( i = MDB_COL_KSIZE-1; i > 1; i-- ) {
+		buf[i] = id & 0xff;
+		id >>= 8;
+	}
+}
+
+static unsigned short
+mdb_column_adx( struct mdb_info *mdb, mdb_column *mc )
+{
+	return mc->mc_ad ? mdb->mi_adxs[mc->mc_ad->ad_index] : 0;
+}
+
+static int
+mdb_column_row_put( struct mdb_info *mdb, MDB_txn *txn, MDB_val *key,
+	Entry *e, AttributeDescription *ad )
+{
+	Attribute *a;
+	MDB_val data;
+	unsigned int n = 0, nflag = 0, l, i;
+	unsigned char *ptr, *lp;
+	int rc;
+
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		if ( !is_ad_subtype( a->a_desc, ad ))
+			continue;
+		n += a->a_numvals;
+		if ( a->a_nvals != a->a_vals )
+			nflag = MDB_COL_NVALS;
+	}
+	if ( !n ) {
+		rc = mdb_del( txn, mdb->mi_id2col, key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		return rc;
+	}
+
+	data.mv_size = ( nflag ? 2*n+1 : n+1 ) * sizeof(unsigned int);
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		if ( !is_ad_subtype( a->a_desc, ad ))
+			continue;
+		for ( i = 0; i < a->a_numvals; i++ ) {
+			data.mv_size += a->a_vals[i].bv_len + 1;
+			if ( nflag )
+				data.mv_size += a->a_nvals[i].bv_len + 1;
+		}
+	}
+	rc = mdb_put( txn, mdb->mi_id2col, key, &data, MDB_RESERVE );
+	if ( rc )
+		return rc;
+
+	/* The row is not necessarily aligned */
+	lp = data.mv_data;
+	l = n | nflag;
+	memcpy( lp, &l, sizeof(l) );
+	lp += sizeof(l);
+	ptr = lp + ( nflag ? 2*n : n ) * sizeof(unsigned int);
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		if ( !is_ad_subtype( a->a_desc, ad ))
+			continue;
+		for ( i = 0; i < a->a_numvals; i++ ) {
+			l = a->a_vals[i].bv_len;
+			memcpy( lp, &l, sizeof(l) );
+			lp += sizeof(l);
+			memcpy( ptr, a->a_vals[i].bv_val, l );
+			ptr += l;
+			*ptr++ = '\0';
+		}
+	}
+	if ( nflag ) {
+		for ( a = e->e_attrs; a; a = a->a_next ) {
+			if ( !is_ad_subtype( a->a_desc, ad ))
+				continue;
+			for ( i = 0; i < a->a_numvals; i++ ) {
+				l = a->a_nvals[i].bv_len;
+				memcpy( lp, &l, sizeof(l) );
+				lp += sizeof(l);
+				memcpy( ptr, a->a_nvals[i].bv_val, l );
+				ptr += l;
+				*ptr++ = '\0';
+			}
+		}
+	}
+	return 0;
+}
+
+/* Write the rows of an entry. Its e_ocflags must be valid, as they
+ * are after mdb_entry_encode() or mdb_entry_decode().
+ */
+int
+mdb_column_put( Operation *op, MDB_txn *txn, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key, data;
+	unsigned int flags;
+	int i, rc;
+
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+
+	flags = e->e_ocflags;
+	data.mv_data = &flags;
+	data.mv_size = sizeof(flags);
+	mdb_column_key( kbuf, 0, e->e_id );
+	rc = mdb_put( txn, mdb->mi_id2col, &key, &data, 0 );
+
+	for ( i = 1; rc == 0 && i < mdb->mi_ncols; i++ ) {
+		AttributeDescription *ad = mdb->mi_cols[i].mc_ad;
+
+		rc = mdb_ad_get( mdb, txn, ad );
+		if ( rc )
+			break;
+		mdb_column_key( kbuf, mdb->mi_adxs[ad->ad_index], e->e_id );
+		rc = mdb_column_row_put( mdb, txn, &key, e, ad );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_column_put: failed: %s(%d) \"%s\"\n",
+			mdb_strerror(rc), rc, e->e_nname.bv_val );
+	}
+	return rc;
+}
+
+int
+mdb_column_delete( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key;
+	unsigned short adx;
+	int i, rc = 0;
+
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		adx = mdb_column_adx( mdb, &mdb->mi_cols[i] );
+		if ( i && !adx )
+			continue;
+		mdb_column_key( kbuf, adx, id );
+		rc = mdb_del( txn, mdb->mi_id2col, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		if ( rc )
+			break;
+	}
+	return rc;
+}
+
+/* Configure a column. The entry flags column comes along with the
+ * first one.
+ */
+int
+mdb_column_add( struct mdb_info *mdb, AttributeDescription *ad )
+{
+	int i, n;
+
+	for ( i = 1; i < mdb->mi_ncols; i++ ) {
+		if ( mdb->mi_cols[i].mc_ad == ad )
+			return LDAP_TYPE_OR_VALUE_EXISTS;
+	}
+	n = mdb->mi_ncols ? mdb->mi_ncols : 1;
+	mdb->mi_cols = ch_realloc( mdb->mi_cols, ( n+1 ) * sizeof(mdb_column) );
+	if ( !mdb->mi_ncols ) {
+		mdb->mi_cols[0].mc_ad = NULL;
+		mdb->mi_cols[0].mc_next = 1;
+		mdb->mi_cols[0].mc_last = 0;
+	}
+	mdb->mi_cols[n].mc_ad = ad;
+	mdb->mi_cols[n].mc_next = 1;
+	mdb->mi_cols[n].mc_last = 0;
+	mdb->mi_ncols = n+1;
+	return 0;
+}
+
+/* Forget the i'th configured column, or all of them if i is -1 */
+void
+mdb_column_del( struct mdb_info *mdb, int i )
+{
+	if ( i >= 0 && mdb->mi_ncols > 2 ) {
+		for ( i++; i < mdb->mi_ncols-1; i++ )
+			mdb->mi_cols[i] = mdb->mi_cols[i+1];
+		mdb->mi_ncols--;
+	} else {
+		ch_free( mdb->mi_cols );
+		mdb->mi_cols = NULL;
+		mdb->mi_ncols = 0;
+	}
+}
+
+void
+mdb_column_unparse( struct mdb_info *mdb, BerVarray *bva )
+{
+	int i;
+
+	for ( i = 1; i < mdb->mi_ncols; i++ )
+		value_add_one( bva, &mdb->mi_cols[i].mc_ad->ad_cname );
+}
+
+static int
+mdb_column_configured( struct mdb_info *mdb, unsigned short adx )
+{
+	int i;
+
+	if ( !mdb->mi_ncols )
+		return 0;
+	if ( !adx )
+		return 1;
+	for ( i = 1; i < mdb->mi_ncols; i++ ) {
+		if ( mdb_column_adx( mdb, &mdb->mi_cols[i] ) == adx )
+			return 1;
+	}
+	return 0;
+}
+
+/* Drop the rows of columns that are no longer configured */
+int
+mdb_column_sweep( struct mdb_info *mdb, MDB_txn *txn )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_cursor *mc;
+	MDB_val key, data;
+	unsigned short adx;
+	unsigned char *ptr;
+	int rc;
+
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2col, &mc );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST );
+	while ( rc == 0 ) {
+		ptr = key.mv_data;
+		adx = ptr[0] << 8 | ptr[1];
+		if ( mdb_column_configured( mdb, adx )) {
+			if ( adx == 0xffff )
+				break;
+			mdb_column_key( kbuf, adx+1, 0 );
+			key.mv_data = kbuf;
+			key.mv_size = sizeof(kbuf);
+			rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+		} else {
+			rc = mdb_cursor_del( mc, 0 );
+			if ( rc == 0 )
+				rc = mdb_cursor_get( mc, &key, &data, MDB_GET_CURRENT );
+		}
+	}
+	mdb_cursor_close( mc );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/* Read the build progress of the configured columns at db_open. The
+ * columns of an empty database are complete right away. Returns the
+ * number of columns that still need to be built.
+ */
+int
+mdb_column_load( struct mdb_info *mdb, MDB_txn *txn, int *pending )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key, data;
+	MDB_stat st;
+	ID next;
+	int i, rc;
+
+	*pending = 0;
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+	for ( i = 1; i < mdb->mi_ncols; i++ ) {
+		rc = mdb_ad_get( mdb, txn, mdb->mi_cols[i].mc_ad );
+		if ( rc )
+			return rc;
+	}
+	rc = mdb_column_sweep( mdb, txn );
+	if ( rc || !mdb->mi_ncols )
+		return rc;
+
+	rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+	if ( rc )
+		return rc;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		mdb_column *mc = &mdb->mi_cols[i];
+
+		mdb_column_key( kbuf, mdb_column_adx( mdb, mc ), 0 );
+		rc = mdb_get( txn, mdb->mi_id2col, &key, &data );
+		if ( rc == 0 ) {
+			memcpy( &next, data.mv_data, sizeof(next) );
+		} else if ( rc == MDB_NOTFOUND ) {
+			next = 1;
+			if ( !st.ms_entries ) {
+				next = NOID;
+				data.mv_data = &next;
+				data.mv_size = sizeof(next);
+				rc = mdb_put( txn, mdb->mi_id2col, &key, &data, 0 );
+				if ( rc )
+					return rc;
+			}
+		} else {
+			return rc;
+		}
+		mc->mc_next = next;
+		mc->mc_last = 0;
+		if ( next != NOID )
+			(*pending)++;
+	}
+	return 0;
+}
+
+/* Online indexer: start the builds of new columns and find the range
+ * of entry IDs that still needs work, like the index builds do.
+ */
+void
+mdb_column_pending( struct mdb_info *mdb, ID last, ID *idp, ID *nextp )
+{
+	int i;
+
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		mdb_column *mc = &mdb->mi_cols[i];
+
+		if ( mc->mc_next == NOID )
+			continue;
+		if ( !mc->mc_last )
+			mc->mc_last = last ? last : 1;
+		if ( mc->mc_next <= mc->mc_last ) {
+			if ( mc->mc_next < *idp )
+				*idp = mc->mc_next;
+			if ( mc->mc_last >= *nextp )
+				*nextp = mc->mc_last + 1;
+		}
+	}
+}
+
+/* The entries below next have all been written */
+static ID
+mdb_column_next( mdb_column *mc, ID next )
+{
+	if ( next < mc->mc_next )
+		next = mc->mc_next;
+	return next > mc->mc_last ? NOID : next;
+}
+
+int
+mdb_column_progress_save( struct mdb_info *mdb, MDB_txn *txn, ID next )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key, data;
+	ID n;
+	int i, rc = 0;
+
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	data.mv_data = &n;
+	data.mv_size = sizeof(n);
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		mdb_column *mc = &mdb->mi_cols[i];
+
+		if ( mc->mc_next == NOID || !mc->mc_last )
+			continue;
+		if ( mc->mc_ad ) {
+			rc = mdb_ad_get( mdb, txn, mc->mc_ad );
+			if ( rc )
+				break;
+		}
+		n = mdb_column_next( mc, next );
+		mdb_column_key( kbuf, mdb_column_adx( mdb, mc ), 0 );
+		rc = mdb_put( txn, mdb->mi_id2col, &key, &data, 0 );
+		if ( rc )
+			break;
+	}
+	return rc;
+}
+
+void
+mdb_column_progress_done( struct mdb_info *mdb, ID next )
+{
+	int i;
+
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		mdb_column *mc = &mdb->mi_cols[i];
+
+		if ( mc->mc_next != NOID && mc->mc_last )
+			mc->mc_next = mdb_column_next( mc, next );
+	}
+}
+
+/* slapindex rewrote the rows of every entry */
+int
+mdb_column_complete( struct mdb_info *mdb, MDB_txn *txn )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key, data;
+	ID n = NOID;
+	int i, rc = 0;
+
+	if ( mdb->mi_flags & MDB_NO_ID2COL )
+		return 0;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	data.mv_data = &n;
+	data.mv_size = sizeof(n);
+	for ( i = 0; i < mdb->mi_ncols; i++ ) {
+		mdb_column *mc = &mdb->mi_cols[i];
+
+		if ( mc->mc_ad ) {
+			rc = mdb_ad_get( mdb, txn, mc->mc_ad );
+			if ( rc )
+				break;
+		}
+		mdb_column_key( kbuf, mdb_column_adx( mdb, mc ), 0 );
+		rc = mdb_put( txn, mdb->mi_id2col, &key, &data, 0 );
+		if ( rc )
+			break;
+		mc->mc_next = NOID;
+	}
+	return rc;
+}
+
+static int
+mdb_column_filter( struct mdb_info *mdb, Filter *f, mdb_colscan *cs )
+{
+	AttributeDescription *ad;
+	int i;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( mdb_column_filter( mdb, f, cs ))
+				return -1;
+		}
+		return 0;
+
+	case LDAP_FILTER_NOT:
+		return mdb_column_filter( mdb, f->f_not, cs );
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+
+	case LDAP_FILTER_EXT:
+		if ( f->f_mr_dnattrs || !f->f_mr_desc )
+			return -1;
+		ad = f->f_mr_desc;
+		break;
+
+	default:
+		return -1;
+	}
+
+	for ( i = 0; i < cs->cs_n; i++ ) {
+		if ( cs->cs_ad[i] == ad )
+			return 0;
+	}
+	if ( cs->cs_n == MDB_COLSCAN_MAX )
+		return -1;
+	for ( i = 1; i < mdb->mi_ncols; i++ ) {
+		if ( mdb->mi_cols[i].mc_ad == ad )
+			break;
+	}
+	if ( i == mdb->mi_ncols )
+		return -1;
+	cs->cs_ad[cs->cs_n++] = ad;
+	return 0;
+}
+
+static int
+mdb_column_ready( struct mdb_info *mdb, MDB_txn *txn, unsigned short adx )
+{
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val key, data;
+	ID next;
+
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	mdb_column_key( kbuf, adx, 0 );
+	if ( mdb_get( txn, mdb->mi_id2col, &key, &data ))
+		return 0;
+	memcpy( &next, data.mv_data, sizeof(next) );
+	return next == NOID;
+}
+
+/* Set up a column scan for the search filter, if every attribute it
+ * tests has a complete column in this txn's snapshot.
+ */
+mdb_colscan *
+mdb_column_scan_init( Operation *op, MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_colscan *cs;
+	int i;
+
+	if ( !mdb->mi_ncols || ( mdb->mi_flags & MDB_NO_ID2COL ))
+		return NULL;
+
+	/* Of an AND, test the terms that the columns can resolve. Any
+	 * entry that matches the whole filter also matches those.
+	 */
+	cs = op->o_tmpcalloc( 1, sizeof(mdb_colscan), op->o_tmpmemctx );
+	if (( op->ors_filter->f_choice & SLAPD_FILTER_MASK ) == LDAP_FILTER_AND ) {
+		Filter *f;
+		for ( f = op->ors_filter->f_and; f; f = f->f_next ) {
+			int n = cs->cs_n;
+			if ( cs->cs_nf < MDB_COLSCAN_MAX &&
+				!mdb_column_filter( mdb, f, cs ))
+				cs->cs_f[cs->cs_nf++] = f;
+			else
+				cs->cs_n = n;
+		}
+	} else if ( !mdb_column_filter( mdb, op->ors_filter, cs )) {
+		cs->cs_f[cs->cs_nf++] = op->ors_filter;
+	}
+	if ( !cs->cs_n )
+		goto fail;
+
+	for ( i = 0; i <= cs->cs_n; i++ ) {
+		if ( i )
+			cs->cs_adx[i] = mdb->mi_adxs[cs->cs_ad[i-1]->ad_index];
+		if (( i && !cs->cs_adx[i] ) ||
+			!mdb_column_ready( mdb, txn, cs->cs_adx[i] ) ||
+			mdb_cursor_open( txn, mdb->mi_id2col, &cs->cs_mc[i] ))
+			goto fail;
+	}
+
+	cs->cs_be = *op->o_bd;
+	cs->cs_be.be_rootdn = mdb_col_rootdn;
+	cs->cs_be.be_rootndn = mdb_col_rootdn;
+	cs->cs_op = *op;
+	cs->cs_op.o_bd = &cs->cs_be;
+	cs->cs_op.o_dn = mdb_col_rootdn;
+	cs->cs_op.o_ndn = mdb_col_rootdn;
+	return cs;
+
+fail:
+	mdb_column_scan_free( op, cs );
+	return NULL;
+}
+
+void
+mdb_column_scan_free( Operation *op, mdb_colscan *cs )
+{
+	int i;
+
+	for ( i = 0; i <= cs->cs_n; i++ ) {
+		if ( cs->cs_mc[i] )
+			mdb_cursor_close( cs->cs_mc[i] );
+	}
+	op->o_tmpfree( cs, op->o_tmpmemctx );
+}
+
+/* The search renewed its read txn */
+void
+mdb_column_scan_renew( mdb_colscan *cs, MDB_txn *txn )
+{
+	int i;
+
+	for ( i = 0; i <= cs->cs_n; i++ ) {
+		mdb_cursor_renew( txn, cs->cs_mc[i] );
+		cs->cs_pos[i] = 0;
+	}
+}
+
+/* Fetch the row of column i for the key. The cursor is left on the
+ * first row at or after the key, so that the rows of ascending IDs are
+ * usually found by stepping forward instead of searching the tree.
+ */
+static int
+mdb_column_seek( mdb_colscan *cs, int i, unsigned char *kbuf, MDB_val *data )
+{
+	MDB_cursor *mc = cs->cs_mc[i];
+	MDB_val key;
+	int rc, cmp;
+
+	if ( cs->cs_pos[i] ) {
+		rc = mdb_cursor_get( mc, &key, data, MDB_GET_CURRENT );
+		if ( rc == 0 ) {
+			cmp = memcmp( key.mv_data, kbuf, MDB_COL_KSIZE );
+			if ( cmp < 0 ) {
+				rc = mdb_cursor_get( mc, &key, data, MDB_NEXT );
+				if ( rc == 0 )
+					cmp = memcmp( key.mv_data, kbuf, MDB_COL_KSIZE );
+			}
+			if ( rc == 0 && cmp >= 0 )
+				return cmp ? MDB_NOTFOUND : 0;
+		}
+	}
+	key.mv_data = kbuf;
+	key.mv_size = MDB_COL_KSIZE;
+	rc = mdb_cursor_get( mc, &key, data, MDB_SET_RANGE );
+	cs->cs_pos[i] = ( rc == 0 );
+	if ( rc == 0 && memcmp( key.mv_data, kbuf, MDB_COL_KSIZE ))
+		rc = MDB_NOTFOUND;
+	return rc;
+}
+
+/* Returns 0 if entry id can't match the filter, 1 if it may */
+int
+mdb_column_scan_test( mdb_colscan *cs, ID id )
+{
+	Operation *op = &cs->cs_op;
+	unsigned char kbuf[MDB_COL_KSIZE];
+	MDB_val data;
+	Attribute attrs[MDB_COLSCAN_MAX], **ap;
+	Entry ce;
+	unsigned int n, l, flags;
+	unsigned char *lp, *ptr;
+	struct berval *bv;
+	int i, j, nv, rc;
+
+	/* the cursors only step forward */
+	if ( id < cs->cs_lastid ) {
+		for ( i = 0; i <= cs->cs_n; i++ )
+			cs->cs_pos[i] = 0;
+	}
+	cs->cs_lastid = id;
+
+	mdb_column_key( kbuf, 0, id );
+	if ( mdb_column_seek( cs, 0, kbuf, &data ))
+		return 1;
+	memcpy( &flags, data.mv_data, sizeof(flags) );
+	/* these are handled before the filter is tested */
+	if ( flags & ( SLAP_OC_REFERRAL|SLAP_OC_ALIAS ))
+		return 1;
+
+	memset( &ce, 0, sizeof(ce) );
+	ce.e_id = id;
+	ce.e_name = slap_empty_bv;
+	ce.e_nname = slap_empty_bv;
+	ce.e_ocflags = flags;
+	ap = &ce.e_attrs;
+
+	for ( i = 0; i < cs->cs_n; i++ ) {
+		mdb_column_key( kbuf, cs->cs_adx[i+1], id );
+		rc = mdb_column_seek( cs, i+1, kbuf, &data );
+		if ( rc == MDB_NOTFOUND )
+			continue;
+		if ( rc ) {
+			rc = 1;
+			goto done;
+		}
+		lp = data.mv_data;
+		memcpy( &n, lp, sizeof(n) );
+		lp += sizeof(n);
+		nv = ( n & MDB_COL_NVALS ) ? 2 : 1;
+		n &= ~MDB_COL_NVALS;
+		bv = op->o_tmpalloc( nv * ( n+1 ) * sizeof(struct berval),
+			op->o_tmpmemctx );
+		ptr = lp + nv * n * sizeof(unsigned int);
+
+		memset( &attrs[i], 0, sizeof(Attribute) );
+		attrs[i].a_desc = cs->cs_ad[i];
+		attrs[i].a_numvals = n;
+		attrs[i].a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		attrs[i].a_vals = bv;
+		attrs[i].a_nvals = bv + ( nv - 1 ) * ( n+1 );
+		for ( j = 0; j < nv * n; j++ ) {
+			memcpy( &l, lp, sizeof(l) );
+			lp += sizeof(l);
+			bv->bv_len = l;
+			bv->bv_val = (char *)ptr;
+			ptr += l + 1;
+			bv++;
+			if ( j % n == n-1 ) {
+				BER_BVZERO( bv );
+				bv++;
+			}
+		}
+		*ap = &attrs[i];
+		ap = &attrs[i].a_next;
+	}
+
+	rc = 1;
+	for ( i = 0; rc && i < cs->cs_nf; i++ )
+		rc = test_filter( op, &ce, cs->cs_f[i] ) == LDAP_COMPARE_TRUE;
+
+done:
+	for ( ap = &ce.e_attrs; *ap; ap = &(*ap)->a_next )
+		op->o_tmpfree( (*ap)->a_vals, op->o_tmpmemctx );
+	return rc;
+}
@@ -0,0 +1,214 @@
+/* commit.c - commit of write operations, optionally grouped */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+
+/*
+ * Normally every write operation runs in its own top-level txn and
+ * pays for its own sync. With groupcommit configured, operations that
+ * arrive close together share one top-level txn instead, and each runs
+ * in a child txn of it so that it can still fail or be aborted on its
+ * own. LMDB allows a txn only one child at a time, so the members take
+ * turns.
+ *
+ * The first operation to find no open group becomes its leader and
+ * begins the shared txn. LMDB ties the writer lock to the thread that
+ * took it, so the leader is also the one to commit: after its own child
+ * it waits out the window for others to join, waits for the members to
+ * end their children, and commits them all with a single sync. Members
+ * wait for that commit before returning, so no result is sent for a
+ * change that is not yet on disk. Operations arriving while the shared
+ * txn commits start the next group.
+ */
+
+struct mdb_group {
+	MDB_txn		*g_txn;		/* the shared top-level txn */
+	mdb_op_info	*g_leader;
+	int		g_nops;		/* operations that joined */
+	int		g_pending;	/* members that have not ended their child */
+	int		g_refs;		/* members that have not returned */
+	int		g_busy;		/* a member's child txn is active */
+	int		g_done;		/* g_rc is final */
+	int		g_rc;
+	int		g_numads;	/* mi_numads when the shared txn began */
+};
+
+/* Called with mi_gc_mutex held */
+static void
+mdb_group_leave( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_group *g = moi->moi_group;
+
+	moi->moi_group = NULL;
+	moi->moi_flag &= ~MOI_GROUP;
+	if ( --g->g_refs == 0 )
+		ch_free( g );
+}
+
+/* End an operation's part in its group. rc is zero if its child
+ * committed into the shared txn, and the result of the shared commit
+ * is returned then. Otherwise the operation does not wait for it.
+ */
+static int
+mdb_group_end( struct mdb_info *mdb, mdb_op_info *moi, int rc )
+{
+	mdb_group *g = moi->moi_group;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	g->g_busy = 0;
+	g->g_pending--;
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+
+	if ( g->g_leader == moi ) {
+		if ( mdb->mi_gc_open == g ) {
+			struct timeval tv;
+
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+			tv.tv_sec = mdb->mi_gc_window / 1000000;
+			tv.tv_usec = mdb->mi_gc_window % 1000000;
+			select( 0, NULL, NULL, NULL, &tv );
+			ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+			if ( mdb->mi_gc_open == g )
+				mdb->mi_gc_open = NULL;
+		}
+		while ( g->g_pending )
+			ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+
+		/* Keep the mutex, so the next group can't begin and
+		 * register attributes before we know if ours were kept.
+		 */
+		g->g_rc = mdb_txn_commit( g->g_txn );
+		g->g_txn = NULL;
+		if ( g->g_rc ) {
+			mdb->mi_numads = g->g_numads;
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_group_end) ": commit of %d operations "
+				"failed: %s (%d)\n",
+				g->g_nops, mdb_strerror(g->g_rc), g->g_rc );
+		}
+		g->g_done = 1;
+		ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+	} else if ( rc == 0 ) {
+		while ( !g->g_done )
+			ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+	}
+	if ( rc == 0 )
+		rc = g->g_rc;
+	mdb_group_leave( mdb, moi );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+
+	return rc;
+}
+
+/* Join the open group, or start one, and begin a child txn in it */
+int
+mdb_group_join( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_group *g;
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+	g = mdb->mi_gc_open;
+	if ( !g ) {
+		g = ch_calloc( 1, sizeof( mdb_group ));
+		g->g_leader = moi;
+		g->g_busy = 1;
+		mdb->mi_gc_open = g;
+	}
+	g->g_nops++;
+	g->g_pending++;
+	g->g_refs++;
+	if ( mdb->mi_gc_maxops && g->g_nops >= mdb->mi_gc_maxops )
+		mdb->mi_gc_open = NULL;
+	moi->moi_group = g;
+	moi->moi_flag |= MOI_GROUP;
+
+	if ( g->g_leader == moi ) {
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &g->g_txn );
+		ldap_pvt_thread_mutex_lock( &mdb->mi_gc_mutex );
+		if ( rc ) {
+			/* Fail everyone who joined meanwhile */
+			if ( mdb->mi_gc_open == g )
+				mdb->mi_gc_open = NULL;
+			g->g_txn = NULL;
+			g->g_rc = rc;
+			g->g_done = 1;
+			g->g_busy = 0;
+			g->g_pending--;
+			ldap_pvt_thread_cond_broadcast( &mdb->mi_gc_cond );
+			goto leave;
+		}
+		g->g_numads = mdb->mi_numads;
+	} else {
+		while ( g->g_busy && !g->g_done )
+			ldap_pvt_thread_cond_wait( &mdb->mi_gc_cond, &mdb->mi_gc_mutex );
+		if ( g->g_done ) {
+			rc = g->g_rc;
+			g->g_pending--;
+			goto leave;
+		}
+		g->g_busy = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, g->g_txn, 0, &moi->moi_txn );
+	if ( rc ) {
+		moi->moi_txn = NULL;
+		mdb_group_end( mdb, moi, rc );
+		return rc;
+	}
+	moi->moi_numads = mdb->mi_numads;
+	return 0;
+
+leave:
+	mdb_group_leave( mdb, moi );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_gc_mutex );
+	return rc;
+}
+
+/* Commit the txn of an operation that began it in mdb_opinfo_get.
+ * With a group, this returns once the group's txn is committed.
+ */
+int
+mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn )
+{
+	int rc;
+
+	if ( moi->moi_flag & MOI_CHANGED )
+		mdb_paged_changed( mdb, mdb_txn_id( txn ));
+	rc = mdb_txn_commit( txn );
+	if ( rc )
+		mdb->mi_numads = moi->moi_numads;
+	if ( moi->moi_flag & MOI_GROUP )
+		rc = mdb_group_end( mdb, moi, rc );
+	return rc;
+}
+
+void
+mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn )
+{
+	mdb->mi_numads = moi->moi_numads;
+	mdb_txn_abort( txn );
+	if ( moi->moi_flag & MOI_GROUP )
+		mdb_group_end( mdb, moi, -1 );
+}
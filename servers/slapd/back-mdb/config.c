@@ -20,8 +20,11 @@
 #include <ac/ctype.h>
 #include <ac/string.h>
 #include <ac/errno.h>
+#include <ac/socket.h>
+#include <ac/time.h>
 
 #include "back-mdb.h"
+#include "idl.h"
 
 #include "config.h"
 
@@ -32,13 +35,20 @@ static ConfigDriver mdb_cf_gen;
 
 enum {
 	MDB_CHKPT = 1,
+	MDB_CLUSTERIDS,
+	MDB_COLUMN,
 	MDB_DIRECTORY,
 	MDB_DBNOSYNC,
+	MDB_ECACHESIZE,
 	MDB_ENVFLAGS,
+	MDB_GCOMMIT,
+	MDB_IDLMAX,
 	MDB_INDEX,
+	MDB_MAPGROWTH,
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
+	MDB_PREFIXKEYS,
 	MDB_SSTACK,
 };
 
@@ -52,20 +62,45 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.2 NAME 'olcDbCheckpoint' "
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "clusterids", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_CLUSTERIDS,
+		mdb_cf_gen, "( OLcfgDbAt:12.13 NAME 'olcDbClusterIDs' "
+		"DESC 'Renumber entries so that each subtree has contiguous IDs' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "column", "attr", 2, 2, 0, ARG_MAGIC|MDB_COLUMN,
+		mdb_cf_gen, "( OLcfgDbAt:12.12 NAME 'olcDbColumn' "
+		"DESC 'Attribute to also store in column form for unindexed searches' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycachesize", "size", 2, 2, 0, ARG_ULONG|ARG_MAGIC|MDB_ECACHESIZE,
+		mdb_cf_gen, "( OLcfgDbAt:12.9 NAME 'olcDbEntryCacheSize' "
+		"DESC 'Bytes of decoded entries to cache' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "usec> <maxops", 2, 3, 0, ARG_MAGIC|MDB_GCOMMIT,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbGroupCommit' "
+		"DESC 'Microseconds to gather write operations into one commit, and most operations per commit' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "idlmax", "num", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_IDLMAX,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbIDLMax' "
+		"DESC 'Number of IDs stored per index key before it becomes a range' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "mapgrowth", "increment> <ceiling", 3, 3, 0, ARG_MAGIC|MDB_MAPGROWTH,
+		mdb_cf_gen, "( OLcfgDbAt:12.11 NAME 'olcDbMapGrowth' "
+		"DESC 'Bytes to grow the DB map by when full, and size it may grow to' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -93,15 +128,39 @@ static ConfigTable mdbcfg[] = {
 		"( OLcfgDbAt:12.7 NAME 'olcDbMultivalLo' "
 		"DESC 'Threshold for consolidating multivalued attr back into main blob' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcache", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_paged_max),
+		"( OLcfgDbAt:12.15 NAME 'olcDbPagedCache' "
+		"DESC 'Number of paged searches whose candidates are kept between pages' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcachettl", "seconds", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_paged_ttl),
+		"( OLcfgDbAt:12.16 NAME 'olcDbPagedCacheTTL' "
+		"DESC 'Seconds the candidates of a paged search are kept' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "prefixkeys", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_PREFIXKEYS,
+		mdb_cf_gen, "( OLcfgDbAt:12.18 NAME 'olcDbPrefixKeys' "
+		"DESC 'Store the keys of new substring and ordered indexes prefix compressed' "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
 		"DESC 'Number of entries to process in one read transaction' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "rtxnage", "seconds", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_rtxn_age),
+		"( OLcfgDbAt:12.17 NAME 'olcDbRtxnAge' "
+		"DESC 'Seconds a search may keep one read transaction' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_threads),
+		"( OLcfgDbAt:12.14 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of threads a search may use to test its candidates' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -116,7 +175,11 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultivalHi $ olcDbMultivalLo ) )",
+		"olcDbMultivalHi $ olcDbMultivalLo $ olcDbIDLMax $ "
+		"olcDbEntryCacheSize $ olcDbGroupCommit $ olcDbMapGrowth $ "
+		"olcDbColumn $ olcDbClusterIDs $ olcDbSearchThreads $ "
+		"olcDbPagedCache $ olcDbPagedCacheTTL $ olcDbRtxnAge $ "
+		"olcDbPrefixKeys ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -127,6 +190,8 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("pagelog"),	MDB_PAGELOG },
+	{ BER_BVC("keepdirty"),	MDB_KEEPDIRTY },
 	{ BER_BVNULL, 0 }
 };
 
@@ -144,7 +209,23 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* The online indexer commits every chunk of this many entries. The
+ * chunk shrinks while other writers are active and grows back while
+ * the database is otherwise idle.
+ */
+#define MDB_INDEX_CHUNK_MIN	16
+#define MDB_INDEX_CHUNK_MAX	4096
+
+/* reindex entries on the fly
+ *
+ * The new index bits of each attribute are built in ID order, one
+ * chunk of entries per write txn. The progress is saved in the same
+ * txn (see mdb_index_progress_save()) so that searches can use the
+ * part of the index that is already built, and so that the build
+ * resumes where it left off after a restart. Entries added or modified
+ * in the meantime are indexed with ai_newmask by the regular update
+ * code.
+ */
 static void *
 mdb_online_index( void *ctx, void *arg )
 {
@@ -159,23 +240,28 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_cursor *curs;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
+	AttrInfo *ai;
+	ID id, next, last;
 	Entry *e;
-	int rc, getnext = 1;
-	int i;
+	size_t txnid = 0, prev = 0;
+	struct timeval tv, t0, t1;
+	int rc, i, n, done = 0, chunk = MDB_INDEX_CHUNK_MIN;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
 
 	op->o_bd = be;
 
-	id = 1;
+	mdb->mi_index_start = slap_get_time();
+	mdb->mi_index_done = 0;
 	key.mv_size = sizeof(ID);
 
 	while ( 1 ) {
 		if ( slapd_shutdown )
 			break;
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
 
+		gettimeofday( &t0, NULL );
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
 		if ( rc )
 			break;
@@ -184,38 +270,83 @@ mdb_online_index( void *ctx, void *arg )
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
-				break;
+
+		/* Other txns committed since our last one, back off */
+		txnid = mdb_txn_id( txn );
+		if ( prev && txnid > prev + 1 ) {
+			chunk /= 2;
+			if ( chunk < MDB_INDEX_CHUNK_MIN )
+				chunk = MDB_INDEX_CHUNK_MIN;
+		} else if ( chunk < MDB_INDEX_CHUNK_MAX ) {
+			chunk *= 2;
+		}
+
+		/* Start any newly configured builds and find the lowest
+		 * ID that still needs work.
+		 */
+		last = 0;
+		rc = mdb_cursor_get( curs, &key, &data, MDB_LAST );
+		if ( rc == 0 )
+			memcpy( &last, key.mv_data, sizeof( last ));
+		id = NOID;
+		next = 0;
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			ai = mdb->mi_attrs[i];
+			if ( !ai->ai_newmask || ( ai->ai_indexmask & MDB_INDEX_DELETING ))
+				continue;
+			if ( !ai->ai_ixlast ) {
+				ai->ai_ixold = ai->ai_indexmask;
+				ai->ai_ixnext = 1;
+				ai->ai_ixlast = last ? last : 1;
+				if ( !( ai->ai_newmask & ~ai->ai_indexmask ))
+					ai->ai_ixnext = ai->ai_ixlast + 1;
+			}
+			if ( ai->ai_ixnext <= ai->ai_ixlast ) {
+				if ( ai->ai_ixnext < id )
+					id = ai->ai_ixnext;
+				if ( ai->ai_ixlast >= next )
+					next = ai->ai_ixlast + 1;
 			}
-			memcpy( &id, key.mv_data, sizeof( id ));
 		}
+		mdb_column_pending( mdb, last, &id, &next );
 
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
+		/* Index the next chunk */
+		if ( id != NOID ) {
+			key.mv_data = &id;
+			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+			for ( n = 0; rc == 0 && n < chunk; n++ ) {
+				memcpy( &id, key.mv_data, sizeof( id ));
+				if ( id >= next )
+					break;
+				rc = mdb_id2entry( op, curs, id, &e );
+				if ( rc )
+					break;
+				rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+				if ( rc == 0 && mdb->mi_ncols )
+					rc = mdb_column_put( op, txn, e );
+				mdb_entry_return( op, e );
+				if ( rc )
+					break;
 				id++;
-				getnext = 1;
-				continue;
+				rc = mdb_cursor_get( curs, &key, &data, MDB_NEXT );
 			}
-			break;
+			if ( rc == MDB_NOTFOUND ) {
+				rc = 0;
+			} else if ( rc == 0 && n == chunk && id < next ) {
+				next = id;
+			}
+			mdb->mi_index_done += n;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
+		mdb_cursor_close( curs );
+
+		if ( rc == 0 )
+			rc = mdb_index_progress_save( mdb, txn, next );
+		if ( rc == 0 )
+			rc = mdb_column_progress_save( mdb, txn, next );
 		if ( rc == 0 ) {
 			rc = mdb_txn_commit( txn );
-			txn = NULL;
 		} else {
 			mdb_txn_abort( txn );
-			txn = NULL;
 		}
 		if ( rc ) {
 			Debug( LDAP_DEBUG_ANY,
@@ -224,18 +355,51 @@ mdb_online_index( void *ctx, void *arg )
 				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
 			break;
 		}
-		id++;
-		getnext = 1;
+		prev = txnid;
+
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			ai = mdb->mi_attrs[i];
+			if ( ai->ai_newmask && ai->ai_ixlast && ai->ai_ixnext < next )
+				ai->ai_ixnext = next;
+		}
+		mdb_column_progress_done( mdb, next );
+		if ( id == NOID ) {
+			done = 1;
+			break;
+		}
+
+		/* Let the writers we held up catch up */
+		if ( chunk == MDB_INDEX_CHUNK_MIN ) {
+			gettimeofday( &t1, NULL );
+			tv.tv_sec = t1.tv_sec - t0.tv_sec;
+			tv.tv_usec = t1.tv_usec - t0.tv_usec;
+			if ( tv.tv_usec < 0 ) {
+				tv.tv_sec--;
+				tv.tv_usec += 1000000;
+			}
+			select( 0, NULL, NULL, NULL, &tv );
+		} else {
+			ldap_pvt_thread_yield();
+		}
 	}
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
+	/* The final txn removed the progress record. Searches with an
+	 * older snapshot must keep ignoring the new index.
+	 */
+	if ( done ) {
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			ai = mdb->mi_attrs[i];
+			if ( ai->ai_indexmask & MDB_INDEX_DELETING
+				|| ai->ai_newmask == 0 )
+			{
+				continue;
+			}
+			ai->ai_ixtxn = txnid;
+			ai->ai_indexmask = ai->ai_newmask;
+			ai->ai_newmask = 0;
+			ai->ai_ixlast = 0;
+			ai->ai_ixnext = 0;
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
@@ -247,6 +411,28 @@ mdb_online_index( void *ctx, void *arg )
 	return NULL;
 }
 
+/* Schedule the online indexer unless it is already running */
+int
+mdb_online_index_start( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+
+	if ( mdb->mi_index_task )
+		return 0;
+
+	/* Start the task as soon as we finish here. Set a long
+	 * interval (10 hours) so that it only gets scheduled once.
+	 */
+	if ( be->be_suffix == NULL || BER_BVISNULL( &be->be_suffix[0] ) )
+		return 1;
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+		mdb_online_index, be,
+		LDAP_XSTRING(mdb_online_index), be->be_suffix[0].bv_val );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return 0;
+}
+
 /* Cleanup loose ends after Modify completes */
 static int
 mdb_cf_cleanup( ConfigArgs *c )
@@ -259,6 +445,27 @@ mdb_cf_cleanup( ConfigArgs *c )
 		mdb->mi_flags ^= MDB_DEL_INDEX;
 	}
 
+	if ( mdb->mi_flags & MDB_DEL_COLUMN ) {
+		MDB_txn *txn;
+		mdb->mi_flags ^= MDB_DEL_COLUMN;
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		if ( rc == 0 ) {
+			rc = mdb_column_sweep( mdb, txn );
+			if ( rc == 0 )
+				rc = mdb_txn_commit( txn );
+			else
+				mdb_txn_abort( txn );
+		}
+		if ( rc ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"failed to drop column rows: %s (%d)",
+				mdb_strerror( rc ), rc );
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_cf_cleanup)
+				": %s\n", c->cr_msg, 0, 0 );
+			rc = LDAP_OTHER;
+		}
+	}
+
 	if ( mdb->mi_flags & MDB_RE_OPEN ) {
 		mdb->mi_flags ^= MDB_RE_OPEN;
 		rc = c->be->bd_info->bi_db_close( c->be, &c->reply );
@@ -321,6 +528,11 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_COLUMN:
+			mdb_column_unparse( mdb, &c->rvalue_vals );
+			if ( !c->rvalue_vals ) rc = 1;
+			break;
+
 		case MDB_DIRECTORY:
 			if ( mdb->mi_dbenv_home ) {
 				c->value_string = ch_strdup( mdb->mi_dbenv_home );
@@ -329,6 +541,16 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_CLUSTERIDS:
+			if ( mdb->mi_flags & MDB_CLUSTER )
+				c->value_int = 1;
+			break;
+
+		case MDB_PREFIXKEYS:
+			if ( mdb->mi_flags & MDB_PREFIX_KEYS )
+				c->value_int = 1;
+			break;
+
 		case MDB_DBNOSYNC:
 			if ( mdb->mi_dbenv_flags & MDB_NOSYNC )
 				c->value_int = 1;
@@ -341,6 +563,27 @@ mdb_cf_gen( ConfigArgs *c )
 			if ( !c->rvalue_vals ) rc = 1;
 			break;
 
+		case MDB_ECACHESIZE:
+			c->value_ulong = mdb->mi_ecache_max;
+			break;
+
+		case MDB_GCOMMIT:
+			if ( mdb->mi_gc_window ) {
+				char buf[ 64 ];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_gc_window, mdb->mi_gc_maxops );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_IDLMAX:
+			c->value_uint = mdb->mi_idl_max;
+			break;
+
 		case MDB_INDEX:
 			mdb_attr_index_unparse( mdb, &c->rvalue_vals );
 			if ( !c->rvalue_vals ) rc = 1;
@@ -357,6 +600,20 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			c->value_ulong = mdb->mi_mapsize;
 			break;
+
+		case MDB_MAPGROWTH:
+			if ( mdb->mi_mapgrow ) {
+				char buf[ 64 ];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%lu %lu",
+					(unsigned long) mdb->mi_mapgrow,
+					(unsigned long) mdb->mi_mapmax );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -370,6 +627,37 @@ mdb_cf_gen( ConfigArgs *c )
 			break;
 #endif
 
+		case MDB_ECACHESIZE:
+			mdb->mi_ecache_max = 0;
+			mdb_ecache_trim( mdb );
+			break;
+
+		case MDB_IDLMAX:
+			mdb->mi_idl_max = MDB_IDL_DB_MAX;
+			break;
+
+		case MDB_COLUMN:
+			mdb_column_del( mdb, c->valx );
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_DEL_COLUMN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+			break;
+
+		case MDB_GCOMMIT:
+			mdb->mi_gc_window = 0;
+			mdb->mi_gc_maxops = 0;
+			break;
+
+		case MDB_MAPGROWTH:
+			mdb->mi_mapgrow = 0;
+			mdb->mi_mapmax = 0;
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+			break;
+
 		/* single-valued no-ops */
 		case MDB_SSTACK:
 		case MDB_MAXREADERS:
@@ -388,6 +676,13 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			mdb->mi_txn_cp = 0;
 			break;
+		case MDB_CLUSTERIDS:
+			/* a pending renumbering notices this */
+			mdb->mi_flags &= ~MDB_CLUSTER;
+			break;
+		case MDB_PREFIXKEYS:
+			mdb->mi_flags &= ~MDB_PREFIX_KEYS;
+			break;
 		case MDB_DIRECTORY:
 			mdb->mi_flags |= MDB_RE_OPEN;
 			ch_free( mdb->mi_dbenv_home );
@@ -604,6 +899,25 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_CLUSTERIDS:
+		if ( c->value_int ) {
+			mdb->mi_flags |= MDB_CLUSTER;
+			if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+				!( slapMode & SLAP_TOOL_MODE ))
+				mdb_cluster_start( c->be );
+		} else {
+			mdb->mi_flags &= ~MDB_CLUSTER;
+		}
+		break;
+
+	case MDB_PREFIXKEYS:
+		/* only index DBs created from now on are affected */
+		if ( c->value_int )
+			mdb->mi_flags |= MDB_PREFIX_KEYS;
+		else
+			mdb->mi_flags &= ~MDB_PREFIX_KEYS;
+		break;
+
 	case MDB_DBNOSYNC:
 		if ( c->value_int )
 			mdb->mi_dbenv_flags |= MDB_NOSYNC;
@@ -649,23 +963,82 @@ mdb_cf_gen( ConfigArgs *c )
 		mdb->mi_flags |= MDB_OPEN_INDEX;
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			c->cleanup = mdb_cf_cleanup;
-			if ( !mdb->mi_index_task ) {
-				/* Start the task as soon as we finish here. Set a long
-				 * interval (10 hours) so that it only gets scheduled once.
-				 */
-				if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
-					fprintf( stderr, "%s: "
-						"\"index\" must occur after \"suffix\".\n",
-						c->log );
-					return 1;
-				}
-				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-				mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
-					mdb_online_index, c->be,
-					LDAP_XSTRING(mdb_online_index), c->be->be_suffix[0].bv_val );
-				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			if ( mdb_online_index_start( c->be )) {
+				fprintf( stderr, "%s: "
+					"\"index\" must occur after \"suffix\".\n",
+					c->log );
+				return 1;
+			}
+		}
+		break;
+
+	case MDB_COLUMN: {
+		AttributeDescription *ad = NULL;
+		const char *text;
+
+		if ( slap_str2ad( c->argv[1], &ad, &text ) != LDAP_SUCCESS ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: %s", c->argv[0], text );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		/* values that are not stored can't be kept in a column */
+		if ( ad->ad_type->sat_flags & SLAP_AT_DYNAMIC ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: attribute \"%s\" is dynamic",
+				c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( mdb_column_add( mdb, ad )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: duplicate column \"%s\"",
+				c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			if ( mdb_online_index_start( c->be )) {
+				fprintf( stderr, "%s: "
+					"\"column\" must occur after \"suffix\".\n",
+					c->log );
+				return 1;
 			}
 		}
+		} break;
+
+	case MDB_ECACHESIZE:
+		mdb->mi_ecache_max = c->value_ulong;
+		mdb_ecache_trim( mdb );
+		break;
+
+	case MDB_GCOMMIT: {
+		unsigned window, maxops = 0;
+		if ( lutil_atoux( &window, c->argv[1], 0 ) != 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid usec \"%s\" in \"groupcommit\".\n",
+				c->log, c->argv[1] );
+			return 1;
+		}
+		if ( c->argc > 2 && lutil_atoux( &maxops, c->argv[2], 0 ) != 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid maxops \"%s\" in \"groupcommit\".\n",
+				c->log, c->argv[2] );
+			return 1;
+		}
+		mdb->mi_gc_window = window;
+		mdb->mi_gc_maxops = maxops;
+		break;
+		}
+
+	case MDB_IDLMAX:
+		if ( c->value_uint < MDB_IDL_DB_MAX ) {
+			fprintf( stderr,
+		"%s: idlmax %u too small, using %u\n",
+			c->log, c->value_uint, MDB_IDL_DB_MAX );
+			c->value_uint = MDB_IDL_DB_MAX;
+		}
+		mdb->mi_idl_max = c->value_uint;
 		break;
 
 	case MDB_SSTACK:
@@ -686,6 +1059,29 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_MAPGROWTH: {
+		unsigned long grow, max;
+		if ( lutil_atoulx( &grow, c->argv[1], 0 ) != 0 || !grow ) {
+			fprintf( stderr, "%s: "
+				"invalid increment \"%s\" in \"mapgrowth\".\n",
+				c->log, c->argv[1] );
+			return 1;
+		}
+		if ( lutil_atoulx( &max, c->argv[2], 0 ) != 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid ceiling \"%s\" in \"mapgrowth\".\n",
+				c->log, c->argv[2] );
+			return 1;
+		}
+		mdb->mi_mapgrow = grow;
+		mdb->mi_mapmax = max;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			mdb->mi_flags |= MDB_RE_OPEN;
+			c->cleanup = mdb_cf_cleanup;
+		}
+		break;
+		}
+
 	case MDB_MAXSIZE:
 		mdb->mi_mapsize = c->value_ulong;
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
@@ -370,12 +370,12 @@ mdb_delete( Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_opinfo_commit( mdb, moi, txn );
 		}
 		txn = NULL;
 	}
@@ -415,7 +415,7 @@ return_results:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
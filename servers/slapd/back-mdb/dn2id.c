@@ -98,6 +98,7 @@ mdb_dn2id_add(
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_dn2id_add 0x%lx: \"%s\"\n",
 		e->e_id, e->e_ndn ? e->e_ndn : "", 0 );
+	mdb_opinfo_changed( op, mdb );
 
 	nrlen = dn_rdnlen( op->o_bd, &e->e_nname );
 	if (nrlen) {
@@ -194,6 +195,10 @@ mdb_dn2id_add(
 		} while ( nid );
 	}
 
+	/* A new entry, or one moved to another superior */
+	if ( rc == 0 && upsub )
+		rc = mdb_cluster_update( mdb, mdb_cursor_txn( mcp ), e->e_id, 0 );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_add 0x%lx: %d\n", e->e_id, rc, 0 );
 
 	return rc;
@@ -213,6 +218,7 @@ mdb_dn2id_delete(
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_dn2id_delete 0x%lx\n",
 		id, 0, 0 );
+	mdb_opinfo_changed( op, op->o_bd->be_private );
 
 	/* Delete our ID from the parent's list */
 	rc = mdb_cursor_del( mc, 0 );
@@ -276,6 +282,10 @@ mdb_dn2id_delete(
 		} while ( nid );
 	}
 
+	if ( rc == 0 && nsubs )
+		rc = mdb_cluster_update( op->o_bd->be_private,
+			mdb_cursor_txn( mc ), id, nsubs );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_dn2id_delete 0x%lx: %d\n", id, rc, 0 );
 	return rc;
 }
@@ -643,8 +653,8 @@ mdb_idscope(
 
 	ida = mdb_idl_first( ids, &cid );
 
-	/* Don't bother moving out of ids if it's a range */
-	if (!MDB_IDL_IS_RANGE(ids)) {
+	/* Don't bother moving out of ids if it's a range or bitmap */
+	if (!MDB_IDL_IS_RANGE(ids) && !MDB_IDL_IS_BITMAP(ids)) {
 		idc = ids[0];
 		ci0 = cid;
 	}
@@ -687,7 +697,7 @@ mdb_idscope(
 		}
 		ida = mdb_idl_next( ids, &cid );
 	}
-	if (!MDB_IDL_IS_RANGE( ids ))
+	if (!MDB_IDL_IS_RANGE( ids ) && !MDB_IDL_IS_BITMAP( ids ))
 		ids[0] = idc;
 
 leave:
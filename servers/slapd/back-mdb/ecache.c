@@ -0,0 +1,388 @@
+/* ecache.c - cache of decoded entries */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/*
+ * Decoded entries point into the LMDB map, which is only valid while
+ * the read txn is open. The cache keeps a private flat copy of each
+ * entry instead: the Entry, its Attributes, the berval arrays and the
+ * value bytes in one block. A hit copies the block into the operation's
+ * memory in one piece and relocates its internal pointers, so the
+ * caller can use and free it like any other decoded entry.
+ *
+ * Each cached copy records the txn snapshot it was decoded from. Every
+ * write to id2entry stamps the entry's slot in mi_ecache_stamps with
+ * the writer's txnid before it commits. A copy decoded at snapshot S is
+ * the right one for a reader at snapshot R iff the entry did not change
+ * between the two, which holds if its stamp is no newer than either.
+ * Slots are shared by IDs with the same low bits, which only costs an
+ * occasional needless miss. A slot is only read or written under the
+ * mutex of the stripe its IDs belong to, so a reader sees the stamps of
+ * all writes committed before its snapshot was taken.
+ */
+
+#define ECACHE_STRIPE(mdb, id)	(&(mdb)->mi_ecache[(id) & (MDB_ECACHE_STRIPES-1)])
+#define ECACHE_STAMP(mdb, id)	((mdb)->mi_ecache_stamps[(id) & (MDB_ECACHE_STAMPS-1)])
+
+/* Don't cache anything larger than this fraction of a stripe */
+#define ECACHE_MAXFRAC	4
+
+typedef struct mdb_ecache_entry {
+	ID ece_id;
+	size_t ece_txnid;	/* snapshot this copy was decoded from */
+	size_t ece_size;	/* size of the Entry block */
+	LDAP_TAILQ_ENTRY(mdb_ecache_entry) ece_lru;
+	Entry *ece_e;
+} mdb_ecache_entry;
+
+static int
+ecache_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ecache_entry *e1 = v1, *e2 = v2;
+
+	if ( e1->ece_id < e2->ece_id )
+		return -1;
+	return e1->ece_id > e2->ece_id;
+}
+
+/* caller must hold the stripe mutex */
+static void
+ecache_remove( mdb_ecache_stripe *ecs, mdb_ecache_entry *ece )
+{
+	avl_delete( &ecs->ecs_tree, ece, ecache_cmp );
+	LDAP_TAILQ_REMOVE( &ecs->ecs_lru, ece, ece_lru );
+	ecs->ecs_size -= ece->ece_size;
+	ecs->ecs_count--;
+	ch_free( ece );
+}
+
+/* caller must hold the stripe mutex */
+static void
+ecache_trim( mdb_ecache_stripe *ecs, size_t max )
+{
+	mdb_ecache_entry *ece;
+
+	while ( ecs->ecs_size > max &&
+		( ece = LDAP_TAILQ_LAST( &ecs->ecs_lru, ecs_lru_head )) != NULL )
+		ecache_remove( ecs, ece );
+}
+
+/* Copy the block of a cached entry to dst, relocating its pointers */
+static Entry *
+ecache_copy( void *dst, Entry *src, size_t size )
+{
+	Entry *e = dst;
+	Attribute *a;
+	struct berval *bv;
+	ptrdiff_t delta = (char *)dst - (char *)src;
+
+#define	RELOC(p)	((p) = (void *)((char *)(p) + delta))
+
+	AC_MEMCPY( dst, src, size );
+	if ( e->e_attrs ) {
+		RELOC( e->e_attrs );
+		for ( a = e->e_attrs; a; a = a->a_next ) {
+			if ( a->a_next )
+				RELOC( a->a_next );
+			if ( a->a_nvals == a->a_vals ) {
+				RELOC( a->a_vals );
+				a->a_nvals = a->a_vals;
+			} else {
+				RELOC( a->a_vals );
+				RELOC( a->a_nvals );
+				for ( bv = a->a_nvals; bv->bv_val; bv++ )
+					RELOC( bv->bv_val );
+			}
+			for ( bv = a->a_vals; bv->bv_val; bv++ )
+				RELOC( bv->bv_val );
+		}
+	}
+#undef RELOC
+	return e;
+}
+
+/* Make a flat copy of a decoded entry */
+static mdb_ecache_entry *
+ecache_flatten( Entry *x, ID id, size_t txnid )
+{
+	mdb_ecache_entry *ece;
+	Entry *e;
+	Attribute *a, *b;
+	struct berval *bv, *bp;
+	size_t size, nattrs = 0, nbvs = 0, len = 0;
+	char *ptr;
+
+	for ( a = x->e_attrs; a; a = a->a_next ) {
+		nattrs++;
+		nbvs += a->a_numvals + 1;
+		for ( bv = a->a_vals; bv->bv_val; bv++ )
+			len += bv->bv_len + 1;
+		if ( a->a_nvals != a->a_vals ) {
+			nbvs += a->a_numvals + 1;
+			for ( bv = a->a_nvals; bv->bv_val; bv++ )
+				len += bv->bv_len + 1;
+		}
+	}
+	size = sizeof(Entry) + nattrs * sizeof(Attribute) +
+		nbvs * sizeof(struct berval) + len;
+
+	ece = ch_malloc( sizeof(mdb_ecache_entry) + size );
+	ece->ece_id = id;
+	ece->ece_txnid = txnid;
+	ece->ece_size = size;
+	ece->ece_e = e = (Entry *)(ece+1);
+
+	*e = *x;
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+	BER_BVZERO( &e->e_bv );
+	e->e_id = id;
+	e->e_private = NULL;
+	e->e_attrs = nattrs ? (Attribute *)(e+1) : NULL;
+
+	b = e->e_attrs;
+	bp = (struct berval *)(b + nattrs);
+	ptr = (char *)(bp + nbvs);
+	for ( a = x->e_attrs; a; a = a->a_next, b++ ) {
+		*b = *a;
+		b->a_next = a->a_next ? b+1 : NULL;
+		b->a_vals = bp;
+		for ( bv = a->a_vals; bv->bv_val; bv++, bp++ ) {
+			bp->bv_len = bv->bv_len;
+			bp->bv_val = ptr;
+			AC_MEMCPY( ptr, bv->bv_val, bv->bv_len );
+			ptr[bv->bv_len] = '\0';
+			ptr += bv->bv_len + 1;
+		}
+		BER_BVZERO( bp );
+		bp++;
+		if ( a->a_nvals != a->a_vals ) {
+			b->a_nvals = bp;
+			for ( bv = a->a_nvals; bv->bv_val; bv++, bp++ ) {
+				bp->bv_len = bv->bv_len;
+				bp->bv_val = ptr;
+				AC_MEMCPY( ptr, bv->bv_val, bv->bv_len );
+				ptr[bv->bv_len] = '\0';
+				ptr += bv->bv_len + 1;
+			}
+			BER_BVZERO( bp );
+			bp++;
+		} else {
+			b->a_nvals = b->a_vals;
+		}
+	}
+	return ece;
+}
+
+/* Only readers may fill the cache; a writer's snapshot may never
+ * be committed.
+ */
+static int
+ecache_is_reader( struct mdb_info *mdb, size_t txnid )
+{
+	MDB_envinfo ei;
+
+	mdb_env_info( mdb->mi_dbenv, &ei );
+	return txnid <= ei.me_last_txnid;
+}
+
+/* Look up a decoded copy of entry id that is valid for this txn.
+ * Returns 0 and a new entry in *e on a hit.
+ */
+int
+mdb_ecache_find( Operation *op, MDB_txn *txn, ID id, Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecache_stripe *ecs;
+	mdb_ecache_entry *ece, key;
+	size_t txnid, stamp;
+	void *ptr;
+	int rc = MDB_NOTFOUND;
+
+	if ( !mdb->mi_ecache_max || ( slapMode & SLAP_TOOL_MODE ))
+		return rc;
+
+	txnid = mdb_txn_id( txn );
+	ecs = ECACHE_STRIPE( mdb, id );
+	key.ece_id = id;
+
+	ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+	stamp = ECACHE_STAMP( mdb, id );
+	ece = avl_find( ecs->ecs_tree, &key, ecache_cmp );
+	if ( ece ) {
+		if ( stamp > ece->ece_txnid ) {
+			/* modified since it was cached */
+			ecache_remove( ecs, ece );
+		} else if ( stamp <= txnid ) {
+			ptr = op->o_tmpalloc( ece->ece_size, op->o_tmpmemctx );
+			*e = ecache_copy( ptr, ece->ece_e, ece->ece_size );
+			(*e)->e_private = *e;
+			LDAP_TAILQ_REMOVE( &ecs->ecs_lru, ece, ece_lru );
+			LDAP_TAILQ_INSERT_HEAD( &ecs->ecs_lru, ece, ece_lru );
+			rc = 0;
+		}
+	}
+	if ( rc )
+		ecs->ecs_misses++;
+	else
+		ecs->ecs_hits++;
+	ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+
+	return rc;
+}
+
+/* Save a copy of an entry just decoded by txn */
+void
+mdb_ecache_add( Operation *op, MDB_txn *txn, ID id, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecache_stripe *ecs;
+	mdb_ecache_entry *ece, *old;
+	size_t txnid, max;
+
+	if ( !mdb->mi_ecache_max || ( slapMode & SLAP_TOOL_MODE ))
+		return;
+
+	txnid = mdb_txn_id( txn );
+	if ( !ecache_is_reader( mdb, txnid ))
+		return;
+
+	ece = ecache_flatten( e, id, txnid );
+	max = mdb->mi_ecache_max / MDB_ECACHE_STRIPES;
+	if ( ece->ece_size > max / ECACHE_MAXFRAC ) {
+		ch_free( ece );
+		return;
+	}
+
+	ecs = ECACHE_STRIPE( mdb, id );
+	ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+	if ( ECACHE_STAMP( mdb, id ) > txnid ) {
+		ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+		ch_free( ece );
+		return;
+	}
+	old = avl_find( ecs->ecs_tree, ece, ecache_cmp );
+	if ( old ) {
+		if ( old->ece_txnid >= txnid ) {
+			ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+			ch_free( ece );
+			return;
+		}
+		ecache_remove( ecs, old );
+	}
+	ecache_trim( ecs, max - ece->ece_size );
+	avl_insert( &ecs->ecs_tree, ece, ecache_cmp, avl_dup_error );
+	LDAP_TAILQ_INSERT_HEAD( &ecs->ecs_lru, ece, ece_lru );
+	ecs->ecs_size += ece->ece_size;
+	ecs->ecs_count++;
+	ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+}
+
+/* Called by writers before an entry is changed or deleted */
+void
+mdb_ecache_stamp( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	mdb_ecache_stripe *ecs = ECACHE_STRIPE( mdb, id );
+
+	ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+	ECACHE_STAMP( mdb, id ) = mdb_txn_id( txn );
+	ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+}
+
+/* Called by writers that change the IDs of entries */
+void
+mdb_ecache_stamp_all( struct mdb_info *mdb, MDB_txn *txn )
+{
+	mdb_ecache_stripe *ecs;
+	size_t txnid = mdb_txn_id( txn );
+	int i, j;
+
+	for ( i = 0; i < MDB_ECACHE_STRIPES; i++ ) {
+		ecs = &mdb->mi_ecache[i];
+		ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+		for ( j = i; j < MDB_ECACHE_STAMPS; j += MDB_ECACHE_STRIPES )
+			mdb->mi_ecache_stamps[j] = txnid;
+		ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+	}
+}
+
+/* Shrink the cache to the current size limit */
+void
+mdb_ecache_trim( struct mdb_info *mdb )
+{
+	mdb_ecache_stripe *ecs;
+	int i;
+
+	for ( i = 0; i < MDB_ECACHE_STRIPES; i++ ) {
+		ecs = &mdb->mi_ecache[i];
+		ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+		ecache_trim( ecs, mdb->mi_ecache_max / MDB_ECACHE_STRIPES );
+		ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+	}
+}
+
+/* Sum the cache statistics over all stripes */
+void
+mdb_ecache_stats( struct mdb_info *mdb, unsigned long *count,
+	unsigned long *hits, unsigned long *misses )
+{
+	mdb_ecache_stripe *ecs;
+	int i;
+
+	*count = *hits = *misses = 0;
+	for ( i = 0; i < MDB_ECACHE_STRIPES; i++ ) {
+		ecs = &mdb->mi_ecache[i];
+		ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+		*count += ecs->ecs_count;
+		*hits += ecs->ecs_hits;
+		*misses += ecs->ecs_misses;
+		ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+	}
+}
+
+void
+mdb_ecache_init( struct mdb_info *mdb )
+{
+	int i;
+
+	for ( i = 0; i < MDB_ECACHE_STRIPES; i++ ) {
+		ldap_pvt_thread_mutex_init( &mdb->mi_ecache[i].ecs_mutex );
+		LDAP_TAILQ_INIT( &mdb->mi_ecache[i].ecs_lru );
+	}
+}
+
+/* Empty the cache. With destroy, also release the stripe locks. */
+void
+mdb_ecache_flush( struct mdb_info *mdb, int destroy )
+{
+	mdb_ecache_stripe *ecs;
+	int i;
+
+	for ( i = 0; i < MDB_ECACHE_STRIPES; i++ ) {
+		ecs = &mdb->mi_ecache[i];
+		ldap_pvt_thread_mutex_lock( &ecs->ecs_mutex );
+		ecache_trim( ecs, 0 );
+		ldap_pvt_thread_mutex_unlock( &ecs->ecs_mutex );
+		if ( destroy )
+			ldap_pvt_thread_mutex_destroy( &ecs->ecs_mutex );
+	}
+}
@@ -29,7 +29,8 @@ static int presence_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
 	AttributeDescription *desc,
-	ID *ids );
+	ID *ids,
+	ID *tmp );
 
 static int equality_candidates(
 	Operation *op,
@@ -138,7 +139,7 @@ mdb_filter_candidates(
 		break;
 	case LDAP_FILTER_PRESENT:
 		Debug( LDAP_DEBUG_FILTER, "\tPRESENT\n", 0, 0, 0 );
-		rc = presence_candidates( op, rtxn, f->f_desc, ids );
+		rc = presence_candidates( op, rtxn, f->f_desc, ids, tmp );
 		break;
 
 	case LDAP_FILTER_EQUALITY:
@@ -171,7 +172,7 @@ mdb_filter_candidates(
 			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_GE );
 		else
-			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
+			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids, tmp );
 		break;
 
 	case LDAP_FILTER_LE:
@@ -181,7 +182,7 @@ mdb_filter_candidates(
 			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_LE );
 		else
-			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
+			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids, tmp );
 		break;
 
 	case LDAP_FILTER_NOT:
@@ -357,8 +358,8 @@ comp_equality_candidates (
 	if ( !cr )
 		return 0;
 
-	rc = mdb_index_param( op->o_bd, mra->ma_desc, LDAP_FILTER_EQUALITY,
-			&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, mra->ma_desc, LDAP_FILTER_EQUALITY,
+			&dbi, &mask, &prefix, NULL );
 
 	if( rc != LDAP_SUCCESS ) {
 		return 0;
@@ -558,6 +559,143 @@ base:
 	return 0;
 }
 
+/* Stop evaluating the terms of an AND once the candidate list is this
+ * many times smaller than the estimated size of the next term. Testing
+ * the few remaining candidates against the filter is cheaper than
+ * reading the rest of the index.
+ */
+#define MDB_AND_SHORTCUT	32
+
+typedef struct filter_term {
+	Filter *ft_filter;
+	ID ft_cost;
+} filter_term;
+
+static ID filter_cost( Operation *op, MDB_txn *rtxn, Filter *f );
+
+/* Estimate the number of IDs the index keys of an assertion would
+ * yield, from the smallest key. Returns NOID if the attribute has no
+ * usable index for this filter type.
+ */
+static ID
+keys_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	MatchingRule *mr,
+	void *assertion )
+{
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	ID cost = NOID, n, unbuilt[2];
+	int i, rc;
+
+	rc = mdb_index_param( op->o_bd, rtxn, desc, ftype, &dbi, &mask, &prefix,
+		unbuilt );
+	if ( rc != LDAP_SUCCESS )
+		return NOID;
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		if ( prefix.bv_val == NULL )
+			return NOID;
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &prefix, &n ) == 0 )
+			cost = n;
+		goto done;
+	}
+
+	if ( !mr || !mr->smr_filter )
+		return NOID;
+
+	rc = (mr->smr_filter)( ftype, mask, desc->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return NOID;
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		if ( mdb_key_count( op->o_bd, rtxn, dbi, &keys[i], &n ) == 0 &&
+			n < cost ) {
+			cost = n;
+			if ( !cost )
+				break;
+		}
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+done:
+	/* entries an online index build hasn't reached are all candidates */
+	if ( unbuilt[0] && cost != NOID )
+		cost += unbuilt[1] - unbuilt[0] + 1;
+	return cost;
+}
+
+/* Estimate the number of candidates a filter will produce. This only
+ * counts index keys, it doesn't read them. NOID means the filter is
+ * unindexed or the estimate is unknown.
+ */
+static ID
+filter_cost(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	ID cost, n;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_TRUE ||
+			f->f_result == LDAP_SUCCESS )
+			return NOID;
+		return 0;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass )
+			return NOID;
+		return keys_cost( op, rtxn, f->f_desc, LDAP_FILTER_PRESENT,
+			NULL, NULL );
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN )
+			return 1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( f->f_av_desc ))
+			return NOID;
+#endif
+		return keys_cost( op, rtxn, f->f_av_desc, LDAP_FILTER_EQUALITY,
+			f->f_av_desc->ad_type->sat_equality, &f->f_av_value );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return keys_cost( op, rtxn, f->f_sub_desc, LDAP_FILTER_SUBSTRINGS,
+			f->f_sub_desc->ad_type->sat_substr, f->f_sub );
+
+	case LDAP_FILTER_AND:
+		cost = NOID;
+		for ( f = f->f_and; f; f = f->f_next ) {
+			n = filter_cost( op, rtxn, f );
+			if ( n < cost )
+				cost = n;
+		}
+		return cost;
+
+	case LDAP_FILTER_OR:
+		cost = 0;
+		for ( f = f->f_or; f; f = f->f_next ) {
+			n = filter_cost( op, rtxn, f );
+			if ( n >= NOID - cost )
+				return NOID;
+			cost += n;
+		}
+		return cost;
+
+	default:
+		return NOID;
+	}
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -570,14 +708,52 @@ list_candidates(
 {
 	int rc = 0;
 	Filter	*f;
+	filter_term *terms, t;
+	int i, j, n, plan = 0;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
-	for ( f = flist; f != NULL; f = f->f_next ) {
+	if ( flist == NULL )
+		return 0;
+
+	for ( f = flist, n = 0; f != NULL; f = f->f_next, n++ )
+		/* a precomputed scope must keep its place */
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+			f->f_result == LDAP_SUCCESS )
+			plan = -1;
+	if ( ftype == LDAP_FILTER_AND && n > 1 && plan == 0 )
+		plan = 1;
+
+	terms = op->o_tmpalloc( n * sizeof(filter_term), op->o_tmpmemctx );
+	for ( f = flist, i = 0; f != NULL; f = f->f_next, i++ ) {
+		terms[i].ft_filter = f;
+		terms[i].ft_cost = plan > 0 ? filter_cost( op, rtxn, f ) : NOID;
+	}
+
+	/* evaluate the most selective terms of an AND first */
+	if ( plan > 0 ) {
+		for ( i = 1; i < n; i++ ) {
+			t = terms[i];
+			for ( j = i; j > 0 && terms[j-1].ft_cost > t.ft_cost; j-- )
+				terms[j] = terms[j-1];
+			terms[j] = t;
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		f = terms[i].ft_filter;
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+		if ( plan > 0 && i > 0 && !MDB_IDL_IS_RANGE( ids ) &&
+			!MDB_IDL_IS_BITMAP( ids ) &&
+			ids[0] * MDB_AND_SHORTCUT < terms[i].ft_cost ) {
+			Debug( LDAP_DEBUG_FILTER,
+				"mdb_list_candidates: %ld candidates, skipping %d terms\n",
+				(long) ids[0], n - i, 0 );
+			break;
+		}
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_IDL_UM_SIZE );
@@ -592,7 +768,7 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( i == 0 ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
@@ -600,13 +776,14 @@ list_candidates(
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
-			if ( f == flist ) {
+			if ( i == 0 ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_union( ids, save );
 			}
 		}
 	}
+	op->o_tmpfree( terms, op->o_tmpmemctx );
 
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -629,11 +806,13 @@ presence_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
 	AttributeDescription *desc,
-	ID *ids )
+	ID *ids,
+	ID *tmp )
 {
 	MDB_dbi dbi;
 	int rc;
 	slap_mask_t mask;
+	ID unbuilt[2];
 	struct berval prefix = {0, NULL};
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_presence_candidates (%s)\n",
@@ -645,8 +824,8 @@ presence_candidates(
 		return 0;
 	}
 
-	rc = mdb_index_param( op->o_bd, desc, LDAP_FILTER_PRESENT,
-		&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, desc, LDAP_FILTER_PRESENT,
+		&dbi, &mask, &prefix, unbuilt );
 
 	if( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		/* not indexed */
@@ -684,6 +863,9 @@ presence_candidates(
 		goto done;
 	}
 
+	if ( rc == 0 && unbuilt[0] )
+		mdb_idl_union_range( ids, unbuilt[0], unbuilt[1] );
+
 	Debug(LDAP_DEBUG_TRACE,
 		"<= mdb_presence_candidates: id=%ld first=%ld last=%ld\n",
 		(long) ids[0],
@@ -706,6 +888,7 @@ equality_candidates(
 	int i;
 	int rc;
 	slap_mask_t mask;
+	ID unbuilt[2];
 	struct berval prefix = {0, NULL};
 	struct berval *keys = NULL;
 	MatchingRule *mr;
@@ -730,8 +913,8 @@ equality_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
-		&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, ava->aa_desc, LDAP_FILTER_EQUALITY,
+		&dbi, &mask, &prefix, unbuilt );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -816,6 +999,9 @@ equality_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == 0 && unbuilt[0] )
+		mdb_idl_union_range( ids, unbuilt[0], unbuilt[1] );
+
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_equality_candidates: id=%ld, first=%ld, last=%ld\n",
 		(long) ids[0],
@@ -837,6 +1023,7 @@ approx_candidates(
 	int i;
 	int rc;
 	slap_mask_t mask;
+	ID unbuilt[2];
 	struct berval prefix = {0, NULL};
 	struct berval *keys = NULL;
 	MatchingRule *mr;
@@ -846,8 +1033,8 @@ approx_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_APPROX,
-		&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, ava->aa_desc, LDAP_FILTER_APPROX,
+		&dbi, &mask, &prefix, unbuilt );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -937,6 +1124,9 @@ approx_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == 0 && unbuilt[0] )
+		mdb_idl_union_range( ids, unbuilt[0], unbuilt[1] );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_approx_candidates %ld, first=%ld, last=%ld\n",
 		(long) ids[0],
 		(long) MDB_IDL_FIRST(ids),
@@ -956,6 +1146,7 @@ substring_candidates(
 	int i;
 	int rc;
 	slap_mask_t mask;
+	ID unbuilt[2];
 	struct berval prefix = {0, NULL};
 	struct berval *keys = NULL;
 	MatchingRule *mr;
@@ -965,8 +1156,8 @@ substring_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
-		&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
+		&dbi, &mask, &prefix, unbuilt );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1052,6 +1243,9 @@ substring_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == 0 && unbuilt[0] )
+		mdb_idl_union_range( ids, unbuilt[0], unbuilt[1] );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_substring_candidates: %ld, first=%ld, last=%ld\n",
 		(long) ids[0],
 		(long) MDB_IDL_FIRST(ids),
@@ -1071,6 +1265,7 @@ inequality_candidates(
 	MDB_dbi	dbi;
 	int rc;
 	slap_mask_t mask;
+	ID unbuilt[2];
 	struct berval prefix = {0, NULL};
 	struct berval *keys = NULL;
 	MatchingRule *mr;
@@ -1081,8 +1276,8 @@ inequality_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
-		&dbi, &mask, &prefix );
+	rc = mdb_index_param( op->o_bd, rtxn, ava->aa_desc, LDAP_FILTER_EQUALITY,
+		&dbi, &mask, &prefix, unbuilt );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1164,6 +1359,9 @@ inequality_candidates(
 	}
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == 0 && unbuilt[0] )
+		mdb_idl_union_range( ids, unbuilt[0], unbuilt[1] );
+
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_inequality_candidates: id=%ld, first=%ld, last=%ld\n",
 		(long) ids[0],
@@ -279,6 +279,8 @@ static int mdb_id2entry_put(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_stamp( mdb, txn, e->e_id );
+
 	rc = mdb_entry_partsize( mdb, txn, e, &ec );
 	if (rc)
 		return LDAP_OTHER;
@@ -326,6 +328,11 @@ again:
 				return LDAP_OTHER;
 			}
 		}
+		if (mdb->mi_ncols) {
+			rc = mdb_column_put( op, txn, e );
+			if ( rc )
+				return LDAP_OTHER;
+		}
 	}
 	if (rc) {
 		/* Was there a hole from slapadd? */
@@ -461,10 +468,17 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_stamp( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
 		return rc;
+	if (mdb->mi_ncols) {
+		rc = mdb_column_delete( mdb, tid, e->e_id );
+		if (rc)
+			return rc;
+	}
 	rc = mdb_cursor_open( tid, mdb->mi_dbis[MDB_ID2VAL], &mvc );
 	if (rc)
 		return rc;
@@ -655,9 +669,35 @@ return_results:
 static void
 mdb_reader_free( void *key, void *data )
 {
-	MDB_txn *txn = data;
+	mdb_rslot *mr = data, **prev;
+
+	if ( !mr ) return;
+	ldap_pvt_thread_mutex_lock( &mr->mr_mdb->mi_rslot_mutex );
+	for ( prev = &mr->mr_mdb->mi_rslots; *prev; prev = &(*prev)->mr_next ) {
+		if ( *prev == mr ) {
+			*prev = mr->mr_next;
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mr->mr_mdb->mi_rslot_mutex );
+	mdb_txn_abort( mr->mr_txn );
+	ch_free( mr );
+}
 
-	if ( txn ) mdb_txn_abort( txn );
+/* The reader txn of this thread took a new snapshot for op */
+void
+mdb_rslot_mark( Operation *op, struct mdb_info *mdb )
+{
+	void *data;
+	mdb_rslot *mr;
+
+	if ( !op->o_threadctx || ldap_pvt_thread_pool_getkey( op->o_threadctx,
+		mdb->mi_dbenv, &data, NULL ))
+		return;
+	mr = data;
+	mr->mr_connid = op->o_connid;
+	mr->mr_opid = op->o_opid;
+	mr->mr_since = slap_get_time();
 }
 
 /* free up any keys used by the main thread */
@@ -682,7 +722,9 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 	void *data;
 	void *ctx;
 	mdb_op_info *moi = NULL;
+	mdb_rslot *mr = NULL;
 	OpExtra *oex;
+	int own = 0;
 
 	assert( op != NULL );
 
@@ -705,7 +747,10 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 	if ( !moi ) {
 		moi = *moip;
 
-		if ( !moi ) {
+		if ( moi ) {
+			/* The caller's own txn, ended by mdb_opinfo_commit/abort */
+			own = 1;
+		} else {
 			if ( op ) {
 				moi = op->o_tmpalloc(sizeof(struct mdb_op_info),op->o_tmpmemctx);
 			} else {
@@ -733,6 +778,16 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		if ( !moi->moi_txn ) {
 			if (( slapMode & SLAP_TOOL_MODE ) && mdb_tool_txn ) {
 				moi->moi_txn = mdb_tool_txn;
+			} else if ( own && mdb->mi_gc_window &&
+				!( slapMode & SLAP_TOOL_MODE ) &&
+				!( mdb->mi_dbenv_flags & MDB_WRITEMAP )) {
+				/* child txns don't work with a writemap */
+				rc = mdb_group_join( mdb, moi );
+				if (rc) {
+					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
+						mdb_strerror(rc), rc, 0 );
+				}
+				return rc;
 			} else {
 				int flag = 0;
 				if ( get_lazyCommit( op ))
@@ -741,6 +796,8 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 				if (rc) {
 					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 						mdb_strerror(rc), rc, 0 );
+				} else {
+					moi->moi_numads = mdb->mi_numads;
 				}
 				return rc;
 			}
@@ -770,20 +827,35 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 					mdb_strerror(rc), rc, 0 );
 				return rc;
 			}
-			data = moi->moi_txn;
+			mr = ch_calloc( 1, sizeof( mdb_rslot ));
+			mr->mr_mdb = mdb;
+			mr->mr_txn = moi->moi_txn;
+			mr->mr_tid = ldap_pvt_thread_self();
+			data = mr;
 			if ( ( rc = ldap_pvt_thread_pool_setkey( ctx, mdb->mi_dbenv,
 				data, mdb_reader_free, NULL, NULL ) ) ) {
 				mdb_txn_abort( moi->moi_txn );
 				moi->moi_txn = NULL;
+				ch_free( mr );
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: thread_pool_setkey failed err (%d)\n",
 					rc, 0, 0 );
 				return rc;
 			}
+			ldap_pvt_thread_mutex_lock( &mdb->mi_rslot_mutex );
+			mr->mr_next = mdb->mi_rslots;
+			mdb->mi_rslots = mr;
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_rslot_mutex );
 		} else {
-			moi->moi_txn = data;
+			mr = data;
+			moi->moi_txn = mr->mr_txn;
 			renew = 1;
 		}
 		moi->moi_flag |= MOI_READER;
+		if ( op ) {
+			mr->mr_connid = op->o_connid;
+			mr->mr_opid = op->o_opid;
+		}
+		mr->mr_since = slap_get_time();
 	}
 ok:
 	if ( moi->moi_ref < 1 ) {
@@ -800,6 +872,22 @@ ok:
 	return 0;
 }
 
+/* The write txn of op changed the indexes or the DIT, candidates
+ * kept for paged searches may be wrong once it commits.
+ */
+void
+mdb_opinfo_changed( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) {
+			((mdb_op_info *)oex)->moi_flag |= MOI_CHANGED;
+			break;
+		}
+	}
+}
+
 #ifdef LDAP_X_TXN
 int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 {
@@ -816,6 +904,8 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		}
 		return rc;
 	case SLAP_TXN_COMMIT:
+		if ( moi->moi_flag & MOI_CHANGED )
+			mdb_paged_changed( mdb, mdb_txn_id( moi->moi_txn ));
 		rc = mdb_txn_commit( moi->moi_txn );
 		if ( rc )
 			mdb->mi_numads = 0;
@@ -1016,6 +1106,12 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 		"=> mdb_entry_decode:\n",
 		0, 0, 0 );
 
+	if ( mdb_ecache_find( op, txn, id, e ) == 0 ) {
+		Debug( LDAP_DEBUG_TRACE, "<= mdb_entry_decode: cached\n",
+			0, 0, 0 );
+		return 0;
+	}
+
 	nattrs = *lp++;
 	nvals = *lp++;
 	x = mdb_entry_alloc(op, nattrs, nvals);
@@ -1122,6 +1218,8 @@ done:
 	*e = x;
 	rc = 0;
 
+	mdb_ecache_add( op, txn, id, x );
+
 leave:
 	if (mvc)
 		mdb_cursor_close(mvc);
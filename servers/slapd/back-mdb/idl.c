@@ -26,11 +26,44 @@
 #define IDL_MIN(x,y)	( (x) < (y) ? (x) : (y) )
 #define IDL_CMP(x,y)	( (x) < (y) ? -1 : (x) > (y) )
 
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define IDL_POPCNT(w)	__builtin_popcountl(w)
+#define IDL_CTZ(w)		__builtin_ctzl(w)
+#define IDL_CLZ(w)		__builtin_clzl(w)
+#else
+static int
+IDL_POPCNT( ID w )
+{
+	int n = 0;
+	for ( ; w; w &= w-1 ) n++;
+	return n;
+}
+
+static int
+IDL_CTZ( ID w )
+{
+	int n = 0;
+	for ( ; !(w & 1); w >>= 1 ) n++;
+	return n;
+}
+
+static int
+IDL_CLZ( ID w )
+{
+	int n = 0;
+	for ( ; !(w & ((ID)1 << (MDB_IDL_BM_BITS-1))); w <<= 1 ) n++;
+	return n;
+}
+#endif
+
 #if IDL_DEBUG > 0
 static void idl_check( ID *ids )
 {
 	if( MDB_IDL_IS_RANGE( ids ) ) {
 		assert( MDB_IDL_RANGE_FIRST(ids) <= MDB_IDL_RANGE_LAST(ids) );
+	} else if( MDB_IDL_IS_BITMAP( ids ) ) {
+		assert( ids[1] <= ids[2] );
+		assert( MDB_IDL_BM_MAP(ids) != NULL );
 	} else {
 		ID i;
 		for( i=1; i < ids[0]; i++ ) {
@@ -48,6 +81,13 @@ static void idl_dump( ID *ids )
 			(long) MDB_IDL_RANGE_FIRST( ids ),
 			(long) MDB_IDL_RANGE_LAST( ids ) );
 
+	} else if( MDB_IDL_IS_BITMAP( ids ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"IDL: bitmap ( %ld - %ld ) count %ld\n",
+			(long) MDB_IDL_FIRST( ids ),
+			(long) MDB_IDL_LAST( ids ),
+			(long) MDB_IDL_BM_COUNT( ids ) );
+
 	} else {
 		ID i;
 		Debug( LDAP_DEBUG_ANY, "IDL: size %ld", (long) ids[0], 0, 0 );
@@ -67,62 +107,835 @@ static void idl_dump( ID *ids )
 #endif /* IDL_DEBUG > 1 */
 #endif /* IDL_DEBUG > 0 */
 
-unsigned mdb_idl_search( ID *ids, ID id )
+/* Roaring bitmaps, see idl.h. A container holds the IDs of one block
+ * of 2^RB_LOBITS IDs, as a sorted array of their low bits while there
+ * are at most RB_ARRAYMAX of them, as a bitmap of the block beyond.
+ */
+#define RB_LOBITS	16
+#define RB_LOMAX	((1U << RB_LOBITS) - 1)
+#define RB_KEY(id)	((id) >> RB_LOBITS)
+#define RB_LOW(id)	((unsigned)((id) & RB_LOMAX))
+#define RB_ID(key,low)	(((key) << RB_LOBITS) | (low))
+#define RB_WORDS	((1U << RB_LOBITS) / MDB_IDL_BM_BITS)
+#define RB_ARRAYMAX	4096	/* the size of a bitmap, in array slots */
+
+typedef struct mdb_rbc {
+	ID		rc_key;		/* the IDs' high bits */
+	unsigned	rc_n;		/* number of IDs */
+	unsigned	rc_max;		/* array slots, 0 for a bitmap */
+	unsigned short	*rc_array;
+	ID		*rc_bits;
+} mdb_rbc;
+
+typedef struct mdb_rbmap {
+	mdb_rbc		*rb_c;		/* sorted by key */
+	unsigned	rb_n;
+	unsigned	rb_max;
+	ID		*rb_ids;	/* IDL buffer it belongs to, NULL if private */
+	struct mdb_rbmap *rb_next;
+} mdb_rbmap;
+
+/* Maps of the IDL buffers of this thread's searches */
+typedef struct mdb_idl_bms {
+	mdb_rbmap	*bs_maps;
+	int		bs_depth;
+} mdb_idl_bms;
+
+/* Ranges wider than this are not turned into bitmaps */
+#define IDL_BM_RANGEMAX	((ID)1 << 24)
+
+/* The bits of the word starting at low ws that are within lo..hi */
+static ID
+rb_mask( unsigned ws, unsigned lo, unsigned hi )
 {
-#define IDL_BINARY_SEARCH 1
-#ifdef IDL_BINARY_SEARCH
-	/*
-	 * binary search of id in ids
-	 * if found, returns position of id
-	 * if not found, returns first postion greater than id
-	 */
-	unsigned base = 0;
-	unsigned cursor = 1;
-	int val = 0;
-	unsigned n = ids[0];
+	ID mask = ~(ID)0;
 
-#if IDL_DEBUG > 0
-	idl_check( ids );
-#endif
+	if ( ws > hi || ws + MDB_IDL_BM_BITS - 1 < lo )
+		return 0;
+	if ( lo > ws )
+		mask &= ~(ID)0 << (lo - ws);
+	if ( hi - ws < MDB_IDL_BM_BITS - 1 )
+		mask &= ~(ID)0 >> (MDB_IDL_BM_BITS - 1 - (hi - ws));
+	return mask;
+}
 
-	while( 0 < n ) {
-		unsigned pivot = n >> 1;
-		cursor = base + pivot + 1;
-		val = IDL_CMP( id, ids[cursor] );
+static void
+rbc_free( mdb_rbc *c )
+{
+	ch_free( c->rc_array );
+	ch_free( c->rc_bits );
+}
 
-		if( val < 0 ) {
+static void
+rbc_clear( mdb_rbc *c )
+{
+	if ( !c->rc_max )
+		memset( c->rc_bits, 0, RB_WORDS * sizeof(ID) );
+	c->rc_n = 0;
+}
+
+static void
+rbc_copy( mdb_rbc *dst, mdb_rbc *src )
+{
+	*dst = *src;
+	if ( src->rc_max ) {
+		dst->rc_array = ch_malloc( src->rc_max * sizeof(unsigned short) );
+		AC_MEMCPY( dst->rc_array, src->rc_array,
+			src->rc_n * sizeof(unsigned short) );
+	} else {
+		dst->rc_bits = ch_malloc( RB_WORDS * sizeof(ID) );
+		AC_MEMCPY( dst->rc_bits, src->rc_bits, RB_WORDS * sizeof(ID) );
+	}
+}
+
+/* Index of the first low >= low in an array container */
+static unsigned
+rbc_search( mdb_rbc *c, unsigned low )
+{
+	unsigned base = 0, n = c->rc_n, pivot;
+
+	while ( n ) {
+		pivot = n >> 1;
+		if ( c->rc_array[base + pivot] < low ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
 			n = pivot;
+		}
+	}
+	return base;
+}
 
-		} else if ( val > 0 ) {
-			base = cursor;
+static int
+rbc_test( mdb_rbc *c, unsigned low )
+{
+	unsigned i;
+
+	if ( !c->rc_max )
+		return ( c->rc_bits[low / MDB_IDL_BM_BITS] >>
+			( low % MDB_IDL_BM_BITS )) & 1;
+	i = rbc_search( c, low );
+	return i < c->rc_n && c->rc_array[i] == low;
+}
+
+/* The first low >= low in the container, or -1 */
+static int
+rbc_next( mdb_rbc *c, unsigned low )
+{
+	unsigned i;
+	ID w;
+
+	if ( c->rc_max ) {
+		i = rbc_search( c, low );
+		return i < c->rc_n ? c->rc_array[i] : -1;
+	}
+	i = low / MDB_IDL_BM_BITS;
+	w = c->rc_bits[i] & ( ~(ID)0 << ( low % MDB_IDL_BM_BITS ));
+	while ( !w ) {
+		if ( ++i >= RB_WORDS )
+			return -1;
+		w = c->rc_bits[i];
+	}
+	return i * MDB_IDL_BM_BITS + IDL_CTZ( w );
+}
+
+/* The highest low in a non-empty container */
+static unsigned
+rbc_last( mdb_rbc *c )
+{
+	unsigned i;
+
+	if ( c->rc_max )
+		return c->rc_array[c->rc_n - 1];
+	for ( i = RB_WORDS - 1; !c->rc_bits[i]; i-- ) ;
+	return i * MDB_IDL_BM_BITS + MDB_IDL_BM_BITS - 1 -
+		IDL_CLZ( c->rc_bits[i] );
+}
+
+static void
+rbc_to_bitmap( mdb_rbc *c )
+{
+	ID *bits = ch_calloc( RB_WORDS, sizeof(ID) );
+	unsigned i;
+
+	for ( i = 0; i < c->rc_n; i++ )
+		bits[c->rc_array[i] / MDB_IDL_BM_BITS] |=
+			(ID)1 << ( c->rc_array[i] % MDB_IDL_BM_BITS );
+	ch_free( c->rc_array );
+	c->rc_array = NULL;
+	c->rc_bits = bits;
+	c->rc_max = 0;
+}
+
+/* Recount a bitmap container, turn it back into an array if that
+ * is smaller.
+ */
+static void
+rbc_shrink( mdb_rbc *c )
+{
+	unsigned i, n = 0;
+	ID w;
+
+	if ( c->rc_max )
+		return;
+	for ( i = 0; i < RB_WORDS; i++ )
+		n += IDL_POPCNT( c->rc_bits[i] );
+	c->rc_n = n;
+	if ( n > RB_ARRAYMAX )
+		return;
+
+	c->rc_max = n ? n : 1;
+	c->rc_array = ch_malloc( c->rc_max * sizeof(unsigned short) );
+	for ( i = 0, n = 0; i < RB_WORDS; i++ ) {
+		for ( w = c->rc_bits[i]; w; w &= w - 1 )
+			c->rc_array[n++] = i * MDB_IDL_BM_BITS + IDL_CTZ( w );
+	}
+	ch_free( c->rc_bits );
+	c->rc_bits = NULL;
+}
+
+static void
+rbc_add( mdb_rbc *c, unsigned low )
+{
+	unsigned i;
+	ID bit;
+
+	if ( c->rc_max ) {
+		/* IDs mostly come in ascending order */
+		if ( !c->rc_n || c->rc_array[c->rc_n - 1] < low )
+			i = c->rc_n;
+		else
+			i = rbc_search( c, low );
+		if ( i < c->rc_n && c->rc_array[i] == low )
+			return;
+		if ( c->rc_n < RB_ARRAYMAX ) {
+			if ( c->rc_n == c->rc_max ) {
+				c->rc_max = IDL_MIN( 2 * c->rc_max, RB_ARRAYMAX );
+				c->rc_array = ch_realloc( c->rc_array,
+					c->rc_max * sizeof(unsigned short) );
+			}
+			AC_MEMCPY( c->rc_array + i + 1, c->rc_array + i,
+				( c->rc_n - i ) * sizeof(unsigned short) );
+			c->rc_array[i] = low;
+			c->rc_n++;
+			return;
+		}
+		rbc_to_bitmap( c );
+	}
+	bit = (ID)1 << ( low % MDB_IDL_BM_BITS );
+	if ( !( c->rc_bits[low / MDB_IDL_BM_BITS] & bit )) {
+		c->rc_bits[low / MDB_IDL_BM_BITS] |= bit;
+		c->rc_n++;
+	}
+}
+
+static void
+rbc_del( mdb_rbc *c, unsigned low )
+{
+	unsigned i;
+	ID bit;
+
+	if ( !c->rc_max ) {
+		bit = (ID)1 << ( low % MDB_IDL_BM_BITS );
+		if ( c->rc_bits[low / MDB_IDL_BM_BITS] & bit ) {
+			c->rc_bits[low / MDB_IDL_BM_BITS] &= ~bit;
+			c->rc_n--;
+		}
+		return;
+	}
+	i = rbc_search( c, low );
+	if ( i < c->rc_n && c->rc_array[i] == low ) {
+		AC_MEMCPY( c->rc_array + i, c->rc_array + i + 1,
+			( c->rc_n - i - 1 ) * sizeof(unsigned short) );
+		c->rc_n--;
+	}
+}
+
+/* c = c intersection d */
+static void
+rbc_and( mdb_rbc *c, mdb_rbc *d )
+{
+	unsigned i, j, n;
+	unsigned short *a;
+
+	if ( !c->rc_max ) {
+		if ( !d->rc_max ) {
+			for ( i = 0; i < RB_WORDS; i++ )
+				c->rc_bits[i] &= d->rc_bits[i];
+			rbc_shrink( c );
+			return;
+		}
+		/* no more IDs than in d's array */
+		a = ch_malloc( d->rc_max * sizeof(unsigned short) );
+		for ( i = 0, n = 0; i < d->rc_n; i++ ) {
+			if ( rbc_test( c, d->rc_array[i] ))
+				a[n++] = d->rc_array[i];
+		}
+		ch_free( c->rc_bits );
+		c->rc_bits = NULL;
+		c->rc_array = a;
+		c->rc_max = d->rc_max;
+		c->rc_n = n;
+		return;
+	}
+
+	if ( !d->rc_max ) {
+		for ( i = 0, n = 0; i < c->rc_n; i++ ) {
+			if ( rbc_test( d, c->rc_array[i] ))
+				c->rc_array[n++] = c->rc_array[i];
+		}
+	} else {
+		for ( i = 0, j = 0, n = 0; i < c->rc_n && j < d->rc_n; ) {
+			if ( c->rc_array[i] < d->rc_array[j] ) {
+				i++;
+			} else if ( c->rc_array[i] > d->rc_array[j] ) {
+				j++;
+			} else {
+				c->rc_array[n++] = c->rc_array[i];
+				i++;
+				j++;
+			}
+		}
+	}
+	c->rc_n = n;
+}
+
+/* c = c minus d */
+static void
+rbc_andnot( mdb_rbc *c, mdb_rbc *d )
+{
+	unsigned i, j, n;
+
+	if ( !c->rc_max ) {
+		if ( !d->rc_max ) {
+			for ( i = 0; i < RB_WORDS; i++ )
+				c->rc_bits[i] &= ~d->rc_bits[i];
+			rbc_shrink( c );
+		} else {
+			for ( i = 0; i < d->rc_n; i++ )
+				rbc_del( c, d->rc_array[i] );
+		}
+		return;
+	}
+
+	if ( !d->rc_max ) {
+		for ( i = 0, n = 0; i < c->rc_n; i++ ) {
+			if ( !rbc_test( d, c->rc_array[i] ))
+				c->rc_array[n++] = c->rc_array[i];
+		}
+	} else {
+		for ( i = 0, j = 0, n = 0; i < c->rc_n; ) {
+			if ( j >= d->rc_n || c->rc_array[i] < d->rc_array[j] ) {
+				c->rc_array[n++] = c->rc_array[i++];
+			} else if ( c->rc_array[i] > d->rc_array[j] ) {
+				j++;
+			} else {
+				i++;
+				j++;
+			}
+		}
+	}
+	c->rc_n = n;
+}
+
+/* c = c union d */
+static void
+rbc_or( mdb_rbc *c, mdb_rbc *d )
+{
+	unsigned i, j, n;
+	unsigned short *a;
+
+	if ( c->rc_max && d->rc_max && c->rc_n + d->rc_n <= RB_ARRAYMAX ) {
+		a = ch_malloc( ( c->rc_n + d->rc_n ) * sizeof(unsigned short) );
+		for ( i = 0, j = 0, n = 0; i < c->rc_n || j < d->rc_n; ) {
+			if ( j >= d->rc_n ||
+				( i < c->rc_n && c->rc_array[i] < d->rc_array[j] ))
+			{
+				a[n++] = c->rc_array[i++];
+			} else {
+				if ( i < c->rc_n && c->rc_array[i] == d->rc_array[j] )
+					i++;
+				a[n++] = d->rc_array[j++];
+			}
+		}
+		ch_free( c->rc_array );
+		c->rc_array = a;
+		c->rc_max = c->rc_n + d->rc_n;
+		c->rc_n = n;
+		return;
+	}
+
+	if ( c->rc_max )
+		rbc_to_bitmap( c );
+	if ( d->rc_max ) {
+		for ( i = 0; i < d->rc_n; i++ )
+			c->rc_bits[d->rc_array[i] / MDB_IDL_BM_BITS] |=
+				(ID)1 << ( d->rc_array[i] % MDB_IDL_BM_BITS );
+	} else {
+		for ( i = 0; i < RB_WORDS; i++ )
+			c->rc_bits[i] |= d->rc_bits[i];
+	}
+	rbc_shrink( c );
+}
+
+/* Keep only the lows within lo..hi, or with keep unset, drop them */
+static void
+rbc_range( mdb_rbc *c, unsigned lo, unsigned hi, int keep )
+{
+	unsigned i, n;
+	ID mask;
+
+	if ( c->rc_max ) {
+		for ( i = 0, n = 0; i < c->rc_n; i++ ) {
+			if (( c->rc_array[i] >= lo && c->rc_array[i] <= hi ) == keep )
+				c->rc_array[n++] = c->rc_array[i];
+		}
+		c->rc_n = n;
+		return;
+	}
+	for ( i = 0; i < RB_WORDS; i++ ) {
+		mask = rb_mask( i * MDB_IDL_BM_BITS, lo, hi );
+		c->rc_bits[i] &= keep ? mask : ~mask;
+	}
+	rbc_shrink( c );
+}
+
+/* Add all of lo..hi */
+static void
+rbc_fill( mdb_rbc *c, unsigned lo, unsigned hi )
+{
+	unsigned i;
+
+	if ( c->rc_max )
+		rbc_to_bitmap( c );
+	for ( i = 0; i < RB_WORDS; i++ )
+		c->rc_bits[i] |= rb_mask( i * MDB_IDL_BM_BITS, lo, hi );
+	rbc_shrink( c );
+}
+
+static void
+rb_clear( mdb_rbmap *rb )
+{
+	unsigned i;
+
+	for ( i = 0; i < rb->rb_n; i++ )
+		rbc_free( &rb->rb_c[i] );
+	rb->rb_n = 0;
+}
+
+static void
+rb_free( mdb_rbmap *rb )
+{
+	rb_clear( rb );
+	ch_free( rb->rb_c );
+	ch_free( rb );
+}
+
+static void
+rb_copy( mdb_rbmap *dst, mdb_rbmap *src )
+{
+	unsigned i;
+
+	rb_clear( dst );
+	if ( dst->rb_max < src->rb_n ) {
+		dst->rb_max = src->rb_n;
+		dst->rb_c = ch_realloc( dst->rb_c, dst->rb_max * sizeof(mdb_rbc) );
+	}
+	for ( i = 0; i < src->rb_n; i++ )
+		rbc_copy( &dst->rb_c[i], &src->rb_c[i] );
+	dst->rb_n = src->rb_n;
+}
+
+/* Index of the first container with a key >= key */
+static unsigned
+rb_search( mdb_rbmap *rb, ID key )
+{
+	unsigned base = 0, n = rb->rb_n, pivot;
+
+	while ( n ) {
+		pivot = n >> 1;
+		if ( rb->rb_c[base + pivot].rc_key < key ) {
+			base += pivot + 1;
 			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	return base;
+}
+
+/* The container for key, added if missing */
+static mdb_rbc *
+rb_container( mdb_rbmap *rb, ID key )
+{
+	unsigned i;
+	mdb_rbc *c;
+
+	if ( !rb->rb_n || rb->rb_c[rb->rb_n - 1].rc_key < key )
+		i = rb->rb_n;
+	else
+		i = rb_search( rb, key );
+	if ( i < rb->rb_n && rb->rb_c[i].rc_key == key )
+		return &rb->rb_c[i];
+
+	if ( rb->rb_n == rb->rb_max ) {
+		rb->rb_max = rb->rb_max ? 2 * rb->rb_max : 16;
+		rb->rb_c = ch_realloc( rb->rb_c, rb->rb_max * sizeof(mdb_rbc) );
+	}
+	c = &rb->rb_c[i];
+	AC_MEMCPY( c + 1, c, ( rb->rb_n - i ) * sizeof(mdb_rbc) );
+	rb->rb_n++;
+	c->rc_key = key;
+	c->rc_n = 0;
+	c->rc_max = 4;
+	c->rc_array = ch_malloc( c->rc_max * sizeof(unsigned short) );
+	c->rc_bits = NULL;
+	return c;
+}
+
+static void
+rb_add( mdb_rbmap *rb, ID id )
+{
+	rbc_add( rb_container( rb, RB_KEY( id )), RB_LOW( id ));
+}
+
+static void
+rb_del( mdb_rbmap *rb, ID id )
+{
+	unsigned i = rb_search( rb, RB_KEY( id ));
+
+	if ( i < rb->rb_n && rb->rb_c[i].rc_key == RB_KEY( id ))
+		rbc_del( &rb->rb_c[i], RB_LOW( id ));
+}
+
+static int
+rb_test( mdb_rbmap *rb, ID id )
+{
+	unsigned i = rb_search( rb, RB_KEY( id ));
+
+	return i < rb->rb_n && rb->rb_c[i].rc_key == RB_KEY( id ) &&
+		rbc_test( &rb->rb_c[i], RB_LOW( id ));
+}
+
+/* The first ID >= id in the map, or NOID */
+static ID
+rb_next( mdb_rbmap *rb, ID id )
+{
+	unsigned i = rb_search( rb, RB_KEY( id ));
+	int low;
+
+	if ( i < rb->rb_n && rb->rb_c[i].rc_key == RB_KEY( id )) {
+		low = rbc_next( &rb->rb_c[i], RB_LOW( id ));
+		if ( low >= 0 )
+			return RB_ID( rb->rb_c[i].rc_key, low );
+		i++;
+	}
+	for ( ; i < rb->rb_n; i++ ) {
+		low = rbc_next( &rb->rb_c[i], 0 );
+		if ( low >= 0 )
+			return RB_ID( rb->rb_c[i].rc_key, low );
+	}
+	return NOID;
+}
+
+/* a = a intersection b */
+static void
+rb_and( mdb_rbmap *a, mdb_rbmap *b )
+{
+	unsigned i, j = 0;
+	mdb_rbc *c;
+
+	for ( i = 0; i < a->rb_n; i++ ) {
+		c = &a->rb_c[i];
+		while ( j < b->rb_n && b->rb_c[j].rc_key < c->rc_key )
+			j++;
+		if ( j < b->rb_n && b->rb_c[j].rc_key == c->rc_key )
+			rbc_and( c, &b->rb_c[j] );
+		else
+			rbc_clear( c );
+	}
+}
+
+/* a = a minus b */
+static void
+rb_andnot( mdb_rbmap *a, mdb_rbmap *b )
+{
+	unsigned i, j = 0;
+	mdb_rbc *c;
+
+	for ( i = 0; i < a->rb_n; i++ ) {
+		c = &a->rb_c[i];
+		while ( j < b->rb_n && b->rb_c[j].rc_key < c->rc_key )
+			j++;
+		if ( j < b->rb_n && b->rb_c[j].rc_key == c->rc_key )
+			rbc_andnot( c, &b->rb_c[j] );
+	}
+}
+
+/* a = a union b */
+static void
+rb_or( mdb_rbmap *a, mdb_rbmap *b )
+{
+	unsigned i = 0, j = 0, n = 0, max = a->rb_n + b->rb_n;
+	mdb_rbc *c;
 
+	if ( !b->rb_n )
+		return;
+	c = ch_malloc( max * sizeof(mdb_rbc) );
+	while ( i < a->rb_n || j < b->rb_n ) {
+		if ( j >= b->rb_n ||
+			( i < a->rb_n && a->rb_c[i].rc_key < b->rb_c[j].rc_key ))
+		{
+			c[n++] = a->rb_c[i++];
+		} else if ( i >= a->rb_n || b->rb_c[j].rc_key < a->rb_c[i].rc_key ) {
+			rbc_copy( &c[n++], &b->rb_c[j++] );
 		} else {
-			return cursor;
+			c[n] = a->rb_c[i++];
+			rbc_or( &c[n++], &b->rb_c[j++] );
 		}
 	}
-	
-	if( val > 0 ) {
-		++cursor;
+	ch_free( a->rb_c );
+	a->rb_c = c;
+	a->rb_n = n;
+	a->rb_max = max;
+}
+
+/* Keep only the IDs within lo..hi, or with keep unset, drop them */
+static void
+rb_range( mdb_rbmap *rb, ID lo, ID hi, int keep )
+{
+	ID klo = RB_KEY( lo ), khi = RB_KEY( hi );
+	unsigned i, l, h;
+	mdb_rbc *c;
+
+	for ( i = 0; i < rb->rb_n; i++ ) {
+		c = &rb->rb_c[i];
+		if ( c->rc_key < klo || c->rc_key > khi ) {
+			if ( keep )
+				rbc_clear( c );
+			continue;
+		}
+		l = c->rc_key == klo ? RB_LOW( lo ) : 0;
+		h = c->rc_key == khi ? RB_LOW( hi ) : RB_LOMAX;
+		if ( l == 0 && h == RB_LOMAX ) {
+			if ( !keep )
+				rbc_clear( c );
+			continue;
+		}
+		rbc_range( c, l, h, keep );
 	}
-	return cursor;
+}
 
-#else
-	/* (reverse) linear search */
-	int i;
+/* Add all of lo..hi */
+static void
+rb_fill( mdb_rbmap *rb, ID lo, ID hi )
+{
+	ID key;
 
-#if IDL_DEBUG > 0
-	idl_check( ids );
-#endif
+	for ( key = RB_KEY( lo ); key <= RB_KEY( hi ); key++ ) {
+		rbc_fill( rb_container( rb, key ),
+			key == RB_KEY( lo ) ? RB_LOW( lo ) : 0,
+			key == RB_KEY( hi ) ? RB_LOW( hi ) : RB_LOMAX );
+	}
+}
 
-	for( i=ids[0]; i; i-- ) {
-		if( id > ids[i] ) {
-			break;
+/* Drop the empty containers of rb and write the header of ids, which
+ * rb belongs to. A bitmap left with few IDs is turned back into a list.
+ */
+static void
+mdb_idl_bm_done( ID *ids, mdb_rbmap *rb )
+{
+	unsigned i, n;
+	ID count = 0, *p, w;
+	mdb_rbc *c;
+
+	for ( i = 0, n = 0; i < rb->rb_n; i++ ) {
+		if ( !rb->rb_c[i].rc_n ) {
+			rbc_free( &rb->rb_c[i] );
+			continue;
 		}
+		count += rb->rb_c[i].rc_n;
+		rb->rb_c[n++] = rb->rb_c[i];
 	}
+	rb->rb_n = n;
+
+	if ( !count ) {
+		MDB_IDL_ZERO( ids );
 
-	return i+1;
+	} else if ( count < MDB_IDL_DB_SIZE ) {
+		p = ids;
+		for ( c = rb->rb_c; c < rb->rb_c + n; c++ ) {
+			if ( c->rc_max ) {
+				for ( i = 0; i < c->rc_n; i++ )
+					*++p = RB_ID( c->rc_key, c->rc_array[i] );
+				continue;
+			}
+			for ( i = 0; i < RB_WORDS; i++ ) {
+				for ( w = c->rc_bits[i]; w; w &= w - 1 )
+					*++p = RB_ID( c->rc_key,
+						i * MDB_IDL_BM_BITS + IDL_CTZ( w ));
+			}
+		}
+		ids[0] = count;
+
+	} else {
+		ids[0] = MDB_IDL_BM_TAG;
+		ids[1] = RB_ID( rb->rb_c[0].rc_key, rbc_next( &rb->rb_c[0], 0 ));
+		ids[2] = RB_ID( rb->rb_c[n-1].rc_key, rbc_last( &rb->rb_c[n-1] ));
+		ids[3] = count;
+		ids[4] = (ID) rb;
+	}
+}
+
+static void
+mdb_idl_bm_release( mdb_idl_bms *bs )
+{
+	mdb_rbmap *rb;
+
+	while (( rb = bs->bs_maps )) {
+		bs->bs_maps = rb->rb_next;
+		rb_free( rb );
+	}
+}
+
+static void
+mdb_idl_bm_keyfree( void *key, void *data )
+{
+	mdb_idl_bm_release( data );
+	ch_free( data );
+}
+
+static mdb_idl_bms *
+mdb_idl_bm_state( void )
+{
+	void *ctx = ldap_pvt_thread_pool_context();
+	void *data = NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)mdb_idl_bm_state,
+		&data, NULL ))
+	{
+		data = ch_calloc( 1, sizeof( mdb_idl_bms ));
+		if ( ldap_pvt_thread_pool_setkey( ctx, (void *)mdb_idl_bm_state,
+			data, mdb_idl_bm_keyfree, NULL, NULL ))
+		{
+			ch_free( data );
+			data = NULL;
+		}
+	}
+	return data;
+}
+
+/* An empty map for a new bitmap in the IDL buffer ids. Returns NULL
+ * if there is none, the caller then settles for a range. Outside of
+ * mdb_idl_bm_begin/end nothing would free the map, so there is none.
+ */
+static mdb_rbmap *
+mdb_idl_bm_get( ID *ids )
+{
+	mdb_idl_bms *bs = mdb_idl_bm_state();
+	mdb_rbmap *rb;
+
+	if ( !bs || !bs->bs_depth )
+		return NULL;
+	for ( rb = bs->bs_maps; rb; rb = rb->rb_next ) {
+		if ( rb->rb_ids == ids ) {
+			rb_clear( rb );
+			return rb;
+		}
+	}
+	rb = ch_calloc( 1, sizeof( mdb_rbmap ));
+	rb->rb_ids = ids;
+	rb->rb_next = bs->bs_maps;
+	bs->bs_maps = rb;
+	return rb;
+}
+
+/* Searches bracket their use of IDLs with these. The maps of the
+ * thread's IDL buffers are freed when the outermost search ends,
+ * a search sending entries may run another one on the same thread.
+ */
+void
+mdb_idl_bm_begin( void )
+{
+	mdb_idl_bms *bs = mdb_idl_bm_state();
+
+	if ( bs ) {
+		/* the last outermost search released everything */
+		assert( bs->bs_depth || !bs->bs_maps );
+		bs->bs_depth++;
+	}
+}
+
+void
+mdb_idl_bm_end( void )
+{
+	mdb_idl_bms *bs = mdb_idl_bm_state();
+
+	if ( bs && bs->bs_depth > 0 && !--bs->bs_depth )
+		mdb_idl_bm_release( bs );
+}
+
+int
+mdb_idl_bm_test( ID *ids, ID id )
+{
+	return id >= ids[1] && id <= ids[2] &&
+		rb_test( MDB_IDL_BM_MAP( ids ), id );
+}
+
+/* MDB_IDL_CPY of a bitmap */
+void
+mdb_idl_bm_copy( ID *dst, ID *src )
+{
+	mdb_rbmap *rb = MDB_IDL_BM_MAP( src );
+
+	if ( rb->rb_ids != dst ) {
+		rb = mdb_idl_bm_get( dst );
+		if ( !rb ) {
+			MDB_IDL_RANGE( dst, src[1], src[2] );
+			return;
+		}
+		rb_copy( rb, MDB_IDL_BM_MAP( src ));
+	}
+	AC_MEMCPY( dst, src, MDB_IDL_BM_HDR * sizeof(ID) );
+	dst[4] = (ID) rb;
+}
+
+/* A copy of ids on the heap that does not depend on the search */
+ID *
+mdb_idl_dup( ID *ids )
+{
+	ID *dup = ch_malloc( MDB_IDL_SIZEOF( ids ));
+	mdb_rbmap *rb;
+
+	AC_MEMCPY( dup, ids, MDB_IDL_SIZEOF( ids ));
+	if ( MDB_IDL_IS_BITMAP( ids )) {
+		rb = ch_calloc( 1, sizeof( mdb_rbmap ));
+		rb_copy( rb, MDB_IDL_BM_MAP( ids ));
+		dup[4] = (ID) rb;
+	}
+	return dup;
+}
+
+void
+mdb_idl_free( ID *ids )
+{
+	if ( ids && MDB_IDL_IS_BITMAP( ids ))
+		rb_free( MDB_IDL_BM_MAP( ids ));
+	ch_free( ids );
+}
+
+unsigned mdb_idl_search( ID *ids, ID id )
+{
+	/*
+	 * search of id in ids
+	 * if found, returns position of id
+	 * if not found, returns first postion greater than id
+	 */
+#if IDL_DEBUG > 0
+	idl_check( ids );
 #endif
+
+	return mdb_idl_vec.iv_search( ids+1, ids[0], id ) + 1;
 }
 
 int mdb_idl_insert( ID *ids, ID id )
@@ -147,6 +960,18 @@ int mdb_idl_insert( ID *ids, ID id )
 		return 0;
 	}
 
+	if (MDB_IDL_IS_BITMAP( ids )) {
+		if (MDB_IDL_BM_TEST( ids, id ))
+			return -1;
+		rb_add( MDB_IDL_BM_MAP( ids ), id );
+		ids[3]++;
+		if ( id < ids[1] )
+			ids[1] = id;
+		if ( id > ids[2] )
+			ids[2] = id;
+		return 0;
+	}
+
 	x = mdb_idl_search( ids, id );
 	assert( x > 0 );
 
@@ -258,6 +1083,44 @@ mdb_show_key(
 	}
 }
 
+/* Read all the IDs of the current key into a bitmap. If no map
+ * can be had for it, return a range instead.
+ */
+static int
+mdb_idl_fetch_bitmap(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			*ids )
+{
+	MDB_val data;
+	mdb_rbmap *rb;
+	ID lo, hi, *i;
+	size_t n;
+	int rc;
+
+	rb = mdb_idl_bm_get( ids );
+	if ( !rb ) {
+		rc = mdb_cursor_get( cursor, key, &data, MDB_LAST_DUP );
+		if ( rc ) return rc;
+		memcpy( &hi, data.mv_data, sizeof(ID) );
+		rc = mdb_cursor_get( cursor, key, &data, MDB_FIRST_DUP );
+		if ( rc ) return rc;
+		memcpy( &lo, data.mv_data, sizeof(ID) );
+		MDB_IDL_RANGE( ids, lo, hi );
+		return mdb_cursor_get( cursor, key, &data, MDB_LAST_DUP );
+	}
+
+	rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		i = data.mv_data;
+		for ( n = data.mv_size / sizeof(ID); n; n--, i++ )
+			rb_add( rb, *i );
+		rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+	}
+	mdb_idl_bm_done( ids, rb );
+	return rc;
+}
+
 int
 mdb_idl_fetch_key(
 	BackendDB	*be,
@@ -271,7 +1134,7 @@ mdb_idl_fetch_key(
 	MDB_val data, key2, *kptr;
 	MDB_cursor *cursor;
 	ID *i;
-	size_t len;
+	size_t len, count;
 	int rc;
 	MDB_cursor_op opflag;
 
@@ -332,6 +1195,14 @@ mdb_idl_fetch_key(
 		rc = MDB_NOTFOUND;
 	}
 	if (rc == 0) {
+		rc = mdb_cursor_count( cursor, &count );
+	}
+	if (rc == 0 && count > MDB_IDL_UM_MAX) {
+		/* Too many IDs for a list, read them into a bitmap */
+		rc = mdb_idl_fetch_bitmap( cursor, key, ids );
+		if ( rc == MDB_NOTFOUND ) rc = 0;
+		data.mv_size = MDB_IDL_SIZEOF(ids);
+	} else if (rc == 0) {
 		i = ids+1;
 		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
 		while (rc == 0) {
@@ -389,6 +1260,55 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Return the number of IDs stored under a key, without reading them.
+ * For a key that was collapsed to a range, this is the size of the range.
+ */
+int
+mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count )
+{
+	MDB_cursor *cursor;
+	MDB_val data;
+	size_t n;
+	ID lo, hi;
+	int rc;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc != 0 )
+		return rc;
+
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_count( cursor, &n );
+	if ( rc == 0 ) {
+		*count = n;
+		memcpy( &lo, data.mv_data, sizeof(ID) );
+		/* On disk, a range is denoted by 0 in the first element */
+		if ( n == MDB_IDL_RANGE_SIZE && lo == 0 ) {
+			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data.mv_data, sizeof(ID) );
+				*count = hi - lo + 1;
+			}
+		}
+	}
+	mdb_cursor_close( cursor );
+
+	if ( rc == MDB_NOTFOUND ) {
+		*count = 0;
+		rc = 0;
+	}
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -447,7 +1367,7 @@ mdb_idl_insert_keys(
 				err = "c_count";
 				goto fail;
 			}
-			if ( count >= MDB_IDL_DB_MAX ) {
+			if ( count >= mdb->mi_idl_max ) {
 			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
@@ -666,6 +1586,57 @@ fail:
 }
 
 
+/*
+ * intersection where at least one of a or b is a bitmap.
+ */
+static int
+mdb_idl_bm_intersection(
+	ID *a,
+	ID *b,
+	ID idmin,
+	ID idmax )
+{
+	mdb_rbmap *rb;
+	ID i, j;
+
+	if ( !MDB_IDL_IS_BITMAP( a )) {
+		if ( MDB_IDL_IS_RANGE( a )) {
+			MDB_IDL_CPY( a, b );
+			if ( MDB_IDL_IS_BITMAP( a )) {
+				rb = MDB_IDL_BM_MAP( a );
+				rb_range( rb, idmin, idmax, 1 );
+				mdb_idl_bm_done( a, rb );
+			} else {
+				MDB_IDL_RANGE( a, idmin, idmax );
+			}
+		} else {
+			for ( i=1, j=0; i<=a[0]; i++ ) {
+				if ( mdb_idl_bm_test( b, a[i] ))
+					a[++j] = a[i];
+			}
+			a[0] = j;
+		}
+		return 0;
+	}
+
+	rb = MDB_IDL_BM_MAP( a );
+	if ( MDB_IDL_IS_RANGE( b )) {
+		rb_range( rb, idmin, idmax, 1 );
+	} else if ( !MDB_IDL_IS_BITMAP( b )) {
+		/* the result is a list no longer than b */
+		for ( i=1, j=0; i<=b[0]; i++ ) {
+			if ( rb_test( rb, b[i] ))
+				a[++j] = b[i];
+		}
+		a[0] = j;
+		return 0;
+	} else {
+		rb_and( rb, MDB_IDL_BM_MAP( b ));
+	}
+	mdb_idl_bm_done( a, rb );
+	return 0;
+}
+
 /*
  * idl_intersection - return a = a intersection b
  */
@@ -689,7 +1660,14 @@ mdb_idl_intersection(
 	if ( idmin > idmax ) {
 		a[0] = 0;
 		return 0;
-	} else if ( idmin == idmax ) {
+	}
+
+	/* Bitmap bounds are not exact, handle them separately */
+	if ( MDB_IDL_IS_BITMAP( a ) || MDB_IDL_IS_BITMAP( b )) {
+		return mdb_idl_bm_intersection( a, b, idmin, idmax );
+	}
+
+	if ( idmin == idmax ) {
 		a[0] = 1;
 		a[1] = idmin;
 		return 0;
@@ -719,6 +1697,12 @@ mdb_idl_intersection(
 		goto done;
 	}
 
+	/* Two lists, use the merge kernel */
+	if ( !MDB_IDL_IS_RANGE( b )) {
+		a[0] = mdb_idl_vec.iv_isect( a+1, a[0], b+1, b[0], a+1 );
+		goto done;
+	}
+
 	/* Fine, do the intersection one element at a time.
 	 * First advance to idmin in both IDLs.
 	 */
@@ -747,6 +1731,43 @@ done:
 }
 
 
+/*
+ * union where the result must be a bitmap. Returns -1 if no map
+ * can be had for it.
+ */
+static int
+mdb_idl_bm_union(
+	ID *a,
+	ID *b )
+{
+	mdb_rbmap *rb;
+	ID i;
+
+	if ( MDB_IDL_IS_BITMAP( a )) {
+		rb = MDB_IDL_BM_MAP( a );
+		if ( MDB_IDL_IS_BITMAP( b )) {
+			rb_or( rb, MDB_IDL_BM_MAP( b ));
+		} else {
+			for ( i=1; i<=b[0]; i++ )
+				rb_add( rb, b[i] );
+		}
+	} else {
+		rb = mdb_idl_bm_get( a );
+		if ( !rb )
+			return -1;
+		if ( MDB_IDL_IS_BITMAP( b )) {
+			rb_copy( rb, MDB_IDL_BM_MAP( b ));
+		} else {
+			for ( i=1; i<=b[0]; i++ )
+				rb_add( rb, b[i] );
+		}
+		for ( i=1; i<=a[0]; i++ )
+			rb_add( rb, a[i] );
+	}
+	mdb_idl_bm_done( a, rb );
+	return 0;
+}
+
 /*
  * idl_union - return a = a union b
  */
@@ -776,6 +1797,22 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_BITMAP( a ) || MDB_IDL_IS_BITMAP( b )) {
+bitmap:
+		if ( mdb_idl_bm_union( a, b ))
+			goto over;
+		return 0;
+	}
+
+	if ( a[0] + b[0] <= MDB_IDL_UM_MAX ) {
+		/* No risk of overflow, use the kernels. The distinct
+		 * elements of a are cat'd to b, then merged into a.
+		 */
+		cursorc = mdb_idl_vec.iv_diff( a+1, a[0], b+1, b[0], b+b[0]+1 );
+		a[0] = mdb_idl_vec.iv_merge( b+1, b[0], b+b[0]+1, cursorc, a+1 );
+		return 0;
+	}
+
 	ida = mdb_idl_first( a, &cursora );
 	idb = mdb_idl_first( b, &cursorb );
 
@@ -785,7 +1822,7 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	while( ida != NOID || idb != NOID ) {
 		if ( ida < idb ) {
 			if( ++cursorc > MDB_IDL_UM_MAX ) {
-				goto over;
+				goto bitmap;
 			}
 			b[cursorc] = ida;
 			ida = mdb_idl_next( a, &cursora );
@@ -819,7 +1856,6 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 }
 
 
-#if 0
 /*
  * mdb_idl_notin - return a intersection ~b (or a minus b)
  */
@@ -845,6 +1881,40 @@ mdb_idl_notin(
 		return 0;
 	}
 
+	if( MDB_IDL_IS_BITMAP( a ) ) {
+		mdb_rbmap *rb;
+		ID i;
+
+		MDB_IDL_CPY( ids, a );
+		if( !MDB_IDL_IS_BITMAP( ids ) ) return 0;
+		rb = MDB_IDL_BM_MAP( ids );
+		if( MDB_IDL_IS_BITMAP( b ) ) {
+			rb_andnot( rb, MDB_IDL_BM_MAP( b ) );
+		} else {
+			for( i=1; i<=b[0]; i++ )
+				rb_del( rb, b[i] );
+		}
+		mdb_idl_bm_done( ids, rb );
+		return 0;
+	}
+
+	if( MDB_IDL_IS_BITMAP( b ) ) {
+		ID i, j;
+
+		MDB_IDL_CPY( ids, a );
+		for( i=1, j=0; i<=ids[0]; i++ ) {
+			if( !mdb_idl_bm_test( b, ids[i] ) )
+				ids[++j] = ids[i];
+		}
+		ids[0] = j;
+		return 0;
+	}
+
+	if( ids != b ) {
+		ids[0] = mdb_idl_vec.iv_diff( a+1, a[0], b+1, b[0], ids+1 );
+		return 0;
+	}
+
 	ida = mdb_idl_first( a, &cursora ),
 	idb = mdb_idl_first( b, &cursorb );
 
@@ -871,7 +1941,6 @@ mdb_idl_notin(
 
 	return 0;
 }
-#endif
 
 ID mdb_idl_first( ID *ids, ID *cursor )
 {
@@ -889,6 +1958,12 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	/* bitmap cursors are IDs, like range cursors */
+	if ( MDB_IDL_IS_BITMAP( ids ) ) {
+		*cursor = rb_next( MDB_IDL_BM_MAP( ids ), *cursor );
+		return *cursor;
+	}
+
 	if ( *cursor == 0 )
 		pos = 1;
 	else
@@ -911,6 +1986,12 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	if ( MDB_IDL_IS_BITMAP( ids ) ) {
+		if ( *cursor != NOID )
+			*cursor = rb_next( MDB_IDL_BM_MAP( ids ), *cursor + 1 );
+		return *cursor;
+	}
+
 	if ( ++(*cursor) <= ids[0] ) {
 		return ids[*cursor];
 	}
@@ -934,6 +2015,9 @@ int mdb_idl_append_one( ID *ids, ID id )
 			ids[2] = id;
 		return 0;
 	}
+	if (MDB_IDL_IS_BITMAP( ids )) {
+		return mdb_idl_insert( ids, id );
+	}
 	if ( ids[0] ) {
 		ID tmp;
 
@@ -958,6 +2042,100 @@ int mdb_idl_append_one( ID *ids, ID id )
 	return 0;
 }
 
+/*
+ * Add all of lo..hi to ids. A range would swallow every ID below lo,
+ * so a list is turned into a bitmap when lo..hi is narrow enough.
+ */
+void
+mdb_idl_union_range( ID *ids, ID lo, ID hi )
+{
+	mdb_rbmap *rb;
+	ID first, last, id;
+
+	if ( MDB_IDL_IS_ZERO( ids )) {
+		MDB_IDL_RANGE( ids, lo, hi );
+		return;
+	}
+
+	first = IDL_MIN( MDB_IDL_FIRST( ids ), lo );
+	last = IDL_MAX( MDB_IDL_LAST( ids ), hi );
+	if ( MDB_IDL_IS_RANGE( ids ) || hi - lo >= IDL_BM_RANGEMAX ) {
+		MDB_IDL_RANGE( ids, first, last );
+		return;
+	}
+
+	if ( MDB_IDL_IS_BITMAP( ids )) {
+		rb = MDB_IDL_BM_MAP( ids );
+	} else {
+		rb = mdb_idl_bm_get( ids );
+		if ( !rb ) {
+			MDB_IDL_RANGE( ids, first, last );
+			return;
+		}
+		for ( id = 1; id <= ids[0]; id++ )
+			rb_add( rb, ids[id] );
+	}
+	rb_fill( rb, lo, hi );
+	mdb_idl_bm_done( ids, rb );
+}
+
+/*
+ * Keep only the IDs within lo..hi or above high, hi <= high. last is
+ * the highest ID in use and ends an open range. A range that is split
+ * in two becomes a bitmap when it is narrow enough.
+ */
+void
+mdb_idl_clip_scope( ID *ids, ID lo, ID hi, ID high, ID last )
+{
+	mdb_rbmap *rb;
+	ID first, end, lo2, hi2, i, j;
+
+	if ( MDB_IDL_IS_ZERO( ids ))
+		return;
+
+	if ( MDB_IDL_IS_RANGE( ids )) {
+		/* the parts of the range in lo..hi and above high */
+		first = IDL_MAX( ids[1], lo );
+		end = IDL_MIN( ids[2], hi );
+		lo2 = IDL_MAX( ids[1], high + 1 );
+		hi2 = IDL_MIN( ids[2], last );
+		if ( first > end ) {
+			if ( lo2 > hi2 )
+				MDB_IDL_ZERO( ids );
+			else
+				MDB_IDL_RANGE( ids, lo2, hi2 );
+		} else if ( lo2 > hi2 ) {
+			MDB_IDL_RANGE( ids, first, end );
+		} else if ( end + 1 < lo2 &&
+			( end - first ) + ( hi2 - lo2 ) < IDL_BM_RANGEMAX &&
+			( rb = mdb_idl_bm_get( ids )) != NULL )
+		{
+			rb_fill( rb, first, end );
+			rb_fill( rb, lo2, hi2 );
+			mdb_idl_bm_done( ids, rb );
+		} else {
+			MDB_IDL_RANGE( ids, first, hi2 );
+		}
+		return;
+	}
+
+	if ( MDB_IDL_IS_BITMAP( ids )) {
+		rb = MDB_IDL_BM_MAP( ids );
+		if ( lo > ids[1] )
+			rb_range( rb, ids[1], lo - 1, 0 );
+		if ( hi < high )
+			rb_range( rb, hi + 1, high, 0 );
+		mdb_idl_bm_done( ids, rb );
+		return;
+	}
+
+	for ( i=1, j=0; i<=ids[0]; i++ ) {
+		if (( ids[i] >= lo && ids[i] <= hi ) || ids[i] > high )
+			ids[++j] = ids[i];
+	}
+	ids[0] = j;
+}
+
 /* Append sorted list b to sorted list a. The result is unsorted but
  * a[1] is the min of the result and a[a[0]] is the max.
  */
@@ -977,6 +2155,7 @@ int mdb_idl_append( ID *a, ID *b )
 	ida = MDB_IDL_LAST( a );
 	idb = MDB_IDL_LAST( b );
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ||
+		MDB_IDL_IS_BITMAP( a ) || MDB_IDL_IS_BITMAP(b) ||
 		a[0] + b[0] >= MDB_IDL_UM_MAX ) {
 		a[2] = IDL_MAX( ida, idb );
 		a[1] = IDL_MIN( a[1], b[1] );
@@ -1024,7 +2203,7 @@ mdb_idl_sort( ID *ids, ID *tmp )
 	int i,j,k,l,ir,jstack;
 	ID a, itmp;
 
-	if ( MDB_IDL_IS_RANGE( ids ))
+	if ( MDB_IDL_IS_RANGE( ids ) || MDB_IDL_IS_BITMAP( ids ))
 		return;
 
 	ir = ids[0];
@@ -32,8 +32,36 @@
 #define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
+
+/* Bitmap IDLs - used instead of a range when a list outgrows UM_SIZE.
+ * The IDs are kept in a roaring bitmap on the heap: one container per
+ * block of 2^16 IDs, either a sorted array of the IDs' low 16 bits or,
+ * once that would be larger, a plain bitmap of the block. The IDL
+ * buffer only holds a header, so a candidate set of any size and span
+ * stays exact:
+ *   ids[0] = MDB_IDL_BM_TAG
+ *   ids[1] = lowest ID present
+ *   ids[2] = highest ID present
+ *   ids[3] = number of IDs
+ *   ids[4] = the mdb_rbmap holding them
+ * A map belongs to the IDL buffer it was built in, by the thread that
+ * built it, and lasts until the outermost search of that thread ends
+ * (see mdb_idl_bm_begin). Outside of a search no maps are made and
+ * large IDLs stay ranges. MDB_IDL_CPY copies the map; use mdb_idl_dup
+ * for a copy that must outlive the search.
+ */
+#define MDB_IDL_BM_TAG		(NOID-1)
+#define MDB_IDL_BM_HDR		(5)
+#define MDB_IDL_BM_BITS		(sizeof(ID)*8)
+
+#define MDB_IDL_IS_BITMAP(ids)	((ids)[0] == MDB_IDL_BM_TAG)
+#define MDB_IDL_BM_COUNT(ids)	((ids)[3])
+#define MDB_IDL_BM_MAP(ids)	((struct mdb_rbmap *)(ids)[4])
+#define MDB_IDL_BM_TEST(ids, id)	mdb_idl_bm_test( (ids), (id) )
+
 #define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_RANGE(ids) \
-	? MDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
+	? MDB_IDL_RANGE_SIZE : MDB_IDL_IS_BITMAP(ids) \
+	? MDB_IDL_BM_HDR : ((ids)[0]+1)) * sizeof(ID))
 
 #define MDB_IDL_RANGE_FIRST(ids)	((ids)[1])
 #define MDB_IDL_RANGE_LAST(ids)		((ids)[2])
@@ -56,7 +84,9 @@
 #define MDB_IDL_IS_ALL( range, ids ) ( (ids)[0] == NOID \
 	&& (ids)[1] <= (range)[1] && (range)[2] <= (ids)[2] )
 
-#define MDB_IDL_CPY( dst, src ) (AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ) ))
+#define MDB_IDL_CPY( dst, src ) ( MDB_IDL_IS_BITMAP( src ) \
+	? mdb_idl_bm_copy( dst, src ) \
+	: (void) AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ) ))
 
 #define MDB_IDL_ID( mdb, ids, id ) MDB_IDL_RANGE( ids, id, NOID )
 #define MDB_IDL_ALL( ids ) MDB_IDL_RANGE( ids, 1, NOID )
@@ -64,10 +94,11 @@
 #define MDB_IDL_FIRST( ids )	( (ids)[1] )
 #define MDB_IDL_LLAST( ids )	( (ids)[(ids)[0]] )
 #define MDB_IDL_LAST( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? (ids)[2] : (ids)[(ids)[0]] )
+	|| MDB_IDL_IS_BITMAP(ids) ? (ids)[2] : (ids)[(ids)[0]] )
 
 #define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
+	? ((ids)[2]-(ids)[1])+1 : MDB_IDL_IS_BITMAP(ids) \
+	? (ids)[3] : (ids)[0] )
 
 	/** An ID2 is an ID/value pair.
 	 */
@@ -83,6 +114,27 @@ typedef struct ID2 {
 	 */
 typedef ID2 *ID2L;
 
+	/** Kernels for set operations on sorted arrays of IDs. The
+	 * arrays passed in are list bodies, without the leading count.
+	 * The isect and diff kernels may write their output over \b a.
+	 */
+typedef struct mdb_idl_vec_ops {
+	const char *iv_name;
+	/** index of the first element >= id, or n */
+	unsigned (*iv_search)( ID *ids, unsigned n, ID id );
+	/** out = a intersection b, returns count */
+	ID (*iv_isect)( ID *a, ID na, ID *b, ID nb, ID *out );
+	/** out = a minus b, returns count */
+	ID (*iv_diff)( ID *a, ID na, ID *b, ID nb, ID *out );
+	/** out = a union b for disjoint a and b, returns count */
+	ID (*iv_merge)( ID *a, ID na, ID *b, ID nb, ID *out );
+} mdb_idl_vec_ops;
+
+#define MDB_IDL_VEC_AUTO	-1
+#define MDB_IDL_VEC_SCALAR	0
+#define MDB_IDL_VEC_SSE42	1
+#define MDB_IDL_VEC_AVX2	2
+
 typedef struct IdScopes {
 	MDB_txn *mt;
 	MDB_cursor *mc;
@@ -111,6 +163,9 @@ unsigned mdb_id2l_search( ID2L ids, ID id );
 	 * @return	0 on success, -1 if the ID was already present in the MIDL2.
 	 */
 int mdb_id2l_insert( ID2L ids, ID2 *id );
+
+extern mdb_idl_vec_ops mdb_idl_vec;
+int mdb_idl_vec_init( int level );
 LDAP_END_DECL
 
 #endif
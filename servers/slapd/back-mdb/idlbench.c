@@ -0,0 +1,186 @@
+/* idlbench.c - micro-benchmark for the IDL set operation kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Usage: idlbench [iterations]
+ *
+ * Runs the intersection, difference, merge and search kernels of
+ * idlvec.c over pairs of lists with the size skew typical of AND
+ * filters (a small equality key against a large objectClass key),
+ * once for every kernel level the CPU supports. The results of each
+ * level are checked against the scalar kernels.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* standalone: not linked with slapd's ch_malloc */
+#undef free
+
+static struct {
+	const char *name;
+	ID na, nb;
+	ID span;
+} cases[] = {
+	{ "equal dense",	60000, 60000, 150000 },
+	{ "equal sparse",	20000, 20000, 4000000 },
+	{ "skew 1:10",		 6000, 60000, 200000 },
+	{ "skew 1:100",		 1000, 100000, 200000 },
+	{ "skew 1:10000",	   10, 120000, 200000 },
+	{ NULL }
+};
+
+static unsigned long seed = 1;
+
+static ID
+rnd( ID max )
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return (seed >> 17) % max;
+}
+
+/* fill ids[0..n-1] with n distinct sorted IDs from 1..span */
+static void
+fill( ID *ids, ID n, ID span )
+{
+	char *used = calloc( span+1, 1 );
+	ID i, k;
+
+	for ( i=0; i<n; ) {
+		k = rnd( span ) + 1;
+		if ( !used[k] ) {
+			used[k] = 1;
+			i++;
+		}
+	}
+	for ( i=0, k=1; k<=span; k++ )
+		if ( used[k] ) ids[i++] = k;
+	free( used );
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+int
+main( int argc, char *argv[] )
+{
+	ID *a, *b, *out, *ref, *tmp, n, nm, nref = 0;
+	int iter = 200, i, c, level, max, rc = 0;
+	double t, t_is, t_df, t_mg, t_se;
+
+	if ( argc > 1 )
+		iter = atoi( argv[1] );
+
+	a = malloc( MDB_IDL_UM_SIZEOF );
+	b = malloc( MDB_IDL_UM_SIZEOF );
+	out = malloc( 2 * MDB_IDL_UM_SIZEOF );
+	ref = malloc( 2 * MDB_IDL_UM_SIZEOF );
+	tmp = malloc( MDB_IDL_UM_SIZEOF );
+
+	max = mdb_idl_vec_init( MDB_IDL_VEC_AUTO );
+	printf( "%-14s %-7s %10s %10s %10s %10s  (usec/op)\n",
+		"case", "kernel", "isect", "diff", "merge", "search" );
+
+	for ( c=0; cases[c].name; c++ ) {
+		fill( a, cases[c].na, cases[c].span );
+		fill( b, cases[c].nb, cases[c].span );
+
+		for ( level = MDB_IDL_VEC_SCALAR; level <= max; level++ ) {
+			mdb_idl_vec_init( level );
+
+			t = now();
+			for ( i=0; i<iter; i++ ) {
+				memcpy( tmp, a, cases[c].na * sizeof(ID) );
+				n = mdb_idl_vec.iv_isect( tmp, cases[c].na, b, cases[c].nb, tmp );
+			}
+			t_is = (now() - t) / iter;
+			if ( level == MDB_IDL_VEC_SCALAR ) {
+				nref = n;
+				memcpy( ref, tmp, n * sizeof(ID) );
+			} else if ( n != nref || memcmp( ref, tmp, n * sizeof(ID) )) {
+				printf( "%s: %s isect mismatch\n", cases[c].name,
+					mdb_idl_vec.iv_name );
+				rc = 1;
+			}
+
+			t = now();
+			for ( i=0; i<iter; i++ )
+				n = mdb_idl_vec.iv_diff( a, cases[c].na, b, cases[c].nb, out );
+			t_df = (now() - t) / iter;
+			if ( n + nref != cases[c].na ) {
+				printf( "%s: %s diff mismatch\n", cases[c].name,
+					mdb_idl_vec.iv_name );
+				rc = 1;
+			}
+
+			/* merge b with the elements of a not in b */
+			memcpy( tmp, out, n * sizeof(ID) );
+			t = now();
+			for ( i=0; i<iter; i++ )
+				nm = mdb_idl_vec.iv_merge( b, cases[c].nb, tmp, n, out );
+			t_mg = (now() - t) / iter;
+			if ( nm + nref != cases[c].na + cases[c].nb ) {
+				printf( "%s: %s merge mismatch\n", cases[c].name,
+					mdb_idl_vec.iv_name );
+				rc = 1;
+			}
+			for ( i=1; i<nm; i++ ) {
+				if ( out[i-1] >= out[i] ) {
+					printf( "%s: %s merge not sorted\n", cases[c].name,
+						mdb_idl_vec.iv_name );
+					rc = 1;
+					break;
+				}
+			}
+
+			t = now();
+			for ( i=0; i<iter; i++ ) {
+				ID j;
+				for ( j=0; j<cases[c].na; j++ ) {
+					unsigned x = mdb_idl_vec.iv_search( b, cases[c].nb, a[j] );
+					if ( x < cases[c].nb && b[x] < a[j] ) {
+						printf( "%s: %s search mismatch\n", cases[c].name,
+							mdb_idl_vec.iv_name );
+						rc = 1;
+						break;
+					}
+				}
+			}
+			t_se = (now() - t) / iter;
+
+			printf( "%-14s %-7s %10.1f %10.1f %10.1f %10.1f\n",
+				cases[c].name, mdb_idl_vec.iv_name, t_is, t_df, t_mg, t_se );
+		}
+	}
+
+	free( a );
+	free( b );
+	free( out );
+	free( ref );
+	free( tmp );
+	return rc;
+}
@@ -0,0 +1,470 @@
+/* idlvec.c - sorted ID array kernels for IDL set operations */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* These kernels work on plain sorted arrays of unique IDs, i.e. the
+ * body of a list IDL without its count. They do not depend on any
+ * other slapd code so that idlbench can link against them directly.
+ *
+ * A scalar version of each kernel is always available. On x86_64
+ * with a compiler that supports per-function target attributes,
+ * SSE4.2 and AVX2 versions are also built and the best one supported
+ * by the running CPU is selected by mdb_idl_vec_init().
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__LP64__) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define IDL_VEC_X86	1
+#include <immintrin.h>
+#endif
+
+/* Above this size ratio, galloping beats a linear merge */
+#define IDL_GALLOP_RATIO	32
+
+/* Flip the sign bit so signed 64-bit compares order IDs as unsigned */
+#define IDL_VEC_SIGN	((long long)1 << 63)
+
+/* Return the index of the first element of ids[0..n-1] >= id,
+ * or n if there is none.
+ */
+static unsigned
+idl_search_scalar( ID *ids, unsigned n, ID id )
+{
+	unsigned base = 0, pivot;
+
+	while ( n > 0 ) {
+		pivot = n >> 1;
+		if ( ids[base + pivot] < id ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	return base;
+}
+
+/* Exponential search for the first element of ids[0..n-1] >= id */
+static ID
+idl_gallop( ID *ids, ID n, ID id )
+{
+	ID lo = 0, hi = 1;
+
+	while ( hi < n && ids[hi] < id ) {
+		lo = hi;
+		hi <<= 1;
+	}
+	if ( hi > n )
+		hi = n;
+	return lo + idl_search_scalar( ids + lo, hi - lo, id );
+}
+
+/* Intersection of very differently sized lists. Only the matching
+ * elements are written, so out may be the same as a.
+ */
+static ID
+idl_isect_gallop( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i, j = 0, k = 0;
+
+	if ( na <= nb ) {
+		for ( i = 0; i < na && j < nb; i++ ) {
+			j += idl_gallop( b + j, nb - j, a[i] );
+			if ( j < nb && b[j] == a[i] )
+				out[k++] = a[i];
+		}
+	} else {
+		for ( i = 0; i < nb && j < na; i++ ) {
+			j += idl_gallop( a + j, na - j, b[i] );
+			if ( j < na && a[j] == b[i] ) {
+				out[k++] = b[i];
+				j++;
+			}
+		}
+	}
+	return k;
+}
+
+static ID
+idl_isect_scalar( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+
+	if ( na * IDL_GALLOP_RATIO < nb || nb * IDL_GALLOP_RATIO < na )
+		return idl_isect_gallop( a, na, b, nb, out );
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			i++;
+		} else if ( a[i] > b[j] ) {
+			j++;
+		} else {
+			out[k++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return k;
+}
+
+static ID
+idl_diff_scalar( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			out[k++] = a[i++];
+		} else if ( a[i] > b[j] ) {
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+	while ( i < na )
+		out[k++] = a[i++];
+	return k;
+}
+
+static ID
+idl_merge_scalar( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] )
+			out[k++] = a[i++];
+		else
+			out[k++] = b[j++];
+	}
+	if ( i < na ) {
+		AC_MEMCPY( out+k, a+i, (na-i) * sizeof(ID) );
+		k += na-i;
+	} else if ( j < nb ) {
+		AC_MEMCPY( out+k, b+j, (nb-j) * sizeof(ID) );
+		k += nb-j;
+	}
+	return k;
+}
+
+/* The block kernels below compare a block of a against a block of b
+ * and accumulate, in mask, which elements of the a block have found a
+ * match. An a block is only emitted once it is retired, so when out
+ * is a the writes never overtake elements that are still to be read.
+ * When the loop ends with a block still pending, every element up to
+ * the highest matched one is smaller than the current b element and
+ * can be settled before falling back to the scalar kernel.
+ */
+#define IDL_TOP_BIT(mask)	(31 - __builtin_clz(mask))
+
+#ifdef IDL_VEC_X86
+
+__attribute__((target("sse4.2")))
+static unsigned
+idl_search_sse42( ID *ids, unsigned n, ID id )
+{
+	unsigned base = 0, pivot;
+	__m128i key, v;
+
+	while ( n > 8 ) {
+		pivot = n >> 1;
+		if ( ids[base + pivot] < id ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	/* count the remaining elements that are < id */
+	key = _mm_set1_epi64x( (long long)id ^ IDL_VEC_SIGN );
+	for ( ; n >= 2; n -= 2, base += 2 ) {
+		v = _mm_xor_si128( _mm_loadu_si128( (__m128i *)(ids + base) ),
+			_mm_set1_epi64x( IDL_VEC_SIGN ));
+		switch ( _mm_movemask_pd( _mm_castsi128_pd(
+			_mm_cmpgt_epi64( key, v )))) {
+		case 3:
+			continue;
+		case 1:
+			return base + 1;
+		default:
+			return base;
+		}
+	}
+	if ( n && ids[base] < id )
+		base++;
+	return base;
+}
+
+__attribute__((target("sse4.2")))
+static ID
+idl_isect_sse42( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+	__m128i va, vb, m;
+	int mask = 0, t;
+
+	if ( na * IDL_GALLOP_RATIO < nb || nb * IDL_GALLOP_RATIO < na )
+		return idl_isect_gallop( a, na, b, nb, out );
+
+	va = _mm_setzero_si128();
+	if ( na >= 2 )
+		va = _mm_loadu_si128( (__m128i *)a );
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		vb = _mm_loadu_si128( (__m128i *)(b + j) );
+		m = _mm_or_si128( _mm_cmpeq_epi64( va, vb ),
+			_mm_cmpeq_epi64( va, _mm_shuffle_epi32( vb, 0x4e )));
+		mask |= _mm_movemask_pd( _mm_castsi128_pd( m ));
+		if ( a[i+1] <= b[j+1] ) {
+			if ( mask & 1 ) out[k++] = a[i];
+			if ( mask & 2 ) out[k++] = a[i+1];
+			mask = 0;
+			j += a[i+1] == b[j+1] ? 2 : 0;
+			i += 2;
+			if ( i + 2 <= na )
+				va = _mm_loadu_si128( (__m128i *)(a + i) );
+		} else {
+			j += 2;
+		}
+	}
+	if ( mask ) {
+		t = IDL_TOP_BIT( mask );
+		if ( mask & 1 ) out[k++] = a[i];
+		if ( mask & 2 ) out[k++] = a[i+1];
+		i += t + 1;
+	}
+	return k + idl_isect_scalar( a+i, na-i, b+j, nb-j, out+k );
+}
+
+__attribute__((target("sse4.2")))
+static ID
+idl_diff_sse42( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+	__m128i va, vb, m;
+	int mask = 0, t;
+
+	va = _mm_setzero_si128();
+	if ( na >= 2 )
+		va = _mm_loadu_si128( (__m128i *)a );
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		vb = _mm_loadu_si128( (__m128i *)(b + j) );
+		m = _mm_or_si128( _mm_cmpeq_epi64( va, vb ),
+			_mm_cmpeq_epi64( va, _mm_shuffle_epi32( vb, 0x4e )));
+		mask |= _mm_movemask_pd( _mm_castsi128_pd( m ));
+		if ( a[i+1] <= b[j+1] ) {
+			if ( !(mask & 1) ) out[k++] = a[i];
+			if ( !(mask & 2) ) out[k++] = a[i+1];
+			mask = 0;
+			j += a[i+1] == b[j+1] ? 2 : 0;
+			i += 2;
+			if ( i + 2 <= na )
+				va = _mm_loadu_si128( (__m128i *)(a + i) );
+		} else {
+			j += 2;
+		}
+	}
+	if ( mask ) {
+		t = IDL_TOP_BIT( mask );
+		if ( t == 1 && !(mask & 1) ) out[k++] = a[i];
+		i += t + 1;
+	}
+	return k + idl_diff_scalar( a+i, na-i, b+j, nb-j, out+k );
+}
+
+__attribute__((target("avx2")))
+static unsigned
+idl_search_avx2( ID *ids, unsigned n, ID id )
+{
+	unsigned base = 0, pivot;
+	__m256i key, sign, v;
+	int mask;
+
+	while ( n > 16 ) {
+		pivot = n >> 1;
+		if ( ids[base + pivot] < id ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	sign = _mm256_set1_epi64x( IDL_VEC_SIGN );
+	key = _mm256_set1_epi64x( (long long)id ^ IDL_VEC_SIGN );
+	for ( ; n >= 4; n -= 4, base += 4 ) {
+		v = _mm256_xor_si256( _mm256_loadu_si256( (__m256i *)(ids + base) ),
+			sign );
+		mask = _mm256_movemask_pd( _mm256_castsi256_pd(
+			_mm256_cmpgt_epi64( key, v )));
+		if ( mask != 0xf )
+			return base + __builtin_popcount( mask );
+	}
+	while ( n && ids[base] < id ) {
+		base++;
+		n--;
+	}
+	return base;
+}
+
+/* all-pairs equality of two 4-element blocks */
+#define IDL_AVX2_EQ4(va, vb) \
+	_mm256_or_si256( \
+		_mm256_or_si256( _mm256_cmpeq_epi64( va, vb ), \
+			_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ))), \
+		_mm256_or_si256( \
+			_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e )), \
+			_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ))))
+
+__attribute__((target("avx2")))
+static ID
+idl_isect_avx2( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+	__m256i va, vb;
+	int mask = 0, t, m;
+
+	if ( na * IDL_GALLOP_RATIO < nb || nb * IDL_GALLOP_RATIO < na )
+		return idl_isect_gallop( a, na, b, nb, out );
+
+	va = _mm256_setzero_si256();
+	if ( na >= 4 )
+		va = _mm256_loadu_si256( (__m256i *)a );
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		vb = _mm256_loadu_si256( (__m256i *)(b + j) );
+		mask |= _mm256_movemask_pd( _mm256_castsi256_pd(
+			IDL_AVX2_EQ4( va, vb )));
+		if ( a[i+3] <= b[j+3] ) {
+			for ( m = mask; m; m &= m-1 )
+				out[k++] = a[i + __builtin_ctz( m )];
+			mask = 0;
+			j += a[i+3] == b[j+3] ? 4 : 0;
+			i += 4;
+			if ( i + 4 <= na )
+				va = _mm256_loadu_si256( (__m256i *)(a + i) );
+		} else {
+			j += 4;
+		}
+	}
+	if ( mask ) {
+		t = IDL_TOP_BIT( mask );
+		for ( m = mask; m; m &= m-1 )
+			out[k++] = a[i + __builtin_ctz( m )];
+		i += t + 1;
+	}
+	return k + idl_isect_scalar( a+i, na-i, b+j, nb-j, out+k );
+}
+
+__attribute__((target("avx2")))
+static ID
+idl_diff_avx2( ID *a, ID na, ID *b, ID nb, ID *out )
+{
+	ID i = 0, j = 0, k = 0;
+	__m256i va, vb;
+	int mask = 0, t, m;
+
+	va = _mm256_setzero_si256();
+	if ( na >= 4 )
+		va = _mm256_loadu_si256( (__m256i *)a );
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		vb = _mm256_loadu_si256( (__m256i *)(b + j) );
+		mask |= _mm256_movemask_pd( _mm256_castsi256_pd(
+			IDL_AVX2_EQ4( va, vb )));
+		if ( a[i+3] <= b[j+3] ) {
+			for ( m = ~mask & 0xf; m; m &= m-1 )
+				out[k++] = a[i + __builtin_ctz( m )];
+			mask = 0;
+			j += a[i+3] == b[j+3] ? 4 : 0;
+			i += 4;
+			if ( i + 4 <= na )
+				va = _mm256_loadu_si256( (__m256i *)(a + i) );
+		} else {
+			j += 4;
+		}
+	}
+	if ( mask ) {
+		t = IDL_TOP_BIT( mask );
+		for ( m = ~mask & ((2 << t) - 1); m; m &= m-1 )
+			out[k++] = a[i + __builtin_ctz( m )];
+		i += t + 1;
+	}
+	return k + idl_diff_scalar( a+i, na-i, b+j, nb-j, out+k );
+}
+
+#endif /* IDL_VEC_X86 */
+
+mdb_idl_vec_ops mdb_idl_vec = {
+	"scalar",
+	idl_search_scalar,
+	idl_isect_scalar,
+	idl_diff_scalar,
+	idl_merge_scalar
+};
+
+/* Select the kernels to use. MDB_IDL_VEC_AUTO picks the best one the
+ * CPU supports; a specific level is used only if the CPU supports it.
+ * Returns the level in effect.
+ */
+int
+mdb_idl_vec_init( int level )
+{
+	int best = MDB_IDL_VEC_SCALAR;
+
+#ifdef IDL_VEC_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "sse4.2" )) {
+		best = MDB_IDL_VEC_SSE42;
+		if ( __builtin_cpu_supports( "avx2" ))
+			best = MDB_IDL_VEC_AVX2;
+	}
+#endif
+	if ( level == MDB_IDL_VEC_AUTO || level > best )
+		level = best;
+
+	switch ( level ) {
+#ifdef IDL_VEC_X86
+	case MDB_IDL_VEC_AVX2:
+		mdb_idl_vec.iv_name = "avx2";
+		mdb_idl_vec.iv_search = idl_search_avx2;
+		mdb_idl_vec.iv_isect = idl_isect_avx2;
+		mdb_idl_vec.iv_diff = idl_diff_avx2;
+		mdb_idl_vec.iv_merge = idl_merge_scalar;
+		break;
+	case MDB_IDL_VEC_SSE42:
+		mdb_idl_vec.iv_name = "sse4.2";
+		mdb_idl_vec.iv_search = idl_search_sse42;
+		mdb_idl_vec.iv_isect = idl_isect_sse42;
+		mdb_idl_vec.iv_diff = idl_diff_sse42;
+		mdb_idl_vec.iv_merge = idl_merge_scalar;
+		break;
+#endif
+	default:
+		level = MDB_IDL_VEC_SCALAR;
+		mdb_idl_vec.iv_name = "scalar";
+		mdb_idl_vec.iv_search = idl_search_scalar;
+		mdb_idl_vec.iv_isect = idl_isect_scalar;
+		mdb_idl_vec.iv_diff = idl_diff_scalar;
+		mdb_idl_vec.iv_merge = idl_merge_scalar;
+		break;
+	}
+	return level;
+}
@@ -71,17 +71,25 @@ AttrInfo *mdb_index_mask(
 }
 
 /* This function is only called when evaluating search filters.
+ * If unbuilt is given, an index that is still being built online may
+ * be used; unbuilt[0..1] is then set to the range of IDs it doesn't
+ * cover yet, or unbuilt[0] to 0 if the index is complete.
  */
 int mdb_index_param(
 	Backend *be,
+	MDB_txn *rtxn,
 	AttributeDescription *desc,
 	int ftype,
 	MDB_dbi *dbip,
 	slap_mask_t *maskp,
-	struct berval *prefixp )
+	struct berval *prefixp,
+	ID *unbuilt )
 {
 	AttrInfo *ai;
-	slap_mask_t mask, type = 0;
+	slap_mask_t mask, built, type = 0;
+
+	if ( unbuilt )
+		unbuilt[0] = 0;
 
 	ai = mdb_index_mask( be, desc, prefixp );
 
@@ -108,7 +116,22 @@ int mdb_index_param(
 
 		return LDAP_INAPPROPRIATE_MATCHING;
 	}
-	mask = ai->ai_indexmask;
+	built = mask = ai->ai_indexmask;
+	if ( ai->ai_newmask && ai->ai_ixlast ) {
+		mdb_ixprog ip;
+
+		if ( unbuilt && !mdb_index_progress_get( be->be_private, rtxn,
+			ai, &ip ) && ip.ip_next > 1 ) {
+			mask |= ip.ip_newmask & ai->ai_newmask;
+			if ( ip.ip_next <= ip.ip_last ) {
+				unbuilt[0] = ip.ip_next;
+				unbuilt[1] = ip.ip_last;
+			}
+		}
+	} else if ( ai->ai_ixtxn > mdb_txn_id( rtxn )) {
+		/* the build completed after this snapshot was taken */
+		mask = ai->ai_ixold;
+	}
 
 	switch( ftype ) {
 	case LDAP_FILTER_PRESENT:
@@ -156,6 +179,8 @@ int mdb_index_param(
 	return LDAP_INAPPROPRIATE_MATCHING;
 
 done:
+	if ( unbuilt && unbuilt[0] && IS_SLAP_INDEX( built, type ))
+		unbuilt[0] = 0;
 	*dbip = ai->ai_dbi;
 	*maskp = mask;
 	return LDAP_SUCCESS;
@@ -179,8 +204,9 @@ static int indexer(
 	char *err;
 
 	assert( mask != 0 );
+	mdb_opinfo_changed( op, (struct mdb_info *) op->o_bd->be_private );
 
-	if ( !mc ) {
+	if ( !mc && !( ai->ai_bulk && opid == SLAP_INDEX_ADD_OP )) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
 		if ( rc ) goto done;
@@ -189,6 +215,12 @@ static int indexer(
 	}
 
 	if ( opid == SLAP_INDEX_ADD_OP ) {
+		if ( ai->ai_bulk ) {
+			/* slapadd -q into an empty database, keys are
+			 * sorted and written at the end */
+			keyfunc = mdb_tool_bulk_add;
+			mc = (MDB_cursor *)ai;
+		} else
 #ifdef MDB_TOOL_IDL_CACHING
 		if (( slapMode & SLAP_TOOL_QUICK ) && slap_tool_thread_max > 2 ) {
 			AttrIxInfo *ax = (AttrIxInfo *)LDAP_SLIST_FIRST(&op->o_extra);
@@ -575,3 +607,175 @@ mdb_index_entry(
 
 	return LDAP_SUCCESS;
 }
+
+/* Look up the persisted progress of the online build of ai as seen
+ * by txn. Returns MDB_NOTFOUND if no build of ai is recorded.
+ */
+int
+mdb_index_progress_get(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	mdb_ixprog *ip )
+{
+	MDB_val key, data;
+	mdb_ixprog *p;
+	ID ad;
+	int i = 0, rc;
+
+	ad = mdb->mi_adxs[ai->ai_desc->ad_index];
+	if ( !ad )
+		return MDB_NOTFOUND;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc )
+		return rc;
+
+	for ( p = data.mv_data; (char *)(p+1) <= (char *)data.mv_data +
+		data.mv_size; p++ ) {
+		if ( p->ip_ad == ad ) {
+			memcpy( ip, p, sizeof( *ip ));
+			return 0;
+		}
+	}
+	return MDB_NOTFOUND;
+}
+
+/* Record the progress of all online index builds. The entries below
+ * next have been indexed for every attribute being built. The record
+ * is removed once all builds are complete.
+ */
+int
+mdb_index_progress_save(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID next )
+{
+	MDB_val key, data;
+	mdb_ixprog *ip;
+	AttrInfo *ai;
+	int i, n, rc, running = 0;
+
+	ip = ch_malloc( mdb->mi_nattrs * sizeof( mdb_ixprog ) + 1 );
+	for ( i = 0, n = 0; i < mdb->mi_nattrs; i++ ) {
+		ai = mdb->mi_attrs[i];
+		if ( !ai->ai_newmask || !ai->ai_ixlast ||
+			( ai->ai_indexmask & MDB_INDEX_DELETING ))
+			continue;
+		rc = mdb_ad_get( mdb, txn, ai->ai_desc );
+		if ( rc )
+			goto done;
+		ip[n].ip_next = ai->ai_ixnext > next ? ai->ai_ixnext : next;
+		ip[n].ip_last = ai->ai_ixlast;
+		ip[n].ip_oldmask = ai->ai_ixold;
+		ip[n].ip_newmask = ai->ai_newmask;
+		ip[n].ip_ad = mdb->mi_adxs[ai->ai_desc->ad_index];
+		if ( ip[n].ip_next <= ip[n].ip_last )
+			running = 1;
+		n++;
+	}
+
+	i = 0;
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	if ( running ) {
+		data.mv_size = n * sizeof( mdb_ixprog );
+		data.mv_data = ip;
+		rc = mdb_put( txn, mdb->mi_ad2id, &key, &data, 0 );
+	} else {
+		rc = mdb_del( txn, mdb->mi_ad2id, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+	}
+done:
+	ch_free( ip );
+	return rc;
+}
+
+/* slapindex: forget the online builds of the attributes being
+ * reindexed.
+ */
+int
+mdb_index_progress_drop(
+	struct mdb_info *mdb,
+	MDB_txn *txn )
+{
+	MDB_val key, data;
+	mdb_ixprog *ip, *p;
+	int i = 0, j, n, rc;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &data );
+	if ( rc )
+		return rc == MDB_NOTFOUND ? 0 : rc;
+
+	ip = ch_malloc( data.mv_size + 1 );
+	n = 0;
+	for ( p = data.mv_data; (char *)(p+1) <= (char *)data.mv_data +
+		data.mv_size; p++ ) {
+		for ( j = 0; j < mdb->mi_nattrs; j++ ) {
+			if ( p->ip_ad == mdb->mi_adxs[mdb->mi_attrs[j]->ai_desc->ad_index] )
+				break;
+		}
+		if ( j == mdb->mi_nattrs )
+			ip[n++] = *p;
+	}
+	if ( n ) {
+		data.mv_size = n * sizeof( mdb_ixprog );
+		data.mv_data = ip;
+		rc = mdb_put( txn, mdb->mi_ad2id, &key, &data, 0 );
+	} else {
+		rc = mdb_del( txn, mdb->mi_ad2id, &key, NULL );
+	}
+	ch_free( ip );
+	return rc;
+}
+
+/* Resume the online index builds that were interrupted by a shutdown.
+ * The configured mask of each attribute becomes the new mask again.
+ * Returns the number of builds to resume.
+ */
+int
+mdb_index_progress_load(
+	struct mdb_info *mdb,
+	MDB_txn *txn )
+{
+	MDB_val key, data;
+	mdb_ixprog *p;
+	AttrInfo *ai;
+	slap_mask_t old;
+	int i = 0, n = 0;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	if ( mdb_get( txn, mdb->mi_ad2id, &key, &data ))
+		return 0;
+
+	for ( p = data.mv_data; (char *)(p+1) <= (char *)data.mv_data +
+		data.mv_size; p++ ) {
+		if ( p->ip_ad > (ID)mdb->mi_numads || !mdb->mi_ads[p->ip_ad] )
+			continue;
+		ai = mdb_attr_mask( mdb, mdb->mi_ads[p->ip_ad] );
+		if ( !ai || ai->ai_newmask )
+			continue;
+		old = p->ip_oldmask & ai->ai_indexmask;
+		if ( old == ai->ai_indexmask )
+			continue;
+		ai->ai_newmask = ai->ai_indexmask;
+		ai->ai_indexmask = old;
+		ai->ai_ixold = old;
+		if ( p->ip_newmask == ai->ai_newmask ) {
+			ai->ai_ixnext = p->ip_next;
+			ai->ai_ixlast = p->ip_last;
+		}
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_index_progress_load)
+			": resuming index build of %s at ID %ld\n",
+			ai->ai_desc->ad_cname.bv_val,
+			(long) ( ai->ai_ixlast ? ai->ai_ixnext : 1 ), 0 );
+		n++;
+	}
+	return n;
+}
@@ -23,6 +23,7 @@
 #include <ac/errno.h>
 #include <sys/stat.h>
 #include "back-mdb.h"
+#include "idl.h"
 #include <lutil.h>
 #include <ldap_rq.h>
 #include "config.h"
@@ -32,6 +33,7 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("id2c"),
 	BER_BVNULL
 };
 
@@ -64,9 +66,17 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_idl_max = MDB_IDL_DB_MAX;
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
+	mdb_ecache_init( mdb );
+	ldap_pvt_thread_mutex_init( &mdb->mi_gc_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_gc_cond );
+	mdb->mi_paged_ttl = DEFAULT_PAGED_TTL;
+	ldap_pvt_thread_mutex_init( &mdb->mi_paged_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_rslot_mutex );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
 
@@ -145,6 +155,18 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	if ( mdb->mi_mapgrow ) {
+		rc = mdb_env_set_mapgrowth( mdb->mi_dbenv,
+			mdb->mi_mapgrow, mdb->mi_mapmax );
+		if( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+				"mdb_env_set_mapgrowth failed: %s (%d).\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			goto fail;
+		}
+	}
+
 	rc = mdb_env_set_maxdbs( mdb->mi_dbenv, MDB_INDICES );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -206,6 +228,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 				flags |= MDB_DUPSORT;
 			if ( i == MDB_ID2VAL )
 				flags ^= MDB_INTEGERKEY|MDB_DUPSORT;
+			if ( i == MDB_ID2COL )
+				flags ^= MDB_INTEGERKEY;
 			if ( !(slapMode & SLAP_TOOL_READONLY) )
 				flags |= MDB_CREATE;
 		}
@@ -215,6 +239,18 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* slapcat of a database from before columns existed. Any
+		 * dbi would be a real DB, mi_flags tells the column code.
+		 */
+		if ( i == MDB_ID2COL ) {
+			if ( rc == MDB_NOTFOUND ) {
+				mdb->mi_dbis[i] = 0;
+				mdb->mi_flags |= MDB_NO_ID2COL;
+				continue;
+			}
+			mdb->mi_flags &= ~MDB_NO_ID2COL;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -284,6 +320,27 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	/* resume interrupted online index builds */
+	if ( !(slapMode & SLAP_TOOL_MODE) )
+		i = mdb_index_progress_load( mdb, txn );
+	else
+		i = 0;
+
+	if ( !(slapMode & SLAP_TOOL_READONLY) ) {
+		int pending;
+		rc = mdb_column_load( mdb, txn, &pending );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+				"loading columns failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+		if ( pending && !(slapMode & SLAP_TOOL_MODE) )
+			i = 1;
+	}
+
 	rc = mdb_txn_commit(txn);
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -293,6 +350,13 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	if ( i )
+		mdb_online_index_start( be );
+
+	/* cluster the entries added since the last renumbering */
+	if (( mdb->mi_flags & MDB_CLUSTER ) && !(slapMode & SLAP_TOOL_MODE) )
+		mdb_cluster_start( be );
+
 	/* monitor setup */
 	rc = mdb_monitor_db_open( be );
 	if ( rc != 0 ) {
@@ -319,6 +383,9 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
+	mdb_ecache_flush( mdb, 0 );
+	mdb_paged_flush( mdb, NULL );
+
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
@@ -374,6 +441,14 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
 
 	mdb_attr_index_destroy( mdb );
+	mdb_column_del( mdb, -1 );
+
+	mdb_ecache_flush( mdb, 1 );
+	mdb_paged_flush( mdb, NULL );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_paged_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_rslot_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_gc_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_gc_mutex );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -415,6 +490,11 @@ mdb_back_initialize(
 
 	bi->bi_controls = controls;
 
+	/* pick the fastest IDL kernels this CPU supports */
+	mdb_idl_vec_init( MDB_IDL_VEC_AUTO );
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_back_initialize)
+		": using %s IDL kernels\n", mdb_idl_vec.iv_name, 0, 0 );
+
 	{	/* version check */
 		int major, minor, patch, ver;
 		char *version = mdb_version( &major, &minor, &patch );
@@ -492,7 +572,7 @@ mdb_back_initialize(
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
 
 	bi->bi_connection_init = 0;
-	bi->bi_connection_destroy = 0;
+	bi->bi_connection_destroy = mdb_connection_destroy;
 
 	rc = mdb_back_init_cf( bi );
 
@@ -543,7 +543,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			/* Only free attrs if they were dup'd.  */
@@ -551,7 +551,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			goto return_results;
 
 		} else {
-			if(( rs->sr_err=mdb_txn_commit( txn )) != 0 ) {
+			if(( rs->sr_err=mdb_opinfo_commit( mdb, moi, txn )) != 0 ) {
 				rs->sr_text = "txn_commit failed";
 			} else {
 				rs->sr_err = LDAP_SUCCESS;
@@ -618,7 +618,7 @@ done:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -33,6 +33,11 @@ static ObjectClass		*oc_olmMDBDatabase;
 
 static AttributeDescription *ad_olmDbDirectory;
 
+static AttributeDescription *ad_olmMDBEntryCache,
+	*ad_olmMDBEntryCacheHits, *ad_olmMDBEntryCacheMisses;
+static AttributeDescription *ad_olmMDBIndexBuild;
+static AttributeDescription *ad_olmMDBReaders;
+
 #ifdef MDB_MONITOR_IDX
 static int
 mdb_monitor_idx_entry_add(
@@ -78,6 +83,46 @@ static struct {
 		"USAGE dSAOperation )",
 		&ad_olmDbDirectory },
 
+	{ "( olmMDBAttributes:4 "
+		"NAME ( 'olmMDBEntryCache' ) "
+		"DESC 'Number of items in Entry Cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCache },
+
+	{ "( olmMDBAttributes:5 "
+		"NAME ( 'olmMDBEntryCacheHits' ) "
+		"DESC 'Number of Entry Cache hits' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheHits },
+
+	{ "( olmMDBAttributes:6 "
+		"NAME ( 'olmMDBEntryCacheMisses' ) "
+		"DESC 'Number of Entry Cache misses' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheMisses },
+
+	{ "( olmMDBAttributes:7 "
+		"NAME ( 'olmMDBIndexBuild' ) "
+		"DESC 'Progress of online index builds' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexBuild },
+
+	{ "( olmMDBAttributes:8 "
+		"NAME ( 'olmMDBReaders' ) "
+		"DESC 'Read transactions holding a snapshot' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReaders },
+
 #ifdef MDB_MONITOR_IDX
 	{ "( olmDatabaseAttributes:2 "
 		"NAME ( 'olmDbNotIndexed' ) "
@@ -102,6 +147,11 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbDirectory "
+			"$ olmMDBEntryCache "
+			"$ olmMDBEntryCacheHits "
+			"$ olmMDBEntryCacheMisses "
+			"$ olmMDBIndexBuild "
+			"$ olmMDBReaders "
 #ifdef MDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
 #endif /* MDB_MONITOR_IDX */
@@ -111,6 +161,156 @@ static struct {
 	{ NULL }
 };
 
+/* One value per attribute being indexed online:
+ * "<attr>#next=<ID>#last=<ID>#percent=<n>#eta=<seconds>"
+ */
+static void
+mdb_monitor_index_build(
+	struct mdb_info		*mdb,
+	Entry			*e )
+{
+	Attribute		*a, **ap;
+	AttrInfo		*ai;
+	BerVarray		vals = NULL;
+	struct berval		bv, dup;
+	char			buf[ SLAP_TEXT_BUFLEN + 128 ];
+	time_t			elapsed;
+	ID			done, left;
+	int			i;
+
+	elapsed = slap_get_time() - mdb->mi_index_start;
+	done = mdb->mi_index_done;
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		ai = mdb->mi_attrs[ i ];
+		if ( !ai->ai_newmask || !ai->ai_ixlast ||
+			ai->ai_ixnext > ai->ai_ixlast )
+			continue;
+		left = ai->ai_ixlast - ai->ai_ixnext + 1;
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%s#next=%lu#last=%lu#percent=%lu",
+			ai->ai_desc->ad_cname.bv_val,
+			(unsigned long) ai->ai_ixnext,
+			(unsigned long) ai->ai_ixlast,
+			(unsigned long) ( 100 - left * 100 / ai->ai_ixlast ));
+		if ( done && elapsed > 0 && bv.bv_len < sizeof( buf ))
+			bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+				"#eta=%lu", (unsigned long) ( left * elapsed / done ));
+		ber_dupbv( &dup, &bv );
+		ber_bvarray_add( &vals, &dup );
+	}
+
+	for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+		if ( (*ap)->a_desc == ad_olmMDBIndexBuild )
+			break;
+	a = *ap;
+	if ( a ) {
+		*ap = a->a_next;
+		a->a_next = NULL;
+		attr_free( a );
+	}
+	if ( vals ) {
+		for ( ; *ap != NULL; ap = &(*ap)->a_next )
+			;
+		a = attr_alloc( ad_olmMDBIndexBuild );
+		a->a_vals = vals;
+		a->a_nvals = a->a_vals;
+		for ( i = 0; !BER_BVISNULL( &vals[ i ] ); i++ )
+			;
+		a->a_numvals = i;
+		*ap = a;
+	}
+}
+
+typedef struct mdb_monitor_rctx {
+	struct mdb_info	*mdb;
+	MDB_envinfo	ei;
+	time_t		now;
+	BerVarray	vals;
+} mdb_monitor_rctx;
+
+/* Called with each line of mdb_reader_list(); lines of readers
+ * without a snapshot, and the header, are skipped */
+static int
+mdb_monitor_reader( const char *msg, void *ctx )
+{
+	mdb_monitor_rctx *rc = ctx;
+	mdb_rslot *mr;
+	struct berval bv, dup;
+	char buf[ 256 ];
+	unsigned long tid, txnid;
+	int pid;
+
+	if ( sscanf( msg, "%d %lx %lu", &pid, &tid, &txnid ) != 3 )
+		return 0;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"pid=%d#thread=%lx#txnid=%lu#behind=%lu",
+		pid, tid, txnid,
+		(unsigned long) rc->ei.me_last_txnid > txnid ?
+			(unsigned long) rc->ei.me_last_txnid - txnid : 0 );
+	if ( pid == getpid() ) {
+		for ( mr = rc->mdb->mi_rslots; mr; mr = mr->mr_next ) {
+			if ( (unsigned long) mr->mr_tid == tid )
+				break;
+		}
+		if ( mr && bv.bv_len < sizeof( buf ))
+			bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+				"#conn=%lu#op=%lu#seconds=%ld", mr->mr_connid, mr->mr_opid,
+				(long) ( rc->now - mr->mr_since ));
+	}
+	if ( bv.bv_len >= sizeof( buf ))
+		bv.bv_len = sizeof( buf ) - 1;
+	ber_dupbv( &dup, &bv );
+	ber_bvarray_add( &rc->vals, &dup );
+	return 0;
+}
+
+/* One value per read txn with a snapshot:
+ * "pid=<n>#thread=<hex>#txnid=<n>#behind=<txns>", followed for the
+ * threads of this slapd by "#conn=<n>#op=<n>#seconds=<n>" of the
+ * operation that took the snapshot
+ */
+static void
+mdb_monitor_readers(
+	struct mdb_info		*mdb,
+	Entry			*e )
+{
+	Attribute		*a, **ap;
+	mdb_monitor_rctx	rc;
+	int			i;
+
+	rc.mdb = mdb;
+	rc.now = slap_get_time();
+	rc.vals = NULL;
+	mdb_env_info( mdb->mi_dbenv, &rc.ei );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_rslot_mutex );
+	mdb_reader_list( mdb->mi_dbenv, mdb_monitor_reader, &rc );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_rslot_mutex );
+
+	for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+		if ( (*ap)->a_desc == ad_olmMDBReaders )
+			break;
+	a = *ap;
+	if ( a ) {
+		*ap = a->a_next;
+		a->a_next = NULL;
+		attr_free( a );
+	}
+	if ( rc.vals ) {
+		for ( ; *ap != NULL; ap = &(*ap)->a_next )
+			;
+		a = attr_alloc( ad_olmMDBReaders );
+		a->a_vals = rc.vals;
+		a->a_nvals = a->a_vals;
+		for ( i = 0; !BER_BVISNULL( &rc.vals[ i ] ); i++ )
+			;
+		a->a_numvals = i;
+		*ap = a;
+	}
+}
+
 static int
 mdb_monitor_update(
 	Operation	*op,
@@ -118,9 +318,37 @@ mdb_monitor_update(
 	Entry		*e,
 	void		*priv )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) priv;
+	Attribute		*a;
+	unsigned long		count, hits, misses;
 
+	char			buf[ BUFSIZ ];
+	struct berval		bv;
+
+	assert( ad_olmMDBEntryCache != NULL );
+
+	mdb_ecache_stats( mdb, &count, &hits, &misses );
+	bv.bv_val = buf;
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCache );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", count );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheHits );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheMisses );
+	assert( a != NULL );
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	mdb_monitor_index_build( mdb, e );
+	mdb_monitor_readers( mdb, e );
+
+#ifdef MDB_MONITOR_IDX
 	mdb_monitor_idx_entry_add( mdb, e );
 #endif /* MDB_MONITOR_IDX */
 
@@ -315,7 +543,7 @@ mdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 1 );
+	a = attrs_alloc( 1 + 4 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -325,6 +553,22 @@ mdb_monitor_db_open( BackendDB *be )
 	attr_valadd( a, &oc_olmMDBDatabase->soc_cname, NULL, 1 );
 	next = a->a_next;
 
+	{
+		struct berval	bv = BER_BVC( "0" );
+
+		next->a_desc = ad_olmMDBEntryCache;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+	}
+
 	{
 		struct berval	bv, nbv;
 		ber_len_t	pathlen = 0, len = 0;
@@ -49,11 +49,51 @@ void mdb_attr_info_free( AttrInfo *ai );
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
+/*
+ * column.c
+ */
+
+int mdb_column_put( Operation *op, MDB_txn *txn, Entry *e );
+int mdb_column_delete( struct mdb_info *mdb, MDB_txn *txn, ID id );
+int mdb_column_add( struct mdb_info *mdb, AttributeDescription *ad );
+void mdb_column_del( struct mdb_info *mdb, int i );
+void mdb_column_unparse( struct mdb_info *mdb, BerVarray *bva );
+int mdb_column_sweep( struct mdb_info *mdb, MDB_txn *txn );
+int mdb_column_load( struct mdb_info *mdb, MDB_txn *txn, int *pending );
+void mdb_column_pending( struct mdb_info *mdb, ID last, ID *idp, ID *nextp );
+int mdb_column_progress_save( struct mdb_info *mdb, MDB_txn *txn, ID next );
+void mdb_column_progress_done( struct mdb_info *mdb, ID next );
+int mdb_column_complete( struct mdb_info *mdb, MDB_txn *txn );
+mdb_colscan *mdb_column_scan_init( Operation *op, MDB_txn *txn );
+void mdb_column_scan_free( Operation *op, mdb_colscan *cs );
+void mdb_column_scan_renew( mdb_colscan *cs, MDB_txn *txn );
+int mdb_column_scan_test( mdb_colscan *cs, ID id );
+
+/*
+ * cluster.c
+ */
+
+int mdb_cluster_get( struct mdb_info *mdb, MDB_txn *txn, mdb_idcluster *ic );
+int mdb_cluster_update( struct mdb_info *mdb, MDB_txn *txn, ID id, ID ndel );
+void mdb_cluster_scope( Operation *op, MDB_txn *txn, MDB_cursor *mci,
+	ID base, ID nsubs, ID *ids );
+int mdb_cluster_renumber( Operation *op, int reindex, ID *nrenum );
+int mdb_cluster_start( BackendDB *be );
+
+/*
+ * commit.c
+ */
+
+int mdb_group_join( struct mdb_info *mdb, mdb_op_info *moi );
+int mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn );
+void mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn );
+
 /*
  * config.c
  */
 
 int mdb_back_init_cf( BackendInfo *bi );
+int mdb_online_index_start( BackendDB *be );
 
 /*
  * dn2entry.c
@@ -152,6 +192,20 @@ void mdb_dn2id_wrestore(
 
 MDB_cmp_func mdb_dup_compare;
 
+/*
+ * ecache.c
+ */
+
+void mdb_ecache_init( struct mdb_info *mdb );
+void mdb_ecache_flush( struct mdb_info *mdb, int destroy );
+void mdb_ecache_trim( struct mdb_info *mdb );
+int mdb_ecache_find( Operation *op, MDB_txn *txn, ID id, Entry **e );
+void mdb_ecache_add( Operation *op, MDB_txn *txn, ID id, Entry *e );
+void mdb_ecache_stamp( struct mdb_info *mdb, MDB_txn *txn, ID id );
+void mdb_ecache_stamp_all( struct mdb_info *mdb, MDB_txn *txn );
+void mdb_ecache_stats( struct mdb_info *mdb, unsigned long *count,
+	unsigned long *hits, unsigned long *misses );
+
 /*
  * filterentry.c
  */
@@ -208,7 +262,9 @@ BI_op_txn mdb_txn;
 int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
 
 void mdb_reader_flush( MDB_env *env );
+void mdb_rslot_mark( Operation *op, struct mdb_info *mdb );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
+void mdb_opinfo_changed( Operation *op, struct mdb_info *mdb );
 
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
@@ -228,6 +284,13 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -249,12 +312,27 @@ mdb_idl_union(
 	ID *a,
 	ID *b );
 
+int
+mdb_idl_notin(
+	ID *a,
+	ID *b,
+	ID *ids );
+
 ID mdb_idl_first( ID *ids, ID *cursor );
 ID mdb_idl_next( ID *ids, ID *cursor );
 
 void mdb_idl_sort( ID *ids, ID *tmp );
 int mdb_idl_append( ID *a, ID *b );
 int mdb_idl_append_one( ID *ids, ID id );
+void mdb_idl_union_range( ID *ids, ID lo, ID hi );
+void mdb_idl_clip_scope( ID *ids, ID lo, ID hi, ID high, ID last );
+
+void mdb_idl_bm_begin( void );
+void mdb_idl_bm_end( void );
+int mdb_idl_bm_test( ID *ids, ID id );
+void mdb_idl_bm_copy( ID *dst, ID *src );
+ID *mdb_idl_dup( ID *ids );
+void mdb_idl_free( ID *ids );
 
 
 /*
@@ -270,11 +348,13 @@ mdb_index_mask LDAP_P((
 extern int
 mdb_index_param LDAP_P((
 	Backend *be,
+	MDB_txn *rtxn,
 	AttributeDescription *desc,
 	int ftype,
 	MDB_dbi *dbi,
 	slap_mask_t *mask,
-	struct berval *prefix ));
+	struct berval *prefix,
+	ID *unbuilt ));
 
 extern int
 mdb_index_values LDAP_P((
@@ -309,6 +389,13 @@ int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+int mdb_index_progress_get LDAP_P(( struct mdb_info *mdb, MDB_txn *txn,
+	AttrInfo *ai, mdb_ixprog *ip ));
+int mdb_index_progress_save LDAP_P(( struct mdb_info *mdb, MDB_txn *txn,
+	ID next ));
+int mdb_index_progress_drop LDAP_P(( struct mdb_info *mdb, MDB_txn *txn ));
+int mdb_index_progress_load LDAP_P(( struct mdb_info *mdb, MDB_txn *txn ));
+
 /*
  * key.c
  */
@@ -323,6 +410,14 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_count(
+    Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+    struct berval *k,
+	ID *count );
+
 /*
  * nextid.c
  */
@@ -359,6 +454,24 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * pscan.c
+ */
+
+mdb_pscan *mdb_pscan_start( Operation *op, MDB_txn *txn, ID *ids, ID first,
+	FilterProg *fprog, int colscan );
+int mdb_pscan_test( mdb_pscan *ps, ID id );
+void mdb_pscan_stop( mdb_pscan *ps );
+void mdb_pscan_free( mdb_pscan *ps );
+
+/*
+ * search.c
+ */
+
+void mdb_paged_changed( struct mdb_info *mdb, ID txnid );
+void mdb_paged_flush( struct mdb_info *mdb, Connection *c );
+BI_connection_destroy mdb_connection_destroy;
+
 /*
  * former external.h
  */
@@ -395,6 +508,7 @@ extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_bulk_add;
 
 LDAP_END_DECL
 
@@ -0,0 +1,451 @@
+/* pscan.c - test search candidates on several threads */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/*
+ * A search that returns few of its candidates spends its time decoding
+ * entries and testing the filter on them. With "searchthreads" the
+ * candidates ahead of the search are cut into chunks of consecutive
+ * IDs, and pool threads test whole chunks in their own read txns. A
+ * worker only starts if its txn is the snapshot of the search. For each
+ * chunk it leaves a bitmap of the candidates that may be returned.
+ *
+ * The search still walks its candidates in ID order and does all it did
+ * before for the ones that are left; it only skips those a worker has
+ * dropped, and takes the filter result of the others. So the order of
+ * the results, the size limit and the paged results cookie are the same
+ * as in a sequential search.
+ *
+ * The search never waits for a chunk nobody started: it takes such a
+ * chunk over and tests it the usual way. A busy pool only costs the
+ * parallelism, and a search can not deadlock against its own workers.
+ * Workers stay within a window ahead of the search, so a search that
+ * stops early, on its size limit or at the end of a page, wastes little.
+ */
+
+#define PSCAN_CHUNK		1024	/* candidates per chunk */
+#define PSCAN_MAXCHUNKS	4096
+#define PSCAN_AHEAD		2	/* chunks ahead of the search per worker */
+
+#define PC_FREE	0
+#define PC_MAIN	1	/* tested by the search itself */
+#define PC_BUSY	2
+#define PC_DONE	3
+
+typedef struct pscan_chunk {
+	ID		pc_lo;
+	ID		pc_hi;
+	ID		pc_base;	/* ID or list position of bit 0 */
+	ID		*pc_bits;	/* candidates that may be returned */
+	int		pc_state;
+} pscan_chunk;
+
+struct mdb_pscan {
+	ldap_pvt_thread_mutex_t	ps_mutex;
+	ldap_pvt_thread_cond_t	ps_cond;
+	Operation	*ps_op;
+	FilterProg	*ps_fprog;
+	ID		*ps_ids;	/* private copy of the candidates */
+	ID		*ps_bits;
+	ID		ps_txnid;
+	ID		ps_pos;		/* list position of the search */
+	int		ps_list;
+	int		ps_colscan;
+	int		ps_nworkers;
+	int		ps_tasks;	/* submitted and not returned */
+	int		ps_running;	/* tasks using ps_op */
+	int		ps_refs;
+	int		ps_stop;
+	int		ps_next;	/* next chunk to hand out */
+	int		ps_cur;		/* chunk the search is in */
+	int		ps_curstate;
+	int		ps_nchunks;
+	pscan_chunk	ps_chunks[1];
+};
+
+static void *mdb_pscan_task( void *ctx, void *arg );
+
+static void
+mdb_pscan_destroy( mdb_pscan *ps )
+{
+	ldap_pvt_thread_cond_destroy( &ps->ps_cond );
+	ldap_pvt_thread_mutex_destroy( &ps->ps_mutex );
+	ch_free( ps->ps_bits );
+	mdb_idl_free( ps->ps_ids );
+	ch_free( ps );
+}
+
+/* Keep ps_nworkers tasks submitted while there is work. Called with
+ * ps_mutex held, or before any task exists.
+ */
+static void
+mdb_pscan_kick( mdb_pscan *ps )
+{
+	while ( ps->ps_tasks < ps->ps_nworkers && !ps->ps_stop &&
+		ps->ps_next < ps->ps_nchunks )
+	{
+		ps->ps_tasks++;
+		ps->ps_refs++;
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_pscan_task, ps ))
+		{
+			ps->ps_tasks--;
+			ps->ps_refs--;
+			break;
+		}
+	}
+}
+
+mdb_pscan *
+mdb_pscan_start( Operation *op, MDB_txn *txn, ID *ids, ID first,
+	FilterProg *fprog, int colscan )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_pscan *ps;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID last, n, lo, step, nwords, *bits;
+	int i, rc, nthreads, nchunks, list;
+
+	nthreads = mdb->mi_search_threads;
+	if ( op->ors_limit && op->ors_limit->lms_threads > 0 &&
+		op->ors_limit->lms_threads < nthreads )
+		nthreads = op->ors_limit->lms_threads;
+	if ( nthreads > connection_pool_max )
+		nthreads = connection_pool_max;
+	if ( nthreads < 2 || first == NOID || ( slapMode & SLAP_TOOL_MODE ))
+		return NULL;
+
+	/* Nothing to test beyond the last entry */
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc )
+		return NULL;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+	if ( rc == 0 )
+		memcpy( &last, key.mv_data, sizeof(ID) );
+	mdb_cursor_close( mc );
+	if ( rc )
+		return NULL;
+	if ( last > MDB_IDL_LAST( ids ))
+		last = MDB_IDL_LAST( ids );
+	if ( last < first )
+		return NULL;
+
+	/* Chunks of a list hold the same number of candidates, those of a
+	 * range or bitmap the same number of IDs.
+	 */
+	list = !MDB_IDL_IS_RANGE( ids ) && !MDB_IDL_IS_BITMAP( ids );
+	if ( list ) {
+		lo = mdb_idl_search( ids, first );
+		step = mdb_idl_search( ids, last );
+		if ( step <= ids[0] && ids[step] == last )
+			step++;
+		n = step - lo;
+	} else {
+		lo = first;
+		n = last - first + 1;
+	}
+	if ( n < 2 * PSCAN_CHUNK )
+		return NULL;
+	nchunks = n / PSCAN_CHUNK;
+	if ( nchunks > PSCAN_MAXCHUNKS )
+		nchunks = PSCAN_MAXCHUNKS;
+	step = n / nchunks;
+
+	ps = ch_calloc( 1, sizeof(mdb_pscan) +
+		( nchunks - 1 ) * sizeof(pscan_chunk) );
+	ps->ps_ids = mdb_idl_dup( ids );
+	nwords = 0;
+	for ( i = 0; i < nchunks; i++ ) {
+		pscan_chunk *pc = &ps->ps_chunks[i];
+		ID end = i == nchunks - 1 ? lo + n - 1 : lo + ( i + 1 ) * step - 1;
+		pc->pc_base = lo + i * step;
+		if ( list ) {
+			pc->pc_lo = ids[pc->pc_base];
+			pc->pc_hi = ids[end];
+		} else {
+			pc->pc_lo = pc->pc_base;
+			pc->pc_hi = end;
+		}
+		nwords += ( end - pc->pc_base ) / MDB_IDL_BM_BITS + 1;
+	}
+	bits = ch_calloc( nwords, sizeof(ID) );
+	ps->ps_bits = bits;
+	for ( i = 0; i < nchunks; i++ ) {
+		pscan_chunk *pc = &ps->ps_chunks[i];
+		ID end = i == nchunks - 1 ? lo + n - 1 : lo + ( i + 1 ) * step - 1;
+		pc->pc_bits = bits;
+		bits += ( end - pc->pc_base ) / MDB_IDL_BM_BITS + 1;
+	}
+
+	ldap_pvt_thread_mutex_init( &ps->ps_mutex );
+	ldap_pvt_thread_cond_init( &ps->ps_cond );
+	ps->ps_op = op;
+	ps->ps_fprog = fprog;
+	ps->ps_txnid = mdb_txn_id( txn );
+	ps->ps_pos = lo;
+	ps->ps_list = list;
+	ps->ps_colscan = colscan;
+	ps->ps_nworkers = nthreads - 1;
+	ps->ps_nchunks = nchunks;
+	ps->ps_refs = 1;
+	mdb_pscan_kick( ps );
+
+	Debug( LDAP_DEBUG_TRACE, "mdb_pscan_start: %d chunks of %ld candidates, "
+		"%d threads\n", nchunks, (long) step, nthreads );
+	return ps;
+}
+
+/* Test the candidates of one chunk, set the bits of those that
+ * may be returned. Returns nonzero if the chunk was not finished.
+ */
+static int
+mdb_pscan_chunk( Operation *op, mdb_pscan *ps, pscan_chunk *pc,
+	MDB_txn *txn, MDB_cursor *mci, MDB_cursor **mcd, mdb_colscan *cs )
+{
+	ID id, idx, cursor = pc->pc_lo;
+	int manageDSAit = get_manageDSAit( op );
+	MDB_val edata;
+	Entry *e;
+	int rc, keep;
+
+	for ( id = mdb_idl_first( ps->ps_ids, &cursor );
+		id != NOID && id <= pc->pc_hi;
+		id = mdb_idl_next( ps->ps_ids, &cursor ))
+	{
+		if ( ps->ps_stop || ps->ps_op->o_abandon || slapd_shutdown )
+			return 1;
+
+		if ( cs && !mdb_column_scan_test( cs, id ))
+			continue;
+		rc = mdb_id2edata( op, mci, id, &edata );
+		if ( rc == MDB_NOTFOUND )
+			continue;
+		if ( rc )
+			return rc;
+		rc = mdb_entry_decode( op, txn, &edata, id, &e );
+		if ( rc )
+			return rc;
+		e->e_id = id;
+		e->e_name.bv_val = NULL;
+		e->e_nname.bv_val = NULL;
+		rc = mdb_id2name( op, txn, mcd, id, &e->e_name, &e->e_nname );
+		if ( rc ) {
+			e->e_name.bv_val = NULL;
+			e->e_nname.bv_val = NULL;
+			mdb_entry_return( op, e );
+			return rc;
+		}
+
+		/* Referrals are sent whatever the filter says */
+		if ( !manageDSAit && op->ors_scope != LDAP_SCOPE_BASE &&
+			is_entry_referral( e ))
+			keep = 1;
+		else
+			keep = test_filter_prog( op, e, ps->ps_fprog ) ==
+				LDAP_COMPARE_TRUE;
+		mdb_entry_return( op, e );
+
+		if ( keep ) {
+			idx = ( ps->ps_list ? cursor : id ) - pc->pc_base;
+			pc->pc_bits[idx / MDB_IDL_BM_BITS] |=
+				(ID) 1 << ( idx % MDB_IDL_BM_BITS );
+		}
+	}
+	return 0;
+}
+
+static void *
+mdb_pscan_task( void *ctx, void *arg )
+{
+	mdb_pscan *ps = arg;
+	struct mdb_info *mdb;
+	Operation op2;
+	Opheader ohdr;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	MDB_txn *txn;
+	MDB_cursor *mci = NULL, *mcd = NULL;
+	mdb_colscan *cs = NULL;
+	int c, rc, refs;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	if ( ps->ps_stop || ps->ps_next >= ps->ps_nchunks )
+		goto leave;
+	ps->ps_running++;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	/* A copy of the search with this thread's memory and txn */
+	op2 = *ps->ps_op;
+	ohdr = *ps->ps_op->o_hdr;
+	op2.o_hdr = &ohdr;
+	op2.o_threadctx = ctx;
+	op2.o_tid = ldap_pvt_thread_pool_tid( ctx );
+	op2.o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op2.o_tmpmfuncs = &slap_sl_mfuncs;
+	op2.o_callback = NULL;
+	op2.o_groups = NULL;
+	LDAP_SLIST_INIT( &op2.o_extra );
+	mdb = (struct mdb_info *) op2.o_bd->be_private;
+
+	rc = mdb_opinfo_get( &op2, mdb, 1, &moi );
+	if ( rc ) {
+		moi = NULL;
+		goto done;
+	}
+	txn = moi->moi_txn;
+	if ( mdb_txn_id( txn ) != ps->ps_txnid )
+		goto done;
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mci );
+	if ( rc )
+		goto done;
+	if ( ps->ps_colscan )
+		cs = mdb_column_scan_init( &op2, txn );
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	for (;;) {
+		pscan_chunk *pc;
+
+		c = ps->ps_next;
+		if ( ps->ps_stop || c >= ps->ps_nchunks ||
+			c > ps->ps_cur + ps->ps_nworkers * PSCAN_AHEAD )
+			break;
+		ps->ps_next++;
+		pc = &ps->ps_chunks[c];
+		pc->pc_state = PC_BUSY;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+		rc = mdb_pscan_chunk( &op2, ps, pc, txn, mci, &mcd, cs );
+
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		pc->pc_state = rc ? PC_MAIN : PC_DONE;
+		ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+		if ( rc )
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+done:
+	if ( cs )
+		mdb_column_scan_free( &op2, cs );
+	if ( mcd )
+		mdb_cursor_close( mcd );
+	if ( mci )
+		mdb_cursor_close( mci );
+	if ( moi ) {
+		mdb_txn_reset( moi->moi_txn );
+		LDAP_SLIST_REMOVE( &op2.o_extra, &moi->moi_oe, OpExtra, oe_next );
+	}
+	slap_op_groups_free( &op2 );
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_running--;
+leave:
+	ps->ps_tasks--;
+	refs = --ps->ps_refs;
+	ldap_pvt_thread_cond_broadcast( &ps->ps_cond );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	if ( !refs )
+		mdb_pscan_destroy( ps );
+	return NULL;
+}
+
+/* Returns 0 if a worker dropped candidate id, 1 if it matched the
+ * filter, and -1 if the search must test it itself.
+ */
+int
+mdb_pscan_test( mdb_pscan *ps, ID id )
+{
+	pscan_chunk *pc;
+	ID idx;
+
+	if ( ps->ps_stop )
+		return -1;
+	while ( ps->ps_cur < ps->ps_nchunks &&
+		id > ps->ps_chunks[ps->ps_cur].pc_hi )
+	{
+		ps->ps_cur++;
+		ps->ps_curstate = PC_FREE;
+	}
+	if ( ps->ps_cur >= ps->ps_nchunks )
+		return -1;
+	pc = &ps->ps_chunks[ps->ps_cur];
+	if ( id < pc->pc_lo )
+		return -1;
+
+	if ( ps->ps_curstate != PC_DONE && ps->ps_curstate != PC_MAIN ) {
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		if ( pc->pc_state == PC_FREE ) {
+			pc->pc_state = PC_MAIN;
+			if ( ps->ps_next <= ps->ps_cur )
+				ps->ps_next = ps->ps_cur + 1;
+		}
+		mdb_pscan_kick( ps );
+		while ( pc->pc_state == PC_BUSY )
+			ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+		ps->ps_curstate = pc->pc_state;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	}
+	if ( ps->ps_curstate != PC_DONE )
+		return -1;
+
+	if ( ps->ps_list ) {
+		if ( ps->ps_pos < pc->pc_base )
+			ps->ps_pos = pc->pc_base;
+		while ( ps->ps_pos <= ps->ps_ids[0] && ps->ps_ids[ps->ps_pos] < id )
+			ps->ps_pos++;
+		if ( ps->ps_pos > ps->ps_ids[0] || ps->ps_ids[ps->ps_pos] != id )
+			return -1;
+		idx = ps->ps_pos - pc->pc_base;
+	} else {
+		idx = id - pc->pc_base;
+	}
+	return ( pc->pc_bits[idx / MDB_IDL_BM_BITS] >>
+		( idx % MDB_IDL_BM_BITS )) & 1;
+}
+
+/* Stop the workers and forget their results, the search moved
+ * to another snapshot or is done.
+ */
+void
+mdb_pscan_stop( mdb_pscan *ps )
+{
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_stop = 1;
+	while ( ps->ps_running )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+}
+
+void
+mdb_pscan_free( mdb_pscan *ps )
+{
+	int refs;
+
+	mdb_pscan_stop( ps );
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	refs = --ps->ps_refs;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	if ( !refs )
+		mdb_pscan_destroy( ps );
+}
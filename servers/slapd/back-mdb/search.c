@@ -44,6 +44,10 @@ static void send_paged_response(
 	ID  *lastid,
 	int tentries );
 
+static int mdb_paged_get( Operation *op, ID *ids, ID *txnid );
+
+static void mdb_paged_put( Operation *op, ID *ids, ID txnid, ID lastid );
+
 /* Dereference aliases for a single alias entry. Return the final
  * dereferenced entry on success, NULL on any failure.
  */
@@ -326,6 +330,8 @@ typedef struct ww_ctx {
 	MDB_val data;
 	int flag;
 	int nentries;
+	ID txnid;	/* txn the search started in */
+	time_t since;	/* when the current snapshot was taken */
 } ww_ctx;
 
 /* ITS#7904 if we get blocked while writing results to client,
@@ -372,6 +378,21 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	mdb_txn_renew( ww->txn );
 	mdb_cursor_renew( ww->txn, mci );
 	mdb_cursor_renew( ww->txn, mcd );
+	ww->since = slap_get_time();
+	mdb_rslot_mark( op, (struct mdb_info *) op->o_bd->be_private );
+
+	/* The entries were renumbered meanwhile, the position is lost */
+	{
+		struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+		ID cid = mdb->mi_cluster_txnid;
+		if ( cid > ww->txnid && mdb_txn_id( ww->txn ) >= cid ) {
+			if ( ww->mcd ) {
+				op->o_tmpfree( ww->data.mv_data, op->o_tmpmemctx );
+				ww->data.mv_data = NULL;
+			}
+			return LDAP_BUSY;
+		}
+	}
 
 	key.mv_size = sizeof(ID);
 	if ( ww->mcd ) {	/* scope-based search using dn2id_walk */
@@ -414,8 +435,8 @@ int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	ID		id, cursor, nsubs, ncand, cscope;
-	ID		lastid = NOID;
+	ID		id, cursor, nsubs, nsubid, ncand, cscope;
+	ID		lastid = NOID, ptxnid = 0;
 	ID		candidates[MDB_IDL_UM_SIZE];
 	ID		iscopes[MDB_IDL_DB_SIZE];
 	ID2		*scopes;
@@ -426,11 +447,14 @@ mdb_search( Operation *op, SlapReply *rs )
 	slap_mask_t	mask;
 	time_t		stoptime;
 	int		manageDSAit;
-	int		tentries = 0;
+	int		tentries = 0, nloop = 0;
 	IdScopes	isc;
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	mdb_colscan	*colscan = NULL;
+	FilterProg	*fprog = NULL;
+	mdb_pscan	*pscan = NULL;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -471,6 +495,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
 	isc.sctmp = stack;
+	mdb_idl_bm_begin();
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		MDB_IDL_ZERO(candidates);
@@ -493,6 +518,8 @@ dn2entry_retry:
 		send_ldap_error( op, rs, LDAP_OTHER, "internal error" );
 		goto done;
 	}
+	/* nsubs belongs to this entry, not to an alias target */
+	nsubid = e ? e->e_id : NOID;
 
 	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
 		if ( matched && is_entry_alias( matched )) {
@@ -663,8 +690,21 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+		/* The next page of a paged search takes the candidates
+		 * of the previous one */
+		if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED &&
+			moi == &opinfo && mdb_paged_get( op, candidates, &ptxnid ))
+		{
+			rs->sr_err = LDAP_SUCCESS;
+		} else {
+			ptxnid = mdb_txn_id( ltid );
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, stack );
+			/* Clustered IDs: the subtree is (mostly) a contiguous range */
+			if ( base->e_id && base->e_id == nsubid && scopes[0].mid == 1 &&
+				op->ors_scope != LDAP_SCOPE_ONELEVEL )
+				mdb_cluster_scope( op, ltid, mci, base->e_id, nsubs, candidates );
+		}
 		ncand = MDB_IDL_N( candidates );
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
@@ -707,6 +747,19 @@ dn2entry_retry:
 		tentries = ncand;
 	}
 
+	/* The indexes didn't narrow the scan down, let the columns
+	 * weed out candidates before they are decoded.
+	 */
+	if ( op->ors_scope != LDAP_SCOPE_BASE && ( nsubs < ncand ||
+		MDB_IDL_IS_RANGE( candidates ) || MDB_IDL_IS_BITMAP( candidates )))
+	{
+		colscan = mdb_column_scan_init( op, ltid );
+	}
+
+	/* Every candidate is tested against the same filter */
+	if ( op->ors_scope != LDAP_SCOPE_BASE && ncand > 1 )
+		fprog = filter_prog_compile( op, op->oq_search.rs_filter );
+
 	wwctx.flag = 0;
 	wwctx.nentries = 0;
 	/* If we're running in our own read txn */
@@ -715,6 +768,8 @@ dn2entry_retry:
 		cb.sc_private = &wwctx;
 		wwctx.txn = ltid;
 		wwctx.mcd = NULL;
+		wwctx.txnid = mdb_txn_id( ltid );
+		wwctx.since = slap_get_time();
 		cb.sc_next = op->o_callback;
 		op->o_callback = &cb;
 	}
@@ -749,6 +804,9 @@ dn2entry_retry:
 		if ( id == (ID)ps->ps_cookie )
 			id = mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
+		if ( moi == &opinfo && fprog )
+			pscan = mdb_pscan_start( op, ltid, candidates, id, fprog,
+				colscan != NULL );
 		goto loop_begin;
 	}
 	if ( nsubs < ncand ) {
@@ -780,11 +838,15 @@ dn2entry_retry:
 		cscope = 0;
 	} else {
 		id = mdb_idl_first( candidates, &cursor );
+		/* Let other threads test the candidates ahead */
+		if ( moi == &opinfo && fprog )
+			pscan = mdb_pscan_start( op, ltid, candidates, id, fprog,
+				colscan != NULL );
 	}
 
 	while (id != NOID)
 	{
-		int scopeok;
+		int scopeok, pst;
 		MDB_val edata;
 
 loop_begin:
@@ -796,6 +858,12 @@ loop_begin:
 			goto done;
 		}
 
+		/* Every 64 candidates, write out entries that were found
+		 * a while ago and are still waiting for more to join them */
+		if ( ( ++nloop & 0x3f ) == 0 ) {
+			slap_send_coalesce_check( op );
+		}
+
 		/* mostly needed by internal searches,
 		 * e.g. related to syncrepl, for whom
 		 * abandon does not get set... */
@@ -825,6 +893,9 @@ loop_begin:
 				if ( id >= MDB_IDL_RANGE_FIRST( candidates ) &&
 					id <= MDB_IDL_RANGE_LAST( candidates ))
 					scopeok = 1;
+			} else if (MDB_IDL_IS_BITMAP( candidates )) {
+				if ( MDB_IDL_BM_TEST( candidates, id ))
+					scopeok = 1;
 			} else {
 				i = mdb_idl_search( candidates, id );
 				if (i <= candidates[0] && candidates[i] == id )
@@ -882,9 +953,24 @@ loop_begin:
 		}
 
 scopeok:
+		pst = -1;
 		if ( id == base->e_id ) {
 			e = base;
 		} else {
+			if ( pscan && ( pst = mdb_pscan_test( pscan, id )) == 0 ) {
+				Debug( LDAP_DEBUG_TRACE,
+					LDAP_XSTRING(mdb_search)
+					": %ld does not match filter\n",
+					(long) id, 0, 0 );
+				goto loop_continue;
+			}
+			if ( pst < 0 && colscan && !mdb_column_scan_test( colscan, id )) {
+				Debug( LDAP_DEBUG_TRACE,
+					LDAP_XSTRING(mdb_search)
+					": %ld does not match column filter\n",
+					(long) id, 0, 0 );
+				goto loop_continue;
+			}
 
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
@@ -1059,7 +1145,12 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( pst > 0 )
+			rs->sr_err = LDAP_COMPARE_TRUE;	/* tested by a worker */
+		else if ( fprog )
+			rs->sr_err = test_filter_prog( op, e, fprog );
+		else
+			rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1068,6 +1159,8 @@ notfound:
 					if (e != base)
 						mdb_entry_return( op, e );
 					e = NULL;
+					if ( moi == &opinfo && op->ors_scope != LDAP_SCOPE_BASE )
+						mdb_paged_put( op, candidates, ptxnid, lastid );
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
@@ -1120,22 +1213,35 @@ notfound:
 		}
 
 loop_continue:
-		if ( moi == &opinfo && !wwctx.flag && mdb->mi_rtxn_size ) {
+		/* Let writers reclaim the pages of an old snapshot, after
+		 * rtxnsize entries or rtxnage seconds */
+		if ( moi == &opinfo && !wwctx.flag ) {
 			wwctx.nentries++;
-			if ( wwctx.nentries >= mdb->mi_rtxn_size ) {
+			if (( mdb->mi_rtxn_size && wwctx.nentries >= mdb->mi_rtxn_size ) ||
+				( mdb->mi_rtxn_age &&
+				slap_get_time() - wwctx.since >= mdb->mi_rtxn_age )) {
 				MDB_envinfo ei;
 				wwctx.nentries = 0;
 				mdb_env_info(mdb->mi_dbenv, &ei);
-				if ( ei.me_last_txnid > mdb_txn_id( ltid ))
+				if ( ei.me_last_txnid > mdb_txn_id( ltid )) {
 					mdb_rtxn_snap( op, &wwctx );
+				} else {
+					/* still the latest snapshot */
+					wwctx.since = slap_get_time();
+				}
 			}
 		}
 		if ( wwctx.flag ) {
+			/* what the workers found is of the old snapshot */
+			if ( pscan )
+				mdb_pscan_stop( pscan );
 			rs->sr_err = mdb_waitfixup( op, &wwctx, mci, mcd, &isc );
 			if ( rs->sr_err ) {
 				send_ldap_result( op, rs );
 				goto done;
 			}
+			if ( colscan )
+				mdb_column_scan_renew( colscan, ltid );
 		}
 
 		if( e != NULL ) {
@@ -1203,6 +1309,12 @@ done:
 			}
 		}
 	}
+	if ( pscan )
+		mdb_pscan_free( pscan );
+	if ( colscan )
+		mdb_column_scan_free( op, colscan );
+	if ( fprog )
+		filter_prog_free( op, fprog );
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
@@ -1218,6 +1330,7 @@ done:
 	if (base)
 		mdb_entry_return( op, base );
 	scope_chunk_ret( op, scopes );
+	mdb_idl_bm_end();
 
 	return rs->sr_err;
 }
@@ -1499,3 +1612,179 @@ send_paged_response(
 done:
 	(void) ber_free_buf( ber );
 }
+
+/* Candidates of paged searches.
+ *
+ * Each page of a paged search computes the candidates again, to skip
+ * ahead to the ID in its cookie. With "pagedcache" the candidates are
+ * kept after a page that was not the last, under the connection and the
+ * cookie sent with it, and the next page takes them if its base, scope
+ * and filter are the same. A connection has one paged search going at a
+ * time, so it has one entry at most; beyond the limit the least recently
+ * used are dropped. An entry expires after pagedcachettl seconds, and
+ * once a write that changed the indexes or the DIT commits after the
+ * snapshot its candidates were computed in.
+ */
+
+static void
+mdb_paged_free( mdb_paged *mp )
+{
+	mdb_paged *next;
+
+	for ( ; mp; mp = next ) {
+		next = mp->mp_next;
+		mdb_idl_free( mp->mp_ids );
+		ch_free( mp );
+	}
+}
+
+static int
+mdb_paged_get( Operation *op, ID *ids, ID *txnid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	PagedResultsState *ps = op->o_pagedresults_state;
+	PagedResultsCookie cookie;
+	mdb_paged *mp, **prev;
+	int rc = 0;
+
+	if ( !mdb->mi_paged_max || !op->o_conn ||
+		( op->ors_deref & LDAP_DEREF_SEARCHING ) ||
+		ps->ps_cookieval.bv_len != sizeof( cookie ))
+		return 0;
+	AC_MEMCPY( &cookie, ps->ps_cookieval.bv_val, sizeof( cookie ));
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	for ( prev = &mdb->mi_paged; ( mp = *prev ); prev = &mp->mp_next ) {
+		if ( mp->mp_connid == op->o_connid )
+			break;
+	}
+	if ( mp ) {
+		*prev = mp->mp_next;
+		mp->mp_next = NULL;
+		mdb->mi_paged_n--;
+		if ( mp->mp_cookie == (ID) cookie &&
+			mp->mp_txnid >= mdb->mi_paged_txnid &&
+			mp->mp_used + mdb->mi_paged_ttl >= slap_get_time() &&
+			mp->mp_scope == op->ors_scope &&
+			bvmatch( &mp->mp_base, &op->o_req_ndn ) &&
+			bvmatch( &mp->mp_filter, &op->ors_filterstr ))
+		{
+			MDB_IDL_CPY( ids, mp->mp_ids );
+			*txnid = mp->mp_txnid;
+			rc = 1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( mp );
+
+	Debug( LDAP_DEBUG_TRACE, "mdb_paged_get: %s candidates for cookie %ld\n",
+		rc ? "kept" : "no", (long) cookie, 0 );
+	return rc;
+}
+
+static void
+mdb_paged_put( Operation *op, ID *ids, ID txnid, ID lastid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_paged *mp, **prev, *dead = NULL;
+	time_t now = slap_get_time();
+	unsigned i;
+
+	if ( !mdb->mi_paged_max || !op->o_conn ||
+		( op->ors_deref & LDAP_DEREF_SEARCHING ))
+		return;
+
+	mp = ch_malloc( sizeof( mdb_paged ) + op->o_req_ndn.bv_len + 1 +
+		op->ors_filterstr.bv_len + 1 );
+	mp->mp_connid = op->o_connid;
+	mp->mp_cookie = lastid;
+	mp->mp_txnid = txnid;
+	mp->mp_used = now;
+	mp->mp_scope = op->ors_scope;
+	mp->mp_base.bv_len = op->o_req_ndn.bv_len;
+	mp->mp_base.bv_val = (char *)( mp + 1 );
+	memcpy( mp->mp_base.bv_val, op->o_req_ndn.bv_val, mp->mp_base.bv_len + 1 );
+	mp->mp_filter.bv_len = op->ors_filterstr.bv_len;
+	mp->mp_filter.bv_val = mp->mp_base.bv_val + mp->mp_base.bv_len + 1;
+	memcpy( mp->mp_filter.bv_val, op->ors_filterstr.bv_val,
+		mp->mp_filter.bv_len + 1 );
+	mp->mp_ids = mdb_idl_dup( ids );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	mp->mp_next = mdb->mi_paged;
+	mdb->mi_paged = mp;
+	mdb->mi_paged_n++;
+	/* Drop older entries of this connection, expired ones, and
+	 * the least recently used beyond the limit */
+	for ( i = 1, prev = &mp->mp_next; ( mp = *prev ); ) {
+		if ( mp->mp_connid == op->o_connid ||
+			mp->mp_used + mdb->mi_paged_ttl < now ||
+			mp->mp_txnid < mdb->mi_paged_txnid ||
+			i >= mdb->mi_paged_max )
+		{
+			*prev = mp->mp_next;
+			mp->mp_next = dead;
+			dead = mp;
+			mdb->mi_paged_n--;
+		} else {
+			prev = &mp->mp_next;
+			i++;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( dead );
+}
+
+/* A write txn that changed the indexes or the DIT is about to commit */
+void
+mdb_paged_changed( struct mdb_info *mdb, ID txnid )
+{
+	mdb_paged *mp, **prev, *dead = NULL;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	if ( txnid > mdb->mi_paged_txnid )
+		mdb->mi_paged_txnid = txnid;
+	for ( prev = &mdb->mi_paged; ( mp = *prev ); ) {
+		if ( mp->mp_txnid < txnid ) {
+			*prev = mp->mp_next;
+			mp->mp_next = dead;
+			dead = mp;
+			mdb->mi_paged_n--;
+		} else {
+			prev = &mp->mp_next;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( dead );
+}
+
+/* Drop the kept candidates of connection c, or all of them */
+void
+mdb_paged_flush( struct mdb_info *mdb, Connection *c )
+{
+	mdb_paged *mp, **prev, *dead = NULL;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	for ( prev = &mdb->mi_paged; ( mp = *prev ); ) {
+		if ( !c || mp->mp_connid == c->c_connid ) {
+			*prev = mp->mp_next;
+			mp->mp_next = dead;
+			dead = mp;
+			mdb->mi_paged_n--;
+		} else {
+			prev = &mp->mp_next;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( dead );
+}
+
+int
+mdb_connection_destroy( BackendDB *be, Connection *c )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+
+	if ( mdb->mi_paged )
+		mdb_paged_flush( mdb, c );
+	return 0;
+}
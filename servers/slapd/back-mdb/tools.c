@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <ac/string.h>
 #include <ac/errno.h>
+#include <ac/unistd.h>
 
 #define AVL_INTERNAL
 #include "back-mdb.h"
@@ -53,6 +54,8 @@ typedef struct mdb_tool_idl_cache {
 MDB_txn *mdb_tool_txn = NULL;
 
 static MDB_txn *txi = NULL;
+static int mdb_tool_columns;	/* slapindex rewrote the columns */
+static int mdb_tool_renumbered;	/* slapindex must rebuild all indices */
 static MDB_cursor *cursor = NULL, *idcursor = NULL;
 static MDB_cursor *mcp = NULL, *mcd = NULL;
 static MDB_val key, data;
@@ -71,6 +74,7 @@ static unsigned nholes;
 static struct berval	*tool_base;
 static int		tool_scope;
 static Filter		*tool_filter;
+static FilterProg	*tool_fprog;
 static Entry		*tool_next_entry;
 
 static ID mdb_tool_ix_id;
@@ -87,6 +91,14 @@ static void * mdb_tool_index_task( void *ctx, void *ptr );
 
 static int	mdb_writes, mdb_writes_per_commit;
 
+/* sorted bulk index load, see mdb_tool_bulk_add() */
+static int mdb_tool_bulkload;
+static ID mdb_tool_bulk_maxid;	/* last committed ID */
+static int mdb_tool_bulk_open( BackendDB *be );
+static int mdb_tool_bulk_spill( struct mdb_info *mdb );
+static void mdb_tool_bulk_drop( struct mdb_info *mdb, ID maxid );
+static int mdb_tool_bulk_flush( BackendDB *be );
+
 /* Number of ops per commit in Quick mode.
  * Batching speeds writes overall, but too large a
  * batch will fail with MDB_TXN_FULL.
@@ -98,9 +110,43 @@ static int	mdb_writes, mdb_writes_per_commit;
 static int
 mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
+/* Give the entries clustered IDs, see cluster.c */
+static int
+mdb_tool_renumber( BackendDB *be, int reindex, ID *nrenum )
+{
+	Operation op = {0};
+	Opheader ohdr = {0};
+	int mode = slapMode;
+	int rc;
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	/* index the entries directly, not through the tool IDL cache */
+	slapMode &= ~SLAP_TOOL_QUICK;
+	rc = mdb_cluster_renumber( &op, reindex, nrenum );
+	slapMode = mode;
+	return rc;
+}
+
 int mdb_tool_entry_open(
 	BackendDB *be, int mode )
 {
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+
+	/* slapindex renumbers first, then rebuilds every index */
+	mdb_tool_renumbered = 0;
+	if (( slapMode & (SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY)) == SLAP_TOOL_READMAIN &&
+		( mdb->mi_flags & (MDB_CLUSTER|MDB_NEED_UPGRADE)) == MDB_CLUSTER )
+	{
+		ID n;
+		if ( mdb_tool_renumber( be, 0, &n ))
+			return -1;
+		mdb_tool_renumbered = n != 0;
+	}
+
 	/* In Quick mode, commit once per 500 entries */
 	mdb_writes = 0;
 	if ( slapMode & SLAP_TOOL_QUICK )
@@ -108,11 +154,19 @@ int mdb_tool_entry_open(
 	else
 		mdb_writes_per_commit = 1;
 
-#ifdef MDB_TOOL_IDL_CACHING			/* threaded indexing has no performance advantage */
-	/* Set up for threaded slapindex */
+	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK )
+		mdb_tool_bulk_open( be );
+
+	/* Set up for threaded slapindex. Threaded indexing has no
+	 * performance advantage unless the index threads only collect
+	 * keys for the bulk load.
+	 */
+#ifdef MDB_TOOL_IDL_CACHING
 	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK ) {
+#else
+	if ( mdb_tool_bulkload ) {
+#endif
 		if ( !mdb_tool_info ) {
-			struct mdb_info *mdb = (struct mdb_info *) be->be_private;
 			ldap_pvt_thread_mutex_init( &mdb_tool_index_mutex );
 			ldap_pvt_thread_cond_init( &mdb_tool_index_cond_main );
 			ldap_pvt_thread_cond_init( &mdb_tool_index_cond_work );
@@ -139,7 +193,6 @@ int mdb_tool_entry_open(
 			}
 		}
 	}
-#endif
 
 	return 0;
 }
@@ -147,9 +200,15 @@ int mdb_tool_entry_open(
 int mdb_tool_entry_close(
 	BackendDB *be )
 {
-#ifdef MDB_TOOL_IDL_CACHING
+	if ( tool_fprog ) {
+		filter_prog_free( NULL, tool_fprog );
+		tool_fprog = NULL;
+	}
+
 	if ( mdb_tool_info ) {
+#ifdef MDB_TOOL_IDL_CACHING
 		int i;
+#endif
 		slapd_shutdown = 1;
 		ldap_pvt_thread_mutex_lock( &mdb_tool_index_mutex );
 
@@ -173,6 +232,7 @@ int mdb_tool_entry_close(
 		slapd_shutdown = 0;
 		ch_free( mdb_tool_index_rec );
 		mdb_tool_index_tcount = mdb_tool_threads - 1;
+#ifdef MDB_TOOL_IDL_CACHING
 		if (mdb_tool_txn)
 			MDB_TOOL_IDL_FLUSH( be, mdb_tool_txn );
 		for (i=0; i<mdb_tool_threads; i++) {
@@ -187,8 +247,11 @@ int mdb_tool_entry_close(
 				free(ice);
 			}
 		}
-	}
 #endif
+	}
+
+	if ( mdb_tool_bulkload && mdb_tool_bulk_flush( be ))
+		return -1;
 
 	if( idcursor ) {
 		mdb_cursor_close( idcursor );
@@ -206,6 +269,33 @@ int mdb_tool_entry_close(
 				mdb->mi_attrs[i]->ai_cursor = NULL;
 		}
 	}
+	/* The columns are complete once the last reindexed entries
+	 * are committed.
+	 */
+	if ( mdb_tool_columns ) {
+		struct mdb_info *mdb = be->be_private;
+		int rc = 0;
+		mdb_tool_columns = 0;
+		if ( !txi )
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txi );
+		if ( rc == 0 ) {
+			MDB_TOOL_IDL_FLUSH( be, txi );
+			rc = mdb_column_complete( mdb, txi );
+			if ( rc == 0 )
+				rc = mdb_txn_commit( txi );
+			else
+				mdb_txn_abort( txi );
+			txi = NULL;
+		}
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+				"column update failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			return -1;
+		}
+	}
+
 	if( mdb_tool_txn ) {
 		int rc;
 		if (( rc = mdb_txn_commit( mdb_tool_txn ))) {
@@ -229,6 +319,14 @@ int mdb_tool_entry_close(
 		return -1;
 	}
 
+	/* slapadd and slapmodify renumber what they loaded */
+	if ( !( slapMode & (SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY))) {
+		struct mdb_info *mdb = be->be_private;
+		if ( mdb && ( mdb->mi_flags & MDB_CLUSTER ) &&
+			mdb_tool_renumber( be, 1, NULL ))
+			return -1;
+	}
+
 	return 0;
 }
 
@@ -242,6 +340,12 @@ mdb_tool_entry_first_x(
 	tool_base = base;
 	tool_scope = scope;
 	tool_filter = f;
+	if ( tool_fprog ) {
+		filter_prog_free( NULL, tool_fprog );
+		tool_fprog = NULL;
+	}
+	if ( f )
+		tool_fprog = filter_prog_compile( NULL, f );
 
 	return mdb_tool_entry_next( be );
 }
@@ -304,7 +408,7 @@ next:;
 
 		assert( tool_next_entry != NULL );
 
-		if ( tool_filter && test_filter( NULL, tool_next_entry, tool_filter ) != LDAP_COMPARE_TRUE )
+		if ( tool_fprog && test_filter_prog( NULL, tool_next_entry, tool_fprog ) != LDAP_COMPARE_TRUE )
 		{
 			mdb_entry_release( &op, tool_next_entry, 0 );
 			tool_next_entry = NULL;
@@ -580,7 +684,7 @@ mdb_tool_index_add(
 			if ( rc )
 				return rc;
 		}
-		for (i=0; i<mdb->mi_nattrs; i++) {
+		for (i=0; i<mdb->mi_nattrs && !mdb_tool_bulkload; i++) {
 			if ( !ir[i].ir_ai )
 				break;
 			rc = mdb_cursor_open( txn, ir[i].ir_ai->ai_dbi,
@@ -760,6 +864,13 @@ done:
 					"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
 					text->bv_val, 0, 0 );
 				e->e_id = NOID;
+			} else if ( mdb_tool_bulkload ) {
+				mdb_tool_bulk_maxid = mdb->mi_nextid;
+				if ( mdb_tool_bulk_spill( mdb )) {
+					snprintf( text->bv_val, text->bv_len,
+						"index key spill failed" );
+					e->e_id = NOID;
+				}
 			}
 		}
 
@@ -770,6 +881,8 @@ done:
 		idcursor = NULL;
 		for ( i=0; i<mdb->mi_nattrs; i++ )
 			mdb->mi_attrs[i]->ai_cursor = NULL;
+		if ( mdb_tool_bulkload )
+			mdb_tool_bulk_drop( mdb, mdb_tool_bulk_maxid );
 		mdb_writes = 0;
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
@@ -810,10 +923,15 @@ int mdb_tool_entry_reindex(
 		return mdb_dn2id_upgrade( be );
 	}
 
+	/* The renumbering emptied all indices */
+	if ( mdb_tool_renumbered )
+		adv = NULL;
+
 	/* No indexes configured, nothing to do. Could return an
-	 * error here to shortcut things.
+	 * error here to shortcut things. Columns are only rebuilt
+	 * along with all indexes.
 	 */
-	if (!mi->mi_attrs) {
+	if (!mi->mi_attrs && ( adv || !mi->mi_ncols )) {
 		return 0;
 	}
 
@@ -877,6 +995,16 @@ int mdb_tool_entry_reindex(
 				mdb_strerror(rc), rc, 0 );
 			goto done;
 		}
+		/* these indices are rebuilt, an online build of them
+		 * must not be resumed */
+		rc = mdb_index_progress_drop( mi, txi );
+		if( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"=> " LDAP_XSTRING(mdb_tool_entry_reindex) ": "
+				"index progress update failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+			goto done;
+		}
 	}
 
 	if ( slapMode & SLAP_TRUNCATE_MODE ) {
@@ -910,6 +1038,10 @@ int mdb_tool_entry_reindex(
 	op.o_tmpmfuncs = &ch_mfuncs;
 
 	rc = mdb_tool_index_add( &op, txi, e );
+	if ( rc == 0 && !adv && mi->mi_ncols ) {
+		rc = mdb_column_put( &op, txi, e );
+		mdb_tool_columns = 1;
+	}
 
 done:
 	if( rc == 0 ) {
@@ -1031,10 +1163,14 @@ done:
 				"=> " LDAP_XSTRING(mdb_tool_entry_modify) ": "
 				"%s\n", text->bv_val, 0, 0 );
 			e->e_id = NOID;
+		} else if ( mdb_tool_bulkload ) {
+			mdb_tool_bulk_maxid = mdb->mi_nextid;
 		}
 
 	} else {
 		mdb_txn_abort( mdb_tool_txn );
+		if ( mdb_tool_bulkload )
+			mdb_tool_bulk_drop( mdb, mdb_tool_bulk_maxid );
 		snprintf( text->bv_val, text->bv_len,
 			"txn_aborted! %s (%d)",
 			mdb_strerror(rc), rc );
@@ -1497,6 +1633,492 @@ int mdb_tool_idl_add(
 }
 #endif /* MDB_TOOL_IDL_CACHING */
 
+/*
+ * Sorted bulk index load.
+ *
+ * When slapadd -q loads an empty database, inserting the index keys of
+ * every entry as it is added updates the index B-trees in random key
+ * order. Instead, the (key, ID) pairs of each index are collected in
+ * memory, by the index threads when tool-threads is above 2. At each
+ * commit, a buffer that outgrew its share of MDB_TOOL_BULK_MEM is sorted
+ * and spilled to an unlinked temporary file in the database directory.
+ * When the load completes, the sorted runs of each index are merged and
+ * the keys appended in order, so the index databases are built
+ * sequentially with full pages. Keys with more than idlmax IDs are
+ * stored as ranges, as mdb_idl_insert_keys() would have done.
+ */
+
+#ifndef MDB_TOOL_BULK_MEM
+#define MDB_TOOL_BULK_MEM	(256*1048576)	/* buffer space for all indices */
+#endif
+#define MDB_TOOL_BULK_MIN	(4*1048576)	/* smallest buffer per index */
+#define MDB_TOOL_BULK_TXN	(1<<20)	/* IDs written per txn */
+
+typedef struct mdb_tool_bulk_rec {
+	ID br_id;
+	unsigned short br_len;
+	char br_key[2];
+} mdb_tool_bulk_rec;
+
+#define BULK_HDR	offsetof(mdb_tool_bulk_rec, br_key)
+#define BULK_RECSIZE(len)	((BULK_HDR + (len) + sizeof(ID)-1) & ~(sizeof(ID)-1))
+#define BULK_MAXREC	(BULK_HDR + 65536)
+
+typedef struct mdb_tool_bulk {
+	char *tb_buf;		/* unsorted records */
+	size_t tb_used;
+	size_t tb_size;
+	size_t tb_nrecs;
+	FILE **tb_runs;		/* sorted runs */
+	int tb_nruns;
+} mdb_tool_bulk;
+
+/* a sorted run being merged */
+typedef struct mdb_tool_bulk_src {
+	mdb_tool_bulk_rec *bs_rec;	/* current record */
+	mdb_tool_bulk_rec **bs_recs;	/* in memory run */
+	size_t bs_i, bs_n;
+	FILE *bs_fp;			/* spilled run */
+	mdb_tool_bulk_rec *bs_buf;
+} mdb_tool_bulk_src;
+
+static size_t mdb_tool_bulk_max;
+
+static int
+mdb_tool_bulk_open( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *txn;
+	MDB_stat st;
+	int i, rc;
+
+	if ( !mdb->mi_nattrs )
+		return 0;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	if ( rc )
+		return 0;
+
+	/* The database and all its indices must be empty */
+	rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+	if ( rc == 0 && st.ms_entries == 0 ) {
+		for ( i=0; i<mdb->mi_nattrs; i++ ) {
+			rc = mdb_stat( txn, mdb->mi_attrs[i]->ai_dbi, &st );
+			if ( rc || st.ms_entries ) {
+				rc = -1;
+				break;
+			}
+		}
+	} else {
+		rc = -1;
+	}
+	mdb_txn_abort( txn );
+	if ( rc )
+		return 0;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ )
+		mdb->mi_attrs[i]->ai_bulk = ch_calloc( 1, sizeof( mdb_tool_bulk ));
+	mdb_tool_bulk_max = MDB_TOOL_BULK_MEM / mdb->mi_nattrs;
+	if ( mdb_tool_bulk_max < MDB_TOOL_BULK_MIN )
+		mdb_tool_bulk_max = MDB_TOOL_BULK_MIN;
+	mdb_tool_bulk_maxid = 0;
+	mdb_tool_bulkload = 1;
+
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_tool_entry_open)
+		": sorted bulk load of %d indices\n", mdb->mi_nattrs, 0, 0 );
+	return 1;
+}
+
+int mdb_tool_bulk_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	AttrInfo *ai = (AttrInfo *)mc;
+	mdb_tool_bulk *tb = ai->ai_bulk;
+	mdb_tool_bulk_rec *br;
+	size_t len, need;
+	int k;
+
+	for ( k=0; keys[k].bv_val; k++ ) {
+		len = keys[k].bv_len;
+#ifndef MISALIGNED_OK
+		/* stored padded, as by mdb_idl_insert_keys() */
+		if ( len & ALIGNER )
+			len = 2 * sizeof(int);
+#endif
+		need = BULK_RECSIZE( len );
+		if ( tb->tb_used + need > tb->tb_size ) {
+			tb->tb_size = tb->tb_size ? tb->tb_size * 2 : 65536;
+			tb->tb_buf = ch_realloc( tb->tb_buf, tb->tb_size );
+		}
+		br = (mdb_tool_bulk_rec *)( tb->tb_buf + tb->tb_used );
+		br->br_id = id;
+		br->br_len = len;
+		if ( len != keys[k].bv_len ) {
+			memset( br->br_key, 0, len );
+			if ( len > keys[k].bv_len )
+				len = keys[k].bv_len;
+		}
+		memcpy( br->br_key, keys[k].bv_val, len );
+		tb->tb_used += need;
+		tb->tb_nrecs++;
+	}
+	return 0;
+}
+
+/* LMDB's default key order, then ID order */
+static int
+mdb_tool_bulk_cmp( mdb_tool_bulk_rec *r1, mdb_tool_bulk_rec *r2 )
+{
+	int rc;
+
+	rc = memcmp( r1->br_key, r2->br_key,
+		r1->br_len < r2->br_len ? r1->br_len : r2->br_len );
+	if ( !rc )
+		rc = r1->br_len - r2->br_len;
+	if ( !rc )
+		rc = ( r1->br_id > r2->br_id ) - ( r1->br_id < r2->br_id );
+	return rc;
+}
+
+static int
+mdb_tool_bulk_qcmp( const void *v1, const void *v2 )
+{
+	return mdb_tool_bulk_cmp( *(mdb_tool_bulk_rec **)v1,
+		*(mdb_tool_bulk_rec **)v2 );
+}
+
+static mdb_tool_bulk_rec **
+mdb_tool_bulk_sort( mdb_tool_bulk *tb )
+{
+	mdb_tool_bulk_rec **recs;
+	char *ptr = tb->tb_buf;
+	size_t i;
+
+	recs = ch_malloc( ( tb->tb_nrecs + 1 ) * sizeof( *recs ));
+	for ( i=0; i<tb->tb_nrecs; i++ ) {
+		recs[i] = (mdb_tool_bulk_rec *)ptr;
+		ptr += BULK_RECSIZE( recs[i]->br_len );
+	}
+	qsort( recs, tb->tb_nrecs, sizeof( *recs ), mdb_tool_bulk_qcmp );
+	return recs;
+}
+
+static FILE *
+mdb_tool_bulk_tmpfile( struct mdb_info *mdb )
+{
+	FILE *fp = NULL;
+#ifdef HAVE_MKSTEMP
+	char *path;
+	int fd;
+
+	path = ch_malloc( strlen( mdb->mi_dbenv_home ) +
+		sizeof( LDAP_DIRSEP "slapadd.XXXXXX" ));
+	sprintf( path, "%s" LDAP_DIRSEP "slapadd.XXXXXX", mdb->mi_dbenv_home );
+	fd = mkstemp( path );
+	if ( fd >= 0 ) {
+		unlink( path );
+		fp = fdopen( fd, "w+b" );
+		if ( !fp )
+			close( fd );
+	}
+	ch_free( path );
+#else
+	fp = tmpfile();
+#endif
+	if ( fp )
+		setvbuf( fp, NULL, _IOFBF, 65536 );
+	return fp;
+}
+
+/* Write out the buffers that outgrew their share. Only called between
+ * txns, so the runs never hold the IDs of aborted entries.
+ */
+static int
+mdb_tool_bulk_spill( struct mdb_info *mdb )
+{
+	int i;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		mdb_tool_bulk *tb = mdb->mi_attrs[i]->ai_bulk;
+		mdb_tool_bulk_rec **recs;
+		FILE *fp;
+		size_t j;
+
+		if ( !tb || tb->tb_used < mdb_tool_bulk_max )
+			continue;
+
+		fp = mdb_tool_bulk_tmpfile( mdb );
+		if ( !fp ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_tool_bulk_spill: "
+				"cannot create temporary file in %s: %s\n",
+				mdb->mi_dbenv_home, STRERROR( errno ), 0 );
+			return -1;
+		}
+		recs = mdb_tool_bulk_sort( tb );
+		for ( j=0; j<tb->tb_nrecs; j++ ) {
+			if ( fwrite( recs[j], BULK_HDR + recs[j]->br_len, 1, fp ) != 1 )
+				break;
+		}
+		ch_free( recs );
+		if ( j < tb->tb_nrecs || fflush( fp )) {
+			Debug( LDAP_DEBUG_ANY, "mdb_tool_bulk_spill: "
+				"write failed: %s\n", STRERROR( errno ), 0, 0 );
+			fclose( fp );
+			return -1;
+		}
+		rewind( fp );
+		tb->tb_runs = ch_realloc( tb->tb_runs,
+			( tb->tb_nruns + 1 ) * sizeof( FILE * ));
+		tb->tb_runs[tb->tb_nruns++] = fp;
+		tb->tb_used = 0;
+		tb->tb_nrecs = 0;
+	}
+	return 0;
+}
+
+/* Forget the keys of entries whose txn was aborted */
+static void
+mdb_tool_bulk_drop( struct mdb_info *mdb, ID maxid )
+{
+	int i;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		mdb_tool_bulk *tb = mdb->mi_attrs[i]->ai_bulk;
+		mdb_tool_bulk_rec *br;
+		size_t src, dst, len;
+
+		if ( !tb )
+			continue;
+		for ( src = dst = 0; src < tb->tb_used; src += len ) {
+			br = (mdb_tool_bulk_rec *)( tb->tb_buf + src );
+			len = BULK_RECSIZE( br->br_len );
+			if ( br->br_id > maxid ) {
+				tb->tb_nrecs--;
+				continue;
+			}
+			if ( dst != src )
+				AC_MEMCPY( tb->tb_buf + dst, br, len );
+			dst += len;
+		}
+		tb->tb_used = dst;
+	}
+}
+
+static mdb_tool_bulk_rec *
+mdb_tool_bulk_next( mdb_tool_bulk_src *bs )
+{
+	mdb_tool_bulk_rec *br = bs->bs_buf;
+
+	if ( !bs->bs_fp ) {
+		bs->bs_rec = bs->bs_i < bs->bs_n ? bs->bs_recs[bs->bs_i++] : NULL;
+	} else if ( fread( br, BULK_HDR, 1, bs->bs_fp ) == 1 &&
+		( !br->br_len || fread( br->br_key, br->br_len, 1, bs->bs_fp ) == 1 )) {
+		bs->bs_rec = br;
+	} else {
+		bs->bs_rec = NULL;
+	}
+	return bs->bs_rec;
+}
+
+/* restore the heap order below heap[i] */
+static void
+mdb_tool_bulk_sift( mdb_tool_bulk_src **heap, int n, int i )
+{
+	mdb_tool_bulk_src *bs = heap[i];
+	int c;
+
+	while (( c = 2*i + 1 ) < n ) {
+		if ( c+1 < n &&
+			mdb_tool_bulk_cmp( heap[c+1]->bs_rec, heap[c]->bs_rec ) < 0 )
+			c++;
+		if ( mdb_tool_bulk_cmp( heap[c]->bs_rec, bs->bs_rec ) >= 0 )
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = bs;
+}
+
+static void
+mdb_tool_bulk_free( AttrInfo *ai )
+{
+	mdb_tool_bulk *tb = ai->ai_bulk;
+	int i;
+
+	for ( i=0; i<tb->tb_nruns; i++ )
+		fclose( tb->tb_runs[i] );
+	ch_free( tb->tb_runs );
+	ch_free( tb->tb_buf );
+	ch_free( tb );
+	ai->ai_bulk = NULL;
+}
+
+/* Merge the runs of one index and append its keys */
+static int
+mdb_tool_bulk_write( BackendDB *be, AttrInfo *ai )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_bulk *tb = ai->ai_bulk;
+	mdb_tool_bulk_src *srcs, **heap;
+	mdb_tool_bulk_rec *br;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc = NULL;
+	MDB_val key, data[2];
+	ID *ids, range[3], last = 0;
+	size_t nids = 0, written = 0;
+	char *kbuf;
+	int nsrc, n, i, rc = 0;
+
+	srcs = ch_calloc( tb->tb_nruns + 1, sizeof( mdb_tool_bulk_src ));
+	heap = ch_malloc( ( tb->tb_nruns + 1 ) * sizeof( mdb_tool_bulk_src * ));
+	for ( nsrc=0; nsrc<tb->tb_nruns; nsrc++ ) {
+		srcs[nsrc].bs_fp = tb->tb_runs[nsrc];
+		srcs[nsrc].bs_buf = ch_malloc( BULK_MAXREC );
+	}
+	if ( tb->tb_nrecs ) {
+		srcs[nsrc].bs_recs = mdb_tool_bulk_sort( tb );
+		srcs[nsrc].bs_n = tb->tb_nrecs;
+		nsrc++;
+	}
+	for ( i=0, n=0; i<nsrc; i++ ) {
+		if ( mdb_tool_bulk_next( &srcs[i] ))
+			heap[n++] = &srcs[i];
+	}
+	for ( i=n/2; i-- > 0; )
+		mdb_tool_bulk_sift( heap, n, i );
+
+	ids = ch_malloc( ( mdb->mi_idl_max + 1 ) * sizeof( ID ));
+	kbuf = ch_malloc( BULK_MAXREC );
+	key.mv_data = kbuf;
+	key.mv_size = 0;
+	data[0].mv_size = sizeof( ID );
+
+	for (;;) {
+		br = n ? heap[0]->bs_rec : NULL;
+
+		/* end of the previous key, store its IDs */
+		if ( nids && ( !br || br->br_len != key.mv_size ||
+			memcmp( br->br_key, key.mv_data, key.mv_size ))) {
+			if ( !txn ) {
+				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+				if ( rc )
+					break;
+				rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+				if ( rc )
+					break;
+			}
+			if ( nids > mdb->mi_idl_max ) {
+				range[0] = 0;
+				range[1] = ids[0];
+				range[2] = last;
+				data[0].mv_data = range;
+				data[1].mv_size = 3;
+			} else {
+				data[0].mv_data = ids;
+				data[1].mv_size = nids;
+			}
+			rc = mdb_cursor_put( mc, &key, data,
+				MDB_APPEND|MDB_APPENDDUP|MDB_MULTIPLE );
+			if ( rc )
+				break;
+			written += data[1].mv_size;
+			nids = 0;
+			if ( written >= MDB_TOOL_BULK_TXN ) {
+				rc = mdb_txn_commit( txn );
+				txn = NULL;
+				written = 0;
+				if ( rc )
+					break;
+			}
+		}
+		if ( !br )
+			break;
+
+		if ( !nids ) {
+			memcpy( kbuf, br->br_key, br->br_len );
+			key.mv_size = br->br_len;
+		}
+		/* values may share a key */
+		if ( !nids || br->br_id != last ) {
+			if ( nids <= mdb->mi_idl_max )
+				ids[nids] = br->br_id;
+			nids++;
+			last = br->br_id;
+		}
+
+		if ( !mdb_tool_bulk_next( heap[0] ))
+			heap[0] = heap[--n];
+		if ( n )
+			mdb_tool_bulk_sift( heap, n, 0 );
+	}
+
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_tool_bulk_write: %s: %s (%d)\n",
+			ai->ai_desc->ad_cname.bv_val, mdb_strerror( rc ), rc );
+	}
+	for ( i=0; i<nsrc; i++ ) {
+		if ( srcs[i].bs_fp && ferror( srcs[i].bs_fp ) && !rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_tool_bulk_write: %s: "
+				"read failed\n", ai->ai_desc->ad_cname.bv_val, 0, 0 );
+			rc = -1;
+		}
+		ch_free( srcs[i].bs_buf );
+		ch_free( srcs[i].bs_recs );
+	}
+	if ( txn ) {
+		if ( rc ) {
+			mdb_txn_abort( txn );
+		} else {
+			rc = mdb_txn_commit( txn );
+		}
+	}
+	ch_free( kbuf );
+	ch_free( ids );
+	ch_free( heap );
+	ch_free( srcs );
+	mdb_tool_bulk_free( ai );
+	return rc;
+}
+
+/* Commit the last entries and build the indices */
+static int
+mdb_tool_bulk_flush( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i, rc = 0;
+
+	if ( mdb_tool_txn ) {
+		rc = mdb_txn_commit( mdb_tool_txn );
+		mdb_tool_txn = NULL;
+		idcursor = NULL;
+		for ( i=0; i<mdb->mi_nattrs; i++ )
+			mdb->mi_attrs[i]->ai_cursor = NULL;
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+				"txn_commit failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		}
+	}
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+
+		if ( !ai->ai_bulk )
+			continue;
+		if ( rc )
+			mdb_tool_bulk_free( ai );
+		else
+			rc = mdb_tool_bulk_write( be, ai );
+	}
+	mdb_tool_bulkload = 0;
+
+	return rc;
+}
+
 /* Upgrade from pre 2.4.34 dn2id format */
 
 #include <ac/unistd.h>
@@ -203,10 +203,18 @@ enum {
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_AFFINITY,
 
 	CFG_LAST
 };
 
+static slap_verbmasks affinity_ops[] = {
+	{ BER_BVC("off"),	0 },
+	{ BER_BVC("conn"),	SLAP_AFFINITY_CONN },
+	{ BER_BVC("cpu"),	SLAP_AFFINITY_CPU },
+	{ BER_BVNULL,	0 }
+};
+
 typedef struct {
 	char *name, *oid;
 } OidRec;
@@ -357,6 +365,12 @@ static ConfigTable config_back_cf_table[] = {
 	{ "concurrency", "level", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_CONCUR,
 		&config_generic, "( OLcfgGlAt:10 NAME 'olcConcurrency' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_max_batch", "max", 2, 2, 0, ARG_INT,
+		&slap_conn_max_batch, "( OLcfgGlAt:101 NAME 'olcConnMaxBatch' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "conn_max_coalesce", "bytes", 2, 2, 0, ARG_INT,
+		&slap_conn_max_coalesce, "( OLcfgGlAt:102 NAME 'olcConnMaxCoalesce' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "conn_max_pending", "max", 2, 2, 0, ARG_INT,
 		&slap_conn_max_pending, "( OLcfgGlAt:11 NAME 'olcConnMaxPending' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
@@ -696,6 +710,15 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadaffinity", "off|conn|cpu", 2, 2, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_STRING|ARG_MAGIC|CFG_AFFINITY, &config_generic,
+#endif
+		"( OLcfgGlAt:100 NAME 'olcThreadAffinity' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
@@ -879,7 +902,8 @@ static ConfigOCs cf_ocs[] = {
 		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
 		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
-		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
+		 "olcConnMaxBatch $ olcConnMaxCoalesce $ olcConnMaxPending $ "
+		 "olcConnMaxPendingAuth $ "
 		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
@@ -894,7 +918,7 @@ static ConfigOCs cf_ocs[] = {
 		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadAffinity $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
@@ -1007,6 +1031,11 @@ config_generic(ConfigArgs *c) {
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
+		case CFG_AFFINITY: {
+			struct berval bv;
+			enum_to_verb( affinity_ops, slapd_affinity, &bv );
+			c->value_string = ch_strdup( bv.bv_val );
+			} break;
 		case CFG_SALT:
 			if ( passwd_salt )
 				c->value_string = ch_strdup( passwd_salt );
@@ -1397,6 +1426,11 @@ config_generic(ConfigArgs *c) {
 				SLAP_DBFLAGS(c->be) |= SLAP_DBFLAG_SINGLE_SHADOW;
 			break;
 
+		case CFG_AFFINITY:
+			slapd_affinity = 0;
+			ldap_pvt_thread_pool_bindcpus( &connection_pool, 0 );
+			break;
+
 #if defined(HAVE_CYRUS_SASL) && defined(SLAP_AUXPROP_DONTUSECOPY)
 		case CFG_AZDUC:
 			if ( c->valx < 0 ) {
@@ -1762,6 +1796,25 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_AFFINITY: {
+			int i = verb_to_mask( c->value_string, affinity_ops );
+			if ( BER_BVISNULL( &affinity_ops[i].word )) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> unknown affinity \"%s\"",
+					c->argv[0], c->value_string );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg, 0 );
+				ch_free( c->value_string );
+				return 1;
+			}
+			ch_free( c->value_string );
+			slapd_affinity = affinity_ops[i].mask;
+			/* listener threads bind themselves when they start */
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_bindcpus( &connection_pool,
+					slapd_affinity == SLAP_AFFINITY_CPU );
+			} break;
+
 		case CFG_TTHREADS:
 			if ( slapMode & SLAP_TOOL_MODE )
 				ldap_pvt_thread_pool_maxthreads(&connection_pool, c->value_int);
@@ -80,6 +80,8 @@ ber_len_t sockbuf_max_incoming = SLAP_SB_MAX_INCOMING_DEFAULT;
 ber_len_t sockbuf_max_incoming_auth= SLAP_SB_MAX_INCOMING_AUTH;
 
 int	slap_conn_max_pending = SLAP_CONN_MAX_PENDING_DEFAULT;
+int	slap_conn_max_batch = SLAP_CONN_MAX_BATCH_DEFAULT;
+int	slap_conn_max_coalesce = SLAP_CONN_MAX_COALESCE_DEFAULT;
 int	slap_conn_max_pending_auth = SLAP_CONN_MAX_PENDING_AUTH;
 
 char   *slapd_pid_file  = NULL;
@@ -73,15 +73,22 @@ connection_state2str( int state )
 
 static Connection* connection_get( ber_socket_t s );
 
+/* Operations read in one go are submitted to the pool together,
+ * this many at a time.
+ */
+#define CONN_OP_BATCH	32
+
 typedef struct conn_readinfo {
 	Operation *op;
 	ldap_pvt_thread_start_t *func;
 	void *arg;
 	void *ctx;
-	int nullop;
+	void *batch[CONN_OP_BATCH];
+	int nbatch;
 } conn_readinfo;
 
 static int connection_input( Connection *c, conn_readinfo *cri );
+static void connection_op_flush( Connection *c, conn_readinfo *cri );
 static void connection_close( Connection *c );
 
 static int connection_op_activate( Operation *op );
@@ -1308,12 +1315,13 @@ static int connection_read( ber_socket_t s, conn_readinfo *cri );
 static void* connection_read_thread( void* ctx, void* argv )
 {
 	int rc ;
-	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0 };
+	conn_readinfo cri = { NULL, NULL, NULL, NULL };
 	ber_socket_t s = (long)argv;
 
 	/*
 	 * read incoming LDAP requests. If there is more than one,
-	 * the first one is returned with new_op
+	 * the first one is returned in cri.op, the others have been
+	 * submitted to the pool
 	 */
 	cri.ctx = ctx;
 	if( ( rc = connection_read( s, &cri ) ) < 0 ) {
@@ -1322,7 +1330,7 @@ static void* connection_read_thread( void* ctx, void* argv )
 	}
 
 	/* execute a single queued request in the same thread */
-	if( cri.op && !cri.nullop ) {
+	if( cri.op ) {
 		rc = (long)connection_operation( ctx, cri.op );
 	} else if ( cri.func ) {
 		rc = (long)cri.func( ctx, cri.arg );
@@ -1344,8 +1352,8 @@ int connection_read_activate( ber_socket_t s )
 	if ( rc )
 		return rc;
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_read_thread, (void *)(long)s );
+	rc = ldap_pvt_thread_pool_submit_q( &connection_pool,
+		connection_read_thread, (void *)(long)s, NULL, SLAP_CONN_QUEUE( s ));
 
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1359,7 +1367,7 @@ int connection_read_activate( ber_socket_t s )
 static int
 connection_read( ber_socket_t s, conn_readinfo *cri )
 {
-	int rc = 0;
+	int rc = 0, nread = 0;
 	Connection *c;
 
 	assert( connections != NULL );
@@ -1501,11 +1509,15 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 #ifdef DATA_READY_LOOP
 	while( !rc && ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_DATA_READY, NULL ));
 #elif defined CONNECTION_INPUT_LOOP
-	while(!rc);
+	/* Don't let a pipelining client keep this thread to itself */
+	while( !rc && ( slap_conn_max_batch <= 0 ||
+		++nread < slap_conn_max_batch ));
 #else
 	while(0);
 #endif
 
+	connection_op_flush( c, cri );
+
 	if( rc < 0 ) {
 		Debug( LDAP_DEBUG_CONNS,
 			"connection_read(%d): input error=%d id=%lu, closing.\n",
@@ -1522,6 +1534,19 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 		slapd_set_write( s, 0 );
 	}
 
+	/* Stopped at slap_conn_max_batch: queue up behind the other
+	 * connections' work for the rest. It may already be sitting in
+	 * the Sockbuf, where the listener wouldn't see it.
+	 */
+	if ( !rc && slap_conn_max_batch > 0 && nread >= slap_conn_max_batch &&
+		ldap_pvt_thread_pool_submit_q( &connection_pool,
+			connection_read_thread, (void *)(long)s, NULL,
+			SLAP_CONN_QUEUE( s )) == 0 )
+	{
+		connection_return( c );
+		return 0;
+	}
+
 	slapd_set_read( s, 1 );
 	connection_return( c );
 
@@ -1757,22 +1782,18 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		conn->c_n_ops_executing++;
 
 		/*
-		 * The first op will be processed in the same thread context,
-		 * as long as there is only one op total.
-		 * Subsequent ops will be submitted to the pool by
-		 * calling connection_op_activate()
+		 * The first op will be processed in the same thread context.
+		 * Subsequent ops are collected and submitted to the pool
+		 * together by connection_op_flush()
 		 */
+		connection_op_queue( op );
 		if ( cri->op == NULL ) {
 			/* the first incoming request */
-			connection_op_queue( op );
 			cri->op = op;
 		} else {
-			if ( !cri->nullop ) {
-				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
-			}
-			connection_op_activate( op );
+			cri->batch[cri->nbatch++] = op;
+			if ( cri->nbatch == CONN_OP_BATCH )
+				connection_op_flush( conn, cri );
 		}
 	}
 
@@ -1787,6 +1808,33 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	return rc;
 }
 
+/* Submit the operations collected by connection_input() */
+static void
+connection_op_flush( Connection *conn, conn_readinfo *cri )
+{
+	int i, n;
+
+	if ( !cri->nbatch )
+		return;
+
+	n = ldap_pvt_thread_pool_submit_batch( &connection_pool,
+		connection_operation, cri->batch, cri->nbatch,
+		SLAP_CONN_QUEUE( conn->c_sd ));
+
+	/* That queue is full, let the others take the rest */
+	for ( i = n < 0 ? 0 : n; i < cri->nbatch; i++ ) {
+		if ( ldap_pvt_thread_pool_submit_q( &connection_pool,
+			connection_operation, cri->batch[i], NULL,
+			SLAP_CONN_QUEUE( conn->c_sd )) != 0 )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"connection_op_flush: submit failed for conn=%lu\n",
+				conn->c_connid, 0, 0 );
+		}
+	}
+	cri->nbatch = 0;
+}
+
 static int
 connection_resched( Connection *conn )
 {
@@ -1960,8 +2008,9 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	rc = ldap_pvt_thread_pool_submit_q( &connection_pool,
+		connection_operation, (void *) op, NULL,
+		SLAP_CONN_QUEUE( op->o_conn->c_sd ));
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
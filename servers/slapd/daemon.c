@@ -45,7 +45,15 @@
 #include <poll.h>
 #endif
 
-#ifdef HAVE_KQUEUE
+#if defined(SLAP_X_IO_URING) && defined(HAVE_EPOLL)
+# define SLAP_SOCK_URING	1
+# include <poll.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif /* SLAP_X_IO_URING */
+
+#if defined(HAVE_KQUEUE) && !defined(SLAP_SOCK_URING)
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
@@ -86,6 +94,7 @@ struct runqueue_s slapd_rq;
 #endif
 int slapd_daemon_threads = 1;
 int slapd_daemon_mask;
+int slapd_affinity;
 
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
@@ -137,6 +146,14 @@ SOCKET *slapd_ws_sockets;
 static ldap_pvt_thread_mutex_t	sd_tcpd_mutex;
 #endif /* TCP Wrappers */
 
+#ifdef SLAP_SOCK_URING
+/* eXperimental */
+typedef struct slap_uring_sock {
+	unsigned		us_seq[2];	/* polls armed so far, read/write */
+	unsigned char		us_armed;	/* polls pending in the kernel */
+} slap_uring_sock;
+#endif /* SLAP_SOCK_URING */
+
 typedef struct slap_daemon_st {
 	ldap_pvt_thread_mutex_t	sd_mutex;
 
@@ -144,7 +161,23 @@ typedef struct slap_daemon_st {
 	int			sd_nwriters;
 	int			sd_nfds;
 
-#if defined(HAVE_KQUEUE)
+#ifdef SLAP_SOCK_URING
+	/* eXperimental, NULL sd_uring when epoll is used instead */
+	slap_uring_sock		*sd_usock;	/* indexed by fd */
+	int			*sd_urearm;
+	int			sd_nurearm;
+	int			sd_uwaiting;	/* listener is in io_uring_enter() */
+	int			sd_ufd;
+	unsigned		sd_usqn;
+	unsigned		*sd_usqhead, *sd_usqtail, *sd_usqmask;
+	unsigned		*sd_ucqhead, *sd_ucqtail, *sd_ucqmask;
+	struct io_uring_sqe	*sd_usqes;
+	struct io_uring_cqe	*sd_ucqes;
+	void			*sd_uring;
+	size_t			sd_uringsz;
+#endif /* SLAP_SOCK_URING */
+
+#if defined(HAVE_KQUEUE) && !defined(SLAP_SOCK_URING)
 	uint8_t*        sd_fdmodes; /* indexed by fd */
 	Listener**      sd_l;       /* indexed by fd */
 	/* Double buffer the kqueue changes to avoid holding the sd_mutex \
@@ -189,11 +222,11 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
  *   with file descriptors and events respectively
  *
  * - SLAP_<type>_* for private interface; type by now is one of
- *   EPOLL, DEVPOLL, SELECT, KQUEUE
+ *   EPOLL, DEVPOLL, SELECT, KQUEUE, URING
  *
  * private interface should not be used in the code.
  */
-#ifdef HAVE_KQUEUE
+#if defined(HAVE_KQUEUE) && !defined(SLAP_SOCK_URING)
 # define SLAP_EVENT_FNAME		    "kqueue"
 # define SLAP_EVENTS_ARE_INDEXED	0
 # define SLAP_EVENT_MAX(t)             (2 * dtblsize)  /* each fd can have a read & a write event */
@@ -415,13 +448,25 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # define SLAP_SOCK_NOT_ACTIVE(t,s)	(SLAP_EPOLL_SOCK_IX(t,s) == -1)
 # define SLAP_EPOLL_SOCK_IS_SET(t,s, mode)	(SLAP_EPOLL_SOCK_EV(t,s) & (mode))
 
+# ifdef SLAP_SOCK_URING
+#  define SLAP_EPOLL_CTL(t,op,s,ev)	slap_uring_ctl(t, (op), (s), (ev))
+#  define SLAP_EPOLL_CREATE(t)		slap_uring_init(t)
+#  define SLAP_EPOLL_CLOSE(t)		slap_uring_destroy(t)
+#  define SLAP_SOCK_SET_SUBMITS(t)	(slap_daemon[t].sd_uring != NULL)
+# else /* ! SLAP_SOCK_URING */
+#  define SLAP_EPOLL_CTL(t,op,s,ev)	epoll_ctl(slap_daemon[t].sd_epfd, \
+	(op), (s), (ev))
+#  define SLAP_EPOLL_CREATE(t)		epoll_create( dtblsize / slapd_daemon_threads )
+#  define SLAP_EPOLL_CLOSE(t)		close( slap_daemon[t].sd_epfd )
+# endif /* ! SLAP_SOCK_URING */
+
 # define SLAP_SOCK_IS_READ(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLIN)
 # define SLAP_SOCK_IS_WRITE(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLOUT)
 
 # define SLAP_EPOLL_SOCK_SET(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) != (mode) ) {	\
 		SLAP_EPOLL_SOCK_EV(t,s) |= (mode); \
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, (s), \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, (s), \
 			&SLAP_EPOLL_SOCK_EP(t,s) ); \
 	} \
 } while (0)
@@ -429,7 +474,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # define SLAP_EPOLL_SOCK_CLR(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) ) { \
 		SLAP_EPOLL_SOCK_EV(t,s) &= ~(mode);	\
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, s, \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, s, \
 			&SLAP_EPOLL_SOCK_EP(t,s) ); \
 	} \
 } while (0)
@@ -461,7 +506,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 	SLAP_EPOLL_SOCK_IX(t,(s)) = slap_daemon[t].sd_nfds; \
 	SLAP_EPOLL_SOCK_EP(t,(s)).data.ptr = (l) ? (l) : (void *)(&SLAP_EPOLL_SOCK_IX(t,s)); \
 	SLAP_EPOLL_SOCK_EV(t,(s)) = EPOLLIN; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_ADD, \
+	rc = SLAP_EPOLL_CTL(t, EPOLL_CTL_ADD, \
 		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
 	if ( rc == 0 ) { \
 		slap_daemon[t].sd_nfds++; \
@@ -484,7 +529,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # define SLAP_SOCK_DEL(t,s)		do { \
 	int fd, rc, index = SLAP_EPOLL_SOCK_IX(t,(s)); \
 	if ( index < 0 ) break; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_DEL, \
+	rc = SLAP_EPOLL_CTL(t, EPOLL_CTL_DEL, \
 		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
 	slap_daemon[t].sd_epolls[index] = \
 		slap_daemon[t].sd_epolls[slap_daemon[t].sd_nfds-1]; \
@@ -512,7 +557,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 		( sizeof(struct epoll_event) * 2 \
 			+ sizeof(int) ) * dtblsize * 2); \
 	slap_daemon[t].sd_index = (int *)&slap_daemon[t].sd_epolls[ 2 * dtblsize ]; \
-	slap_daemon[t].sd_epfd = epoll_create( dtblsize / slapd_daemon_threads ); \
+	slap_daemon[t].sd_epfd = SLAP_EPOLL_CREATE(t); \
 	for ( j = 0; j < dtblsize; j++ ) slap_daemon[t].sd_index[j] = -1; \
 } while (0)
 
@@ -521,12 +566,22 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 		ch_free( slap_daemon[t].sd_epolls ); \
 		slap_daemon[t].sd_epolls = NULL; \
 		slap_daemon[t].sd_index = NULL; \
-		close( slap_daemon[t].sd_epfd ); \
+		SLAP_EPOLL_CLOSE(t); \
 	} \
 } while ( 0 )
 
 # define SLAP_EVENT_DECL		struct epoll_event *revents
 
+# ifdef SLAP_SOCK_URING
+# define SLAP_EVENT_INIT(t)		do { \
+	revents = slap_daemon[t].sd_epolls + dtblsize; \
+	slap_uring_rearm(t); \
+} while (0)
+
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( t, revents, (tvp) ); \
+} while (0)
+# else /* ! SLAP_SOCK_URING */
 # define SLAP_EVENT_INIT(t)		do { \
 	revents = slap_daemon[t].sd_epolls + dtblsize; \
 } while (0)
@@ -535,6 +590,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 	*(nsp) = epoll_wait( slap_daemon[t].sd_epfd, revents, \
 		dtblsize, (tvp) ? (tvp)->tv_sec * 1000 : -1 ); \
 } while (0)
+# endif /* ! SLAP_SOCK_URING */
 
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
 
@@ -905,6 +961,350 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # endif /* !HAVE_WINSOCK */
 #endif /* ! kqueue && ! epoll && ! /dev/poll */
 
+#ifdef SLAP_SOCK_URING
+/*******************************************************
+ * Use io_uring(7) polls - eXperimental, Linux >= 5.11 *
+ *******************************************************/
+/*
+ * Built on top of the epoll implementation: sd_index and sd_epolls
+ * still track which sockets are active and what slapd wants to hear
+ * about, and events are returned in the epoll revents array, so only
+ * SLAP_EPOLL_CTL, SLAP_EVENT_INIT and SLAP_EVENT_WAIT differ.  A
+ * daemon thread whose ring cannot be set up (old kernel, io_uring
+ * disabled, locked memory limit) leaves sd_uring NULL and uses plain
+ * epoll instead.
+ *
+ * Every socket gets a one-shot IORING_OP_POLL_ADD per direction
+ * slapd is interested in.  Interest changes made while the listener
+ * is busy are queued on the submission ring and handed to the kernel
+ * by the same io_uring_enter() that waits for the next events; while
+ * it is waiting, the thread making the change submits it itself.
+ * Either way the listener needn't be woken up for it, see
+ * SLAP_SOCK_SET_SUBMITS.
+ *
+ * Clearing interest does not cancel a pending poll: if it fires
+ * while nobody wants it the completion is dropped, and if interest
+ * comes back first the pending poll is simply kept.  Polls that
+ * fired while still wanted are re-armed before the next wait, which
+ * keeps epoll's level-triggered semantics.  Only EPOLL_CTL_DEL has
+ * to cancel right away, as a pending poll pins the socket open.
+ *
+ * The user_data of a poll carries the fd, the direction and the
+ * arm count of that direction, so completions of polls that were
+ * superseded or belong to a closed and reused fd are ignored.
+ */
+# define SLAP_URING_NOEVENT		(~(__u64)0)
+# define SLAP_URING_UD(s,dir,seq)	(((__u64)(seq) << 32) | \
+	((__u64)(s) << 1) | (dir))
+# define SLAP_URING_SOCK(t,s)		(slap_daemon[t].sd_usock[(s)])
+# define SLAP_URING_EV(dir)		((dir) ? EPOLLOUT : EPOLLIN)
+
+static int
+slap_uring_enter( int t, unsigned submit, unsigned wait, unsigned flags,
+	void *arg, size_t argsz )
+{
+	return syscall( __NR_io_uring_enter, slap_daemon[t].sd_ufd,
+		submit, wait, flags, arg, argsz );
+}
+
+/* Get a zeroed SQE; the caller must hold sd_mutex */
+static struct io_uring_sqe *
+slap_uring_sqe( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	unsigned tail;
+	struct io_uring_sqe *sqe;
+
+	tail = *sd->sd_usqtail;
+	if ( tail - __atomic_load_n( sd->sd_usqhead, __ATOMIC_ACQUIRE )
+		>= sd->sd_usqn )
+	{
+		/* Ring is full, push it to the kernel now */
+		slap_uring_enter( t, sd->sd_usqn, 0, 0, NULL, 0 );
+		if ( tail - __atomic_load_n( sd->sd_usqhead, __ATOMIC_ACQUIRE )
+			>= sd->sd_usqn )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: io_uring submission ring full, errno=%d, "
+				"shutting down\n", errno, 0, 0 );
+			slapd_shutdown = 2;
+			return NULL;
+		}
+	}
+	sqe = &sd->sd_usqes[tail & *sd->sd_usqmask];
+	memset( sqe, 0, sizeof( *sqe ));
+	return sqe;
+}
+
+static void
+slap_uring_push( int t )
+{
+	__atomic_store_n( slap_daemon[t].sd_usqtail,
+		*slap_daemon[t].sd_usqtail + 1, __ATOMIC_RELEASE );
+}
+
+static void
+slap_uring_arm( int t, ber_socket_t s, int dir )
+{
+	slap_uring_sock *us = &SLAP_URING_SOCK(t,s);
+	struct io_uring_sqe *sqe = slap_uring_sqe( t );
+
+	if ( sqe == NULL ) return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = s;
+	sqe->poll32_events = dir ? POLLOUT : POLLIN;
+	sqe->user_data = SLAP_URING_UD( s, dir, ++us->us_seq[dir] );
+	slap_uring_push( t );
+	us->us_armed |= 1 << dir;
+}
+
+/* Stands in for epoll_ctl(); ev->events has already been updated */
+static int
+slap_uring_ctl( int t, int op, ber_socket_t s, struct epoll_event *ev )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring_sock *us;
+	struct io_uring_sqe *sqe;
+	int dir, submit = 0;
+
+	if ( sd->sd_uring == NULL )
+		return epoll_ctl( sd->sd_epfd, op, s, ev );
+
+	assert( s < dtblsize );
+	us = &SLAP_URING_SOCK(t,s);
+
+	if ( op == EPOLL_CTL_ADD )
+		us->us_armed = 0;
+
+	for ( dir = 0; dir < 2; dir++ ) {
+		if ( op == EPOLL_CTL_DEL ) {
+			if ( !( us->us_armed & ( 1 << dir ))) continue;
+			sqe = slap_uring_sqe( t );
+			if ( sqe == NULL ) break;
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = SLAP_URING_UD( s, dir, us->us_seq[dir] );
+			sqe->user_data = SLAP_URING_NOEVENT;
+			slap_uring_push( t );
+
+			/* The pending polls hold a reference on the socket,
+			 * don't let them delay its close until the listener
+			 * wakes up.
+			 */
+			submit = 1;
+
+		} else if (( ev->events & SLAP_URING_EV( dir )) &&
+			!( us->us_armed & ( 1 << dir )))
+		{
+			slap_uring_arm( t, s, dir );
+			submit = sd->sd_uwaiting;
+		}
+	}
+	if ( op == EPOLL_CTL_DEL )
+		us->us_armed = 0;
+
+	if ( submit )
+		slap_uring_enter( t, sd->sd_usqn, 0, 0, NULL, 0 );
+	return 0;
+}
+
+/* Re-arm the polls that fired while still wanted. Called with
+ * sd_mutex held, after the last batch of events was handled.
+ */
+static void
+slap_uring_rearm( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	int i;
+
+	if ( sd->sd_uring == NULL ) return;
+
+	for ( i = 0; i < sd->sd_nurearm; i++ ) {
+		ber_socket_t s = sd->sd_urearm[i] >> 1;
+		int dir = sd->sd_urearm[i] & 1;
+
+		if ( SLAP_SOCK_IS_ACTIVE(t,s) &&
+			SLAP_EPOLL_SOCK_IS_SET(t,s, SLAP_URING_EV(dir)) &&
+			!( SLAP_URING_SOCK(t,s).us_armed & ( 1 << dir )))
+		{
+			slap_uring_arm( t, s, dir );
+		}
+	}
+	sd->sd_nurearm = 0;
+	sd->sd_uwaiting = 1;
+}
+
+static int
+slap_uring_wait( int t, struct epoll_event *revents, struct timeval *tvp )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail, flags = IORING_ENTER_GETEVENTS;
+	int rc, err = 0, ns = 0;
+
+	if ( sd->sd_uring == NULL ) {
+		return epoll_wait( sd->sd_epfd, revents, dtblsize,
+			tvp ? tvp->tv_sec * 1000 : -1 );
+	}
+	if ( tvp ) {
+		memset( &arg, 0, sizeof( arg ));
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(uintptr_t)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+	rc = slap_uring_enter( t, sd->sd_usqn, 1, flags,
+		tvp ? &arg : NULL, tvp ? sizeof( arg ) : 0 );
+	if ( rc < 0 ) err = errno;
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	sd->sd_uwaiting = 0;
+	head = *sd->sd_ucqhead;
+	tail = __atomic_load_n( sd->sd_ucqtail, __ATOMIC_ACQUIRE );
+
+	/* Whatever doesn't fit in revents is picked up by the next wait */
+	for ( ; head != tail && ns < dtblsize; head++ ) {
+		struct io_uring_cqe *cqe = &sd->sd_ucqes[head & *sd->sd_ucqmask];
+		__u64 ud = cqe->user_data;
+		ber_socket_t s = (ber_socket_t)(( ud & 0xffffffffU ) >> 1 );
+		int dir = ud & 1;
+		slap_uring_sock *us;
+
+		if ( ud == SLAP_URING_NOEVENT || s >= dtblsize ||
+			SLAP_SOCK_NOT_ACTIVE(t,s) )
+		{
+			continue;
+		}
+		us = &SLAP_URING_SOCK(t,s);
+		if ( !( us->us_armed & ( 1 << dir )) ||
+			us->us_seq[dir] != (unsigned)( ud >> 32 ))
+		{
+			continue;
+		}
+		us->us_armed &= ~( 1 << dir );
+		if ( !SLAP_EPOLL_SOCK_IS_SET(t,s, SLAP_URING_EV(dir)) ) continue;
+
+		/* Errors and hangups are left for the reader/writer to find */
+		sd->sd_urearm[sd->sd_nurearm++] = ( s << 1 ) | dir;
+		revents[ns].events = SLAP_URING_EV( dir );
+		revents[ns].data.ptr = SLAP_EPOLL_SOCK_EP(t,s).data.ptr;
+		ns++;
+	}
+	__atomic_store_n( sd->sd_ucqhead, head, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	if ( !ns && err && err != ETIME && err != EBUSY ) {
+		errno = err;
+		return -1;
+	}
+	return ns;
+}
+
+/* Set up the ring of daemon thread t. Returns the epoll fd to use
+ * instead if that fails, -1 otherwise.
+ */
+static int
+slap_uring_init( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_params p;
+	size_t sqsz, cqsz;
+	unsigned i, entries = 64;
+	char *ring;
+
+	sd->sd_uring = NULL;
+	sd->sd_usock = NULL;
+	sd->sd_urearm = NULL;
+	sd->sd_nurearm = 0;
+	sd->sd_uwaiting = 0;
+
+	while ( entries < 4096 && entries < dtblsize / slapd_daemon_threads )
+		entries <<= 1;
+
+	memset( &p, 0, sizeof( p ));
+	sd->sd_ufd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( sd->sd_ufd < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: SLAP_SOCK_INIT: "
+			"io_uring_setup() failed, errno=%d, using epoll\n",
+			errno, 0, 0 );
+		goto fallback;
+	}
+	if ( !( p.features & IORING_FEAT_SINGLE_MMAP ) ||
+		!( p.features & IORING_FEAT_NODROP ) ||
+		!( p.features & IORING_FEAT_EXT_ARG ))
+	{
+		Debug( LDAP_DEBUG_ANY, "daemon: SLAP_SOCK_INIT: "
+			"io_uring features 0x%x unsupported, using epoll\n",
+			p.features, 0, 0 );
+		goto fallback;
+	}
+
+	sqsz = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	cqsz = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	sd->sd_uringsz = sqsz > cqsz ? sqsz : cqsz;
+	ring = mmap( NULL, sd->sd_uringsz, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, sd->sd_ufd, IORING_OFF_SQ_RING );
+	sd->sd_usqes = mmap( NULL, p.sq_entries * sizeof( struct io_uring_sqe ),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, sd->sd_ufd,
+		IORING_OFF_SQES );
+	if ( ring == MAP_FAILED || sd->sd_usqes == MAP_FAILED ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: SLAP_SOCK_INIT: "
+			"io_uring mmap() failed, errno=%d, using epoll\n",
+			errno, 0, 0 );
+		if ( ring != MAP_FAILED )
+			munmap( ring, sd->sd_uringsz );
+		if ( sd->sd_usqes != MAP_FAILED )
+			munmap( sd->sd_usqes, p.sq_entries * sizeof( struct io_uring_sqe ));
+		goto fallback;
+	}
+
+	sd->sd_uring = ring;
+	sd->sd_usqn = p.sq_entries;
+	sd->sd_usqhead = (unsigned *)( ring + p.sq_off.head );
+	sd->sd_usqtail = (unsigned *)( ring + p.sq_off.tail );
+	sd->sd_usqmask = (unsigned *)( ring + p.sq_off.ring_mask );
+	sd->sd_ucqhead = (unsigned *)( ring + p.cq_off.head );
+	sd->sd_ucqtail = (unsigned *)( ring + p.cq_off.tail );
+	sd->sd_ucqmask = (unsigned *)( ring + p.cq_off.ring_mask );
+	sd->sd_ucqes = (struct io_uring_cqe *)( ring + p.cq_off.cqes );
+	for ( i = 0; i < p.sq_entries; i++ )
+		((unsigned *)( ring + p.sq_off.array ))[i] = i;
+
+	/* A socket has at most one pending poll per direction */
+	sd->sd_usock = ch_calloc( dtblsize, sizeof( slap_uring_sock ));
+	sd->sd_urearm = ch_malloc( 2 * dtblsize * sizeof( int ));
+	return -1;
+
+fallback:
+	if ( sd->sd_ufd >= 0 ) {
+		close( sd->sd_ufd );
+		sd->sd_ufd = -1;
+	}
+	return epoll_create( dtblsize / slapd_daemon_threads );
+}
+
+static void
+slap_uring_destroy( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+
+	if ( sd->sd_uring == NULL ) {
+		close( sd->sd_epfd );
+		return;
+	}
+	ch_free( sd->sd_usock );
+	sd->sd_usock = NULL;
+	ch_free( sd->sd_urearm );
+	sd->sd_urearm = NULL;
+	munmap( sd->sd_usqes, sd->sd_usqn * sizeof( struct io_uring_sqe ));
+	munmap( sd->sd_uring, sd->sd_uringsz );
+	sd->sd_uring = NULL;
+	close( sd->sd_ufd );
+	sd->sd_ufd = -1;
+}
+#endif /* SLAP_SOCK_URING */
+
 #ifdef HAVE_SLP
 /*
  * SLP related functions
@@ -1195,6 +1595,10 @@ slapd_set_write( ber_socket_t s, int wake )
 	}
 
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
+#ifdef SLAP_SOCK_SET_SUBMITS
+	if ( SLAP_SOCK_SET_SUBMITS( id ))
+		wake = 0;
+#endif
 	WAKE_LISTENER(id,wake);
 }
 
@@ -1228,6 +1632,10 @@ slapd_set_read( ber_socket_t s, int wake )
 		do_wake = 0;
 	}
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
+#ifdef SLAP_SOCK_SET_SUBMITS
+	if ( SLAP_SOCK_SET_SUBMITS( id ))
+		do_wake = 0;
+#endif
 	if ( do_wake )
 		WAKE_LISTENER(id,wake);
 }
@@ -2343,6 +2751,13 @@ slapd_daemon_task(
 
 #define SLAPD_IDLE_CHECK_LIMIT 4
 
+	if ( slapd_affinity == SLAP_AFFINITY_CPU &&
+		ldap_pvt_thread_bindcpu( tid ) != 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: cannot bind listener thread %d to a CPU\n",
+			tid, 0, 0 );
+	}
+
 	slapd_add( wake_sds[tid][0], 0, NULL, tid );
 	if ( tid )
 		goto loop;
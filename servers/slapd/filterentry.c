@@ -984,3 +984,502 @@ test_substrings_filter(
 		rc, 0, 0 );
 	return rc;
 }
+
+/*
+ * Compiled filters.
+ *
+ * filter_prog_compile() flattens a filter into an array of nodes in
+ * preorder, with the attribute type, matching rule and match function
+ * of every simple assertion looked up once. test_filter_prog() and
+ * test_filter_batch() then give the same results as test_filter(),
+ * without repeating that work for every entry. Access checks are
+ * skipped when they would grant everything anyway, i.e. for the
+ * rootdn of a database without access control overlays, or when
+ * there is no operation at all.
+ *
+ * Assertions with special semantics (extensible matches, approx,
+ * hasSubordinates, entryDN, component filters) are left to
+ * test_filter().
+ */
+
+#define FP_BATCH	64
+
+typedef struct FilterNode {
+	ber_tag_t	fn_choice;
+	int		fn_next;	/* node after this subtree */
+	int		fn_level;	/* nesting depth */
+	int		fn_simple;	/* no subtypes, tags or flags */
+	Filter		*fn_f;
+	AttributeDescription *fn_desc;
+	MatchingRule	*fn_mr;		/* for values of fn_desc's type */
+	unsigned	fn_use;
+	void		*fn_assert;	/* assertion value */
+} FilterNode;
+
+/* fn_choice for subtrees evaluated by test_filter() */
+#define FP_GENERIC	((ber_tag_t) -1)
+
+struct FilterProg {
+	int		fp_acl;
+	int		fp_nnodes;
+	int		fp_depth;
+	int		*fp_scratch;	/* two FP_BATCH vectors per level */
+	FilterNode	fp_nodes[1];
+};
+
+static int
+filter_prog_count( Filter *f, int level, int *depth )
+{
+	Filter *c;
+	int n = 1;
+
+	if ( level > *depth )
+		*depth = level;
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return n;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( c = f->f_list; c; c = c->f_next )
+			n += filter_prog_count( c, level + 1, depth );
+		break;
+	case LDAP_FILTER_NOT:
+		n += filter_prog_count( f->f_not, level + 1, depth );
+		break;
+	}
+	return n;
+}
+
+static void
+filter_prog_leaf( FilterNode *fn, AttributeDescription *desc )
+{
+	AttributeType *at = desc->ad_type;
+
+	if ( desc == slap_schema.si_ad_hasSubordinates ||
+		desc == slap_schema.si_ad_entryDN ||
+		desc == slap_schema.si_ad_subschemaSubentry )
+	{
+		fn->fn_choice = FP_GENERIC;
+		return;
+	}
+
+	fn->fn_desc = desc;
+	fn->fn_simple = at->sat_subtypes == NULL &&
+		desc->ad_flags == 0 && BER_BVISEMPTY( &desc->ad_tags );
+
+	switch ( fn->fn_choice ) {
+	case LDAP_FILTER_EQUALITY:
+		fn->fn_use = SLAP_MR_EQUALITY;
+		fn->fn_mr = at->sat_equality;
+		break;
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		fn->fn_use = SLAP_MR_ORDERING;
+		fn->fn_mr = at->sat_ordering;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		fn->fn_use = SLAP_MR_SUBSTR;
+		fn->fn_mr = at->sat_substr;
+		break;
+	}
+}
+
+static int
+filter_prog_fill( FilterProg *fp, Filter *f, int i, int level )
+{
+	FilterNode *fn = &fp->fp_nodes[i];
+	Filter *c;
+	int n = i + 1;
+
+	fn->fn_choice = f->f_choice;
+	fn->fn_level = level;
+	fn->fn_f = f;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fn->fn_choice = FP_GENERIC;
+		fn->fn_next = n;
+		return n;
+	}
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( c = f->f_list; c; c = c->f_next )
+			n = filter_prog_fill( fp, c, n, level + 1 );
+		break;
+
+	case LDAP_FILTER_NOT:
+		n = filter_prog_fill( fp, f->f_not, n, level + 1 );
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_ava->aa_cf ) {
+			fn->fn_choice = FP_GENERIC;
+			break;
+		}
+#endif
+		fn->fn_assert = &f->f_ava->aa_value;
+		filter_prog_leaf( fn, f->f_ava->aa_desc );
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		fn->fn_assert = f->f_sub;
+		filter_prog_leaf( fn, f->f_sub_desc );
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		filter_prog_leaf( fn, f->f_desc );
+		break;
+
+	case SLAPD_FILTER_COMPUTED:
+		break;
+
+	default:
+		fn->fn_choice = FP_GENERIC;
+		break;
+	}
+	fn->fn_next = n;
+	return n;
+}
+
+FilterProg *
+filter_prog_compile( Operation *op, Filter *f )
+{
+	FilterProg *fp;
+	void *ctx = op ? op->o_tmpmemctx : NULL;
+	int n, depth = 0;
+
+	n = filter_prog_count( f, 0, &depth );
+	fp = slap_sl_calloc( 1, sizeof( FilterProg ) +
+		( n - 1 ) * sizeof( FilterNode ) +
+		( depth + 1 ) * 2 * FP_BATCH * sizeof( int ), ctx );
+	fp->fp_nnodes = n;
+	fp->fp_depth = depth;
+	fp->fp_scratch = (int *)( fp->fp_nodes + n );
+	filter_prog_fill( fp, f, 0, 0 );
+
+	/* Access control would grant everything, see slap_access_allowed() */
+	fp->fp_acl = 0;
+	if ( op ) {
+		BackendInfo *bi = NULL;
+
+		fp->fp_acl = 1;
+		if ( op->o_bd ) {
+			bi = op->o_bd->bd_info->bi_access_allowed ?
+				op->o_bd->bd_info : frontendDB->bd_info;
+		}
+		if ( bi && bi->bi_access_allowed == fe_access_allowed &&
+			be_isroot( op ))
+			fp->fp_acl = 0;
+	}
+	return fp;
+}
+
+void
+filter_prog_free( Operation *op, FilterProg *fp )
+{
+	slap_sl_free( fp, op ? op->o_tmpmemctx : NULL );
+}
+
+/* test_ava_filter() and test_substrings_filter() for a compiled node */
+static int
+test_prog_leaf(
+	Operation	*op,
+	FilterProg	*fp,
+	FilterNode	*fn,
+	Entry		*e )
+{
+	AttributeDescription *desc = fn->fn_desc;
+	Attribute	*a;
+	int rc;
+
+	if ( fp->fp_acl && !access_allowed( op, e, desc,
+		fn->fn_choice == LDAP_FILTER_EQUALITY ||
+		fn->fn_choice == LDAP_FILTER_GE ||
+		fn->fn_choice == LDAP_FILTER_LE ? fn->fn_assert : NULL,
+		ACL_SEARCH, NULL ))
+	{
+		return LDAP_INSUFFICIENT_ACCESS;
+	}
+
+	rc = LDAP_COMPARE_FALSE;
+
+	for ( a = e->e_attrs; a != NULL; a = a->a_next ) {
+		MatchingRule *mr;
+		struct berval *bv;
+
+		if ( fn->fn_simple ) {
+			if ( a->a_desc->ad_type != desc->ad_type )
+				continue;
+		} else if ( !is_ad_subtype( a->a_desc, desc )) {
+			continue;
+		}
+
+		if ( fp->fp_acl && desc != a->a_desc && !access_allowed( op,
+			e, a->a_desc, fn->fn_choice == LDAP_FILTER_SUBSTRINGS ||
+			fn->fn_choice == LDAP_FILTER_PRESENT ? NULL : fn->fn_assert,
+			ACL_SEARCH, NULL ))
+		{
+			rc = LDAP_INSUFFICIENT_ACCESS;
+			continue;
+		}
+
+		if ( fn->fn_choice == LDAP_FILTER_PRESENT )
+			return LDAP_COMPARE_TRUE;
+
+		mr = fn->fn_mr;
+		if ( a->a_desc->ad_type != desc->ad_type ) {
+			switch ( fn->fn_choice ) {
+			case LDAP_FILTER_EQUALITY:
+				mr = a->a_desc->ad_type->sat_equality;
+				break;
+			case LDAP_FILTER_SUBSTRINGS:
+				mr = a->a_desc->ad_type->sat_substr;
+				break;
+			default:
+				mr = a->a_desc->ad_type->sat_ordering;
+				break;
+			}
+		}
+		if ( mr == NULL ) {
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			continue;
+		}
+
+		if (( a->a_flags & SLAP_ATTR_SORTED_VALS ) &&
+			fn->fn_choice != LDAP_FILTER_SUBSTRINGS )
+		{
+			unsigned slot;
+			int ret;
+
+			if ( fn->fn_use == SLAP_MR_ORDERING ) {
+				const char *text;
+				int match, which;
+				which = ( fn->fn_choice == LDAP_FILTER_LE ) ? 0 : a->a_numvals-1;
+				ret = value_match( &match, a->a_desc, mr, fn->fn_use,
+					&a->a_nvals[which], fn->fn_assert, &text );
+				if ( ret != LDAP_SUCCESS ) return ret;
+				if (( fn->fn_choice == LDAP_FILTER_LE && match <= 0 ) ||
+					( fn->fn_choice == LDAP_FILTER_GE && match >= 0 ))
+					return LDAP_COMPARE_TRUE;
+				continue;
+			}
+			ret = attr_valfind( a, fn->fn_use |
+				SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+				SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+				fn->fn_assert, &slot, NULL );
+			if ( ret == LDAP_SUCCESS )
+				return LDAP_COMPARE_TRUE;
+			else if ( ret != LDAP_NO_SUCH_ATTRIBUTE )
+				return ret;
+			continue;
+		}
+
+		for ( bv = a->a_nvals; !BER_BVISNULL( bv ); bv++ ) {
+			int ret, match;
+			const char *text;
+
+			if ( fn->fn_choice == LDAP_FILTER_SUBSTRINGS ) {
+				ret = value_match( &match, a->a_desc, mr,
+					SLAP_MR_SUBSTR, bv, fn->fn_assert, &text );
+			} else if ( a->a_desc->ad_type->sat_flags & SLAP_AT_ORDERED ) {
+				ret = ordered_value_match( &match, a->a_desc, mr,
+					fn->fn_use, bv, fn->fn_assert, &text );
+			} else if ( mr->smr_match ) {
+				ret = mr->smr_match( &match, fn->fn_use,
+					a->a_desc->ad_type->sat_syntax, mr, bv, fn->fn_assert );
+			} else {
+				/* as ordered_value_match() does */
+				match = ber_bvcmp( bv, (struct berval *)fn->fn_assert );
+				ret = LDAP_SUCCESS;
+			}
+
+			if ( ret != LDAP_SUCCESS ) {
+				rc = ret;
+				break;
+			}
+
+			switch ( fn->fn_choice ) {
+			case LDAP_FILTER_GE:
+				if ( match >= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+			case LDAP_FILTER_LE:
+				if ( match <= 0 ) return LDAP_COMPARE_TRUE;
+				break;
+			default:
+				if ( match == 0 ) return LDAP_COMPARE_TRUE;
+				break;
+			}
+		}
+	}
+
+	return rc;
+}
+
+static int
+test_prog_node( Operation *op, FilterProg *fp, int i, Entry *e )
+{
+	FilterNode *fn = &fp->fp_nodes[i];
+	int c, rc, rtn;
+
+	switch ( fn->fn_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		return fn->fn_f->f_result;
+
+	case LDAP_FILTER_AND:
+		rtn = LDAP_COMPARE_TRUE;
+		for ( c = i + 1; c < fn->fn_next; c = fp->fp_nodes[c].fn_next ) {
+			rc = test_prog_node( op, fp, c, e );
+			if ( rc == LDAP_COMPARE_FALSE )
+				return rc;
+			if ( rc != LDAP_COMPARE_TRUE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case LDAP_FILTER_OR:
+		rtn = LDAP_COMPARE_FALSE;
+		for ( c = i + 1; c < fn->fn_next; c = fp->fp_nodes[c].fn_next ) {
+			rc = test_prog_node( op, fp, c, e );
+			if ( rc == LDAP_COMPARE_TRUE )
+				return rc;
+			if ( rc != LDAP_COMPARE_FALSE )
+				rtn = rc;
+		}
+		return rtn;
+
+	case LDAP_FILTER_NOT:
+		rc = test_prog_node( op, fp, i + 1, e );
+		if ( rc == LDAP_COMPARE_TRUE )
+			rc = LDAP_COMPARE_FALSE;
+		else if ( rc == LDAP_COMPARE_FALSE )
+			rc = LDAP_COMPARE_TRUE;
+		return rc;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_SUBSTRINGS:
+	case LDAP_FILTER_PRESENT:
+		return test_prog_leaf( op, fp, fn, e );
+
+	default:
+		return test_filter( op, e, fn->fn_f );
+	}
+}
+
+/*
+ * test_filter_prog - test a compiled filter against a single entry.
+ * returns the same as test_filter().
+ */
+int
+test_filter_prog(
+	Operation	*op,
+	Entry		*e,
+	FilterProg	*fp )
+{
+	return test_prog_node( op, fp, 0, e );
+}
+
+/* Evaluate node i for the entries ev[sel[0..nsel-1]], into rcv[]. An AND
+ * or OR only passes on the entries its result is still open for.
+ */
+static void
+test_prog_batch(
+	Operation	*op,
+	FilterProg	*fp,
+	int		i,
+	Entry		**ev,
+	int		*sel,
+	int		nsel,
+	int		*rcv )
+{
+	FilterNode *fn = &fp->fp_nodes[i];
+	int *act, *res, nact, c, k, j, r, done, open;
+
+	switch ( fn->fn_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		if ( fn->fn_choice == LDAP_FILTER_AND ) {
+			open = LDAP_COMPARE_TRUE;
+			done = LDAP_COMPARE_FALSE;
+		} else {
+			open = LDAP_COMPARE_FALSE;
+			done = LDAP_COMPARE_TRUE;
+		}
+		act = fp->fp_scratch + fn->fn_level * 2 * FP_BATCH;
+		res = act + FP_BATCH;
+		for ( k = 0; k < nsel; k++ ) {
+			act[k] = sel[k];
+			rcv[sel[k]] = open;
+		}
+		nact = nsel;
+		for ( c = i + 1; nact && c < fn->fn_next; c = fp->fp_nodes[c].fn_next ) {
+			test_prog_batch( op, fp, c, ev, act, nact, res );
+			for ( k = j = 0; k < nact; k++ ) {
+				r = res[act[k]];
+				if ( r == done ) {
+					rcv[act[k]] = r;
+					continue;
+				}
+				if ( r != open )
+					rcv[act[k]] = r;
+				act[j++] = act[k];
+			}
+			nact = j;
+		}
+		break;
+
+	case LDAP_FILTER_NOT:
+		test_prog_batch( op, fp, i + 1, ev, sel, nsel, rcv );
+		for ( k = 0; k < nsel; k++ ) {
+			r = rcv[sel[k]];
+			if ( r == LDAP_COMPARE_TRUE )
+				rcv[sel[k]] = LDAP_COMPARE_FALSE;
+			else if ( r == LDAP_COMPARE_FALSE )
+				rcv[sel[k]] = LDAP_COMPARE_TRUE;
+		}
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_SUBSTRINGS:
+	case LDAP_FILTER_PRESENT:
+		for ( k = 0; k < nsel; k++ )
+			rcv[sel[k]] = test_prog_leaf( op, fp, fn, ev[sel[k]] );
+		break;
+
+	default:
+		for ( k = 0; k < nsel; k++ )
+			rcv[sel[k]] = test_prog_node( op, fp, i, ev[sel[k]] );
+		break;
+	}
+}
+
+/*
+ * test_filter_batch - test a compiled filter against n entries,
+ * storing the result for ev[i] in rcv[i].
+ */
+void
+test_filter_batch(
+	Operation	*op,
+	Entry		**ev,
+	int		n,
+	FilterProg	*fp,
+	int		*rcv )
+{
+	int sel[FP_BATCH];
+	int i, k;
+
+	for ( i = 0; i < n; i += FP_BATCH ) {
+		int m = n - i < FP_BATCH ? n - i : FP_BATCH;
+		for ( k = 0; k < m; k++ )
+			sel[k] = k;
+		test_prog_batch( op, fp, 0, ev + i, sel, m, rcv + i );
+	}
+}
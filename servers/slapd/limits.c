@@ -366,6 +366,8 @@ limits_parse(
 	 * "time" [ "." { "soft" | "hard" } ] "=" <integer>
 	 *
 	 * "size" [ "." { "soft" | "hard" | "unchecked" } ] "=" <integer>
+	 *
+	 * "threads" "=" <integer>
 	 */
 	
 	pattern = argv[1];
@@ -869,6 +871,14 @@ limits_parse_one(
 		} else {
 			return( 1 );
 		}
+
+	} else if ( STRSTART( arg, "threads=" ) ) {
+		arg += STRLENOF( "threads=" );
+		if ( lutil_atoi( &limit->lms_threads, arg ) != 0
+			|| limit->lms_threads < 1 )
+		{
+			return( 1 );
+		}
 	}
 
 	return 0;
@@ -935,7 +945,7 @@ limits_unparse( struct slap_limits *lim, struct berval *bv, ber_len_t buflen )
 		btmp.bv_val = ptr;
 		btmp.bv_len = 0;
 		rc = limits_unparse_one( &lim->lm_limits,
-			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME,
+			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME | SLAP_LIMIT_THREADS,
 			&btmp, WHATSLEFT );
 		if ( rc == 0 )
 			bv->bv_len += btmp.bv_len;
@@ -1047,6 +1057,13 @@ t_hard:
 				return -1;
 		}
 	}
+
+	if ( which & SLAP_LIMIT_THREADS ) {
+		if ( lim->lms_threads ) {
+			if ( ptr_APPEND_FMT1( " threads=%d ", lim->lms_threads ) )
+				return -1;
+		}
+	}
 	if ( ptr != bv->bv_val ) {
 		ptr--;
 		*ptr = '\0';
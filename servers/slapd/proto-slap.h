@@ -902,6 +902,7 @@ LDAP_SLAPD_V (slap_ssf_t) local_ssf;
 LDAP_SLAPD_V (struct runqueue_s) slapd_rq;
 LDAP_SLAPD_V (int) slapd_daemon_threads;
 LDAP_SLAPD_V (int) slapd_daemon_mask;
+LDAP_SLAPD_V (int) slapd_affinity;
 #ifdef LDAP_TCP_BUFFER
 LDAP_SLAPD_V (int) slapd_tcp_rmem;
 LDAP_SLAPD_V (int) slapd_tcp_wmem;
@@ -1146,6 +1147,14 @@ LDAP_SLAPD_F (void) filter_destroy LDAP_P(( void ));
  */
 
 LDAP_SLAPD_F (int) test_filter LDAP_P(( Operation *op, Entry *e, Filter *f ));
+LDAP_SLAPD_F (FilterProg *) filter_prog_compile LDAP_P((
+	Operation *op, Filter *f ));
+LDAP_SLAPD_F (void) filter_prog_free LDAP_P((
+	Operation *op, FilterProg *fp ));
+LDAP_SLAPD_F (int) test_filter_prog LDAP_P((
+	Operation *op, Entry *e, FilterProg *fp ));
+LDAP_SLAPD_F (void) test_filter_batch LDAP_P((
+	Operation *op, Entry **ev, int n, FilterProg *fp, int *rcv ));
 
 /*
  * frontend.c
@@ -1623,6 +1632,9 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) slap_send_coalesce_begin LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_send_coalesce_check LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_send_coalesce_end LDAP_P(( Operation *op ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -2051,6 +2063,8 @@ LDAP_SLAPD_V (unsigned int) index_intlen_strlen;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming;
 LDAP_SLAPD_V (ber_len_t) sockbuf_max_incoming_auth;
 LDAP_SLAPD_V (int)		slap_conn_max_pending;
+LDAP_SLAPD_V (int)		slap_conn_max_batch;
+LDAP_SLAPD_V (int)		slap_conn_max_coalesce;
 LDAP_SLAPD_V (int)		slap_conn_max_pending_auth;
 
 LDAP_SLAPD_V (slap_mask_t)	global_allows;
@@ -37,6 +37,27 @@
 
 #include "slap.h"
 
+#if defined(HAVE_SYS_UIO_H) && !defined(_WIN32)
+#include <limits.h>
+#include <sys/uio.h>
+
+/* Search entries may be written with writev, gathering large values
+ * directly from the entry instead of copying them into the PDU */
+#define SLAP_SEND_GATHER	1
+
+/* Values at least this long are sent by reference */
+#define SLAP_GATHER_MINVAL	512
+
+#ifdef IOV_MAX
+#define SLAP_IOV_MAX	IOV_MAX
+#else
+#define SLAP_IOV_MAX	16
+#endif
+#endif
+
+/* Longest time a buffered search response waits for more to join it */
+#define SLAP_COALESCE_USEC	10000
+
 #if SLAP_STATS_ETIME
 #define ETIME_SETUP \
 	struct timeval now; \
@@ -331,17 +352,33 @@ slap_writewait_play(
 	}
 }
 
-static long send_ldap_ber(
+/* Writes (part of) a PDU to the connection. Returns 0 once the whole
+ * PDU was written, -1 with the socket error set otherwise.
+ */
+typedef int (SLAP_PDU_WRITE)( Connection *conn, void *arg );
+
+/* Called before the writer blocks, to make the rest of a PDU
+ * independent of memory the writewait callbacks may release.
+ */
+typedef void (SLAP_PDU_DETACH)( Operation *op, void *arg );
+
+static int
+send_pdu_ber( Connection *conn, void *arg )
+{
+	return ber_flush2( conn->c_sb, (BerElement *)arg, LBER_FLUSH_FREE_NEVER );
+}
+
+static long send_ldap_pdu(
 	Operation *op,
-	BerElement *ber )
+	SLAP_PDU_WRITE *pdu_write,
+	SLAP_PDU_DETACH *pdu_detach,
+	void *arg,
+	ber_len_t bytes )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
 	long ret = 0;
 	char *close_reason;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
-
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
 	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
@@ -375,7 +412,7 @@ static long send_ldap_ber(
 	while( 1 ) {
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+		if ( pdu_write( conn, arg ) == 0 ) {
 			ret = bytes;
 			break;
 		}
@@ -388,7 +425,7 @@ static long send_ldap_ber(
 		 * it's a hard error and return.
 		 */
 
-		Debug( LDAP_DEBUG_CONNS, "ber_flush2 failed errno=%d reason=\"%s\"\n",
+		Debug( LDAP_DEBUG_CONNS, "pdu write failed errno=%d reason=\"%s\"\n",
 		    err, sock_errstr(err), 0 );
 
 		if ( err != EWOULDBLOCK && err != EAGAIN ) {
@@ -404,6 +441,9 @@ fail:
 		}
 
 		/* wait for socket to be write-ready */
+		if ( pdu_detach ) {
+			pdu_detach( op, arg );
+		}
 		conn->c_writewaiter = 1;
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_idle( &connection_pool );
@@ -443,6 +483,271 @@ fail:
 	return ret;
 }
 
+/*
+ * Search entries and references are not written one by one while
+ * the search is running in the thread that started it: they are
+ * collected in a per-thread buffer and written together once
+ * conn_max_coalesce octets have been gathered, once the oldest one
+ * has been held for SLAP_COALESCE_USEC (checked as responses are added
+ * and by the backend's candidate loop through slap_send_coalesce_check),
+ * or before any other response to the search (the searchResultDone
+ * usually shares the last write).
+ *
+ * The buffer belongs to one operation, identified by connection and
+ * message ID so that copies of the Operation made by overlays find
+ * it as well.  Other threads never see it, hence sends from them
+ * (e.g. persistent search changes) go straight to the connection.
+ * Flushes go through send_ldap_pdu(), so a blocked client stalls the
+ * search and runs the writewait callbacks exactly as before.
+ */
+typedef struct send_coalesce {
+	unsigned long	co_connid;
+	ber_int_t	co_msgid;
+	int		co_active;
+	struct berval	co_buf;		/* bv_len is the amount buffered */
+	ber_len_t	co_size;
+	struct timeval	co_first;	/* when the oldest PDU was buffered */
+} send_coalesce;
+
+static void
+send_coalesce_free( void *key, void *data )
+{
+	send_coalesce *co = data;
+
+	ch_free( co->co_buf.bv_val );
+	ch_free( co );
+}
+
+/* The buffer of this thread if it is collecting the responses of op */
+static send_coalesce *
+send_coalesce_get( Operation *op )
+{
+	void *data = NULL;
+	send_coalesce *co;
+
+	if ( op->o_tag != LDAP_REQ_SEARCH ||
+		ldap_pvt_thread_pool_getkey( ldap_pvt_thread_pool_context(),
+			(void *)slap_send_coalesce_begin, &data, NULL ) )
+	{
+		return NULL;
+	}
+	co = data;
+	if ( !co->co_active || co->co_connid != op->o_connid ||
+		co->co_msgid != op->o_msgid )
+	{
+		return NULL;
+	}
+	return co;
+}
+
+/* true once the oldest buffered PDU has waited long enough */
+static int
+send_coalesce_due( send_coalesce *co, struct timeval *now )
+{
+	return ( now->tv_sec - co->co_first.tv_sec ) * 1000000L +
+		now->tv_usec - co->co_first.tv_usec >= SLAP_COALESCE_USEC;
+}
+
+static long
+send_coalesce_flush( Operation *op, send_coalesce *co )
+{
+	BerElementBuffer berbuf;
+	BerElement	*ber = (BerElement *) &berbuf;
+	long		bytes;
+
+	if ( BER_BVISEMPTY( &co->co_buf ) ) {
+		return 0;
+	}
+
+	/* write the whole buffer as if it had just been encoded */
+	ber_init2( ber, &co->co_buf, LBER_USE_DER );
+	ber_reset( ber, 0 );
+	bytes = send_ldap_pdu( op, send_pdu_ber, NULL, ber, co->co_buf.bv_len );
+	co->co_buf.bv_len = 0;
+
+	return bytes;
+}
+
+/*
+ * Appends a PDU to the buffer, flushing it first if there is no room.
+ * Returns len once the PDU is buffered, 0 if the caller must write it
+ * itself because it does not fit into the buffer at all, -1 if a flush
+ * failed.
+ */
+static long
+send_coalesce_add( Operation *op, send_coalesce *co, char *pdu, ber_len_t len )
+{
+	ber_len_t max = slap_conn_max_coalesce > 0 ? slap_conn_max_coalesce : 0;
+	struct timeval now;
+
+	if ( co->co_buf.bv_len + len > max ) {
+		if ( send_coalesce_flush( op, co ) < 0 ) {
+			return -1;
+		}
+		if ( len >= max ) {
+			return 0;
+		}
+	}
+
+	if ( co->co_size < max ) {
+		co->co_buf.bv_val = ch_realloc( co->co_buf.bv_val, max );
+		co->co_size = max;
+	}
+
+	(void) gettimeofday( &now, NULL );
+	if ( BER_BVISEMPTY( &co->co_buf ) ) {
+		co->co_first = now;
+	}
+	AC_MEMCPY( co->co_buf.bv_val + co->co_buf.bv_len, pdu, len );
+	co->co_buf.bv_len += len;
+
+	if ( send_coalesce_due( co, &now ) &&
+		send_coalesce_flush( op, co ) < 0 )
+	{
+		return -1;
+	}
+
+	return len;
+}
+
+/*
+ * Starts collecting the entries of the search op on this thread.
+ * Returns nonzero if it did, in which case slap_send_coalesce_end()
+ * must be called before the operation is done.
+ */
+int
+slap_send_coalesce_begin( Operation *op )
+{
+	Connection *conn = op->o_conn;
+	void *ctx = ldap_pvt_thread_pool_context(), *data = NULL;
+	send_coalesce *co;
+
+	if ( slap_conn_max_coalesce <= 0 || op->o_tag != LDAP_REQ_SEARCH ||
+		conn == NULL || conn->c_sd == AC_SOCKET_INVALID )
+	{
+		return 0;
+	}
+#ifdef LDAP_CONNECTIONLESS
+	if ( conn->c_is_udp ) {
+		return 0;
+	}
+#endif
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)slap_send_coalesce_begin,
+		&data, NULL ) )
+	{
+		data = ch_calloc( 1, sizeof( send_coalesce ) );
+		if ( ldap_pvt_thread_pool_setkey( ctx,
+			(void *)slap_send_coalesce_begin, data,
+			send_coalesce_free, NULL, NULL ) )
+		{
+			ch_free( data );
+			return 0;
+		}
+	}
+	co = data;
+
+	/* nested searches leave the buffer to the outer one */
+	if ( co->co_active ) {
+		return 0;
+	}
+
+	co->co_connid = op->o_connid;
+	co->co_msgid = op->o_msgid;
+	co->co_buf.bv_len = 0;
+	co->co_active = 1;
+
+	return 1;
+}
+
+/*
+ * Writes the responses buffered for op once the oldest has waited
+ * SLAP_COALESCE_USEC.  Backends call this while looking for the next
+ * entry, so a match found early in a long scan is not held back until
+ * the next one.
+ */
+void
+slap_send_coalesce_check( Operation *op )
+{
+	send_coalesce *co;
+	struct timeval now;
+
+	co = send_coalesce_get( op );
+	if ( co == NULL || BER_BVISEMPTY( &co->co_buf ) ) {
+		return;
+	}
+
+	(void) gettimeofday( &now, NULL );
+	if ( send_coalesce_due( co, &now ) ) {
+		(void) send_coalesce_flush( op, co );
+	}
+}
+
+void
+slap_send_coalesce_end( Operation *op )
+{
+	send_coalesce *co = send_coalesce_get( op );
+
+	if ( co != NULL ) {
+		(void) send_coalesce_flush( op, co );
+		co->co_active = 0;
+	}
+}
+
+static long send_ldap_ber(
+	Operation *op,
+	BerElement *ber )
+{
+	ber_len_t bytes;
+	send_coalesce *co;
+
+	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+
+	/* anything else sent for the search goes after the buffered
+	 * entries, in the same write if there is room for it */
+	co = send_coalesce_get( op );
+	if ( co != NULL && !BER_BVISEMPTY( &co->co_buf ) ) {
+		if ( co->co_buf.bv_len + bytes <= co->co_size ) {
+			struct berval bv;
+			long rc;
+
+			ber_flatten2( ber, &bv, 0 );
+			AC_MEMCPY( co->co_buf.bv_val + co->co_buf.bv_len,
+				bv.bv_val, bv.bv_len );
+			co->co_buf.bv_len += bv.bv_len;
+			rc = send_coalesce_flush( op, co );
+			return rc > 0 ? (long)bytes : rc;
+		}
+		if ( send_coalesce_flush( op, co ) < 0 ) {
+			return -1;
+		}
+	}
+
+	return send_ldap_pdu( op, send_pdu_ber, NULL, ber, bytes );
+}
+
+/* Sends a searchResultEntry or searchResultReference, or buffers it
+ * while the search is coalescing its responses */
+static long send_search_ber(
+	Operation *op,
+	BerElement *ber )
+{
+	send_coalesce *co = send_coalesce_get( op );
+
+	if ( co != NULL ) {
+		struct berval bv;
+		long bytes;
+
+		ber_flatten2( ber, &bv, 0 );
+		bytes = send_coalesce_add( op, co, bv.bv_val, bv.bv_len );
+		if ( bytes != 0 ) {
+			return bytes;
+		}
+	}
+
+	return send_ldap_ber( op, ber );
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -1000,6 +1305,399 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
 #define set_ldap_error( rs, err, text ) do { \
 		(rs)->sr_err = err; (rs)->sr_text = text; } while(0)
 
+/*
+ * Tells whether desc is to be returned with the entry in rs, according
+ * to the requested attributes; oper is set for the attributes in
+ * rs->sr_operational_attrs.
+ */
+static int
+send_attr_wanted(
+	Operation *op,
+	SlapReply *rs,
+	AttributeDescription *desc,
+	int userattrs,
+	int oper )
+{
+	int listed;
+
+	if ( rs->sr_attrs == NULL ) {
+		/* all user attrs request, skip operational attributes */
+		return !is_at_operational( desc->ad_type );
+	}
+
+	/* specific attrs requested */
+	if ( !is_at_operational( desc->ad_type ) ) {
+		return userattrs || ad_inlist( desc, rs->sr_attrs );
+	}
+
+	/* if not explicitly requested and not all op attrs requested, skip */
+	listed = ad_inlist( desc, rs->sr_attrs );
+	if ( !listed && !SLAP_OPATTRS( rs->sr_attr_flags ) ) {
+		return 0;
+	}
+
+	/* if DSA-specific and replicating, skip; explicitly requested
+	 * entry attributes are still returned */
+	if ( ( oper || !listed ) && op->o_sync != SLAP_CONTROL_NONE &&
+		desc->ad_type->sat_usage == LDAP_SCHEMA_DSA_OPERATION )
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+#ifdef SLAP_SEND_GATHER
+#ifdef HAVE_TLS
+#define SLAP_CONN_TLS(c)	((c)->c_is_tls)
+#else
+#define SLAP_CONN_TLS(c)	0
+#endif
+#ifdef LDAP_CONNECTIONLESS
+#define SLAP_CONN_UDP(c)	((c)->c_is_udp)
+#else
+#define SLAP_CONN_UDP(c)	0
+#endif
+
+/* true if writes on the connection go straight to the socket */
+#define SLAP_CONN_GATHER(c)	( (c) != NULL && \
+	(c)->c_sd != AC_SOCKET_INVALID && \
+	!SLAP_CONN_TLS(c) && !SLAP_CONN_UDP(c) && \
+	!(c)->c_sasl_layers && (c)->c_sasl_sockctx == NULL )
+
+typedef struct send_iov {
+	struct iovec	*si_iov;
+	int		si_cnt;
+	int		si_byref;	/* some vectors point into the entry */
+	char		*si_copy;	/* the unsent rest, once detached */
+	struct iovec	si_rest;
+} send_iov;
+
+static int
+send_pdu_iov( Connection *conn, void *arg )
+{
+	send_iov *si = arg;
+	ssize_t n;
+
+	while ( si->si_cnt > 0 ) {
+		n = writev( conn->c_sd, si->si_iov,
+			si->si_cnt < SLAP_IOV_MAX ? si->si_cnt : SLAP_IOV_MAX );
+		if ( n < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return -1;
+		}
+
+		/* skip what was written, resume partial vectors */
+		for ( ; si->si_cnt > 0 && (size_t)n >= si->si_iov->iov_len; si->si_cnt-- ) {
+			n -= si->si_iov->iov_len;
+			si->si_iov++;
+		}
+		if ( n > 0 ) {
+			si->si_iov->iov_base = (char *)si->si_iov->iov_base + n;
+			si->si_iov->iov_len -= n;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Values sent by reference point into the entry, and with back-mdb into
+ * the pages of its reader txn, which mdb_writewait() may reset while we
+ * wait for the client.  Copy whatever is still unsent into memory of
+ * the operation before that can happen.
+ */
+static void
+send_pdu_iov_detach( Operation *op, void *arg )
+{
+	send_iov *si = arg;
+	ber_len_t len = 0;
+	char *p;
+	int i;
+
+	if ( !si->si_byref || si->si_copy != NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < si->si_cnt; i++ ) {
+		len += si->si_iov[i].iov_len;
+	}
+	p = si->si_copy = op->o_tmpalloc( len ? len : 1, op->o_tmpmemctx );
+	for ( i = 0; i < si->si_cnt; i++ ) {
+		AC_MEMCPY( p, si->si_iov[i].iov_base, si->si_iov[i].iov_len );
+		p += si->si_iov[i].iov_len;
+	}
+
+	si->si_rest.iov_base = si->si_copy;
+	si->si_rest.iov_len = len;
+	si->si_iov = &si->si_rest;
+	si->si_cnt = 1;
+}
+
+/* length of the BER encoding of len */
+static ber_len_t
+gather_lenlen( ber_len_t len )
+{
+	ber_len_t n = 1;
+
+	if ( len >= 0x80 ) {
+		for ( ; len; len >>= 8 ) n++;
+	}
+	return n;
+}
+
+/* length of an element with a single octet tag */
+#define GATHER_TLV(len)	( 1 + gather_lenlen( len ) + (len) )
+
+static char *
+gather_hdr( char *p, ber_tag_t tag, ber_len_t len )
+{
+	ber_len_t n = gather_lenlen( len ) - 1;
+
+	*p++ = (char)tag;
+	if ( n == 0 ) {
+		*p++ = (char)len;
+	} else {
+		*p++ = (char)( 0x80 | n );
+		while ( n-- ) {
+			*p++ = (char)( len >> ( n * 8 ) );
+		}
+	}
+	return p;
+}
+
+typedef struct gather_attr {
+	Attribute	*ga_attr;
+	char		*ga_vals;	/* which values are returned */
+	ber_len_t	ga_setlen;	/* content length of the value set */
+	ber_len_t	ga_len;		/* content length of the attribute */
+} gather_attr;
+
+/*
+ * Sends the entry in rs as a searchResultEntry without controls.
+ *
+ * All element lengths are computed before encoding, so the PDU is
+ * written as a list of iovecs: the DER headers and short values are
+ * packed into one buffer, while values of SLAP_GATHER_MINVAL octets
+ * or more are written directly from the entry.  With back-mdb those
+ * values still point into the memory map, so they go from the mapped
+ * pages to the socket without an intermediate copy.
+ *
+ * Attribute selection and access checks are the same as those of
+ * the generic encoder in slap_send_search_entry().
+ */
+static int
+send_search_entry_gather(
+	Operation *op,
+	SlapReply *rs,
+	AccessControlState *acl_state )
+{
+	Entry		*e = rs->sr_entry;
+	Attribute	*a, *lists[2];
+	gather_attr	*ga;
+	struct iovec	*iov0, *iov;
+	send_iov	si;
+	send_coalesce	*co;
+	unsigned char	msgid[sizeof(ber_int_t)], *mp;
+	ber_uint_t	u;
+	ber_len_t	attrslen = 0, oplen, msglen, total, refd = 0, pending = 0;
+	char		*vals, *buf, *p, *seg;
+	int		userattrs = SLAP_USERATTRS( rs->sr_attr_flags );
+	int		na = 0, nv = 0, nref = 0, niov = 0, ml, l, i, k;
+	long		bytes;
+
+	lists[0] = e->e_attrs;
+	lists[1] = rs->sr_operational_attrs;
+
+	for ( l = 0; l < 2; l++ ) {
+		for ( a = lists[l]; a != NULL; a = a->a_next, na++ ) {
+			for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) nv++;
+		}
+	}
+	ga = op->o_tmpalloc( na * sizeof(gather_attr) + nv + 1,
+		op->o_tmpmemctx );
+	vals = (char *)( ga + na );
+
+	/* select the attributes and values, size everything */
+	na = 0;
+	for ( l = 0; l < 2; l++ ) {
+		for ( a = lists[l]; a != NULL; a = a->a_next ) {
+			AttributeDescription *desc = a->a_desc;
+			BerVarray acl_vals = l ? a->a_vals : a->a_nvals;
+			ber_len_t setlen = 0;
+			int sent = 0;
+
+			if ( !send_attr_wanted( op, rs, desc, userattrs, l ) ) {
+				continue;
+			}
+
+			if ( l && !access_allowed( op, e, desc, NULL,
+				ACL_READ, acl_state ) )
+			{
+				Debug( LDAP_DEBUG_ACL,
+					"send_search_entry: conn %lu "
+					"access to attribute %s not allowed\n",
+					op->o_connid, desc->ad_cname.bv_val, 0 );
+				continue;
+			}
+
+			/* cached after the first value unless the ACLs are
+			 * value dependent */
+			for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+				vals[i] = access_allowed( op, e, desc, &acl_vals[i],
+					ACL_READ, acl_state ) != 0;
+				if ( !vals[i] ) {
+					continue;
+				}
+				sent++;
+				setlen += GATHER_TLV( a->a_vals[i].bv_len );
+				if ( a->a_vals[i].bv_len >= SLAP_GATHER_MINVAL ) {
+					refd += a->a_vals[i].bv_len;
+					nref++;
+				}
+			}
+
+			/* entry attributes without readable values are omitted */
+			if ( !l && !sent ) {
+				continue;
+			}
+
+			ga[na].ga_attr = a;
+			ga[na].ga_vals = vals;
+			ga[na].ga_setlen = setlen;
+			ga[na].ga_len = GATHER_TLV( desc->ad_cname.bv_len ) +
+				GATHER_TLV( setlen );
+			attrslen += GATHER_TLV( ga[na].ga_len );
+			vals += i;
+			na++;
+		}
+	}
+
+	/* minimal two's complement encoding of the message ID */
+	u = op->o_msgid;
+	for ( k = sizeof(msgid); k--; u >>= 8 ) {
+		msgid[k] = (unsigned char)u;
+	}
+	for ( mp = msgid, ml = sizeof(msgid); ml > 1 &&
+		( ( mp[0] == 0 && !( mp[1] & 0x80 ) ) ||
+		  ( mp[0] == 0xff && ( mp[1] & 0x80 ) ) ); mp++, ml-- )
+		;
+
+	oplen = GATHER_TLV( e->e_name.bv_len ) + GATHER_TLV( attrslen );
+	msglen = GATHER_TLV( ml ) + GATHER_TLV( oplen );
+	total = GATHER_TLV( msglen );
+
+	/* one spare vector for responses buffered before this one */
+	iov0 = op->o_tmpalloc( ( 2 * nref + 2 ) * sizeof(struct iovec) +
+		total - refd, op->o_tmpmemctx );
+	iov = iov0 + 1;
+	buf = (char *)( iov + 2 * nref + 1 );
+
+	p = seg = buf;
+	p = gather_hdr( p, LDAP_TAG_MESSAGE, msglen );
+	p = gather_hdr( p, LDAP_TAG_MSGID, ml );
+	AC_MEMCPY( p, mp, ml );
+	p += ml;
+	p = gather_hdr( p, LDAP_RES_SEARCH_ENTRY, oplen );
+	p = gather_hdr( p, LBER_OCTETSTRING, e->e_name.bv_len );
+	AC_MEMCPY( p, e->e_name.bv_val, e->e_name.bv_len );
+	p += e->e_name.bv_len;
+	p = gather_hdr( p, LBER_SEQUENCE, attrslen );
+
+	for ( k = 0; k < na; k++ ) {
+		AttributeDescription *desc;
+
+		a = ga[k].ga_attr;
+		desc = a->a_desc;
+		p = gather_hdr( p, LBER_SEQUENCE, ga[k].ga_len );
+		p = gather_hdr( p, LBER_OCTETSTRING, desc->ad_cname.bv_len );
+		AC_MEMCPY( p, desc->ad_cname.bv_val, desc->ad_cname.bv_len );
+		p += desc->ad_cname.bv_len;
+		p = gather_hdr( p, LBER_SET, ga[k].ga_setlen );
+
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+			struct berval *bv = &a->a_vals[i];
+
+			if ( !ga[k].ga_vals[i] ) {
+				continue;
+			}
+			p = gather_hdr( p, LBER_OCTETSTRING, bv->bv_len );
+			if ( bv->bv_len < SLAP_GATHER_MINVAL ) {
+				AC_MEMCPY( p, bv->bv_val, bv->bv_len );
+				p += bv->bv_len;
+				continue;
+			}
+			iov[niov].iov_base = seg;
+			iov[niov++].iov_len = p - seg;
+			iov[niov].iov_base = bv->bv_val;
+			iov[niov++].iov_len = bv->bv_len;
+			seg = p;
+		}
+	}
+	if ( p > seg ) {
+		iov[niov].iov_base = seg;
+		iov[niov++].iov_len = p - seg;
+	}
+	assert( p - buf == total - refd );
+
+	op->o_tmpfree( ga, op->o_tmpmemctx );
+
+	Statslog( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
+	    op->o_log_prefix, e->e_nname.bv_val, 0, 0, 0 );
+
+	co = send_coalesce_get( op );
+	if ( co != NULL && nref == 0 ) {
+		/* a single segment, small enough to be buffered */
+		bytes = send_coalesce_add( op, co, buf, total );
+		if ( bytes != 0 ) {
+			goto done;
+		}
+	}
+
+	si.si_iov = iov;
+	si.si_cnt = niov;
+	si.si_byref = nref;
+	si.si_copy = NULL;
+	if ( co != NULL && !BER_BVISEMPTY( &co->co_buf ) ) {
+		/* flush the buffer with the same writev */
+		pending = co->co_buf.bv_len;
+		iov0->iov_base = co->co_buf.bv_val;
+		iov0->iov_len = pending;
+		si.si_iov = iov0;
+		si.si_cnt++;
+		co->co_buf.bv_len = 0;
+	}
+	bytes = send_ldap_pdu( op, send_pdu_iov, send_pdu_iov_detach, &si,
+		pending + total );
+	if ( si.si_copy != NULL ) {
+		op->o_tmpfree( si.si_copy, op->o_tmpmemctx );
+	}
+	if ( bytes > 0 ) {
+		bytes -= pending;
+	}
+
+done:;
+	op->o_tmpfree( iov0, op->o_tmpmemctx );
+
+	if ( bytes < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"send_search_entry: conn %lu  writev failed.\n",
+			op->o_connid, 0, 0 );
+		return LDAP_UNAVAILABLE;
+	}
+	rs->sr_nentries++;
+
+	ldap_pvt_thread_mutex_lock( &op->o_counters->sc_mutex );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_bytes, (unsigned long)bytes );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_entries, 1 );
+	ldap_pvt_mp_add_ulong( op->o_counters->sc_pdu, 1 );
+	ldap_pvt_thread_mutex_unlock( &op->o_counters->sc_mutex );
+
+	return LDAP_SUCCESS;
+}
+#endif /* SLAP_SEND_GATHER */
+
 /*
  * returns:
  *
@@ -1081,6 +1779,15 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		goto error_return;
 	}
 
+#ifdef SLAP_SEND_GATHER
+	if ( op->o_res_ber == NULL && !attrsonly && op->o_vrFilter == NULL &&
+		rs->sr_ctrls == NULL && SLAP_CONN_GATHER( op->o_conn ) )
+	{
+		rc = send_search_entry_gather( op, rs, &acl_state );
+		goto error_return;
+	}
+#endif
+
 	if ( op->o_res_ber ) {
 		/* read back control or LDAP_CONNECTIONLESS */
 	    ber = op->o_res_ber;
@@ -1180,30 +1887,8 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		AttributeDescription *desc = a->a_desc;
 		int finish = 0;
 
-		if ( rs->sr_attrs == NULL ) {
-			/* all user attrs request, skip operational attributes */
-			if( is_at_operational( desc->ad_type ) ) {
-				continue;
-			}
-
-		} else {
-			/* specific attrs requested */
-			if ( is_at_operational( desc->ad_type ) ) {
-				/* if not explicitly requested */
-				if ( !ad_inlist( desc, rs->sr_attrs )) {
-					/* if not all op attrs requested, skip */
-					if ( !SLAP_OPATTRS( rs->sr_attr_flags ))
-						continue;
-					/* if DSA-specific and replicating, skip */
-					if ( op->o_sync != SLAP_CONTROL_NONE &&
-						desc->ad_type->sat_usage == LDAP_SCHEMA_DSA_OPERATION )
-						continue;
-				}
-			} else {
-				if ( !userattrs && !ad_inlist( desc, rs->sr_attrs ) ) {
-					continue;
-				}
-			}
+		if ( !send_attr_wanted( op, rs, desc, userattrs, 0 ) ) {
+			continue;
 		}
 
 		if ( attrsonly ) {
@@ -1346,29 +2031,8 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	for (a = rs->sr_operational_attrs, j=0; a != NULL; a = a->a_next, j++ ) {
 		AttributeDescription *desc = a->a_desc;
 
-		if ( rs->sr_attrs == NULL ) {
-			/* all user attrs request, skip operational attributes */
-			if( is_at_operational( desc->ad_type ) ) {
-				continue;
-			}
-
-		} else {
-			/* specific attrs requested */
-			if( is_at_operational( desc->ad_type ) ) {
-				if ( !SLAP_OPATTRS( rs->sr_attr_flags ) && 
-					!ad_inlist( desc, rs->sr_attrs ) )
-				{
-					continue;
-				}
-				/* if DSA-specific and replicating, skip */
-				if ( op->o_sync != SLAP_CONTROL_NONE &&
-					desc->ad_type->sat_usage == LDAP_SCHEMA_DSA_OPERATION )
-					continue;
-			} else {
-				if ( !userattrs && !ad_inlist( desc, rs->sr_attrs ) ) {
-					continue;
-				}
-			}
+		if ( !send_attr_wanted( op, rs, desc, userattrs, 1 ) ) {
+			continue;
 		}
 
 		if ( ! access_allowed( op, rs->sr_entry, desc, NULL,
@@ -1478,7 +2142,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_search_ber( op, ber );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1646,7 +2310,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_search_ber( op, ber );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
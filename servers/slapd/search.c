@@ -403,7 +403,12 @@ fail1:
 	} else if ( op->o_bd->be_search ) {
 		if ( limits_check( op, rs ) == 0 ) {
 			/* actually do the search and send the result(s) */
+			int coalesce = slap_send_coalesce_begin( op );
+
 			(op->o_bd->be_search)( op, rs );
+			if ( coalesce ) {
+				slap_send_coalesce_end( op );
+			}
 		}
 		/* else limits_check() sends error */
 
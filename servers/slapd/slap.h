@@ -140,10 +140,19 @@ LDAP_BEGIN_DECL
 
 #define SLAP_MAX_WORKER_THREADS		(16)
 
+/* slapd_affinity: a connection's reads and operations go to the pool
+ * queue of its listener thread, and with CPU those threads are bound
+ * to the CPU of the same number */
+#define SLAP_AFFINITY_CONN	1
+#define SLAP_AFFINITY_CPU	2
+#define SLAP_CONN_QUEUE(sd)	( slapd_affinity ? (int)( (sd) & slapd_daemon_mask ) : -1 )
+
 #define SLAP_SB_MAX_INCOMING_DEFAULT ((1<<18) - 1)
 #define SLAP_SB_MAX_INCOMING_AUTH ((1<<24) - 1)
 
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
+#define SLAP_CONN_MAX_BATCH_DEFAULT	16
+#define SLAP_CONN_MAX_COALESCE_DEFAULT	32768
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
 
 #define SLAP_TEXT_BUFLEN (256)
@@ -354,6 +363,7 @@ typedef struct ContentRule ContentRule;
 typedef struct AttributeAssertion AttributeAssertion;
 typedef struct SubstringsAssertion SubstringsAssertion;
 typedef struct Filter Filter;
+typedef struct FilterProg FilterProg;
 typedef struct ValuesReturnFilter ValuesReturnFilter;
 typedef struct Attribute Attribute;
 #ifdef LDAP_COMP_MATCH
@@ -1684,6 +1694,7 @@ slap_cf_aux_table_parse_x LDAP_P((
 
 #define SLAP_LIMIT_TIME	1
 #define SLAP_LIMIT_SIZE	2
+#define SLAP_LIMIT_THREADS	4
 
 struct slap_limits_set {
 	/* time limits */
@@ -1697,6 +1708,9 @@ struct slap_limits_set {
 	int	lms_s_pr;
 	int	lms_s_pr_hide;
 	int	lms_s_pr_total;
+
+	/* search threads, 0 leaves it to the database */
+	int	lms_threads;
 };
 
 /* Note: this is different from LDAP_NO_LIMIT (0); slapd internal use only */
@@ -28,6 +28,7 @@
 #include <ac/ctype.h>
 #include <ac/socket.h>
 #include <ac/string.h>
+#include <ac/time.h>
 
 #include "slapcommon.h"
 #include "ldif.h"
@@ -40,6 +41,97 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+static double
+slapcat_now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+/* -o filter-bench: time test_filter() against its compiled forms */
+static int
+slapcat_filter_bench( const char *progname )
+{
+	Operation op = {0};
+	Entry **ev = NULL;
+	FilterProg *fp;
+	int *rc1, *rc2, *rc3;
+	int n = 0, max = 0, i, matches = 0;
+	unsigned r;
+	double t0, t1, t2, t3;
+	ID id;
+
+	op.o_bd = be;
+	id = be->be_entry_first ? be->be_entry_first( be ) :
+		be->be_entry_first_x( be, NULL, LDAP_SCOPE_DEFAULT, NULL );
+	for ( ; id != NOID && !gotsig; id = be->be_entry_next( be ))
+	{
+		Entry *e = be->be_entry_get( be, id );
+		if ( e == NULL )
+			continue;
+		if ( n == max ) {
+			max = max ? max * 2 : 1024;
+			ev = ch_realloc( ev, max * sizeof(Entry *) );
+		}
+		ev[n++] = entry_dup( e );
+		be_entry_release_r( &op, e );
+	}
+	if ( n == 0 ) {
+		fprintf( stderr, "%s: no entries.\n", progname );
+		ch_free( ev );
+		return EXIT_FAILURE;
+	}
+
+	rc1 = ch_malloc( 3 * n * sizeof(int) );
+	rc2 = rc1 + n;
+	rc3 = rc2 + n;
+	fp = filter_prog_compile( NULL, filter );
+
+	t0 = slapcat_now();
+	for ( r = 0; r < filter_bench; r++ )
+		for ( i = 0; i < n; i++ )
+			rc1[i] = test_filter( NULL, ev[i], filter );
+	t1 = slapcat_now();
+	for ( r = 0; r < filter_bench; r++ )
+		for ( i = 0; i < n; i++ )
+			rc2[i] = test_filter_prog( NULL, ev[i], fp );
+	t2 = slapcat_now();
+	for ( r = 0; r < filter_bench; r++ )
+		test_filter_batch( NULL, ev, n, fp, rc3 );
+	t3 = slapcat_now();
+
+	for ( i = 0; i < n; i++ ) {
+		if ( rc1[i] != rc2[i] || rc1[i] != rc3[i] ) {
+			fprintf( stderr, "%s: results differ for \"%s\": %d %d %d\n",
+				progname, ev[i]->e_name.bv_val, rc1[i], rc2[i], rc3[i] );
+			matches = -1;
+			break;
+		}
+		if ( rc1[i] == LDAP_COMPARE_TRUE )
+			matches++;
+	}
+
+	if ( matches >= 0 ) {
+		printf( "%d entries, %u rounds, %d matches\n",
+			n, filter_bench, matches );
+		printf( "test_filter       %8.1f ns/entry\n",
+			( t1 - t0 ) / n / filter_bench );
+		printf( "test_filter_prog  %8.1f ns/entry\n",
+			( t2 - t1 ) / n / filter_bench );
+		printf( "test_filter_batch %8.1f ns/entry\n",
+			( t3 - t2 ) / n / filter_bench );
+	}
+
+	filter_prog_free( NULL, fp );
+	ch_free( rc1 );
+	for ( i = 0; i < n; i++ )
+		entry_free( ev[i] );
+	ch_free( ev );
+	return matches < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -80,6 +172,20 @@ slapcat( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	if ( filter_bench ) {
+		if ( filter == NULL ) {
+			fprintf( stderr, "%s: filter-bench needs a filter (-a).\n",
+				progname );
+			rc = EXIT_FAILURE;
+		} else {
+			rc = slapcat_filter_bench( progname );
+		}
+		be->be_entry_close( be );
+		if ( slap_tool_destroy())
+			rc = EXIT_FAILURE;
+		return rc;
+	}
+
 	op.o_bd = be;
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
@@ -250,6 +250,20 @@ parse_slapopt( int tool, int *mode )
 			break;
 		}
 
+	} else if ( strncasecmp( optarg, "filter-bench", len ) == 0 ) {
+		switch ( tool ) {
+		case SLAPCAT:
+			if ( lutil_atou( &filter_bench, p ) || filter_bench == 0 ) {
+				Debug( LDAP_DEBUG_ANY, "unable to parse filter-bench=\"%s\".\n", p, 0, 0 );
+				return -1;
+			}
+			break;
+
+		default:
+			Debug( LDAP_DEBUG_ANY, "filter-bench meaningless for tool.\n", 0, 0, 0 );
+			break;
+		}
+
 	} else {
 		return -1;
 	}
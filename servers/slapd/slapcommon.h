@@ -66,6 +66,7 @@ typedef struct tool_vars {
 	unsigned tv_dn_mode;
 	unsigned int tv_csnsid;
 	ber_len_t tv_ldif_wrap;
+	unsigned tv_filter_bench;
 	char tv_maxcsnbuf[ LDAP_PVT_CSNSTR_BUFSIZE * ( SLAP_SYNC_SID_MAX + 1 ) ];
 	struct berval tv_maxcsn[ SLAP_SYNC_SID_MAX + 1 ];
 } tool_vars;
@@ -103,6 +104,7 @@ extern tool_vars tool_globals;
 #define dn_mode tool_globals.tv_dn_mode
 #define csnsid tool_globals.tv_csnsid
 #define ldif_wrap tool_globals.tv_ldif_wrap
+#define filter_bench tool_globals.tv_filter_bench
 #define maxcsn tool_globals.tv_maxcsn
 #define maxcsnbuf tool_globals.tv_maxcsnbuf
 
@@ -21,6 +21,8 @@
  * This tool is a MT reader.  It behaves like slapd-read however
  * with one or more threads simultaneously using the same connection.
  * If -M is enabled, then M threads will also perform write operations.
+ * With -S it reports the rate of operations, to measure how well the
+ * server spreads the requests of a few busy connections over its threads.
  */
 
 #include "portable.h"
@@ -34,6 +36,7 @@
 #include "ac/param.h"
 #include "ac/socket.h"
 #include "ac/string.h"
+#include "ac/time.h"
 #include "ac/unistd.h"
 #include "ac/wait.h"
 
@@ -93,6 +96,7 @@ int		nobind = 0;
 int		threads = 1;
 int		rwthreads = 0;
 int		verbose = 0;
+int		rate = 0;
 
 int		noconns = 1;
 LDAP		**lds = NULL;
@@ -139,6 +143,7 @@ usage( char *name, char opt )
 		"[-A] "
 		"[-F] "
 		"[-N] "
+		"[-S] "
 		"[-v] "
 		"[-c connections] "
 		"[-f filter] "
@@ -163,13 +168,15 @@ main( int argc, char **argv )
 	char		outstr[BUFSIZ];
 	int		ptpass;
 	int		testfail = 0;
+	struct timeval	start, end;
+	long		msec, ops;
 
 	config = tester_init( "slapd-mtread", TESTER_READ );
 
 	/* by default, tolerate referrals and no such object */
 	tester_ignore_str2errlist( "REFERRAL,NO_SUCH_OBJECT" );
 
-	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "Ac:e:Ff:M:m:NT:v" )) != EOF ) {
+	while ( (i = getopt( argc, argv, TESTER_COMMON_OPTS "Ac:e:Ff:M:m:NST:v" )) != EOF ) {
 		switch ( i ) {
 		case 'A':
 			noattrs++;
@@ -179,6 +186,10 @@ main( int argc, char **argv )
 			nobind = TESTER_INIT_ONLY;
 			break;
 
+		case 'S':
+			rate++;
+			break;
+
 		case 'v':
 			verbose++;
 			break;
@@ -269,6 +280,8 @@ main( int argc, char **argv )
 	snprintf(outstr, BUFSIZ, "Threads: RO: %d RW: %d", threads, rwthreads);
 	tester_error(outstr);
 
+	gettimeofday( &start, NULL );
+
 	/* Set up read only threads */
 	for ( i = 0; i < threads; i++ ) {
 		ldap_pvt_thread_create( &rtid[i], 0, do_onethread, &rtid[i]);
@@ -291,6 +304,8 @@ main( int argc, char **argv )
 	for ( i = 0; i < rwthreads; i++ )
 		ldap_pvt_thread_join(rwtid[i], NULL);
 
+	gettimeofday( &end, NULL );
+
 	for(i = 0; i < noconns; i++) {
 		if ( lds[i] != NULL ) {
 			ldap_unbind_ext( lds[i], NULL, NULL );
@@ -318,6 +333,17 @@ main( int argc, char **argv )
 			testfail++;
 		}
 	}
+	if ( rate ) {
+		msec = ( end.tv_sec - start.tv_sec ) * 1000 +
+			( end.tv_usec - start.tv_usec ) / 1000;
+		for ( i = 0, ops = 0; i < threads; i++ )
+			ops += rt_pass[i];
+		for ( i = 0; i < rwthreads; i++ )
+			ops += rwt_pass[i];
+		snprintf(outstr, BUFSIZ, "MT Test rate: %ld ops in %ld.%03ld s, %ld ops/s",
+			ops, msec / 1000, msec % 1000, msec ? ops * 1000 / msec : ops );
+		tester_error(outstr);
+	}
 	snprintf(outstr, BUFSIZ, "MT Test complete" );
 	tester_error(outstr);
 